@@ -2,7 +2,14 @@
 #define PIM_COMPILER_H
 
 // Global constants
+// Row size of the default ISA; code generation reads activeIsa().memoryRowSize
 const int MEMORY_ROW_SIZE = 512;  // Each row in memory subarray has 512 elements
+const int MEMORY_SLOT_BITS = 32;  // Each element slot of a memory row is 32 bits wide
+
+// Compiler version and code generation revision, both part of every compile
+// cache key. Bump the revision whenever generated programs change.
+const char* const PIM_COMPILER_VERSION = "1.0";
+const int PIM_CODEGEN_REVISION = 6;
 
 #include <string>
 #include <vector>
@@ -57,6 +64,27 @@ struct MemoryMap {
     int rowsPerMatrixRowA;
     int rowsPerMatrixRowB;
     int rowsPerMatrixRowC;
+    // Tiled layout (see TilePlan): each tile takes one memory row; all 0 when
+    // the matrices are stored row-major
+    int tileM;
+    int tileN;
+    int tileK;
+    // LUT images (see LutFunction), one per memory row after C; 0 images
+    // when the LUTs are not programmed by the program
+    int baseAddrLut;
+    int lutImages;
+    // Elements one memory row of each matrix holds: the ISA row size times
+    // the elements packed per slot (see ElementPrecision)
+    int elementsPerRowA;
+    int elementsPerRowB;
+    int elementsPerRowC;
+    // Epilogue (see EpilogueSpec), between C and the LUT images: the bias
+    // vector, N elements stored as C's are, and the output stage's parameter
+    // row; 0 rows each when the epilogue has neither
+    int baseAddrBias;
+    int biasRows;
+    int baseAddrOutputStage;
+    int outputStages;
 };
 
 // Forward declarations for main compiler components
@@ -75,19 +103,1174 @@ ThreeAddressCode generateThreeAddressCode(const MatrixDimensions& dims);
 // Work distribution - assigns matrix portions to cores
 std::vector<WorkAssignment> distributeWork(const MatrixDimensions& dims, int numCores);
 
-// Memory layout optimizer - arranges matrices in memory
+// Memory layout optimizer - arranges matrices in memory, tiled when the
+// options carry a tile plan, packed when they carry a low precision, compact
+// when they carry a sparse plan, with the rows of their epilogue and LUTs.
+// The form without options lays out plain row-major matrices.
+struct CodegenOptions;
 MemoryMap optimizeMemoryLayout(const MatrixDimensions& dims);
+MemoryMap optimizeMemoryLayout(const MatrixDimensions& dims, const CodegenOptions& options);
+
+// Logical operation codes; their encodings come from the active ISA
+enum Opcode {
+    OPCODE_NOOP = 0,  // 00
+    OPCODE_PROG = 1,  // 01
+    OPCODE_EXE = 2,   // 10
+    OPCODE_END = 3    // 11
+};
+
+// A bit field of the instruction word
+struct IsaField {
+    int shift;
+    int width;
+    
+    uint32_t mask() const { return width >= 32 ? 0xFFFFFFFFu : ((1u << width) - 1); }
+    uint32_t get(uint32_t word) const { return (word >> shift) & mask(); }
+    bool fits(int64_t value) const { return value >= 0 && static_cast<uint64_t>(value) <= mask(); }
+};
+
+// Instruction set description: word width, field positions, opcode encodings
+// and memory row size. The default ("pim24") is the original 24-bit format:
+// bits 18-17 opcode, 16-11 core pointer, 10 read, 9 write, 8-0 address.
+// An ISA may add a broadcast bit: when it is set, the instruction goes to
+// every core from 0 through the core pointer instead of that core alone.
+struct IsaDescriptor {
+    std::string name;
+    int wordBits;
+    IsaField opcode;
+    IsaField coreId;
+    IsaField read;
+    IsaField write;
+    IsaField addr;
+    IsaField broadcast;        // Width 0: the ISA has no broadcast bit
+    uint32_t opcodeValues[4];  // Encodings of NOOP, PROG, EXE, END
+    int memoryRowSize;
+    int accumulators;          // Accumulators a core exposes (see ExeOperation)
+    
+    int instructionBytes() const { return (wordBits + 7) / 8; }
+    int hexDigits() const { return (wordBits + 3) / 4; }
+    int maxCores() const { return static_cast<int>(coreId.mask()) + 1; }
+    int maxRows() const { return static_cast<int>(addr.mask()) + 1; }
+    bool hasBroadcast() const { return broadcast.width > 0; }
+    // Logical opcode of an encoded opcode field, -1 if it names none
+    int logicalOpcode(uint32_t raw) const {
+        for (int op = 0; op < 4; op++) {
+            if (opcodeValues[op] == raw) return op;
+        }
+        return -1;
+    }
+};
+
+IsaDescriptor defaultIsa();
+
+// Built-in descriptors: "pim24" (default), "pim24b" (pim24 plus a broadcast
+// bit at bit 19) and "pim32" (1024 cores, 2^18 rows), all with one accumulator
+bool isaByName(const std::string& name, IsaDescriptor& out);
+
+// Load a descriptor by built-in name or from a config file of "key = value"
+// lines; see README for the keys. Invalid descriptors are rejected.
+bool loadIsa(const std::string& nameOrPath, IsaDescriptor& out);
+
+// Parse "key=value" tokens (the one-line form written into program headers)
+bool parseIsaDescription(const std::string& text, IsaDescriptor& out, std::string& error);
+std::string describeIsa(const IsaDescriptor& isa);
+bool validateIsa(const IsaDescriptor& isa, std::string& error);
+bool isDefaultIsa(const IsaDescriptor& isa);
+
+// The descriptor every encoder, decoder and writer uses. Set once before
+// compiling; reading a program that records its ISA also sets it.
+const IsaDescriptor& activeIsa();
+void setActiveIsa(const IsaDescriptor& isa);
+
+// Encoders never truncate: a value that does not fit its field is counted and
+// reported, and the driver rejects the program
+size_t isaOverflowCount();
+
+// Check up front that every core id and memory row of a compile fits the ISA
+bool checkProgramFitsIsa(const std::vector<WorkAssignment>& assignments,
+                         const MemoryMap& memMap, const MatrixDimensions& dims,
+                         std::string& error);
+
+// A single PIM instruction packed into a 32-bit word, laid out by the active ISA
+struct Instruction {
+    uint32_t word;
+    
+    Instruction() : word(0) {}
+    explicit Instruction(uint32_t value) : word(value) {}
+    
+    int opcode() const { return activeIsa().logicalOpcode(activeIsa().opcode.get(word)); }
+    int coreId() const { return static_cast<int>(activeIsa().coreId.get(word)); }
+    bool read() const { return activeIsa().read.get(word) != 0; }
+    bool write() const { return activeIsa().write.get(word) != 0; }
+    int addr() const { return static_cast<int>(activeIsa().addr.get(word)); }
+    bool broadcast() const { return activeIsa().broadcast.get(word) != 0; }
+    
+    bool operator==(const Instruction& other) const { return word == other.word; }
+    bool operator!=(const Instruction& other) const { return word != other.word; }
+};
+
+// Comment kinds recorded alongside the instruction stream
+enum AnnotationKind {
+    NOTE_CORE_HEADER,  // "# Instructions for Core a (Rows b to c)"
+    NOTE_ROW,          // "# Processing row a"
+    NOTE_ELEMENT       // "# Computing element C[a][b]"
+};
+
+// A comment placed before the instruction at `position`; only formatted as text on emit
+struct Annotation {
+    size_t position;
+    AnnotationKind kind;
+    int a;
+    int b;
+    int c;
+};
+
+// Contiguous instruction stream for one program, plus its comment markers
+struct InstructionBuffer {
+    std::vector<Instruction> instructions;
+    std::vector<Annotation> annotations;
+    
+    void push(Instruction instr) { instructions.push_back(instr); }
+    void annotate(AnnotationKind kind, int a, int b = 0, int c = 0) {
+        Annotation note = {instructions.size(), kind, a, b, c};
+        annotations.push_back(note);
+    }
+    size_t size() const { return instructions.size(); }
+};
+
+// Instruction generators following the active ISA
+// Operation codes (default encoding): 00=NoOp, 01=PROG, 10=EXE, 11=END at bits 18-17
+Instruction genNoOpInstr(int coreId = 0);
+Instruction genProgInstr(int coreId, bool read = true, bool write = false, int addr = 0);
+Instruction genExeInstr(int coreId, bool read = false, bool write = false, int addr = 0);
+Instruction genEndInstr(int coreId, bool read = false, bool write = false, int addr = 0);
+// END with R=1 parks a core: it stops as at END but stays programmed, its
+// LUTs loaded, for the next invocation of a persistent kernel
+Instruction genParkInstr(int coreId = 0);
+// PROG with W=1 alone runs the output stage whose parameters are stored in
+// memory row addr on the current accumulator (see EpilogueSpec); the core
+// stays programmed
+Instruction genOutputStageInstr(int coreId, int row);
+bool isOutputStage(Instruction instr);
+
+// The same instruction addressed to another core, or with broadcast set to
+// the group of cores 0 through coreId (the ISA must have a broadcast bit)
+Instruction retargetInstr(Instruction instr, int coreId, bool broadcast = false);
+
+// Text forms used by the .pim emitter
+std::string to_hex_string(int value);
+std::string formatAnnotation(const Annotation& note);
+
+// Destination for generated instructions. Code generation writes straight into a
+// sink, so programs stream to their output instead of being held in memory.
+// The driver brackets each core's program with beginCore/endCore.
+class InstructionSink {
+public:
+    virtual ~InstructionSink() {}
+    virtual void beginCore(const WorkAssignment& /*work*/) {}
+    virtual void emit(Instruction instr) = 0;
+    virtual void annotate(const Annotation& /*note*/) {}
+    virtual void endCore() {}
+    virtual bool finish() { return true; }
+};
+
+// Appends to an in-memory buffer
+class BufferSink : public InstructionSink {
+public:
+    explicit BufferSink(InstructionBuffer& target) : buffer(target) {}
+    void emit(Instruction instr) override { buffer.push(instr); }
+    void annotate(const Annotation& note) override {
+        buffer.annotate(note.kind, note.a, note.b, note.c);
+    }
+private:
+    InstructionBuffer& buffer;
+};
+
+// Counts instructions (and the NOOPs among them) and comment lines, in
+// total and per core
+class CountingSink : public InstructionSink {
+public:
+    CountingSink() : instructions(0), annotations(0), noops(0) {}
+    void beginCore(const WorkAssignment& /*work*/) override { perCore.push_back(0); }
+    void emit(Instruction instr) override {
+        instructions++;
+        if (!perCore.empty()) perCore.back()++;
+        if (instr.opcode() == OPCODE_NOOP) noops++;
+    }
+    void annotate(const Annotation& /*note*/) override { annotations++; }
+    
+    size_t instructions;
+    size_t annotations;
+    size_t noops;
+    std::vector<size_t> perCore;
+};
+
+// Forwards everything to two sinks
+class TeeSink : public InstructionSink {
+public:
+    TeeSink(InstructionSink& first, InstructionSink& second) : a(first), b(second) {}
+    void beginCore(const WorkAssignment& work) override { a.beginCore(work); b.beginCore(work); }
+    void emit(Instruction instr) override { a.emit(instr); b.emit(instr); }
+    void annotate(const Annotation& note) override { a.annotate(note); b.annotate(note); }
+    void endCore() override { a.endCore(); b.endCore(); }
+    bool finish() override {
+        bool okA = a.finish();
+        bool okB = b.finish();
+        return okA && okB;
+    }
+private:
+    InstructionSink& a;
+    InstructionSink& b;
+};
+
+// Writes .pim text: the file header, a blank line ahead of each core, comments,
+// and "<hex> # Binary: <bits>" per instruction, as wide as the active ISA's word
+// (non-default ISAs also get a "# ISA: ..." header line, and programs with
+// layout tokens a "# Layout: ..." one). Lines are assembled from lookup tables
+// into a large buffer that is written out in blocks.
+class TextFileSink : public InstructionSink {
+public:
+    TextFileSink(std::ostream& stream, const MatrixDimensions& dims, size_t numCores,
+                 const CodegenOptions& options);
+    ~TextFileSink() override;
+    void beginCore(const WorkAssignment& work) override;
+    void emit(Instruction instr) override;
+    void annotate(const Annotation& note) override;
+    bool finish() override;
+private:
+    void append(const char* text, size_t length);
+    void appendNumber(int value);
+    void flushBlock();
+    
+    std::ostream& out;
+    std::vector<char> block;
+    size_t used;
+    int wordBits;
+    int wordBytes;
+    int hexDigits;
+};
+
+// Send a buffered program through a sink, annotations in their recorded positions
+void replayBuffer(const InstructionBuffer& buffer, InstructionSink& sink);
+
+// Operations selected by the low two address bits of an EXE with R=0, W=0 and
+// no access pending. The bits above name the accumulator the operation uses
+// (0 on a core with one); CLEAR, LOAD_ACC and MAC make it the current one,
+// and a C store writes the current accumulator. A MAC takes A[i][k] from the
+// value read last if that was A[i][k], and otherwise reads it from A itself.
+enum ExeOperation {
+    EXE_OP_CLEAR = 0,     // Clear the accumulator
+    EXE_OP_LOAD_ACC = 1,  // Accumulator = the value read last (a partial sum from C)
+    EXE_OP_MAC = 2,       // Accumulator += A[i][k] * the B value read last
+    EXE_OP_SELECT = 3     // Make the accumulator current, for the store that follows
+};
+
+// Address of an operation on one accumulator, and the parts of an address
+inline int exeOperand(ExeOperation op, int accumulator) { return op | (accumulator << 2); }
+inline int exeOperation(int addr) { return addr & 3; }
+inline int exeAccumulator(int addr) { return addr >> 2; }
+
+// Loop nest of each core's sequence
+//   ijk: one C element at a time, each walking a column of B
+//   ikj: for each A[i][k], sweep row k of B, accumulating partial sums in C
+//   blocked: ikj over blocks of C columns within one memory row of C, so that
+//            row stays open for every k
+//   kji: load each B[k][j] once per core and apply it to every row the core
+//        owns, streaming A[i][k] and accumulating partial sums in C
+// auto picks whichever the row activation model predicts is fastest.
+enum LoopOrder {
+    LOOP_ORDER_AUTO,
+    LOOP_ORDER_IJK,
+    LOOP_ORDER_IKJ,
+    LOOP_ORDER_BLOCKED,
+    LOOP_ORDER_KJI
+};
+
+// What stays put while the other operands stream past
+//   output: the accumulator holds C[i][j] for all k (ijk)
+//   input: A[i][k] is held while row k of B streams (ikj, blocked)
+//   weight: B[k][j] is held while the core's rows of A stream (kji)
+enum Dataflow {
+    DATAFLOW_ANY,
+    DATAFLOW_OUTPUT,
+    DATAFLOW_INPUT,
+    DATAFLOW_WEIGHT
+};
+
+// How the cores' programs share the single controller stream
+//   concat: core 0's whole program, then core 1's, and so on
+//   interleave: merged by the scheduler so one core's memory and LUT latency
+//               hides behind the other cores' issue slots; each core's own
+//               instructions keep their order
+//   broadcast: merged in lockstep, and an instruction cores 0..n would all
+//              issue next goes out once with the ISA's broadcast bit set
+enum StreamSchedule {
+    SCHEDULE_CONCAT,
+    SCHEDULE_INTERLEAVE,
+    SCHEDULE_BROADCAST
+};
+
+// Tile sizes for the tiled layout. A is stored as tileM x tileK tiles, B as
+// tileK x tileN and C as tileM x tileN, each tile in its own memory row, so a
+// tile's working set never leaves one row of its subarray.
+struct TilePlan {
+    int tileM = 0;
+    int tileN = 0;
+    int tileK = 0;   // All 0: untiled (in a request: the planner picks)
+};
+
+// Which program of a persistent kernel to generate. The setup program runs
+// once: PROG and the table loads on every core, which then parks (see
+// genParkInstr). The invocation program runs on the parked cores each time
+// the host calls the kernel with a new A, B staying where it was placed,
+// and parks them again.
+enum ProgramPart {
+    PROGRAM_WHOLE,        // Programs the cores, computes C and ends
+    PROGRAM_SETUP,
+    PROGRAM_INVOCATION
+};
+
+// Bits of the elements of a packed layout (see choosePrecision)
+struct ElementPrecision {
+    int dataBits = MEMORY_SLOT_BITS;         // A and B
+    int accumulatorBits = MEMORY_SLOT_BITS;  // C and the core's accumulator
+};
+
+struct WeightPlan;
+struct SparsePlan;
+struct EpilogueSpec;
+struct LatencyModel;
+
+// Code generation switches; the defaults are what the driver uses. The
+// layout (optimizeMemoryLayout) and the program headers (layoutTokens) are
+// taken from the same options.
+struct CodegenOptions {
+    bool rowReuse = true;                   // Run the row-address reuse pass (RowReuseSink)
+    LoopOrder loopOrder = LOOP_ORDER_AUTO;
+    Dataflow dataflow = DATAFLOW_ANY;       // Limits which orders auto may pick
+    int blockColumns = 0;                   // Blocked order: C columns per block (0 = one memory row)
+    bool tiling = false;                    // Tiled layout and tile-by-tile sequences
+    TilePlan tiles;                         // Requested sizes (0 = planner's choice), then the planned ones
+    StreamSchedule schedule = SCHEDULE_CONCAT;
+    int lutPrecision = 0;                   // Operand bits to program the LUTs for (0 = preloaded)
+    ElementPrecision precision;             // Int4 and int8 operands are packed (see choosePrecision)
+    int registerBlock = 1;                  // ijk: C elements per A load, one accumulator each
+    const WeightPlan* weights = nullptr;    // ijk specialized to a known B (not owned; see planWeights)
+    const LatencyModel* pipeline = nullptr; // ijk software-pipelined and padded for these latencies (not owned)
+    const SparsePlan* sparse = nullptr;     // ijk over the structural nonzeros of A and B (not owned; see planSparsity)
+    const EpilogueSpec* epilogue = nullptr; // ijk: bias and output stage fused before the C stores (not owned)
+    ProgramPart part = PROGRAM_WHOLE;       // Persistent kernels: the setup or the invocation program
+};
+
+// Cache-key form of the options, e.g. "rowReuse=1 order=ijk dataflow=any
+// block=0 tiles=off schedule=concat lut=off precision=int32 regblock=1
+// weights=off pipeline=off part=whole sparse=off epilogue=off"
+std::string describeCodegenOptions(const CodegenOptions& options);
+
+const char* loopOrderName(LoopOrder order);
+bool parseLoopOrder(const std::string& name, LoopOrder& out);
+
+// "output", "input", "weight" (and "any")
+const char* dataflowName(Dataflow dataflow);
+bool parseDataflow(const std::string& name, Dataflow& out);
+Dataflow dataflowOf(LoopOrder order);
+
+// Columns per block in the blocked order
+int blockColumnsFor(const MatrixDimensions& dims, const CodegenOptions& options);
+
+// End (exclusive) of the block starting at column jBlock of C row i: at most
+// blockColumns wide, and never crossing into the next memory row of C
+int blockEnd(int i, int jBlock, const MatrixDimensions& dims, const MemoryMap& memMap, int blockColumns);
+
+// When K is wider than a memory row, row i of A is processed in segments, the
+// parts of it that share a memory row. End (exclusive) of the segment holding
+// column k, and the number of segments in row i.
+int segmentEnd(int i, int k, const MatrixDimensions& dims, const MemoryMap& memMap);
+int segmentsInRow(int i, const MatrixDimensions& dims, const MemoryMap& memMap);
+
+// Row activation model: A, B and C sit in separate subarrays, each with one
+// open row per core, and an access to any other row of that subarray
+// activates it. An activation costs ROW_ACTIVATION_CYCLES on top of the
+// one cycle every instruction takes to issue.
+const int ROW_ACTIVATION_CYCLES = 32;
+
+struct LoopOrderCost {
+    LoopOrder order;
+    uint64_t activations;
+    uint64_t instructions;
+    uint64_t cycles;
+};
+
+// Exact activation count of the generated programs under the model
+uint64_t countRowActivations(const MatrixDimensions& dims,
+                             const std::vector<WorkAssignment>& assignments,
+                             const MemoryMap& memMap, LoopOrder order, int blockColumns);
+
+// Model every concrete order for the whole matrix on one core, without
+// register blocking
+std::vector<LoopOrderCost> compareLoopOrders(const MatrixDimensions& dims, const MemoryMap& memMap,
+                                             const CodegenOptions& options);
+
+// Element accesses the generated programs make, by operand
+struct AccessCounts {
+    uint64_t aLoads;
+    uint64_t bLoads;
+    uint64_t cLoads;     // Partial sums read back
+    uint64_t cStores;
+    uint64_t macs;
+    uint64_t aMacReads;  // MACs that read A[i][k] themselves (see ExeOperation)
+    
+    uint64_t loads() const { return aLoads + bLoads + cLoads; }
+};
+
+AccessCounts countAccesses(const MatrixDimensions& dims, const std::vector<WorkAssignment>& assignments,
+                           const MemoryMap& memMap, LoopOrder order, int blockColumns);
+
+// Register blocking. The ijk order with registerBlock = r > 1 computes
+// C[i][j..j+r) together in accumulators 0..r-1: clear them, then for each k
+// load A[i][k] once and, for each j, load B[k][j] and MAC into j's
+// accumulator; finally store them, last first, selecting each before its
+// store. Every A load serves r MACs, where ijk leaves each MAC to read A
+// itself. r is limited by the accumulators the ISA's cores expose.
+AccessCounts countRegisterBlockedAccesses(const MatrixDimensions& dims,
+                                          const std::vector<WorkAssignment>& assignments, int registerBlock);
+
+// Exact instruction count of one core's register-blocked program
+uint64_t registerBlockedCoreInstructions(const MatrixDimensions& dims, const MemoryMap& memMap,
+                                         const WorkAssignment& work, int registerBlock, bool rowReuse);
+
+// Whether the options generate the register-blocked kernel
+bool usesRegisterBlocking(const MemoryMap& memMap, const CodegenOptions& options);
+
+// Whether the options generate the software-pipelined ijk kernel (plain
+// ijk only: not tiled, register-blocked, weight-specialized, sparse or with
+// an epilogue)
+bool usesPipelining(const MemoryMap& memMap, const CodegenOptions& options);
+
+// The options with LOOP_ORDER_AUTO replaced by the cheapest order the dataflow allows
+CodegenOptions resolveLoopOrder(const MatrixDimensions& dims, const MemoryMap& memMap,
+                                const CodegenOptions& options);
+
+// Tiling. With a tile plan in the options, optimizeMemoryLayout stores every
+// tile in its own memory row and each core walks its rows one M tile at a
+// time: for each N tile and K tile, select row i of A, then per C element
+// start from a cleared accumulator (first K tile) or the partial sum in C,
+// MAC over the tile's k and store. Program headers record the plan
+// ("tiles=M,N,K").
+bool isTiled(const TilePlan& plan);
+std::string describeTilePlan(const TilePlan& plan);        // "M,N,K"
+bool parseTilePlan(const std::string& text, TilePlan& out);
+
+// Tile plan of a layout (all 0 when row-major)
+TilePlan tilePlanOf(const MemoryMap& memMap);
+
+// Exact instruction count of one core's tiled program, and the row activations
+// of all of them under the row activation model
+uint64_t tiledCoreInstructions(const MatrixDimensions& dims, const TilePlan& plan,
+                               const WorkAssignment& work, bool rowReuse);
+uint64_t countTiledRowActivations(const MatrixDimensions& dims, const TilePlan& plan,
+                                  const std::vector<WorkAssignment>& assignments);
+
+// Fill in the tile sizes options.tiles leaves at 0, choosing the cheapest plan
+// under the row activation model. Tiles must fit a memory row, tileM is at most
+// one core's share of M, and the padded layout must fit the ISA's address
+// field. Returns false (with a reason) if no plan meets those limits.
+bool planTiles(const MatrixDimensions& dims, const std::vector<WorkAssignment>& assignments,
+               const CodegenOptions& options, TilePlan& out, std::string& error);
+
+// LUT programming. A core multiplies and adds through 8-bit look-up tables
+// of 256 entries, indexed by two 4-bit operands (x << 4 | y). Operands of a
+// chosen precision are split into 4-bit digits, the top one signed, and
+// multiplied digit by digit; the partial products are summed by rippling
+// nibble adds. With a precision set, optimizeMemoryLayout stores each table
+// the precision needs in a memory row of its own after C, shared by all
+// cores, and every core's program starts by loading them in LutFunction
+// order: PROG R=1 W=1 with the image's row as address. Program headers
+// record the precision ("lut=8").
+enum LutFunction {
+    LUT_MUL_UU,   // Unsigned digit x unsigned digit
+    LUT_MUL_SU,   // Signed (top) digit x unsigned digit
+    LUT_MUL_SS,   // Signed digit x signed digit
+    LUT_ADD,      // x + y: sum in bits 3-0, carry in bit 4
+    LUT_ADDC      // x + y + 1 (carry in)
+};
+
+const char* lutFunctionName(LutFunction function);
+
+// 4, 8 or 16 bits
+bool parseLutPrecision(const std::string& text, int& out);
+
+// Tables a precision loads: a single signed digit needs only MUL_SS
+std::vector<LutFunction> lutFunctions(int precision);
+
+// Table entry for operands x, y (4-bit fields); signed results are stored
+// as 8-bit two's complement
+int lutEntry(LutFunction function, int x, int y);
+
+// Lookups one MAC makes: d = precision / 4 digits give d^2 digit products,
+// each added into the 2 * precision bit product with 2d nibble adds
+int lutLookupsPerMac(int precision);
+
+// Packed low-precision data (see ElementPrecision). A memory row is
+// memoryRowSize slots of MEMORY_SLOT_BITS bits, and by default every slot
+// holds one element. With int4 or int8 operands A and B pack 8 or 4 elements
+// per slot, and C packs its elements at the accumulator width: the narrowest
+// of 8, 16 and 32 bits that holds a K-term dot product of worst-case
+// operands, so no partial sum can overflow. Offsets count elements, so a
+// packed row needs offsets up to its element count. Program headers record
+// the packing ("precision=8,32").
+
+// "int4", "int8" or "int32"
+bool parseDataPrecision(const std::string& text, int& bits);
+
+// Header form "dataBits,accumulatorBits", e.g. "8,32"
+std::string describeElementPrecision(const ElementPrecision& precision);
+bool parseElementPrecision(const std::string& text, ElementPrecision& out);
+
+inline bool isPacked(const ElementPrecision& precision) {
+    return precision.dataBits < MEMORY_SLOT_BITS;
+}
+
+// Elements of `bits` that share a slot
+inline int elementsPerSlot(int bits) {
+    return MEMORY_SLOT_BITS / bits;
+}
+
+// Signed bits a K-term sum of dataBits x dataBits products needs. The
+// largest magnitude, K * 2^(2 * dataBits - 2), comes from multiplying the
+// most negative operands, so 2 * dataBits + floor(log2 K) bits.
+int accumulatorBitsNeeded(int dataBits, int K);
 
-// Instruction generators for 24-bit PIM instructions following the ISA format
-// Operation codes: 00=NoOp, 01=PROG, 10=EXE, 11=END at bits 18-17
-std::string genNoOpInstr();
-std::string genProgInstr(int coreId, bool read = true, bool write = false, int addr = 0);
-std::string genExeInstr(int coreId, bool read = false, bool write = false, int addr = 0);
-std::string genEndInstr(int coreId, bool read = false, bool write = false, int addr = 0);
+// Packing for dataBits operands over K: the narrowest safe accumulator.
+// False (with a reason) if even MEMORY_SLOT_BITS could overflow.
+bool choosePrecision(int dataBits, int K, ElementPrecision& out, std::string& error);
 
-// Core instruction sequence generator
-std::vector<std::string> generateCoreInstructions(
+// Weight specialization. When B is a weight matrix known at compile time
+// (--weights), the ijk kernel is specialized to its values: MACs with a zero
+// weight are dropped, and a column of B equal to an earlier one is not
+// computed again; its C elements are extra stores of that column's
+// accumulator. A segmented row skips an element in a later segment when none
+// of its weights fall there. Program headers record the file
+// ("weights=<path>") so the simulator runs with the same B.
+struct WeightMatrix {
+    int K = 0;
+    int N = 0;
+    std::vector<int32_t> values;   // Row-major K x N
+    
+    int32_t at(int k, int j) const { return values[static_cast<size_t>(k) * N + j]; }
+};
+
+// B from a .npy file (signed integer dtype, shape K x N) or from raw
+// little-endian int32 values, K * N of them. False, with a reason, for
+// anything else.
+bool readWeightFile(const std::string& path, int K, int N, WeightMatrix& out, std::string& error);
+
+// What the specialized kernel computes, and what it saves
+struct WeightPlan {
+    int K = 0;
+    int N = 0;
+    std::vector<int> computed;              // Columns computed, ascending
+    std::vector<std::vector<int>> copies;   // Per column: the later columns equal to it
+    std::vector<uint32_t> columnStart;      // Column j's nonzero k: nonzeroK[columnStart[j]..columnStart[j + 1])
+    std::vector<int> nonzeroK;
+    uint64_t macsPerRow = 0;                // MACs per row of A, against K * N unspecialized
+    uint64_t zeros = 0;
+    uint64_t distinctValues = 0;            // Distinct nonzero weights
+    uint64_t powersOfTwo = 0;               // Nonzero weights of magnitude 2^n
+    std::string fingerprint;                // Hash of K, N and the values, for the compile cache
+    std::string source;                     // Weight file, recorded in program headers
+    
+    // Positions [first, last) in nonzeroK of column j's weights with kStart <= k < kEnd
+    void nonzeroRange(int j, int kStart, int kEnd, uint32_t& first, uint32_t& last) const;
+};
+
+WeightPlan planWeights(const WeightMatrix& weights);
+
+// Whether every weight fits a signed `bits`-bit operand
+bool weightsFit(const WeightMatrix& weights, int bits);
+
+// Whether the options generate the weight-specialized kernel
+bool usesWeightSpecialization(const MemoryMap& memMap, const CodegenOptions& options);
+
+// Exact instruction count of one core's weight-specialized program, and
+// the accesses of all of them
+uint64_t weightedCoreInstructions(const MatrixDimensions& dims, const MemoryMap& memMap,
+                                  const WorkAssignment& work, const WeightPlan& plan, bool rowReuse);
+AccessCounts countWeightedAccesses(const MatrixDimensions& dims, const std::vector<WorkAssignment>& assignments,
+                                   const MemoryMap& memMap, const WeightPlan& plan);
+
+// Sparse operands. A pruned A or B is described by its structural nonzeros
+// (--sparse-a, --sparse-b) and optimizeMemoryLayout stores only those: A's
+// in CSR order, B's in CSC order, each matrix's from its base row on. The
+// ijk kernel then visits, per C element, only the k where both A[i][k] and
+// B[k][j] are nonzero; the compact indices are compiled into the addresses
+// of its loads. An empty element is cleared and stored. Program headers
+// record the files ("sparse-a=<path>", "sparse-b=<path>") so the simulator
+// lays out the same values.
+struct SparsityPattern {
+    int rows = 0;
+    int cols = 0;
+    std::vector<uint32_t> rowStart;         // Row r's nonzero columns: colIndex[rowStart[r]..rowStart[r + 1])
+    std::vector<int> colIndex;              // Ascending within a row
+    
+    uint64_t nonzeros() const { return colIndex.size(); }
+    // The pattern of the transpose: columns become rows
+    SparsityPattern transposed() const;
+};
+
+// Every element of a rows x cols matrix
+SparsityPattern densePattern(int rows, int cols);
+
+// The pattern of a rows x cols matrix from a text description or from the
+// matrix itself. Descriptions are whitespace-separated tokens ('#' starts a
+// comment): "csr R C indptr ... indices ..." (column indices per row), "csc
+// R C indptr ... indices ..." (row indices per column), "bsr R C bR bC
+// indptr ... indices ..." (bR x bC blocks, block columns per block row;
+// edge blocks are clipped), or "mask R C" and R rows of 0/1 characters.
+// Anything else is read as the matrix (see readWeightFile) and its nonzero
+// elements are the pattern. False, with a reason, on malformed files.
+bool readSparsityPattern(const std::string& path, int rows, int cols, SparsityPattern& out, std::string& error);
+
+// What the sparse kernel stores and computes
+struct SparsePlan {
+    SparsityPattern a;                      // A by rows (M x K); every element when A is dense
+    SparsityPattern b;                      // B by columns (N x K, the pattern of B's transpose)
+    std::string sourceA;                    // Pattern files, "" for a dense operand
+    std::string sourceB;
+    int maxRowNonzerosA = 0;                // Most nonzeros in a row of A
+    uint64_t macs = 0;                      // Over all of C, against M * N * K dense
+    std::string fingerprint;                // Hash of both patterns, for the compile cache
+    
+    bool sparseA() const { return !sourceA.empty(); }
+    bool sparseB() const { return !sourceB.empty(); }
+    // Element index in B's storage of nonzero p of column j: its CSC position,
+    // or the row-major k * N + j of a dense B
+    int64_t indexB(uint32_t p, int j) const {
+        return sparseB() ? static_cast<int64_t>(p) : static_cast<int64_t>(b.colIndex[p]) * b.rows + j;
+    }
+    // End (exclusive) of the segment of row i of A holding its nonzero p:
+    // the nonzeros that share p's memory row, `rowSize` elements to a row
+    uint32_t segmentEnd(int i, uint32_t p, int rowSize) const;
+    // Nonzeros of column j of B (positions in b) whose k is among A's
+    // nonzeros [first, last), ascending
+    void pairs(int j, uint32_t first, uint32_t last, std::vector<uint32_t>& out) const;
+};
+
+// Plans A and B of `dims`, either pattern (with its source file) null when
+// that matrix is dense
+SparsePlan planSparsity(const MatrixDimensions& dims, const SparsityPattern* a, const std::string& sourceA,
+                        const SparsityPattern* b, const std::string& sourceB);
+
+// Whether the options generate the sparse kernel
+bool usesSparsity(const MemoryMap& memMap, const CodegenOptions& options);
+
+// Exact instruction count of one core's sparse program
+uint64_t sparseCoreInstructions(const MatrixDimensions& dims, const MemoryMap& memMap,
+                                const WorkAssignment& work, const SparsePlan& plan, bool rowReuse);
+
+// Whether either operand is sparse
+bool isSparse(const SparsePlan& plan);
+
+// GEMM epilogue fused into the ijk kernel, so the host needs no second pass
+// over C: C = clamp(((A * B + bias) * alpha) >> shift, min, max). The bias
+// (placed by optimizeMemoryLayout after C) is where each element's
+// accumulator starts: the kernel reads bias[j] and loads it in place of the
+// clear. The cores have no multiply, shift or compare on the accumulator, so
+// the rest runs as one output stage instruction before the element's last
+// store (see genOutputStageInstr), with alpha, shift, min and max read from
+// the parameter row. Written "bias,alpha=3,shift=8,relu,clamp=-128:127" in
+// any order; relu raises min to 0. Program headers record the canonical
+// form ("epilogue=bias,alpha=3,shift=8,clamp=0:127") so the simulator lays
+// out the same rows.
+struct EpilogueSpec {
+    bool bias = false;
+    int32_t alpha = 1;
+    int shift = 0;                          // Arithmetic: rounds toward minus infinity
+    int32_t min = INT32_MIN;
+    int32_t max = INT32_MAX;
+    
+    // Whether alpha, the shift or the clamp change the accumulator
+    bool hasOutputStage() const { return alpha != 1 || shift != 0 || min != INT32_MIN || max != INT32_MAX; }
+    // C[i][j] from its dot product and bias[j] (0 without a bias)
+    int64_t apply(int64_t dot, int64_t biasValue) const;
+};
+
+// False, with a reason, on unknown items or values out of range
+bool parseEpilogue(const std::string& text, EpilogueSpec& out, std::string& error);
+// Canonical form, "" for an epilogue that changes nothing
+std::string describeEpilogue(const EpilogueSpec& spec);
+bool hasEpilogue(const EpilogueSpec& spec);
+
+// Whether the options fuse an epilogue: the untiled ijk kernels without
+// register blocking, weights or sparse operands
+bool usesEpilogue(const MemoryMap& memMap, const CodegenOptions& options);
+
+// Instructions the epilogue adds per C element: a bias load and the load of
+// the accumulator (3) replace the clear (1), and the output stage is one.
+// No row access of the plain ijk kernel could reuse the latch around them.
+int epilogueInstructionsPerElement(const EpilogueSpec& spec);
+
+// Row-address reuse pass for one core's stream. A row access is a row-set
+// (EXE R=1 or W=1, addr = memory row) followed by an offset (EXE R=0 W=0).
+// The core keeps the row and its direction latched afterwards, so when a pair
+// targets the latched row in the same direction it is replaced by a single
+// EXE R=1 W=1 whose address is the offset. PROG and END forget the latch.
+class RowReuseSink : public InstructionSink {
+public:
+    explicit RowReuseSink(InstructionSink& target)
+        : next(target), holding(false), latched(false), latchedRow(0), latchedWrite(false), removed(0) {}
+    void beginCore(const WorkAssignment& work) override;
+    void emit(Instruction instr) override;
+    void annotate(const Annotation& note) override;
+    void endCore() override;
+    bool finish() override;
+    // Pass on a row-set still waiting for its offset
+    void flush();
+    
+    size_t removedInstructions() const { return removed; }
+private:
+    InstructionSink& next;
+    bool holding;
+    Instruction held;
+    bool latched;
+    int latchedRow;
+    bool latchedWrite;
+    size_t removed;
+};
+
+// Core instruction sequence generator, streaming into a sink
+void generateCoreInstructions(
     int coreId, int startRow, int endRow, 
-    const MatrixDimensions& dims, const MemoryMap& memMap);
+    const MatrixDimensions& dims, const MemoryMap& memMap,
+    InstructionSink& sink, const CodegenOptions& options = CodegenOptions());
+
+// Convenience form that collects one core's program in a buffer
+InstructionBuffer generateCoreInstructions(
+    int coreId, int startRow, int endRow, 
+    const MatrixDimensions& dims, const MemoryMap& memMap,
+    const CodegenOptions& options = CodegenOptions());
+
+// Generate every core's program on a pool of threads (0 = one per hardware thread)
+// and send them to the sink in core order, so output matches the serial run
+void generateCoresParallel(const std::vector<WorkAssignment>& assignments,
+                           const MatrixDimensions& dims, const MemoryMap& memMap,
+                           int numThreads, InstructionSink& sink,
+                           const CodegenOptions& options = CodegenOptions());
+
+// Stream scheduling
+// "concat", "interleave", "broadcast"
+const char* scheduleName(StreamSchedule schedule);
+bool parseSchedule(const std::string& name, StreamSchedule& out);
+
+// Persistent kernels
+// "whole", "setup", "invocation"
+const char* programPartName(ProgramPart part);
+bool parseProgramPart(const std::string& name, ProgramPart& out);
+
+// Start of a core's program: PROG and its LUT loads, which invocations leave
+// to the setup program. False when the part ends there, the setup program
+// having parked the core.
+bool emitCoreSetup(int coreId, const MemoryMap& memMap, ProgramPart part, InstructionSink& sink);
+
+// Last instruction of a core's program; invocations park the core again
+Instruction coreEndInstr(int coreId, ProgramPart part);
+
+// Latency model of the single controller stream. The controller issues one
+// instruction per cycle in stream order, and an instruction waits until its
+// core is done with the previous one. Cycles a core stays busy:
+struct LatencyModel {
+    int issue = 1;                               // Row-sets, CLEAR, LOAD_ACC, END
+    int access = 4;                              // Reading or writing an element of the open row
+    int rowActivation = ROW_ACTIVATION_CYCLES;   // Added when the access opens another row
+    int mac = 2;
+    int program = 16;                            // PROG: loading the core's function into its LUT
+};
+
+// Busy cycles of each instruction of one core's program. Rows open per core
+// and subarray, as in the row activation model.
+std::vector<uint32_t> instructionLatencies(const std::vector<Instruction>& program,
+                                           const MemoryMap& memMap, const LatencyModel& model);
+
+// Latency tables as text: "key=value" tokens for any of issue, access,
+// activation, mac and program, separated by commas or white space, with #
+// comments (also the form of a table file). Keys left out keep their value
+// in `out`. Program headers record the whole table on one token.
+bool parseLatencyModel(const std::string& text, LatencyModel& out, std::string& error);
+std::string describeLatencyModel(const LatencyModel& model);   // "issue=1,access=4,activation=32,mac=2,program=16"
+
+// A table from a file, or inline text if no such file exists
+bool loadLatencyModel(const std::string& fileOrText, LatencyModel& out, std::string& error);
+
+// One core issuing its program without interlocks: an instruction per
+// cycle, in order, each result ready its latency after issue. An
+// instruction may issue once everything it reads is ready, and when its
+// results will land no earlier than the ones they overwrite:
+//   row-set            writes the row latch (issue)
+//   offset, reuse      reads the latch, waits for the previous access to its
+//                      subarray to finish (access, + rowActivation opening
+//                      a row); a read writes the loaded value and the A or B
+//                      operand, a write reads the accumulator
+//   CLEAR, SELECT      write the accumulator (issue)
+//   LOAD_ACC           reads the loaded value, writes the accumulator (issue)
+//   MAC                reads the A and B operands, the accumulator and the
+//                      LUTs, writes the accumulator (mac)
+//   PROG               writes the LUTs (program)
+//   END                waits for every result; NOOP touches nothing
+// The accumulators count as one value.
+class PipelineTiming {
+public:
+    PipelineTiming(const MemoryMap& memMap, const LatencyModel& model);
+    // A new program: nothing in flight, the next issue at cycle 0
+    void reset();
+    // First cycle, no earlier than now(), at which instr is hazard-free
+    uint64_t earliest(Instruction instr) const;
+    // Issue instr at `cycle` (no earlier than now()); the next slot follows it
+    void issue(Instruction instr, uint64_t cycle);
+    uint64_t now() const { return next; }
+    // Cycle the last result is ready
+    uint64_t finish() const { return last; }
+private:
+    enum Resource { LATCH, LOADED, OPERAND_A, OPERAND_B, ACCUMULATOR, TABLES, RESOURCES };
+    struct Effect {
+        unsigned reads;      // Bit per Resource
+        unsigned writes;
+        int subarray;        // Accessed subarray (0 A, 1 B, 2 C), -1 none
+        int row;
+        uint64_t cycles;
+        bool barrier;
+    };
+    Effect effectOf(Instruction instr) const;
+    
+    MemoryMap memoryMap;
+    LatencyModel latency;
+    uint64_t next;
+    uint64_t last;
+    uint64_t ready[RESOURCES];
+    uint64_t busy[3];
+    int openRow[3];
+    bool pending;
+    int latchedRow;
+    bool latchedWrite;
+};
+
+// Static schedule pass for one core's stream: ahead of each instruction it
+// emits the NOOPs PipelineTiming needs for it to issue hazard-free, so the
+// core runs the program one instruction per cycle with no interlocks
+class HazardPaddingSink : public InstructionSink {
+public:
+    HazardPaddingSink(InstructionSink& target, const MemoryMap& memMap, const LatencyModel& model)
+        : next(target), timing(memMap, model), padding(0) {}
+    void beginCore(const WorkAssignment& work) override;
+    void emit(Instruction instr) override;
+    void annotate(const Annotation& note) override { next.annotate(note); }
+    void endCore() override { next.endCore(); }
+    bool finish() override { return next.finish(); }
+    
+    size_t noops() const { return padding; }
+private:
+    InstructionSink& next;
+    PipelineTiming timing;
+    size_t padding;
+};
+
+struct ScheduleReport {
+    uint64_t instructions;
+    uint64_t concatCycles;        // Makespan of the programs one after another
+    uint64_t interleaveCycles;    // Makespan of the scheduler's order
+};
+
+// Merge the cores' programs (given as their latencies) into one issue order:
+// slot s issues the next instruction of program order[s]. Each slot goes to
+// the core that can issue soonest, lowest index first on ties.
+std::vector<uint32_t> interleavePrograms(const std::vector<std::vector<uint32_t>>& latencies,
+                                         const LatencyModel& model, ScheduleReport& report);
+
+// Collects every core's program, then on finish() schedules them and sends
+// the interleaved stream on: beginCore ahead of a core's first instruction,
+// comments ahead of the instruction they precede. Holds the whole program.
+class InterleavingSink : public InstructionSink {
+public:
+    InterleavingSink(InstructionSink& target, const MemoryMap& memMap,
+                     const LatencyModel& model = LatencyModel())
+        : next(target), memoryMap(memMap), latency(model), report() {}
+    void beginCore(const WorkAssignment& work) override;
+    void emit(Instruction instr) override;
+    void annotate(const Annotation& note) override;
+    bool finish() override;
+    
+    const ScheduleReport& scheduleReport() const { return report; }
+private:
+    InstructionSink& next;
+    MemoryMap memoryMap;
+    LatencyModel latency;
+    ScheduleReport report;
+    std::vector<WorkAssignment> cores;
+    std::vector<InstructionBuffer> programs;
+};
+
+struct BroadcastReport {
+    uint64_t instructions;   // Per-core instructions, as the concatenated stream carries them
+    uint64_t emitted;        // Instructions on the controller bus
+    uint64_t broadcasts;     // Emitted instructions addressed to a group of cores
+};
+
+// Collects every core's program, then on finish() merges them in lockstep:
+// the core furthest behind goes next, and if cores 0..n are all about to
+// issue the same instruction (up to the core pointer) it is sent once,
+// broadcast to that group. Each core still receives exactly its own program,
+// in order. Needs an ISA with a broadcast bit.
+class BroadcastSink : public InstructionSink {
+public:
+    explicit BroadcastSink(InstructionSink& target) : next(target), report() {}
+    void beginCore(const WorkAssignment& work) override;
+    void emit(Instruction instr) override;
+    void annotate(const Annotation& note) override;
+    bool finish() override;
+    
+    const BroadcastReport& broadcastReport() const { return report; }
+private:
+    InstructionSink& next;
+    BroadcastReport report;
+    std::vector<WorkAssignment> cores;
+    std::vector<InstructionBuffer> programs;
+};
+
+// Closed-form prediction of what code generation would produce
+struct CoreEstimate {
+    int coreId;
+    int startRow;
+    int endRow;
+    uint64_t instructions;
+    uint64_t annotations;
+};
+
+struct CompileEstimate {
+    std::vector<CoreEstimate> cores;
+    uint64_t totalInstructions;
+    uint64_t totalAnnotations;
+    uint64_t textBytes;       // .pim file size
+    uint64_t binaryBytes;     // .pimb file size
+    uint64_t serialCycles;    // Makespan issuing the concatenated stream one per cycle
+    uint64_t parallelCycles;  // Makespan if every core consumed its own stream
+};
+
+// Exact instruction counts and output sizes without generating any
+// instructions (not for pipelined programs, whose padding needs the schedule,
+// or for setup programs)
+CompileEstimate estimateCompile(const MatrixDimensions& dims,
+                                const std::vector<WorkAssignment>& assignments,
+                                const MemoryMap& memMap,
+                                const CodegenOptions& options = CodegenOptions());
+void printEstimate(const CompileEstimate& estimate);
+
+// Description stored after the core table of .pimb/.piml headers: the ISA
+// (non-default ISAs only), then the layout tokens of the options the program
+// was generated with. Empty for default programs, so those files keep their
+// original layout.
+std::string containerHeaderBlock(const CodegenOptions& options);
+// The tile plan (tiled layouts only), the schedule (merged streams only), the
+// LUT precision (programs that load their LUTs only), the packing (packed
+// data only), the weight file, the pipeline latencies, the persistent kernel
+// part, the sparse pattern files and the epilogue, each only where used, as
+// "key=value" tokens; text programs carry them on a "# Layout: " line
+std::string layoutTokens(const CodegenOptions& options);
+
+// The layout tokens of a program read back. Holds what CodegenOptions points
+// to; the weight and sparse plans name their files only.
+struct ProgramLayout {
+    TilePlan tiles;
+    StreamSchedule schedule = SCHEDULE_CONCAT;
+    int lutPrecision = 0;
+    ElementPrecision precision;
+    WeightPlan weights;
+    bool pipelined = false;
+    LatencyModel pipeline;
+    ProgramPart part = PROGRAM_WHOLE;
+    SparsePlan sparse;
+    EpilogueSpec epilogue;
+
+    // Options with the same tokens, pointing into this layout
+    CodegenOptions options() const;
+};
+
+// Apply a block found between the core table end and the header end, or the
+// text of a "# ISA: " / "# Layout: " line: the ISA becomes the active one,
+// and `layout` is set to the tokens (the defaults where there are none)
+bool applyContainerHeader(const char* begin, const char* end, ProgramLayout& layout);
+
+// Packed binary program container (.pimb)
+// Layout (all fields little-endian uint32):
+//   0  magic "PIMB"          20  N
+//   4  format version        24  number of cores
+//   8  header size (bytes)   28  total instruction count
+//   12 M                     32  bytes per instruction (3 for the default ISA)
+//   16 K                     36  reserved
+//   40 core table: one {coreId, startRow, endRow, firstInstr, instrCount}
+//      entry per core, then the header block (containerHeaderBlock), padded
+//      with zeros to an 8-byte boundary. In an interleaved stream firstInstr
+//      is the position of the core's first instruction.
+// The instruction stream follows the header as packed little-endian words.
+const uint32_t PIMB_MAGIC = 0x424D4950;  // "PIMB" read as a little-endian uint32
+const uint32_t PIMB_VERSION = 1;
+const int PIMB_INSTRUCTION_BYTES = 3;  // Default ISA; others use activeIsa().instructionBytes()
+
+// Streams a .pimb file; the core table and totals are patched in by finish()
+class BinaryFileSink : public InstructionSink {
+public:
+    BinaryFileSink(const std::string& filename, const MatrixDimensions& dims,
+                   const std::vector<WorkAssignment>& assignments, const CodegenOptions& options);
+    bool isOpen() const { return out.is_open(); }
+    void beginCore(const WorkAssignment& work) override;
+    void emit(Instruction instr) override;
+    bool finish() override;
+private:
+    void flushChunk();
+    
+    std::ofstream out;
+    std::vector<WorkAssignment> cores;
+    std::vector<uint32_t> firstInstr;
+    std::vector<uint32_t> counts;
+    std::vector<int> entryOfCore;   // Core table entry by core id, -1 if none
+    std::vector<char> chunk;
+    uint32_t total;
+    int wordBytes;
+    std::string headerBlock;
+};
+
+// Loop-compressed program container (.piml)
+// Same 40-byte header as .pimb (magic "PIML", reserved field = record stream
+// bytes), then one {coreId, startRow, endRow, firstInstr, instrCount,
+// recordOffset} entry per core. Each core's program is stored as repeat
+// records: a body of tokens, a repeat count, and a per-leaf address stride
+// applied on every repeat. Records nest, one level per generated loop.
+const uint32_t PIML_MAGIC = 0x4C4D4950;  // "PIML" read as a little-endian uint32
+const uint32_t PIML_VERSION = 1;
+
+// A literal instruction (leaf) or a repeat record
+struct LoopToken {
+    bool repeat;
+    uint32_t word;                  // Leaf instruction, address field holds the first value
+    uint32_t count;                 // Repeat count
+    uint32_t leaves;                // Leaf instructions in this token, before expansion
+    std::vector<LoopToken> body;    // Repeated tokens
+    std::vector<int32_t> strides;   // Address step per repeat for each leaf of the body
+};
+
+// Fold regular repeats in an instruction stream into nested repeat records
+std::vector<LoopToken> compressLoops(const std::vector<Instruction>& instructions);
+
+// Expand records back into the exact original instruction stream
+void expandLoops(const std::vector<LoopToken>& tokens, InstructionSink& sink);
+
+// Serialize records to / from the 32-bit word stream stored in .piml files
+void encodeLoops(const std::vector<LoopToken>& tokens, std::vector<uint32_t>& out);
+bool decodeLoops(const uint32_t* data, size_t numWords, std::vector<LoopToken>& out);
+
+// Writes a .piml file, compressing each core's program as it completes
+class LoopFileSink : public InstructionSink {
+public:
+    LoopFileSink(const std::string& filename, const MatrixDimensions& dims,
+                 const std::vector<WorkAssignment>& assignments, const CodegenOptions& options);
+    bool isOpen() const { return out.is_open(); }
+    void beginCore(const WorkAssignment& work) override;
+    void emit(Instruction instr) override;
+    void endCore() override;
+    bool finish() override;
+private:
+    std::ofstream out;
+    MatrixDimensions dimensions;
+    std::vector<WorkAssignment> cores;
+    std::vector<uint32_t> firstInstr;
+    std::vector<uint32_t> counts;
+    std::vector<uint32_t> recordOffsets;
+    std::vector<Instruction> program;
+    std::string headerBlock;
+    uint32_t total;
+    uint32_t recordWords;
+    int current;
+};
+
+// A .piml file loaded back into records
+struct LoopProgram {
+    MatrixDimensions dims;
+    std::vector<WorkAssignment> assignments;
+    std::vector<std::vector<LoopToken>> cores;
+    ProgramLayout layout;
+};
+
+bool readLoopProgram(const std::string& filename, LoopProgram& program);
+
+// Instruction fields split out into parallel arrays (structure of arrays), so
+// analysis passes can scan one field across millions of instructions
+struct DecodedInstructions {
+    std::vector<uint8_t> opcode;
+    std::vector<uint16_t> coreId;
+    std::vector<uint8_t> read;
+    std::vector<uint8_t> write;
+    std::vector<uint32_t> addr;
+    
+    size_t size() const { return opcode.size(); }
+    void resize(size_t count) {
+        opcode.resize(count);
+        coreId.resize(count);
+        read.resize(count);
+        write.resize(count);
+        addr.resize(count);
+    }
+};
+
+// Inverse of the gen*Instr functions
+// Packed words are activeIsa().instructionBytes() wide, least significant byte first
+Instruction unpackInstruction(const uint8_t* bytes);
+void decodeInstructions(const uint8_t* packed, size_t count, DecodedInstructions& out);
+void decodeInstructions(const std::vector<Instruction>& instructions, DecodedInstructions& out);
+
+// Disassembly: "PROG", "EXE" ... and "EXE core=1 R=1 W=0 addr=5"
+const char* opcodeName(int opcode);
+std::string disassemble(Instruction instr);
+
+// Parse the hex word at the start of a .pim line; false for comments and blank lines
+bool parseHexInstruction(const std::string& line, Instruction& out);
+
+// Any program file (.pim text, .pimb or .piml) loaded as a flat instruction
+// stream with each core's slice recorded. A recorded ISA becomes the active one.
+// Interleaved streams are regrouped core by core, each core's order kept.
+struct LoadedProgram {
+    MatrixDimensions dims;
+    std::vector<WorkAssignment> assignments;
+    std::vector<size_t> firstInstr;
+    std::vector<size_t> counts;
+    std::vector<Instruction> instructions;
+    ProgramLayout layout;
+};
+
+bool readProgramFile(const std::string& filename, LoadedProgram& program);
+
+// Persistent compile cache
+// Entries are content-addressed by a hash of the normalized compile inputs
+// (dimensions, cores, output format, active ISA, codegen options, compiler
+// version and codegen revision).
+// Each entry is three files in the cache directory: <hash>.prog (the program
+// in the requested format), <hash>.tac and <hash>.key (the full key plus
+// output counts). Files are written to unique temporaries and renamed into
+// place, .key last, so a concurrent reader sees either no entry or a whole one.
+struct CacheEntryInfo {
+    uint64_t instructions;
+    uint64_t commentLines;
+};
+
+std::string compileCacheKey(const MatrixDimensions& dims, int numCores, const std::string& outputFormat,
+                            const CodegenOptions& options = CodegenOptions());
+std::string compileCacheHash(const std::string& key);
+
+// Copy a cached program and .tac to the given paths; false on a miss
+bool fetchFromCache(const std::string& cacheDir, const std::string& key,
+                    const std::string& outputFile, const std::string& tacFile,
+                    CacheEntryInfo& info);
+
+// Add a freshly compiled program and .tac to the cache
+bool storeInCache(const std::string& cacheDir, const std::string& key,
+                  const std::string& outputFile, const std::string& tacFile,
+                  const CacheEntryInfo& info);
 
 #endif // PIM_COMPILER_H
\ No newline at end of file
@@ -6,19 +6,380 @@ the original memory-based approach.
 """
 
 import re
+import struct
 import numpy as np
 import argparse
 from typing import List, Dict, Tuple, Optional
 
-# Constants
+# Constants (MEMORY_ROW_SIZE and ADDR_FIELD_MASK follow the active ISA, see configure_isa)
 MEMORY_ROW_SIZE = 512
 
+# Packed binary container (.pimb) written by pim_compiler --format=bin
+PIMB_MAGIC = b'PIMB'
+PIMB_HEADER_FORMAT = '<4s9I'  # magic, version, header size, M, K, N, cores, count, bytes/instr, reserved
+PIMB_CORE_FORMAT = '<5I'      # core id, start row, end row, first instruction, instruction count
+
+# Loop-compressed container (.piml) written by pim_compiler --format=loop
+PIML_MAGIC = b'PIML'
+PIML_CORE_FORMAT = '<6I'      # as PIMB, plus the byte offset of the core's records
+PIML_REPEAT_TAG = 0x80000000
+ADDR_FIELD_MASK = 0x1FF
+ADDR_FIELD_SHIFT = 0
+
+# Tile sizes (M, N, K) of a tiled layout, from the program header; None when
+# the matrices are stored row-major
+TILE_PLAN = None
+
+# Operand bits of the multiply/add LUTs the program loads itself, from the
+# program header; None when the LUTs are assumed preloaded
+LUT_PRECISION = None
+
+# (operand bits, accumulator bits) of packed low-precision data, from the
+# program header; None when every memory slot holds one 32-bit element
+PRECISION = None
+MEMORY_SLOT_BITS = 32
+
+# Weight file B was specialized to, from the program header; None when the
+# program works for any B
+WEIGHT_FILE = None
+
+# Latency table a software-pipelined program was padded for, from the
+# program header ("pipeline=issue=1,access=4,..."); None when it was not
+PIPELINE = None
+
+# Part of a persistent kernel ("setup" or "invocation"), from the program
+# header; None for a program that programs the cores, computes C and ends
+PERSISTENT = None
+
+# Pattern files of sparse operands ("A", "B"), from the program header, and
+# the patterns read from them (boolean masks); empty when both are dense
+SPARSE_FILES = {}
+SPARSE_MASKS = {}
+
+# Epilogue fused into the kernel, from the program header ("epilogue=bias,
+# alpha=3,shift=8,clamp=0:127"): whether a bias vector starts each element's
+# accumulator, and the output stage parameters; None without one
+EPILOGUE = None
+INT32_MIN, INT32_MAX = -(1 << 31), (1 << 31) - 1
+
+def parse_epilogue(text: str) -> Dict[str, int]:
+    """The compiler's epilogue spec as a dict of bias, alpha, shift, min and max"""
+    epilogue = {'bias': 0, 'alpha': 1, 'shift': 0, 'min': INT32_MIN, 'max': INT32_MAX}
+    relu = False
+    for item in text.split(','):
+        key, _, value = item.partition('=')
+        if item == 'bias':
+            epilogue['bias'] = 1
+        elif item == 'relu':
+            relu = True
+        elif key in ('alpha', 'shift'):
+            epilogue[key] = int(value)
+        elif key == 'clamp':
+            epilogue['min'], epilogue['max'] = (int(v) for v in value.split(':'))
+        else:
+            raise ValueError(f"unknown epilogue item '{item}'")
+    if relu:
+        epilogue['min'] = max(epilogue['min'], 0)
+    return epilogue
+
+def has_output_stage(epilogue: Dict[str, int]) -> bool:
+    return (epilogue['alpha'], epilogue['shift'], epilogue['min'], epilogue['max']) != (1, 0, INT32_MIN, INT32_MAX)
+
+def apply_epilogue(product: np.ndarray, bias: Optional[np.ndarray]) -> np.ndarray:
+    """C as the epilogue leaves it: clamp(((A @ B + bias) * alpha) >> shift)"""
+    if EPILOGUE is None:
+        return product
+    result = product.astype(np.int64)
+    if EPILOGUE['bias']:
+        result = result + bias.astype(np.int64)
+    result = (result * EPILOGUE['alpha']) >> EPILOGUE['shift']
+    return np.clip(result, EPILOGUE['min'], EPILOGUE['max'])
+
+# LUT functions, in the order a program loads them (see the compiler's LutFunction).
+# A table has 256 8-bit entries indexed by two 4-bit operands (x << 4 | y).
+LUT_MUL_UU, LUT_MUL_SU, LUT_MUL_SS, LUT_ADD, LUT_ADDC = range(5)
+LUT_ENTRIES = 256
+LUT_LOAD_CYCLES = 16  # Loading a table, as PROG in the compiler's latency model
+
+def lut_functions(precision: int) -> List[int]:
+    """Tables a precision loads: a single signed digit needs only the signed multiply"""
+    if precision <= 4:
+        return [LUT_MUL_SS, LUT_ADD, LUT_ADDC]
+    return [LUT_MUL_UU, LUT_MUL_SU, LUT_MUL_SS, LUT_ADD, LUT_ADDC]
+
+def signed_digit(x: int) -> int:
+    return x - 16 if x >= 8 else x
+
+def lut_entry(function: int, x: int, y: int) -> int:
+    """Table contents; signed products are stored as 8-bit two's complement"""
+    if function == LUT_MUL_UU:
+        return x * y
+    if function == LUT_MUL_SU:
+        return (signed_digit(x) * y) & 0xFF
+    if function == LUT_MUL_SS:
+        return (signed_digit(x) * signed_digit(y)) & 0xFF
+    if function == LUT_ADD:
+        return x + y
+    return x + y + 1
+
+def lut_lookups_per_mac(precision: int) -> int:
+    """d^2 digit products, each added into the 2 * precision bit product with 2d nibble adds"""
+    digits = (precision + 3) // 4
+    return digits * digits * (1 + 2 * digits)
+
+def wrap_to_precision(matrix: np.ndarray, precision: int) -> np.ndarray:
+    """Two's complement wrap of every element into a signed precision-bit operand"""
+    half = 1 << (precision - 1)
+    return ((matrix + half) % (2 * half) - half).astype(np.int32)
+
+def wrap_value(value: int, bits: int) -> int:
+    """Two's complement wrap of one value into a signed bits-wide field"""
+    half = 1 << (bits - 1)
+    return (value + half) % (2 * half) - half
+
+# Operations of an EXE with R=0, W=0 and no access pending, in the low two
+# address bits; the bits above name the accumulator
+OP_CLEAR, OP_LOAD_ACC, OP_MAC, OP_SELECT = range(4)
+
 # Instruction Types
 INSTR_NOOP = 0  # 00
 INSTR_PROG = 1  # 01
 INSTR_EXE = 2   # 10
 INSTR_END = 3   # 11
 
+class IsaDescriptor:
+    """Instruction word layout: field (shift, width) pairs, opcode encodings and row size"""
+    
+    def __init__(self):
+        self.name = 'pim24'
+        self.word = 24
+        self.opcode = (17, 2)
+        self.core = (11, 6)
+        self.read = 10
+        self.write = 9
+        self.addr = (0, 9)
+        self.ops = [0, 1, 2, 3]  # Encodings of NOOP, PROG, EXE, END
+        self.row = 512
+        self.broadcast = None    # Bit that sends an instruction to cores 0..core, if the ISA has one
+        self.accumulators = 1    # Accumulators a core exposes, numbered in the operation address
+    
+    def field(self, word: int, shift: int, width: int) -> int:
+        return (word >> shift) & ((1 << width) - 1)
+    
+    def instruction_bytes(self) -> int:
+        return (self.word + 7) // 8
+
+def isa_by_name(name: str) -> Optional[IsaDescriptor]:
+    """Built-in descriptors, matching the compiler's isaByName"""
+    isa = IsaDescriptor()
+    if name == 'pim24':
+        return isa
+    if name == 'pim24b':
+        isa.name = 'pim24b'
+        isa.broadcast = 19
+        return isa
+    if name == 'pim32':
+        isa.name = 'pim32'
+        isa.word = 32
+        isa.opcode = (30, 2)
+        isa.core = (20, 10)
+        isa.read = 19
+        isa.write = 18
+        isa.addr = (0, 18)
+        return isa
+    return None
+
+def parse_isa_description(text: str) -> IsaDescriptor:
+    """Parse the "key=value ..." form the compiler writes into program headers"""
+    isa = IsaDescriptor()
+    isa.name = 'custom'
+    for token in text.split():
+        key, _, value = token.partition('=')
+        if key == 'name':
+            isa.name = value
+        elif key == 'word':
+            isa.word = int(value)
+        elif key in ('opcode', 'core', 'addr'):
+            shift, width = value.split(':')
+            setattr(isa, key, (int(shift), int(width)))
+        elif key in ('read', 'write', 'broadcast'):
+            setattr(isa, key, int(value))
+        elif key == 'ops':
+            isa.ops = [int(v) for v in value.split(',')]
+        elif key == 'row':
+            isa.row = int(value)
+        elif key == 'acc':
+            isa.accumulators = int(value)
+        else:
+            raise ValueError(f"Unknown ISA key '{key}'")
+    return isa
+
+def load_isa(name_or_path: str) -> IsaDescriptor:
+    """Built-in name or a descriptor file of "key = value" lines"""
+    isa = isa_by_name(name_or_path)
+    if isa is not None:
+        return isa
+    tokens = []
+    with open(name_or_path, 'r') as f:
+        for line in f:
+            line = line.split('#', 1)[0]
+            if '=' in line:
+                key, _, value = line.partition('=')
+                tokens.append(key.strip() + '=' + ''.join(value.split()))
+    return parse_isa_description(' '.join(tokens))
+
+ISA = IsaDescriptor()
+
+def configure_isa(isa: IsaDescriptor):
+    """Make an ISA the one used for decoding and memory layout"""
+    global ISA, MEMORY_ROW_SIZE, ADDR_FIELD_MASK, ADDR_FIELD_SHIFT
+    ISA = isa
+    MEMORY_ROW_SIZE = isa.row
+    ADDR_FIELD_SHIFT, width = isa.addr
+    ADDR_FIELD_MASK = ((1 << width) - 1) << ADDR_FIELD_SHIFT
+
+# Latency table keys and the compiler's defaults (its LatencyModel)
+DEFAULT_LATENCIES = {'issue': 1, 'access': 4, 'activation': 32, 'mac': 2, 'program': 16}
+
+def parse_latency_table(text: str) -> Dict[str, int]:
+    """Latencies from "key=value" tokens (commas, spaces or newlines between
+    them, '#' comments), over the defaults"""
+    table = dict(DEFAULT_LATENCIES)
+    for line in text.splitlines():
+        for key, value in re.findall(r'(\w+)\s*=\s*(\d+)', line.split('#', 1)[0]):
+            if key not in table:
+                raise ValueError(f"unknown latency '{key}' (expected {', '.join(table)})")
+            table[key] = int(value)
+    return table
+
+def load_latency_table(file_or_text: str) -> Dict[str, int]:
+    """A latency table file, or the table given inline"""
+    try:
+        with open(file_or_text) as f:
+            return parse_latency_table(f.read())
+    except FileNotFoundError:
+        return parse_latency_table(file_or_text)
+
+def describe_latency_table(table: Dict[str, int]) -> str:
+    return ','.join(f"{key}={table[key]}" for key in DEFAULT_LATENCIES)
+
+class PipelineChecker:
+    """Checks that each core could run its instructions, at the cycles the
+    stream issues them, without interlocks under a latency table (the
+    compiler's PipelineTiming): no instruction may read a result before it is
+    ready, overwrite one that lands after its own, or access a subarray
+    still busy with the previous access. END waits for everything."""
+    LATCH, LOADED, OPERAND_A, OPERAND_B, ACCUMULATOR, TABLES = range(6)
+    NAMES = ['row latch', 'loaded value', 'A operand', 'B operand', 'accumulator', 'LUTs']
+    
+    def __init__(self, latencies: Dict[str, int], base_addr_b: int, base_addr_c: int):
+        self.latencies = latencies
+        self.base_addr_b = base_addr_b
+        self.base_addr_c = base_addr_c
+        self.cores = {}
+        self.hazards = 0
+        self.first_hazard = None
+        self.last_result = 0
+    
+    def step(self, core_id: int, instr_type: int, read_flag: bool, write_flag: bool, addr: int, cycle: int):
+        state = self.cores.setdefault(core_id, {'ready': [0] * 6, 'busy': [0] * 3, 'open': [None] * 3,
+                                                 'pending': False, 'row': None, 'write': False})
+        lat = self.latencies
+        reads, writes, subarray, cycles, barrier = set(), set(), None, lat['issue'], False
+        if instr_type == INSTR_PROG and write_flag and not read_flag:
+            # The output stage works on the accumulator as a MAC does
+            reads = writes = {self.ACCUMULATOR}
+            cycles = lat['mac']
+        elif instr_type == INSTR_PROG:
+            writes = {self.TABLES}
+            cycles = lat['program']
+        elif instr_type == INSTR_END:
+            barrier = True
+        elif instr_type == INSTR_EXE:
+            reuse = read_flag and write_flag
+            if not reuse and (read_flag or write_flag):
+                writes = {self.LATCH}
+            elif reuse or state['pending']:
+                row = state['row']
+                subarray = 0 if row < self.base_addr_b else 1 if row < self.base_addr_c else 2
+                cycles = lat['access'] + (lat['activation'] if state['open'][subarray] != row else 0)
+                reads = {self.LATCH}
+                if state['write']:
+                    reads.add(self.ACCUMULATOR)
+                else:
+                    writes = {self.LOADED}
+                    if subarray < 2:
+                        writes.add(self.OPERAND_A if subarray == 0 else self.OPERAND_B)
+            elif addr & 3 == OP_MAC:
+                reads = {self.OPERAND_A, self.OPERAND_B, self.ACCUMULATOR, self.TABLES}
+                writes = {self.ACCUMULATOR}
+                cycles = lat['mac']
+            elif addr & 3 == OP_LOAD_ACC:
+                reads = {self.LOADED}
+                writes = {self.ACCUMULATOR}
+            else:
+                writes = {self.ACCUMULATOR}
+        cycles = max(cycles, lat['issue'])
+        done = cycle + cycles
+        
+        ready, busy = state['ready'], state['busy']
+        late = [f"reads the {self.NAMES[r]} {ready[r] - cycle} cycles early"
+                for r in (range(6) if barrier else sorted(reads)) if ready[r] > cycle]
+        late += [f"overwrites the {self.NAMES[r]} {ready[r] - done} cycles early"
+                 for r in sorted(writes) if ready[r] > done]
+        late += [f"accesses subarray {'ABC'[s]} {busy[s] - cycle} cycles early"
+                 for s in range(3) if (barrier or s == subarray) and busy[s] > cycle]
+        if late:
+            self.hazards += 1
+            if self.first_hazard is None:
+                self.first_hazard = f"core {core_id} at cycle {cycle} {late[0]}"
+        
+        for r in writes:
+            ready[r] = done
+        if subarray is not None:
+            busy[subarray] = done
+            state['open'][subarray] = state['row']
+        if instr_type == INSTR_EXE and read_flag != write_flag:
+            state['row'], state['write'], state['pending'] = addr, write_flag, True
+        elif instr_type != INSTR_NOOP:
+            state['pending'] = False
+        self.last_result = max(self.last_result, done)
+
+def apply_header_description(text: str):
+    """Apply "key=value" tokens from a program header: a tile plan and/or an ISA"""
+    global TILE_PLAN, LUT_PRECISION, PRECISION, WEIGHT_FILE, PIPELINE, PERSISTENT, SPARSE_FILES, EPILOGUE
+    isa_tokens = []
+    for token in text.split():
+        if token.startswith('tiles='):
+            TILE_PLAN = tuple(int(v) for v in token[len('tiles='):].split(','))
+        elif token.startswith('lut='):
+            LUT_PRECISION = int(token[len('lut='):])
+        elif token.startswith('precision='):
+            PRECISION = tuple(int(v) for v in token[len('precision='):].split(','))
+        elif token.startswith('weights='):
+            WEIGHT_FILE = token[len('weights='):]
+        elif token.startswith('pipeline='):
+            PIPELINE = parse_latency_table(token[len('pipeline='):])
+        elif token.startswith('persistent='):
+            PERSISTENT = token[len('persistent='):]
+        elif token.startswith('sparse-a=') or token.startswith('sparse-b='):
+            SPARSE_FILES[token[len('sparse-')].upper()] = token[len('sparse-a='):]
+        elif token.startswith('epilogue='):
+            EPILOGUE = parse_epilogue(token[len('epilogue='):])
+        elif token.startswith('schedule='):
+            # Merged streams need nothing special: every core keeps its own
+            # state, instructions run in stream order, and a broadcast runs
+            # on each core of its group
+            continue
+        else:
+            isa_tokens.append(token)
+    if isa_tokens:
+        configure_isa(parse_isa_description(' '.join(isa_tokens)))
+
+def read_header_block(data: bytes, begin: int, end: int) -> str:
+    """Tokens of the header block recorded after a container's core table, if any"""
+    return data[begin:end].rstrip(b'\0').decode('ascii')
+
 class PIMCore:
     """Represents a single Processing-in-Memory core"""
     
@@ -37,15 +398,34 @@ class PIMCore:
         self.current_k = None
         self.current_j = None
         
-        # Computation state
-        self.accumulator = 0
+        # Computation state: CLEAR, LOAD_ACC and MAC name an accumulator and
+        # make it current; stores write the current one
+        self.accumulators = {}
+        self.current_acc = 0
+        self.last_read_value = None  # Operand for the load-accumulator operation
+        self.a_operand = None        # (i, k, value) of the A element read last, for the MAC
+        
+        # Open row of each matrix's subarray, for counting row activations
+        self.open_rows = {}
+        
+        # Tables loaded by PROG R=1 W=1, in load order
+        self.luts = []
         
         # Instruction state
         self.function = None
         self.next_operation = None
         self.addr_register = None
+        self.addr_direction = None  # "read" or "write", whichever last set addr_register
         self.offset_register = None
         
+    @property
+    def accumulator(self) -> int:
+        return self.accumulators.get(self.current_acc, 0)
+    
+    @accumulator.setter
+    def accumulator(self, value: int):
+        self.accumulators[self.current_acc] = value
+    
     def reset(self):
         """Reset the core state"""
         self.__init__(self.core_id)
@@ -56,7 +436,7 @@ class PIMCore:
 class PIMMemory:
     """Simulates PIM memory with matrices stored in rows"""
     
-    def __init__(self, matrix_a: np.ndarray, matrix_b: np.ndarray):
+    def __init__(self, matrix_a: np.ndarray, matrix_b: np.ndarray, bias: Optional[np.ndarray] = None):
         self.M, self.K = matrix_a.shape
         self.K2, self.N = matrix_b.shape
         assert self.K == self.K2, f"Matrix dimensions mismatch: A is {self.M}x{self.K}, B is {self.K2}x{self.N}"
@@ -66,51 +446,170 @@ class PIMMemory:
         self.size_b = self.K * self.N
         self.size_c = self.M * self.N
         
-        self.rows_a = (self.size_a + MEMORY_ROW_SIZE - 1) // MEMORY_ROW_SIZE
-        self.rows_b = (self.size_b + MEMORY_ROW_SIZE - 1) // MEMORY_ROW_SIZE
-        self.rows_c = (self.size_c + MEMORY_ROW_SIZE - 1) // MEMORY_ROW_SIZE
+        # Sparse operands keep their nonzeros only, A's in CSR order and B's
+        # in CSC order: per matrix, the (row, col) of each stored element and
+        # the position of each
+        self.sparse = {}
+        for matrix, mask in SPARSE_MASKS.items():
+            if matrix == "A":
+                positions = list(zip(*(axis.tolist() for axis in np.nonzero(mask))))
+            else:
+                columns, rows = np.nonzero(mask.T)
+                positions = list(zip(rows.tolist(), columns.tolist()))
+            self.sparse[matrix] = (positions, {element: p for p, element in enumerate(positions)})
+        if "A" in self.sparse:
+            self.size_a = len(self.sparse["A"][0])
+        if "B" in self.sparse:
+            self.size_b = len(self.sparse["B"][0])
+        
+        # Packed data: A and B share each 32-bit slot at the operand width,
+        # C at the accumulator width. (bits, elements per slot) per matrix.
+        data_bits, acc_bits = PRECISION if PRECISION else (MEMORY_SLOT_BITS, MEMORY_SLOT_BITS)
+        self.formats = {"A": (data_bits, MEMORY_SLOT_BITS // data_bits),
+                        "B": (data_bits, MEMORY_SLOT_BITS // data_bits),
+                        "C": (acc_bits, MEMORY_SLOT_BITS // acc_bits)}
+        self.row_elements = {m: MEMORY_ROW_SIZE * lanes for m, (_, lanes) in self.formats.items()}
+        
+        self.rows_a = (self.size_a + self.row_elements["A"] - 1) // self.row_elements["A"]
+        self.rows_b = (self.size_b + self.row_elements["B"] - 1) // self.row_elements["B"]
+        self.rows_c = (self.size_c + self.row_elements["C"] - 1) // self.row_elements["C"]
+        
+        # Tiled layout: every tile in a memory row of its own, edge tiles padded
+        self.tiles = TILE_PLAN
+        if self.tiles:
+            tile_m, tile_n, tile_k = self.tiles
+            tiles_m = (self.M + tile_m - 1) // tile_m
+            tiles_n = (self.N + tile_n - 1) // tile_n
+            tiles_k = (self.K + tile_k - 1) // tile_k
+            # (tile rows, tile columns, tiles across) of A, B and C
+            self.tile_shape = {"A": (tile_m, tile_k, tiles_k), "B": (tile_k, tile_n, tiles_n),
+                               "C": (tile_m, tile_n, tiles_n)}
+            self.rows_a = tiles_m * tiles_k
+            self.rows_b = tiles_k * tiles_n
+            self.rows_c = tiles_m * tiles_n
         
         # Base addresses
         self.base_addr_a = 0
         self.base_addr_b = self.rows_a
         self.base_addr_c = self.rows_a + self.rows_b
         
+        # The epilogue's bias follows C, stored as C is, then its output
+        # stage parameters (alpha, shift, min, max) in a row of their own
+        self.base_addr_bias = self.base_addr_c + self.rows_c
+        bias_rows = 0
+        if EPILOGUE and EPILOGUE['bias']:
+            bias_rows = (self.N + self.row_elements["C"] - 1) // self.row_elements["C"]
+        self.base_addr_output_stage = self.base_addr_bias + bias_rows
+        output_stages = 1 if EPILOGUE and has_output_stage(EPILOGUE) else 0
+        
+        # LUT images follow, one table per row
+        self.base_addr_lut = self.base_addr_output_stage + output_stages
+        self.lut_images = lut_functions(LUT_PRECISION) if LUT_PRECISION else []
+        
         # Initialize memory as a list of rows
-        total_rows = self.rows_a + self.rows_b + self.rows_c
+        total_rows = self.base_addr_lut + len(self.lut_images)
         self.memory = [np.zeros(MEMORY_ROW_SIZE, dtype=np.int32) for _ in range(total_rows)]
+        if output_stages:
+            self.memory[self.base_addr_output_stage][:4] = [EPILOGUE[key] for key in ('alpha', 'shift', 'min', 'max')]
+        if bias_rows:
+            for j in range(self.N):
+                self.write(self.base_addr_bias + j // self.row_elements["C"], j % self.row_elements["C"], int(bias[j]))
+        for image, function in enumerate(self.lut_images):
+            row = self.memory[self.base_addr_lut + image]
+            for index in range(LUT_ENTRIES):
+                row[index] = lut_entry(function, index >> 4, index & 0xF)
         
         # Store matrices A and B in memory
-        self._store_matrix(matrix_a, self.base_addr_a, self.K)
-        self._store_matrix(matrix_b, self.base_addr_b, self.N)
+        self.store_a(matrix_a)
+        if "B" in self.sparse:
+            for k, j in self.sparse["B"][0]:
+                self.set_matrix_element("B", k, j, matrix_b[k, j])
+        elif self.tiles:
+            for k in range(self.K):
+                for j in range(self.N):
+                    self.set_matrix_element("B", k, j, matrix_b[k, j])
+        else:
+            self._store_matrix(matrix_b, self.base_addr_b, self.N)
         
         # Matrix C will be filled during execution
         self.matrix_c = np.zeros((self.M, self.N), dtype=np.int32)
     
+    def store_a(self, matrix_a: np.ndarray):
+        """Place A in memory, as the host does before each invocation of a persistent kernel"""
+        if "A" in self.sparse:
+            for i, k in self.sparse["A"][0]:
+                self.set_matrix_element("A", i, k, matrix_a[i, k])
+        elif self.tiles:
+            for i in range(self.M):
+                for k in range(self.K):
+                    self.set_matrix_element("A", i, k, matrix_a[i, k])
+        else:
+            self._store_matrix(matrix_a, self.base_addr_a, self.K)
+    
     def _store_matrix(self, matrix: np.ndarray, base_addr: int, cols: int):
         """Store a matrix in memory starting at the given base address"""
         rows, _ = matrix.shape
+        per_row = self.row_elements["A" if base_addr == self.base_addr_a else "B"]
         for i in range(rows):
             for j in range(cols):
                 idx = i * cols + j
-                row_idx = base_addr + idx // MEMORY_ROW_SIZE
-                col_idx = idx % MEMORY_ROW_SIZE
-                self.memory[row_idx][col_idx] = matrix[i, j]
+                self.write(base_addr + idx // per_row, idx % per_row, int(matrix[i, j]))
+    
+    def _element_format(self, addr: int) -> Tuple[int, int]:
+        """(bits, elements per slot) of the row at addr; output stage and LUT rows are unpacked"""
+        if self.tiles or addr >= self.base_addr_output_stage:
+            return MEMORY_SLOT_BITS, 1
+        if addr < self.base_addr_b:
+            return self.formats["A"]
+        if addr < self.base_addr_c:
+            return self.formats["B"]
+        return self.formats["C"]
+    
+    def _tiled_location(self, matrix: str, row: int, col: int) -> Tuple[int, int]:
+        """Memory row and offset of an element in the tiled layout"""
+        tile_rows, tile_cols, across = self.tile_shape[matrix]
+        base = {"A": self.base_addr_a, "B": self.base_addr_b, "C": self.base_addr_c}[matrix]
+        mem_addr = base + (row // tile_rows) * across + col // tile_cols
+        return mem_addr, (row % tile_rows) * tile_cols + col % tile_cols
+    
+    def _sparse_location(self, matrix: str, row: int, col: int) -> Optional[Tuple[int, int]]:
+        """Memory row and offset of an element of a sparse operand; None for a structural zero"""
+        position = self.sparse[matrix][1].get((row, col))
+        if position is None:
+            return None
+        base = self.base_addr_a if matrix == "A" else self.base_addr_b
+        return base + position // self.row_elements[matrix], position % self.row_elements[matrix]
     
     def read(self, addr: int, offset: int) -> int:
-        """Read a value from memory at the given address and offset"""
+        """Read a value from memory at the given address and offset (an
+        element index: packed rows hold several elements per slot)"""
         if addr < 0 or addr >= len(self.memory):
             raise ValueError(f"Memory address out of bounds: {addr}")
-        if offset < 0 or offset >= MEMORY_ROW_SIZE:
+        bits, lanes = self._element_format(addr)
+        if offset < 0 or offset >= MEMORY_ROW_SIZE * lanes:
             raise ValueError(f"Memory offset out of bounds: {offset}")
-        return self.memory[addr][offset]
+        if lanes == 1:
+            return self.memory[addr][offset]
+        slot = int(self.memory[addr][offset // lanes]) & 0xFFFFFFFF
+        field = (slot >> (bits * (offset % lanes))) & ((1 << bits) - 1)
+        return wrap_value(field, bits)
     
     def write(self, addr: int, offset: int, value: int):
         """Write a value to memory at the given address and offset"""
         if addr < 0 or addr >= len(self.memory):
             raise ValueError(f"Memory address out of bounds: {addr}")
-        if offset < 0 or offset >= MEMORY_ROW_SIZE:
+        bits, lanes = self._element_format(addr)
+        if offset < 0 or offset >= MEMORY_ROW_SIZE * lanes:
             raise ValueError(f"Memory offset out of bounds: {offset}")
-        self.memory[addr][offset] = value
+        if lanes == 1:
+            self.memory[addr][offset] = value
+            return
+        # Replace one field of the slot, keeping its neighbours
+        shift = bits * (offset % lanes)
+        mask = ((1 << bits) - 1) << shift
+        slot = int(self.memory[addr][offset // lanes]) & 0xFFFFFFFF
+        slot = (slot & ~mask) | ((int(value) << shift) & mask)
+        self.memory[addr][offset // lanes] = wrap_value(slot, MEMORY_SLOT_BITS)
     
     def get_matrix_element(self, matrix: str, row: int, col: int) -> int:
         """
@@ -122,23 +621,31 @@ class PIMMemory:
             if row < 0 or row >= self.M or col < 0 or col >= self.K:
                 raise ValueError(f"A[{row}][{col}] out of bounds")
             linear_idx = row * self.K + col
-            mem_addr = self.base_addr_a + linear_idx // MEMORY_ROW_SIZE
-            mem_offset = linear_idx % MEMORY_ROW_SIZE
+            mem_addr = self.base_addr_a + linear_idx // self.row_elements["A"]
+            mem_offset = linear_idx % self.row_elements["A"]
         elif matrix == "B":
             if row < 0 or row >= self.K or col < 0 or col >= self.N:
                 raise ValueError(f"B[{row}][{col}] out of bounds")
             linear_idx = row * self.N + col
-            mem_addr = self.base_addr_b + linear_idx // MEMORY_ROW_SIZE
-            mem_offset = linear_idx % MEMORY_ROW_SIZE
+            mem_addr = self.base_addr_b + linear_idx // self.row_elements["B"]
+            mem_offset = linear_idx % self.row_elements["B"]
         elif matrix == "C":
             if row < 0 or row >= self.M or col < 0 or col >= self.N:
                 raise ValueError(f"C[{row}][{col}] out of bounds")
             linear_idx = row * self.N + col
-            mem_addr = self.base_addr_c + linear_idx // MEMORY_ROW_SIZE
-            mem_offset = linear_idx % MEMORY_ROW_SIZE
+            mem_addr = self.base_addr_c + linear_idx // self.row_elements["C"]
+            mem_offset = linear_idx % self.row_elements["C"]
         else:
             raise ValueError(f"Unknown matrix: {matrix}")
         
+        if self.tiles:
+            mem_addr, mem_offset = self._tiled_location(matrix, row, col)
+        if matrix in self.sparse:
+            location = self._sparse_location(matrix, row, col)
+            if location is None:
+                return 0
+            mem_addr, mem_offset = location
+        
         # Return the value from memory
         return self.read(mem_addr, mem_offset)
     
@@ -149,23 +656,33 @@ class PIMMemory:
             if row < 0 or row >= self.M or col < 0 or col >= self.K:
                 raise ValueError(f"A[{row}][{col}] out of bounds")
             linear_idx = row * self.K + col
-            mem_addr = self.base_addr_a + linear_idx // MEMORY_ROW_SIZE
-            mem_offset = linear_idx % MEMORY_ROW_SIZE
+            mem_addr = self.base_addr_a + linear_idx // self.row_elements["A"]
+            mem_offset = linear_idx % self.row_elements["A"]
         elif matrix == "B":
             if row < 0 or row >= self.K or col < 0 or col >= self.N:
                 raise ValueError(f"B[{row}][{col}] out of bounds")
             linear_idx = row * self.N + col
-            mem_addr = self.base_addr_b + linear_idx // MEMORY_ROW_SIZE
-            mem_offset = linear_idx % MEMORY_ROW_SIZE
+            mem_addr = self.base_addr_b + linear_idx // self.row_elements["B"]
+            mem_offset = linear_idx % self.row_elements["B"]
         elif matrix == "C":
             if row < 0 or row >= self.M or col < 0 or col >= self.N:
                 raise ValueError(f"C[{row}][{col}] out of bounds")
             linear_idx = row * self.N + col
-            mem_addr = self.base_addr_c + linear_idx // MEMORY_ROW_SIZE
-            mem_offset = linear_idx % MEMORY_ROW_SIZE
+            mem_addr = self.base_addr_c + linear_idx // self.row_elements["C"]
+            mem_offset = linear_idx % self.row_elements["C"]
         else:
             raise ValueError(f"Unknown matrix: {matrix}")
         
+        if self.tiles:
+            mem_addr, mem_offset = self._tiled_location(matrix, row, col)
+        if matrix in self.sparse:
+            location = self._sparse_location(matrix, row, col)
+            if location is None:
+                if value != 0:
+                    raise ValueError(f"{matrix}[{row}][{col}] is a structural zero of its sparse pattern")
+                return
+            mem_addr, mem_offset = location
+        
         # Write the value to memory
         self.write(mem_addr, mem_offset, value)
     
@@ -174,33 +691,58 @@ class PIMMemory:
         Convert memory address and offset to matrix indices.
         Returns (row_idx, col_idx, matrix_name) or None if not a valid matrix access.
         """
+        if self.tiles:
+            return self._tiled_indices(addr, offset)
+        
         if addr < self.base_addr_b:
             # Matrix A
-            element_idx = (addr - self.base_addr_a) * MEMORY_ROW_SIZE + offset
+            element_idx = (addr - self.base_addr_a) * self.row_elements["A"] + offset
             if element_idx >= self.size_a:
                 return None
+            if "A" in self.sparse:
+                return self.sparse["A"][0][element_idx] + ("A",)
             row_idx = element_idx // self.K
             col_idx = element_idx % self.K
             return (row_idx, col_idx, "A")
             
         elif addr < self.base_addr_c:
             # Matrix B
-            element_idx = (addr - self.base_addr_b) * MEMORY_ROW_SIZE + offset
+            element_idx = (addr - self.base_addr_b) * self.row_elements["B"] + offset
             if element_idx >= self.size_b:
                 return None
+            if "B" in self.sparse:
+                return self.sparse["B"][0][element_idx] + ("B",)
             row_idx = element_idx // self.N
             col_idx = element_idx % self.N
             return (row_idx, col_idx, "B")
             
         else:
             # Matrix C
-            element_idx = (addr - self.base_addr_c) * MEMORY_ROW_SIZE + offset
+            element_idx = (addr - self.base_addr_c) * self.row_elements["C"] + offset
             if element_idx >= self.size_c:
                 return None
             row_idx = element_idx // self.N
             col_idx = element_idx % self.N
             return (row_idx, col_idx, "C")
     
+    def _tiled_indices(self, addr: int, offset: int) -> Optional[Tuple[int, int, str]]:
+        """get_matrix_indices for the tiled layout; padding reads as no element"""
+        if addr < self.base_addr_b:
+            matrix, base, rows, cols = "A", self.base_addr_a, self.M, self.K
+        elif addr < self.base_addr_c:
+            matrix, base, rows, cols = "B", self.base_addr_b, self.K, self.N
+        else:
+            matrix, base, rows, cols = "C", self.base_addr_c, self.M, self.N
+        tile_rows, tile_cols, across = self.tile_shape[matrix]
+        if offset >= tile_rows * tile_cols:
+            return None
+        tile = addr - base
+        row_idx = (tile // across) * tile_rows + offset // tile_cols
+        col_idx = (tile % across) * tile_cols + offset % tile_cols
+        if row_idx >= rows or col_idx >= cols:
+            return None
+        return (row_idx, col_idx, matrix)
+    
     def get_result_matrix(self) -> np.ndarray:
         """Extract the result matrix C from memory"""
         # Reconstitute matrix C from memory
@@ -213,13 +755,27 @@ class PIMMemory:
 class PIMSimulator:
     """Main simulator for PIM instructions"""
     
-    def __init__(self, num_cores: int, matrix_a: np.ndarray, matrix_b: np.ndarray, row_assignments: Dict[int, Tuple[int, int]]):
+    def __init__(self, num_cores: int, matrix_a: np.ndarray, matrix_b: np.ndarray, row_assignments: Dict[int, Tuple[int, int]],
+                 bias: Optional[np.ndarray] = None):
         self.num_cores = num_cores
         self.cores = [PIMCore(i) for i in range(num_cores)]
-        self.memory = PIMMemory(matrix_a, matrix_b)
+        self.memory = PIMMemory(matrix_a, matrix_b, bias)
         self.cycle_count = 0
+        self.row_activations = 0
+        self.loads = {"A": 0, "B": 0, "C": 0}  # Element reads per matrix
+        self.macs = 0
+        self.core_operations = 0  # Instructions run on a core; above cycle_count when broadcasts share words
+        self.lut_loads = 0        # PROG R=1 W=1 table loads
+        self.programs = 0         # PROG instructions that program a core's function
+        self.output_stages = 0    # PROG W=1 epilogue output stages
+        self.lut_lookups = 0      # Table lookups made by MACs
+        self.overflows = 0        # MACs whose sum wrapped at a packed accumulator's width
+        self.mac_a_reads = 0      # MACs that read A[i][k] from memory, none having been loaded
+        self.accumulators_used = 1
+        self.pipeline = None      # PipelineChecker, when checking against a latency table
         self.matrix_a = matrix_a
         self.matrix_b = matrix_b
+        self.bias = bias
         
         # Set row assignments for each core
         for core_id, (start_row, end_row) in row_assignments.items():
@@ -236,6 +792,18 @@ class PIMSimulator:
         if self.debug_enabled:
             print(f"[DEBUG] {message}")
             
+    def count_row_access(self, core: PIMCore, mem_addr: int):
+        """Count an activation when a core touches a row other than the one open in that matrix's subarray"""
+        if mem_addr < self.memory.base_addr_b:
+            subarray = "A"
+        elif mem_addr < self.memory.base_addr_c:
+            subarray = "B"
+        else:
+            subarray = "C"
+        if core.open_rows.get(subarray) != mem_addr:
+            core.open_rows[subarray] = mem_addr
+            self.row_activations += 1
+    
     def enable_debug(self):
         """Enable debug output"""
         self.debug_enabled = True
@@ -243,14 +811,18 @@ class PIMSimulator:
     def parse_instruction(self, instr_hex: str) -> Tuple[int, int, bool, bool, int]:
         """Parse a hex instruction into its components"""
         # Convert hex to int
-        instr = int(instr_hex, 16)
-        
-        # Extract fields
-        instr_type = (instr >> 17) & 0x3        # Bits 18-17 (opcode)
-        core_ptr = (instr >> 11) & 0x3F         # Bits 16-11 (core pointer)
-        read_flag = ((instr >> 10) & 0x1) != 0  # Bit 10 (read flag)
-        write_flag = ((instr >> 9) & 0x1) != 0  # Bit 9 (write flag)
-        addr = instr & 0x1FF                    # Bits 8-0 (address)
+        return self.decode_word(int(instr_hex, 16))
+    
+    def decode_word(self, instr: int) -> Tuple[int, int, bool, bool, int]:
+        """Split a packed instruction word into its components (the broadcast bit aside)"""
+        # Extract fields where the active ISA places them (default: opcode at
+        # bits 18-17, core pointer 16-11, read 10, write 9, address 8-0)
+        raw_type = ISA.field(instr, *ISA.opcode)
+        instr_type = ISA.ops.index(raw_type) if raw_type in ISA.ops else -1
+        core_ptr = ISA.field(instr, *ISA.core)
+        read_flag = ISA.field(instr, ISA.read, 1) != 0
+        write_flag = ISA.field(instr, ISA.write, 1) != 0
+        addr = ISA.field(instr, *ISA.addr)
         
         return instr_type, core_ptr, read_flag, write_flag, addr
     
@@ -259,13 +831,31 @@ class PIMSimulator:
         if not instr_hex or instr_hex.startswith('#'):
             return True  # Skip comments and empty lines
         
-        instr_type, core_ptr, read_flag, write_flag, addr = self.parse_instruction(instr_hex)
+        return self.execute_word(int(instr_hex, 16))
+    
+    def execute_word(self, instr: int) -> bool:
+        """Execute a single packed PIM instruction word"""
+        instr_type, core_ptr, read_flag, write_flag, addr = self.decode_word(instr)
         
         # Check if core_ptr is valid
         if core_ptr >= self.num_cores:
             print(f"Warning: Instruction references core {core_ptr} but only {self.num_cores} cores are available")
             return True
         
+        # A broadcast word runs on every core from 0 through core_ptr, one
+        # word on the controller bus
+        broadcast = ISA.broadcast is not None and ISA.field(instr, ISA.broadcast, 1) != 0
+        targets = range(core_ptr + 1) if broadcast else (core_ptr,)
+        for target in targets:
+            self.core_operations += 1
+            if self.pipeline:
+                self.pipeline.step(target, instr_type, read_flag, write_flag, addr, self.cycle_count)
+            self.execute_on_core(target, instr_type, read_flag, write_flag, addr)
+        self.cycle_count += 1
+        return True
+    
+    def execute_on_core(self, core_ptr: int, instr_type: int, read_flag: bool, write_flag: bool, addr: int):
+        """Run a decoded instruction on one core"""
         core = self.cores[core_ptr]
         
         # Process instruction based on type
@@ -274,27 +864,64 @@ class PIMSimulator:
             # No operation
             
         elif instr_type == INSTR_PROG:
+            if read_flag and write_flag:
+                # Load the core's next LUT from the table stored in memory row addr
+                self.debug(f"Core {core_ptr}: PROG load LUT {len(core.luts)} from row {addr}")
+                if addr >= len(self.memory.memory):
+                    print(f"Warning: Core {core_ptr} loads a LUT from row {addr}, past the end of memory")
+                    return
+                core.luts.append([int(v) for v in self.memory.memory[addr][:LUT_ENTRIES]])
+                self.lut_loads += 1
+                return
+            if write_flag and not read_flag:
+                # Output stage: the epilogue's parameters in row addr applied
+                # to the current accumulator
+                if addr >= len(self.memory.memory):
+                    print(f"Warning: Core {core_ptr} runs an output stage from row {addr}, past the end of memory")
+                    return
+                alpha, shift, low, high = (int(v) for v in self.memory.memory[addr][:4])
+                value = min(max((core.accumulator * alpha) >> shift, low), high)
+                if PRECISION:
+                    value = wrap_value(value, PRECISION[1])
+                self.debug(f"Core {core_ptr}: PROG output stage from row {addr}: {core.accumulator} -> {value}")
+                core.accumulator = value
+                self.output_stages += 1
+                return
+            
             self.debug(f"Core {core_ptr}: PROG func={addr} read={read_flag} write={write_flag}")
             # Program the core
+            self.programs += 1
             core.active = True
             core.function = addr
             core.completed = False
+            core.luts = []
             
         elif instr_type == INSTR_EXE:
             if not core.active:
                 print(f"Warning: Executing on inactive core {core_ptr}")
-                return True
+                return
                 
             self.debug(f"Core {core_ptr}: EXE addr={addr} read={read_flag} write={write_flag}")
             
+            if read_flag and write_flag:
+                # Row reuse: addr is an offset into the row already held in
+                # addr_register, accessed in the same direction as last time
+                if core.addr_register is None:
+                    print(f"Warning: Core {core_ptr} reuses a row before setting one")
+                    return
+                core.next_operation = core.addr_direction
+                read_flag = write_flag = False
+            
             if read_flag:
                 # Load operation - First part: set address
                 core.addr_register = addr
+                core.addr_direction = "read"
                 core.next_operation = "read"
                 
             elif write_flag:
                 # Store operation - First part: set address
                 core.addr_register = addr
+                core.addr_direction = "write"
                 core.next_operation = "write"
                 
             else:
@@ -309,22 +936,28 @@ class PIMSimulator:
                     
                     # Read the value from memory
                     value = self.memory.read(mem_addr, offset)
+                    core.last_read_value = value
+                    self.count_row_access(core, mem_addr)
+                    if indices:
+                        self.loads[indices[2]] += 1
                     
                     if indices and indices[2] == "A":
                         # Reading from matrix A
                         row_idx, col_idx, _ = indices
+                        core.a_operand = (row_idx, col_idx, value)
                         
-                        # Update row tracking if this is a row access (usually first element)
-                        if col_idx == 0:  # First element of the row
-                            if core.current_i != row_idx:
-                                self.debug(f"Core {core_ptr}: Reading from matrix A, setting row index to {row_idx}")
-                                core.current_i = row_idx
-                                
-                                # Track row transitions
-                                if core_ptr not in self.row_transitions:
-                                    self.row_transitions[core_ptr] = []
-                                if row_idx not in self.row_transitions[core_ptr]:
-                                    self.row_transitions[core_ptr].append(row_idx)
+                        # Any element of A selects its row: the row load at the
+                        # start of a row reads column 0, the weight-stationary
+                        # order reads A[i][k] itself
+                        if core.current_i != row_idx:
+                            self.debug(f"Core {core_ptr}: Reading from matrix A, setting row index to {row_idx}")
+                            core.current_i = row_idx
+                            
+                            # Track row transitions
+                            if core_ptr not in self.row_transitions:
+                                self.row_transitions[core_ptr] = []
+                            if row_idx not in self.row_transitions[core_ptr]:
+                                self.row_transitions[core_ptr].append(row_idx)
                         
                         self.debug(f"Core {core_ptr}: Read A[{row_idx}][{col_idx}] = {value}")
                         
@@ -348,6 +981,7 @@ class PIMSimulator:
                     
                     # Get matrix indices (if applicable)
                     indices = self.memory.get_matrix_indices(mem_addr, offset)
+                    self.count_row_access(core, mem_addr)
                     
                     if indices and indices[2] == "C":
                         # Writing to matrix C
@@ -375,23 +1009,57 @@ class PIMSimulator:
                     core.next_operation = None
                     
                 else:
-                    # Special operations
-                    if addr == 0:
+                    # Special operations, on the accumulator the upper bits name
+                    operation, acc = addr & 3, addr >> 2
+                    if acc >= ISA.accumulators:
+                        print(f"Warning: Core {core_ptr} uses accumulator {acc}, "
+                              f"but its cores expose {ISA.accumulators}")
+                        return
+                    core.current_acc = acc
+                    self.accumulators_used = max(self.accumulators_used, acc + 1)
+                    
+                    if operation == OP_CLEAR:
                         # Clear accumulator
                         core.accumulator = 0
-                        self.debug(f"Core {core_ptr}: Clear accumulator")
+                        self.debug(f"Core {core_ptr}: Clear accumulator {acc}")
+                    
+                    elif operation == OP_SELECT:
+                        # Only makes the accumulator current, for a store
+                        self.debug(f"Core {core_ptr}: Select accumulator {acc}")
                         
-                    elif addr == 2:
+                    elif operation == OP_LOAD_ACC:
+                        # Load accumulator: resume a partial sum read back from C
+                        if core.last_read_value is None:
+                            print(f"Warning: Core {core_ptr} loads the accumulator before any read")
+                        else:
+                            core.accumulator = int(core.last_read_value)
+                            self.debug(f"Core {core_ptr}: Load accumulator = {core.accumulator}")
+                        
+                    elif operation == OP_MAC:
                         # Multiply-accumulate - THE CORE FIX IS HERE
                         # This is now using proper memory addressing to get the A value
                         if core.current_i is not None and core.current_k is not None and core.current_b_value is not None:
                             try:
-                                # Get the A value directly from memory with proper addressing
-                                a_value = self.memory.get_matrix_element("A", core.current_i, core.current_k)
+                                # A[i][k] is the A element read last, or the MAC reads it from memory
+                                if core.a_operand and core.a_operand[:2] == (core.current_i, core.current_k):
+                                    a_value = core.a_operand[2]
+                                else:
+                                    a_value = self.memory.get_matrix_element("A", core.current_i, core.current_k)
+                                    self.mac_a_reads += 1
                                 
                                 # Proper multiply-accumulate
-                                product = a_value * core.current_b_value
+                                self.macs += 1
+                                if LUT_PRECISION:
+                                    product = self.lut_multiply(core, int(a_value), int(core.current_b_value))
+                                else:
+                                    product = a_value * core.current_b_value
                                 core.accumulator += product
+                                if PRECISION:
+                                    # The accumulator is as wide as an element of C
+                                    wrapped = wrap_value(core.accumulator, PRECISION[1])
+                                    if wrapped != core.accumulator:
+                                        self.overflows += 1
+                                    core.accumulator = wrapped
                                 
                                 self.debug(f"Core {core_ptr}: MAC: {core.accumulator} += A[{core.current_i}][{core.current_k}]({a_value}) * B[{core.current_k}][{core.current_j}]({core.current_b_value}) = {product}")
                             except ValueError as e:
@@ -400,6 +1068,11 @@ class PIMSimulator:
                             self.debug(f"Core {core_ptr}: MAC: Missing matrix indices, skipping")
                                     
         elif instr_type == INSTR_END:
+            if read_flag:
+                # Park: done for this invocation, still programmed for the next
+                self.debug(f"Core {core_ptr}: END (parked)")
+                core.completed = True
+                return
             self.debug(f"Core {core_ptr}: END")
             # End operation on this core
             core.active = False
@@ -407,17 +1080,74 @@ class PIMSimulator:
             
         else:
             print(f"Warning: Unknown instruction type {instr_type}")
-            
-        self.cycle_count += 1
-        return True
     
-    def execute_program(self, instructions: List[str]) -> np.ndarray:
-        """Execute a sequence of PIM instructions"""
+    def lut_multiply(self, core: PIMCore, a: int, b: int) -> int:
+        """Multiply two operands through the core's tables: digit products from
+        the multiply tables, summed into a 2 * precision bit product by rippling
+        nibble adds through ADD and ADDC"""
+        functions = lut_functions(LUT_PRECISION)
+        if len(core.luts) != len(functions):
+            print(f"Warning: Core {core.core_id} multiplies with {len(core.luts)} LUTs loaded, "
+                  f"{LUT_PRECISION}-bit operands need {len(functions)}")
+            return 0
+        table = dict(zip(functions, core.luts))
+        digits = (LUT_PRECISION + 3) // 4
+        width = 2 * digits  # Nibbles of the product
+        mask = (1 << (4 * digits)) - 1
+        a_digits = [((a & mask) >> (4 * i)) & 0xF for i in range(digits)]
+        b_digits = [((b & mask) >> (4 * i)) & 0xF for i in range(digits)]
+        top = digits - 1
+        
+        product = 0
+        for i in range(digits):
+            for j in range(digits):
+                x, y = a_digits[i], b_digits[j]
+                if i == top and j == top:
+                    partial = table[LUT_MUL_SS][x << 4 | y]
+                elif i == top:
+                    partial = table[LUT_MUL_SU][x << 4 | y]
+                elif j == top:
+                    partial = table[LUT_MUL_SU][y << 4 | x]
+                else:
+                    partial = table[LUT_MUL_UU][x << 4 | y]
+                if i == top or j == top:
+                    partial = partial - 256 if partial >= 128 else partial
+                addend = (partial << (4 * (i + j))) & ((1 << (4 * width)) - 1)
+                
+                # Ripple the addend into the product a nibble at a time
+                carry = 0
+                total = 0
+                for n in range(width):
+                    s = table[LUT_ADDC if carry else LUT_ADD][((product >> (4 * n)) & 0xF) << 4 |
+                                                              ((addend >> (4 * n)) & 0xF)]
+                    total |= (s & 0xF) << (4 * n)
+                    carry = s >> 4
+                product = total
+                self.lut_lookups += 1 + width
+        
+        # The product register is 2 * precision bits, two's complement
+        return product - (1 << (4 * width)) if product >> (4 * width - 1) else product
+    
+    def execute_program(self, instructions: List, report: bool = True) -> np.ndarray:
+        """Execute a sequence of PIM instructions (text lines or packed words).
+        Cores keep their programming and LUTs from the program before, as a
+        persistent kernel's invocations need; report=False skips the summary."""
         self.cycle_count = 0
+        self.core_operations = 0
+        self.lut_loads = 0
+        self.lut_lookups = 0
+        self.programs = 0
+        self.output_stages = 0
+        self.overflows = 0
+        self.row_activations = 0
+        self.loads = {"A": 0, "B": 0, "C": 0}
+        self.macs = 0
+        self.mac_a_reads = 0
         self.row_transitions = {}
         
         # Initialize all cores with their row ranges
         for core in self.cores:
+            core.completed = False
             if hasattr(core, 'row_range') and core.row_range is not None:
                 # Set initial row to the start of the range
                 core.current_i = core.row_range[0]
@@ -436,6 +1166,8 @@ class PIMSimulator:
         # Pre-process instructions to identify explicit row transitions
         explicit_row_transitions = {}  # Maps instruction index to (core_id, row_idx)
         for i, instr in enumerate(instructions):
+            if isinstance(instr, int):
+                continue
             if "Processing row" in instr:
                 match = re.search(r"Core (\d+).*Processing row (\d+)", instr)
                 if match:
@@ -459,6 +1191,11 @@ class PIMSimulator:
                         if row_idx not in self.row_transitions[core_id]:
                             self.row_transitions[core_id].append(row_idx)
             
+            # Packed words from a .pimb container need no text handling
+            if isinstance(instr, int):
+                self.execute_word(instr)
+                continue
+            
             # Skip comments and empty lines
             if not instr or instr.startswith('#'):
                 continue
@@ -488,13 +1225,47 @@ class PIMSimulator:
         
         # Get the result matrix
         result = self.memory.get_result_matrix()
+        if not report:
+            return result
         
         print(f"Execution completed in {self.cycle_count} cycles")
+        if LUT_PRECISION:
+            print(f"LUT cycles: {self.lut_loads * LUT_LOAD_CYCLES} programming ({self.lut_loads} table loads) vs "
+                  f"{self.lut_lookups} computing ({self.macs} MACs x {lut_lookups_per_mac(LUT_PRECISION)} lookups)")
+        if PRECISION:
+            print(f"Packed: int{PRECISION[0]} operands, int{PRECISION[1]} accumulator, "
+                  f"{self.overflows} accumulator overflows")
+        if self.core_operations > self.cycle_count:
+            print(f"Broadcast: {self.cycle_count} instructions on the controller bus ran "
+                  f"{self.core_operations} core operations")
+        print(f"Row activations: {self.row_activations}")
+        if self.macs:
+            loads = self.loads["A"] + self.loads["B"] + self.loads["C"]
+            print(f"Loads per MAC: {loads / self.macs:.3f} (A {self.loads['A'] / self.macs:.3f}, "
+                  f"B {self.loads['B'] / self.macs:.3f}, C {self.loads['C'] / self.macs:.3f}) + "
+                  f"{self.mac_a_reads / self.macs:.3f} A reads by the MAC")
+        if WEIGHT_FILE or SPARSE_MASKS:
+            dense = self.memory.M * self.memory.K * self.memory.N
+            print(f"MACs: {self.macs} of {dense} for dense {'B' if WEIGHT_FILE else 'operands'} ({dense - self.macs} eliminated, "
+                  f"{100.0 * (dense - self.macs) / max(dense, 1):.1f}%)")
+        if EPILOGUE:
+            print(f"Epilogue: fused, {self.output_stages} output stages"
+                  f"{', each element starting from its bias' if EPILOGUE['bias'] else ''}")
+        if self.accumulators_used > 1:
+            print(f"Accumulators: {self.accumulators_used} per core, each A load serving "
+                  f"{self.macs / max(self.loads['A'], 1):.2f} MACs")
+        if self.pipeline:
+            print(f"Pipeline: {self.pipeline.hazards} hazards without interlocks under latencies "
+                  f"{describe_latency_table(self.pipeline.latencies)}, last result ready at cycle "
+                  f"{self.pipeline.last_result}")
+            if self.pipeline.first_hazard:
+                print(f"  first: {self.pipeline.first_hazard}")
         return result
         
     def validate_result(self, pim_result: np.ndarray) -> bool:
-        """Validate the PIM result against a direct numpy matrix multiplication"""
-        expected = np.matmul(self.matrix_a, self.matrix_b)
+        """Validate the PIM result against a direct numpy matrix multiplication
+        (and the epilogue, if the program fuses one)"""
+        expected = apply_epilogue(np.matmul(self.matrix_a, self.matrix_b), self.bias)
         
         # Check if shapes match
         if pim_result.shape != expected.shape:
@@ -563,13 +1334,15 @@ class PIMSimulator:
                 
         return np.array_equal(pim_result, expected)
 
-def parse_input_file(filename: str) -> Tuple[int, int, int, int, List[str], Dict[int, Tuple[int, int]]]:
+def parse_input_file(filename: str, apply: bool = True) -> Tuple[int, int, int, int, List[str], Dict[int, Tuple[int, int]], str]:
     """
     Parse the input file to extract matrix dimensions, number of cores, and row assignments.
-    Returns (M, K, N, num_cores, instructions, row_assignments) where row_assignments
-    is a dictionary mapping core_id to (start_row, end_row).
+    Returns (M, K, N, num_cores, instructions, row_assignments, header) where row_assignments
+    is a dictionary mapping core_id to (start_row, end_row) and header holds the
+    tokens of its ISA and layout lines, which apply=False leaves unapplied.
     """
     instructions = []
+    header = []
     dimensions = None
     num_cores = None
     row_assignments = {}
@@ -588,6 +1361,18 @@ def parse_input_file(filename: str) -> Tuple[int, int, int, int, List[str], Dict
                         print(f"Warning: Matrix dimensions mismatch: {K1} != {K2}")
                     dimensions = (M, K1, N)
             
+            # Non-default instruction format
+            elif line.startswith("# ISA: "):
+                header.append(line[len("# ISA: "):])
+                if apply:
+                    configure_isa(parse_isa_description(header[-1]))
+            
+            # Tiled memory layout
+            elif line.startswith("# Layout: "):
+                header.append(line[len("# Layout: "):])
+                if apply:
+                    apply_header_description(header[-1])
+            
             # Extract number of cores
             elif "Using" in line and "cores" in line:
                 # Format: # Using X cores
@@ -623,7 +1408,126 @@ def parse_input_file(filename: str) -> Tuple[int, int, int, int, List[str], Dict
                 row_assignments[core_id] = (start_row, end_row)
     
     M, K, N = dimensions
-    return M, K, N, num_cores, instructions, row_assignments
+    return M, K, N, num_cores, instructions, row_assignments, ' '.join(header)
+
+def is_binary_program(filename: str) -> bool:
+    """Check whether a file is a packed .pimb container"""
+    with open(filename, 'rb') as f:
+        return f.read(len(PIMB_MAGIC)) == PIMB_MAGIC
+
+def is_loop_program(filename: str) -> bool:
+    """Check whether a file is a loop-compressed .piml container"""
+    with open(filename, 'rb') as f:
+        return f.read(len(PIML_MAGIC)) == PIML_MAGIC
+
+def decode_loop_tokens(words: List[int], pos: int, num_tokens: int) -> Tuple[List, int]:
+    """
+    Decode repeat-record chunks into tokens. A token is either an int (one
+    instruction) or a tuple (count, body tokens, per-leaf strides, leaf count).
+    """
+    tokens = []
+    while len(tokens) < num_tokens:
+        tag = words[pos]
+        pos += 1
+        if not tag & PIML_REPEAT_TAG:
+            tokens.extend(words[pos:pos + tag])
+            pos += tag
+            continue
+        count = words[pos]
+        body, pos = decode_loop_tokens(words, pos + 1, tag & ~PIML_REPEAT_TAG)
+        leaves = sum(1 if isinstance(t, int) else t[3] for t in body)
+        strides = [w - (1 << 32) if w & 0x80000000 else w for w in words[pos:pos + leaves]]
+        pos += leaves
+        tokens.append((count, body, strides, leaves))
+    return tokens, pos
+
+def expand_loop_tokens(tokens: List, offsets: List[int], out: List[int]):
+    """Expand tokens into instruction words, adding offsets[i] to leaf i's address"""
+    leaf = 0
+    for token in tokens:
+        if isinstance(token, int):
+            addr = (((token & ADDR_FIELD_MASK) >> ADDR_FIELD_SHIFT) + offsets[leaf]) << ADDR_FIELD_SHIFT
+            out.append((token & ~ADDR_FIELD_MASK) | (addr & ADDR_FIELD_MASK))
+            leaf += 1
+            continue
+        count, body, strides, leaves = token
+        current = offsets[leaf:leaf + leaves]
+        for _ in range(count):
+            expand_loop_tokens(body, current, out)
+            current = [c + s for c, s in zip(current, strides)]
+        leaf += leaves
+
+def parse_loop_file(filename: str, apply: bool = True) -> Tuple[int, int, int, int, List[int], Dict[int, Tuple[int, int]], str]:
+    """
+    Parse a loop-compressed .piml container and expand it to instruction words.
+    Returns the same tuple as parse_binary_file.
+    """
+    with open(filename, 'rb') as f:
+        data = f.read()
+    
+    header_size_fixed = struct.calcsize(PIMB_HEADER_FORMAT)
+    (magic, version, header_size, M, K, N, num_cores,
+     count, _, stream_bytes) = struct.unpack_from(PIMB_HEADER_FORMAT, data, 0)
+    if magic != PIML_MAGIC:
+        raise ValueError("Not a PIML container")
+    if version != 1:
+        raise ValueError(f"Unsupported PIML container version {version}")
+    
+    header = read_header_block(data, header_size_fixed + num_cores * struct.calcsize(PIML_CORE_FORMAT), header_size)
+    if apply:
+        apply_header_description(header)
+    words = list(struct.unpack_from(f'<{stream_bytes // 4}I', data, header_size))
+    row_assignments = {}
+    instructions = []
+    for c in range(num_cores):
+        core_id, start_row, end_row, _, _, _ = struct.unpack_from(
+            PIML_CORE_FORMAT, data, header_size_fixed + c * struct.calcsize(PIML_CORE_FORMAT))
+        row_assignments[core_id] = (start_row, end_row)
+    
+    # Core record streams are stored back to back, so decode chunk by chunk
+    pos = 0
+    while pos < len(words):
+        tokens, pos = decode_loop_tokens(words, pos, 1 if words[pos] & PIML_REPEAT_TAG else words[pos])
+        leaves = sum(1 if isinstance(t, int) else t[3] for t in tokens)
+        expand_loop_tokens(tokens, [0] * leaves, instructions)
+    
+    if len(instructions) != count:
+        raise ValueError(f"PIML expansion produced {len(instructions)} instructions, header says {count}")
+    return M, K, N, num_cores, instructions, row_assignments, header
+
+def parse_binary_file(filename: str, apply: bool = True) -> Tuple[int, int, int, int, List[int], Dict[int, Tuple[int, int]], str]:
+    """
+    Parse a packed .pimb container. Returns the same tuple as parse_input_file,
+    with instructions as integer words instead of text lines.
+    """
+    with open(filename, 'rb') as f:
+        data = f.read()
+    
+    header_size_fixed = struct.calcsize(PIMB_HEADER_FORMAT)
+    (magic, version, header_size, M, K, N, num_cores,
+     count, instr_bytes, _) = struct.unpack_from(PIMB_HEADER_FORMAT, data, 0)
+    if magic != PIMB_MAGIC:
+        raise ValueError("Not a PIMB container")
+    header = read_header_block(data, header_size_fixed + num_cores * struct.calcsize(PIMB_CORE_FORMAT), header_size)
+    if apply:
+        apply_header_description(header)
+    if version != 1 or instr_bytes != ISA.instruction_bytes():
+        raise ValueError(f"Unsupported PIMB container (version {version}, {instr_bytes} bytes per instruction)")
+    
+    row_assignments = {}
+    for c in range(num_cores):
+        core_id, start_row, end_row, _, _ = struct.unpack_from(
+            PIMB_CORE_FORMAT, data, header_size_fixed + c * struct.calcsize(PIMB_CORE_FORMAT))
+        row_assignments[core_id] = (start_row, end_row)
+    
+    # Vectorised little-endian unpack of the whole stream
+    raw = np.frombuffer(data, dtype=np.uint8, count=count * instr_bytes, offset=header_size)
+    raw = raw.reshape(-1, instr_bytes).astype(np.uint32)
+    words = np.zeros(count, dtype=np.uint32)
+    for b in range(instr_bytes):
+        words |= raw[:, b] << (8 * b)
+    
+    return M, K, N, num_cores, words.tolist(), row_assignments, header
 
 def generate_test_matrices(M: int, K: int, N: int, random=True, seed=None) -> Tuple[np.ndarray, np.ndarray]:
     """Generate test matrices for simulation"""
@@ -651,35 +1555,204 @@ def generate_test_matrices(M: int, K: int, N: int, random=True, seed=None) -> Tu
     
     return A, B
 
+def generate_invocation_a(M: int, K: int, invocation: int, random=True, worst_case=False) -> np.ndarray:
+    """The A a later invocation of a persistent kernel brings, fit to the operand width as the first one"""
+    if PRECISION and worst_case:
+        A = np.full((M, K), -(1 << (PRECISION[0] - 1)), dtype=np.int32)
+    elif random:
+        A = np.random.randint(-10, 11, (M, K), dtype=np.int32)
+    else:
+        A = np.fromfunction(lambda i, k: i + k + invocation, (M, K), dtype=np.int32)
+    if LUT_PRECISION:
+        A = wrap_to_precision(A, LUT_PRECISION)
+    if PRECISION:
+        A = wrap_to_precision(A, PRECISION[0])
+    if "A" in SPARSE_MASKS:
+        A = np.where(SPARSE_MASKS["A"], A, 0)
+    return A
+
+def parse_program(filename: str, apply: bool = True) -> Tuple[int, int, int, int, List, Dict[int, Tuple[int, int]], str]:
+    """Parse a program in any of the compiler's formats. With apply=False its
+    header tokens are only returned: instructions decode with the ISA already
+    configured, and the simulator's settings stay as they are."""
+    if is_binary_program(filename):
+        return parse_binary_file(filename, apply)
+    if is_loop_program(filename):
+        return parse_loop_file(filename, apply)
+    return parse_input_file(filename, apply)
+
+def load_weights(path: str, K: int, N: int) -> np.ndarray:
+    """B from a .npy file or raw little-endian int32 values, as the compiler reads it"""
+    with open(path, 'rb') as f:
+        is_npy = f.read(6) == b'\x93NUMPY'
+    if is_npy:
+        B = np.load(path)
+        if B.dtype.kind != 'i':
+            raise ValueError(f"weights in {path} are {B.dtype}, not signed integers")
+    else:
+        B = np.fromfile(path, dtype='<i4')
+        if B.size != K * N:
+            raise ValueError(f"{path} holds {B.size} int32 values, not {K} x {N}")
+        B = B.reshape(K, N)
+    if B.shape != (K, N):
+        raise ValueError(f"weights in {path} are {B.shape[0]} x {B.shape[1]}, not {K} x {N}")
+    return B.astype(np.int64)
+
+def load_sparsity_pattern(path: str, rows: int, cols: int) -> Tuple[np.ndarray, Optional[np.ndarray]]:
+    """The pattern of a sparse operand as the compiler reads it, as a boolean
+    mask, and the matrix itself when the file holds one"""
+    with open(path, 'rb') as f:
+        data = f.read()
+    tokens = []
+    if not data.startswith(b'\x93NUMPY'):
+        text = data.decode('ascii', errors='replace')
+        tokens = [token for line in text.splitlines() for token in line.split('#')[0].split()]
+    if not tokens or tokens[0] not in ('csr', 'csc', 'bsr', 'mask'):
+        matrix = load_weights(path, rows, cols)
+        return matrix != 0, matrix
+    
+    kind = tokens[0]
+    shape = [int(v) for v in tokens[1:5 if kind == 'bsr' else 3]]
+    if shape[:2] != [rows, cols]:
+        raise ValueError(f"pattern in {path} is {shape[0]} x {shape[1]}, not {rows} x {cols}")
+    rest = tokens[1 + len(shape):]
+    mask = np.zeros((rows, cols), dtype=bool)
+    if kind == 'mask':
+        for r, line in enumerate(rest):
+            mask[r] = [c == '1' for c in line]
+        return mask, None
+    major = {'csr': rows, 'csc': cols, 'bsr': -(-rows // shape[-2])}[kind]
+    indptr = [int(v) for v in rest[1:major + 2]]
+    indices = [int(v) for v in rest[major + 3:]]
+    for r in range(major):
+        for index in indices[indptr[r]:indptr[r + 1]]:
+            if kind == 'csr':
+                mask[r, index] = True
+            elif kind == 'csc':
+                mask[index, r] = True
+            else:
+                block_rows, block_cols = shape[2:]
+                mask[r * block_rows:(r + 1) * block_rows, index * block_cols:(index + 1) * block_cols] = True
+    return mask, None
+
 def main():
     # Parse command line arguments
     parser = argparse.ArgumentParser(description='PIM Simulator for Matrix Multiplication')
-    parser.add_argument('input_file', help='Input file with PIM instructions')
+    parser.add_argument('input_file', help='Input file with PIM instructions (.pim text, .pimb binary or .piml loop-compressed)')
     parser.add_argument('--debug', action='store_true', help='Enable debug output')
     parser.add_argument('--no-validate', action='store_true', help='Skip result validation')
     parser.add_argument('--deterministic', action='store_true', help='Use deterministic test matrices instead of random')
     parser.add_argument('--seed', type=int, help='Random seed for matrix generation')
+    parser.add_argument('--worst-case', action='store_true',
+                        help='Fill A and B with the most negative operand of a packed precision, '
+                             'the largest dot products its accumulator must hold')
+    parser.add_argument('--isa', help='ISA name (pim24, pim24b, pim32) or descriptor file, for programs that do not record one')
+    parser.add_argument('--weights', help='Weight file for B, instead of the one a weight-specialized program records')
+    parser.add_argument('--latency', help='Check the program runs hazard-free without interlocks under this latency '
+                                          'table (a file, or e.g. access=6,mac=3), instead of the one a pipelined '
+                                          'program records')
+    parser.add_argument('--setup', help='Setup program of a persistent kernel, run once before its invocation '
+                                        'program (default: the invocation program\'s name + .setup)')
+    parser.add_argument('--repeat', type=int, default=1,
+                        help='Run the program this many times, each with a new A and the same B in place; a '
+                             'persistent kernel\'s cores stay programmed in between')
     args = parser.parse_args()
     
+    if args.isa:
+        configure_isa(load_isa(args.isa))
+    
     # Parse input file
     try:
-        M, K, N, num_cores, instructions, row_assignments = parse_input_file(args.input_file)
+        M, K, N, num_cores, instructions, row_assignments, header = parse_program(args.input_file)
         print(f"Parsed matrix dimensions: {M}x{K} * {K}x{N}")
         print(f"Using {num_cores} cores")
         
+        # A persistent kernel's invocation program needs the cores its setup
+        # program leaves programmed
+        setup_instructions = None
+        if PERSISTENT == 'setup':
+            raise ValueError(f"{args.input_file} is the setup program of a persistent kernel; "
+                             f"simulate its invocation program, which runs it first")
+        if PERSISTENT == 'invocation':
+            setup_file = args.setup or args.input_file + '.setup'
+            # Its header must be this program's, part aside, so the settings
+            # in place decode and run it too
+            setup = parse_program(setup_file, apply=False)
+            if (setup[:4] != (M, K, N, num_cores) or
+                    setup[6] != header.replace('persistent=invocation', 'persistent=setup')):
+                raise ValueError(f"{setup_file} is not the setup program of this persistent kernel")
+            setup_instructions = setup[4]
+            print(f"Persistent kernel: setup program {setup_file}")
+        if args.repeat < 1:
+            raise ValueError("--repeat needs at least one run")
+        
         # Generate test matrices
         random = not args.deterministic
         A, B = generate_test_matrices(M, K, N, random=random, seed=args.seed)
+        weight_file = args.weights or WEIGHT_FILE
+        if weight_file:
+            # A specialized program only computes A @ B for its own weights
+            B = load_weights(weight_file, K, N)
+            print(f"Weights: B from {weight_file}, {int(np.count_nonzero(B == 0))} of {K * N} zero")
+        # A sparse operand is zero off its pattern, or is the matrix its file holds
+        for matrix, path in sorted(SPARSE_FILES.items()):
+            shape = (M, K) if matrix == "A" else (K, N)
+            mask, values = load_sparsity_pattern(path, *shape)
+            SPARSE_MASKS[matrix] = mask
+            if matrix == "A":
+                A = values if values is not None else np.where(mask, A, 0)
+            else:
+                B = values if values is not None else np.where(mask, B, 0)
+            nonzeros = int(np.count_nonzero(mask))
+            print(f"Sparse {matrix}: pattern from {path}, {nonzeros} of {mask.size} elements stored "
+                  f"({100.0 * (mask.size - nonzeros) / mask.size:.1f}% zeros) in "
+                  f"{'CSR' if matrix == 'A' else 'CSC'} order")
+        if LUT_PRECISION:
+            # Operands must fit the precision the LUTs were loaded for
+            A = wrap_to_precision(A, LUT_PRECISION)
+            B = wrap_to_precision(B, LUT_PRECISION)
+            print(f"LUT precision: {LUT_PRECISION}-bit operands")
+        if PRECISION:
+            # Operands must fit the packed element width
+            data_bits = PRECISION[0]
+            if args.worst_case:
+                A = np.full((M, K), -(1 << (data_bits - 1)), dtype=np.int32)
+                B = np.full((K, N), -(1 << (data_bits - 1)), dtype=np.int32)
+            A = wrap_to_precision(A, data_bits)
+            B = wrap_to_precision(B, data_bits)
+            print(f"Precision: int{data_bits} operands packed {MEMORY_SLOT_BITS // data_bits} per slot, "
+                  f"C as int{PRECISION[1]}")
+        
+        bias = None
+        if EPILOGUE:
+            # The host places the bias vector along with A and B
+            if EPILOGUE['bias']:
+                bias = np.random.randint(-100, 101, N) if random else np.arange(N) - N // 2
+            print(f"Epilogue: {', '.join(f'{k}={v}' for k, v in EPILOGUE.items())}")
         
         print("\nMatrix A:")
         print(A)
         print("\nMatrix B:")
         print(B)
+        if bias is not None:
+            print("\nBias:")
+            print(bias)
         
         # Create and initialize simulator
-        simulator = PIMSimulator(num_cores, A, B, row_assignments)
+        simulator = PIMSimulator(num_cores, A, B, row_assignments, bias)
         if args.debug:
             simulator.enable_debug()
+        setup_cycles = 0
+        if setup_instructions is not None:
+            print("\nRunning the setup program...")
+            simulator.execute_program(setup_instructions, report=False)
+            setup_cycles = simulator.cycle_count
+            print(f"Setup completed in {setup_cycles} cycles: {simulator.programs} cores programmed, "
+                  f"{simulator.lut_loads} LUTs loaded")
+        latencies = load_latency_table(args.latency) if args.latency else PIPELINE
+        if latencies:
+            simulator.pipeline = PipelineChecker(latencies, simulator.memory.base_addr_b,
+                                                 simulator.memory.base_addr_c)
         
         # Execute program
         print("\nExecuting PIM instructions...")
@@ -693,6 +1766,30 @@ def main():
             print("\nValidating result...")
             simulator.validate_result(result)
         
+        # Later runs: a new A in place of the last, the same B, and the cores
+        # as the run before left them. Each runs the same instructions, so
+        # the first run's hazard check covers them.
+        if args.repeat > 1:
+            run_cycles = simulator.cycle_count
+            simulator.pipeline = None
+            reprogrammed = 0
+            failed = 0
+            for invocation in range(1, args.repeat):
+                A = generate_invocation_a(M, K, invocation, random=random, worst_case=args.worst_case)
+                simulator.matrix_a = A
+                simulator.memory.store_a(A)
+                result = simulator.execute_program(instructions, report=False)
+                reprogrammed += simulator.programs
+                if not args.no_validate and not np.array_equal(result, apply_epilogue(np.matmul(A, B), bias)):
+                    failed += 1
+            runs = "invocations" if setup_instructions is not None else "runs"
+            total = setup_cycles + args.repeat * run_cycles
+            print(f"\nRepeated: {args.repeat} {runs} of {run_cycles} cycles"
+                  f"{f' after a {setup_cycles}-cycle setup' if setup_instructions is not None else ''}"
+                  f" = {total} cycles, {reprogrammed} cores reprogrammed after the first")
+            if not args.no_validate:
+                print(f"Repeated runs validation {'PASSED' if failed == 0 else f'FAILED in {failed} runs'}")
+        
     except Exception as e:
         print(f"Error: {e}")
         import traceback
@@ -0,0 +1,116 @@
+#include "pim_compiler.h"
+#include <fstream>
+#include <iostream>
+
+// Instructions are buffered and written in chunks of this many bytes
+static const size_t CHUNK_BYTES = 1 << 16;
+
+// Append a little-endian uint32 to a byte buffer
+static void putU32(std::vector<char>& bytes, uint32_t value) {
+    bytes.push_back(static_cast<char>(value & 0xFF));
+    bytes.push_back(static_cast<char>((value >> 8) & 0xFF));
+    bytes.push_back(static_cast<char>((value >> 16) & 0xFF));
+    bytes.push_back(static_cast<char>((value >> 24) & 0xFF));
+}
+
+// Fixed header, core table and description block, padded so the stream starts 8-byte aligned
+static uint32_t headerSizeFor(size_t numCores, const std::string& headerBlock) {
+    uint32_t headerSize = 40 + 20 * static_cast<uint32_t>(numCores) + static_cast<uint32_t>(headerBlock.size());
+    return (headerSize + 7) & ~7u;
+}
+
+BinaryFileSink::BinaryFileSink(const std::string& filename, const MatrixDimensions& dims,
+                               const std::vector<WorkAssignment>& assignments, const CodegenOptions& options)
+    : out(filename, std::ios::binary), cores(assignments),
+      firstInstr(assignments.size(), 0), counts(assignments.size(), 0), total(0),
+      wordBytes(activeIsa().instructionBytes()), headerBlock(containerHeaderBlock(options)) {
+    for (size_t c = 0; c < cores.size(); c++) {
+        if (cores[c].coreId >= static_cast<int>(entryOfCore.size())) {
+            entryOfCore.resize(cores[c].coreId + 1, -1);
+        }
+        entryOfCore[cores[c].coreId] = static_cast<int>(c);
+    }
+    if (!out.is_open()) {
+        std::cerr << "Error: Could not open output file " << filename << std::endl;
+        return;
+    }
+
+    // The header goes out now with zero totals; finish() rewrites it in place
+    uint32_t headerSize = headerSizeFor(cores.size(), headerBlock);
+    std::vector<char> header;
+    header.reserve(headerSize);
+    putU32(header, PIMB_MAGIC);
+    putU32(header, PIMB_VERSION);
+    putU32(header, headerSize);
+    putU32(header, dims.M);
+    putU32(header, dims.K);
+    putU32(header, dims.N);
+    putU32(header, static_cast<uint32_t>(cores.size()));
+    putU32(header, 0);
+    putU32(header, wordBytes);
+    putU32(header, 0);
+    header.resize(40 + 20 * cores.size(), 0);
+    header.insert(header.end(), headerBlock.begin(), headerBlock.end());
+    header.resize(headerSize, 0);
+    out.write(header.data(), header.size());
+
+    chunk.reserve(CHUNK_BYTES);
+}
+
+void BinaryFileSink::beginCore(const WorkAssignment& work) {
+    if (work.coreId < static_cast<int>(entryOfCore.size()) && entryOfCore[work.coreId] >= 0) {
+        firstInstr[entryOfCore[work.coreId]] = total;
+    }
+}
+
+void BinaryFileSink::emit(Instruction instr) {
+    // Instruction stream: wordBytes bytes per instruction (3 for the default
+    // ISA), least significant byte first
+    for (int b = 0; b < wordBytes; b++) {
+        chunk.push_back(static_cast<char>((instr.word >> (8 * b)) & 0xFF));
+    }
+    // Counted by the cores the instruction addresses, so merged streams are
+    // counted the same as concatenated ones
+    int last = instr.coreId();
+    int first = instr.broadcast() ? 0 : last;
+    for (int core = first; core <= last && core < static_cast<int>(entryOfCore.size()); core++) {
+        if (entryOfCore[core] >= 0) {
+            counts[entryOfCore[core]]++;
+        }
+    }
+    total++;
+    if (chunk.size() + wordBytes > CHUNK_BYTES) {
+        flushChunk();
+    }
+}
+
+void BinaryFileSink::flushChunk() {
+    out.write(chunk.data(), chunk.size());
+    chunk.clear();
+}
+
+bool BinaryFileSink::finish() {
+    flushChunk();
+
+    // Patch the instruction total and the core table now that counts are known
+    std::vector<char> patch;
+    putU32(patch, total);
+    out.seekp(28);
+    out.write(patch.data(), patch.size());
+
+    patch.clear();
+    for (size_t c = 0; c < cores.size(); c++) {
+        putU32(patch, cores[c].coreId);
+        putU32(patch, cores[c].startRow);
+        putU32(patch, cores[c].endRow);
+        putU32(patch, firstInstr[c]);
+        putU32(patch, counts[c]);
+    }
+    out.seekp(40);
+    out.write(patch.data(), patch.size());
+    out.close();
+
+    std::cout << "Binary program: " << total << " instructions, "
+              << (headerSizeFor(cores.size(), headerBlock) + static_cast<uint64_t>(total) * wordBytes) << " bytes" << std::endl;
+    return !out.fail();
+}
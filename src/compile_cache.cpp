@@ -0,0 +1,175 @@
+#include "pim_compiler.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
+
+std::string describeCodegenOptions(const CodegenOptions& options) {
+    std::string tiles = "off";
+    if (options.tiling) {
+        bool requested = options.tiles.tileM > 0 || options.tiles.tileN > 0 || options.tiles.tileK > 0;
+        tiles = requested ? describeTilePlan(options.tiles) : "auto";
+    }
+    
+    std::ostringstream text;
+    text << "rowReuse=" << (options.rowReuse ? 1 : 0)
+         << " order=" << loopOrderName(options.loopOrder)
+         << " dataflow=" << dataflowName(options.dataflow)
+         << " block=" << options.blockColumns
+         << " tiles=" << tiles
+         << " schedule=" << scheduleName(options.schedule)
+         << " lut=" << (options.lutPrecision > 0 ? std::to_string(options.lutPrecision) : "off")
+         << " precision=int" << options.precision.dataBits
+         << " regblock=" << options.registerBlock
+         << " weights=" << (options.weights ? options.weights->fingerprint : "off")
+         << " pipeline=" << (options.pipeline ? describeLatencyModel(*options.pipeline) : "off")
+         << " part=" << programPartName(options.part)
+         << " sparse=" << (options.sparse ? options.sparse->fingerprint : "off")
+         << " epilogue=" << (options.epilogue && hasEpilogue(*options.epilogue) ? describeEpilogue(*options.epilogue)
+                                                                              : "off");
+    return text.str();
+}
+
+std::string compileCacheKey(const MatrixDimensions& dims, int numCores, const std::string& outputFormat,
+                            const CodegenOptions& options) {
+    // distributeWork never uses more cores than rows, so those requests share an entry
+    int cores = std::min(numCores, dims.M);
+
+    std::ostringstream key;
+    key << "pim-compile-cache 1\n";
+    key << "compiler " << PIM_COMPILER_VERSION << " codegen " << PIM_CODEGEN_REVISION << "\n";
+    key << "isa " << describeIsa(activeIsa()) << "\n";
+    key << "dims " << dims.M << " " << dims.K << " " << dims.N << "\n";
+    key << "cores " << cores << "\n";
+    key << "format " << outputFormat << "\n";
+    key << "options " << describeCodegenOptions(options) << "\n";
+    if (options.weights) {
+        // Programs record where their weights came from
+        key << "weights " << options.weights->source << "\n";
+    }
+    if (options.sparse) {
+        // Programs record their pattern files too
+        key << "sparse " << options.sparse->sourceA << " " << options.sparse->sourceB << "\n";
+    }
+    return key.str();
+}
+
+// 64-bit FNV-1a, printed as 16 hex digits
+std::string compileCacheHash(const std::string& key) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (char c : key) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3ull;
+    }
+    char text[17];
+    std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(hash));
+    return text;
+}
+
+// mkdir -p
+static bool makeDirectories(const std::string& path) {
+    for (size_t pos = 1; pos <= path.size(); pos++) {
+        if (pos == path.size() || path[pos] == '/') {
+            std::string prefix = path.substr(0, pos);
+            if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool copyFile(const std::string& from, const std::string& to) {
+    std::ifstream in(from, std::ios::binary);
+    if (!in.is_open()) {
+        return false;
+    }
+    std::ofstream out(to, std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        return false;
+    }
+    out << in.rdbuf();
+    out.close();
+    return !out.fail();
+}
+
+// A name no other process or thread can pick for its temporary
+static std::string temporaryName(const std::string& path) {
+    static std::atomic<unsigned> counter(0);
+    std::ostringstream name;
+    name << path << ".tmp." << getpid() << "."
+         << std::hash<std::thread::id>()(std::this_thread::get_id()) << "." << counter++;
+    return name.str();
+}
+
+// Write through a temporary and rename over the final name, which is atomic
+// within one filesystem
+static bool publish(const std::string& path, const std::function<bool(const std::string&)>& write) {
+    std::string temporary = temporaryName(path);
+    if (!write(temporary) || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+static std::string entryPath(const std::string& cacheDir, const std::string& key, const char* suffix) {
+    return cacheDir + "/" + compileCacheHash(key) + suffix;
+}
+
+bool fetchFromCache(const std::string& cacheDir, const std::string& key,
+                    const std::string& outputFile, const std::string& tacFile,
+                    CacheEntryInfo& info) {
+    std::ifstream keyFile(entryPath(cacheDir, key, ".key"), std::ios::binary);
+    if (!keyFile.is_open()) {
+        return false;
+    }
+    std::string stored((std::istreambuf_iterator<char>(keyFile)), std::istreambuf_iterator<char>());
+
+    // The full key is stored so a hash collision reads as a miss
+    if (stored.compare(0, key.size(), key) != 0) {
+        return false;
+    }
+    std::istringstream counts(stored.substr(key.size()));
+    std::string label;
+    if (!(counts >> label >> info.instructions) || label != "instructions" ||
+        !(counts >> label >> info.commentLines) || label != "comments") {
+        return false;
+    }
+
+    return copyFile(entryPath(cacheDir, key, ".prog"), outputFile) &&
+           copyFile(entryPath(cacheDir, key, ".tac"), tacFile);
+}
+
+bool storeInCache(const std::string& cacheDir, const std::string& key,
+                  const std::string& outputFile, const std::string& tacFile,
+                  const CacheEntryInfo& info) {
+    if (!makeDirectories(cacheDir)) {
+        std::cerr << "Warning: Could not create cache directory " << cacheDir << std::endl;
+        return false;
+    }
+
+    bool stored =
+        publish(entryPath(cacheDir, key, ".prog"),
+                [&](const std::string& path) { return copyFile(outputFile, path); }) &&
+        publish(entryPath(cacheDir, key, ".tac"),
+                [&](const std::string& path) { return copyFile(tacFile, path); }) &&
+        publish(entryPath(cacheDir, key, ".key"), [&](const std::string& path) {
+            std::ofstream out(path, std::ios::binary);
+            out << key << "instructions " << info.instructions << "\n"
+                << "comments " << info.commentLines << "\n";
+            out.close();
+            return !out.fail();
+        });
+
+    if (!stored) {
+        std::cerr << "Warning: Could not write cache entry in " << cacheDir << std::endl;
+    }
+    return stored;
+}
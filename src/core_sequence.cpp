@@ -1,102 +1,560 @@
 #include "pim_compiler.h"
 #include <iostream>
 
-// Generate the complete instruction sequence for a single core
-std::vector<std::string> generateCoreInstructions(
-    int coreId, int startRow, int endRow, 
-    const MatrixDimensions& dims, const MemoryMap& memMap) {
+// Pass a comment marker to the sink; its position is wherever the stream is now
+static void note(InstructionSink& sink, AnnotationKind kind, int a, int b = 0, int c = 0) {
+    Annotation annotation = {0, kind, a, b, c};
+    sink.annotate(annotation);
+}
+
+// Load A[i][k], which selects row i for the MACs that follow
+static void loadA(InstructionSink& sink, int coreId, const MemoryMap& memMap, int i, int k) {
+    int aIndex = i * memMap.rowSizeA + k;
+    sink.emit(genExeInstr(coreId, true, false, memMap.baseAddrA + aIndex / memMap.elementsPerRowA));
+    sink.emit(genExeInstr(coreId, false, false, aIndex % memMap.elementsPerRowA));
+}
+
+// Load B[k][j]: set its memory row, then its offset
+static void loadB(InstructionSink& sink, int coreId, const MemoryMap& memMap, int k, int j) {
+    // Calculate address for B[k][j] using rowSizeB
+    int bIndex = k * memMap.rowSizeB + j;
+    int bAddr = memMap.baseAddrB + (bIndex / memMap.elementsPerRowB);
+    int bOffset = bIndex % memMap.elementsPerRowB;
     
-    std::vector<std::string> instructions;
+    sink.emit(genExeInstr(coreId, true, false, bAddr));
+    sink.emit(genExeInstr(coreId, false, false, bOffset));
+}
+
+// Read (a partial sum) or write C[i][j]
+static void accessC(InstructionSink& sink, int coreId, const MemoryMap& memMap,
+                    int i, int j, bool write) {
+    // Calculate address for C[i][j] using rowSizeC
+    int cIndex = i * memMap.rowSizeC + j;
+    int cAddr = memMap.baseAddrC + (cIndex / memMap.elementsPerRowC);
+    int cOffset = cIndex % memMap.elementsPerRowC;
+    
+    sink.emit(genExeInstr(coreId, !write, write, cAddr));
+    sink.emit(genExeInstr(coreId, false, false, cOffset));
+}
+
+// Start C[i][j]'s accumulator: cleared, or at bias[j] when an epilogue adds one
+static void startElement(InstructionSink& sink, int coreId, const MemoryMap& memMap,
+                         const EpilogueSpec* epilogue, int j) {
+    if (!epilogue || !epilogue->bias) {
+        sink.emit(genExeInstr(coreId, false, false, EXE_OP_CLEAR));
+        return;
+    }
+    sink.emit(genExeInstr(coreId, true, false, memMap.baseAddrBias + j / memMap.elementsPerRowC));
+    sink.emit(genExeInstr(coreId, false, false, j % memMap.elementsPerRowC));
+    sink.emit(genExeInstr(coreId, false, false, EXE_OP_LOAD_ACC));
+}
+
+// Store C[i][j]; its last store runs the epilogue's output stage first
+static void storeElement(InstructionSink& sink, int coreId, const MemoryMap& memMap,
+                         const EpilogueSpec* epilogue, int i, int j, bool last) {
+    if (last && epilogue && epilogue->hasOutputStage()) {
+        sink.emit(genOutputStageInstr(coreId, memMap.baseAddrOutputStage));
+    }
+    accessC(sink, coreId, memMap, i, j, true);
+}
+
+// One step of the k loop for C[i][j] when partial sums live in C: the first
+// step starts from a cleared accumulator, later ones reload the partial sum
+static void accumulateStep(InstructionSink& sink, int coreId, const MemoryMap& memMap,
+                           int i, int j, int k) {
+    if (k == 0) {
+        note(sink, NOTE_ELEMENT, i, j);
+        sink.emit(genExeInstr(coreId, false, false, EXE_OP_CLEAR));
+    } else {
+        accessC(sink, coreId, memMap, i, j, false);
+        sink.emit(genExeInstr(coreId, false, false, EXE_OP_LOAD_ACC));
+    }
+    loadB(sink, coreId, memMap, k, j);
+    sink.emit(genExeInstr(coreId, false, false, EXE_OP_MAC));
+    accessC(sink, coreId, memMap, i, j, true);
+}
+
+// Weight-stationary body: each B[k][j] is loaded once and applied to every
+// row the core owns. The A read selects the row the MAC multiplies by.
+static void generateWeightStationary(int coreId, int startRow, int endRow,
+                                     const MatrixDimensions& dims, const MemoryMap& memMap,
+                                     InstructionSink& sink) {
+    for (int k = 0; k < dims.K; k++) {
+        for (int j = 0; j < dims.N; j++) {
+            loadB(sink, coreId, memMap, k, j);
+            for (int i = startRow; i <= endRow; i++) {
+                if (k == 0) {
+                    if (j == 0) {
+                        note(sink, NOTE_ROW, i);
+                    }
+                    note(sink, NOTE_ELEMENT, i, j);
+                }
+                
+                loadA(sink, coreId, memMap, i, k);
+                
+                if (k == 0) {
+                    sink.emit(genExeInstr(coreId, false, false, EXE_OP_CLEAR));
+                } else {
+                    accessC(sink, coreId, memMap, i, j, false);
+                    sink.emit(genExeInstr(coreId, false, false, EXE_OP_LOAD_ACC));
+                }
+                sink.emit(genExeInstr(coreId, false, false, EXE_OP_MAC));
+                accessC(sink, coreId, memMap, i, j, true);
+            }
+        }
+    }
+}
+
+// Register-blocked ijk body: C[i][j0..j1) share each load of A[i][k], one
+// accumulator per element. The last MAC leaves the block's last accumulator
+// current, so the stores run backwards and select every other one first.
+static void generateRegisterBlocked(int coreId, int startRow, int endRow,
+                                    const MatrixDimensions& dims, const MemoryMap& memMap,
+                                    InstructionSink& sink, int registerBlock) {
+    for (int i = startRow; i <= endRow; i++) {
+        note(sink, NOTE_ROW, i);
+        for (int j0 = 0; j0 < dims.N; j0 += registerBlock) {
+            int j1 = std::min(dims.N, j0 + registerBlock);
+            for (int j = j0; j < j1; j++) {
+                note(sink, NOTE_ELEMENT, i, j);
+                sink.emit(genExeInstr(coreId, false, false, exeOperand(EXE_OP_CLEAR, j - j0)));
+            }
+            for (int k = 0; k < dims.K; k++) {
+                loadA(sink, coreId, memMap, i, k);
+                for (int j = j0; j < j1; j++) {
+                    loadB(sink, coreId, memMap, k, j);
+                    sink.emit(genExeInstr(coreId, false, false, exeOperand(EXE_OP_MAC, j - j0)));
+                }
+            }
+            for (int j = j1 - 1; j >= j0; j--) {
+                if (j != j1 - 1) {
+                    sink.emit(genExeInstr(coreId, false, false, exeOperand(EXE_OP_SELECT, j - j0)));
+                }
+                accessC(sink, coreId, memMap, i, j, true);
+            }
+        }
+    }
+}
+
+// Weight-specialized ijk body: only the computed columns of B get a dot
+// product, over their nonzero weights, and its accumulator is stored to the
+// column and every later copy of it. A segmented row streams segment by
+// segment as plain ijk does, leaving out an element in a later segment when
+// none of its weights fall there (its partial sum in C is already final).
+static void generateWeightSpecialized(int coreId, int startRow, int endRow,
+                                      const MatrixDimensions& dims, const MemoryMap& memMap,
+                                      InstructionSink& sink, const WeightPlan& plan) {
+    const bool segmented = memMap.rowsPerMatrixRowA > 1;
+    for (int i = startRow; i <= endRow; i++) {
+        note(sink, NOTE_ROW, i);
+        for (int kStart = 0; kStart < dims.K;) {
+            int kEnd = segmented ? segmentEnd(i, kStart, dims, memMap) : dims.K;
+            loadA(sink, coreId, memMap, i, kStart);
+            for (int j : plan.computed) {
+                uint32_t first, last;
+                plan.nonzeroRange(j, kStart, kEnd, first, last);
+                if (kStart == 0) {
+                    note(sink, NOTE_ELEMENT, i, j);
+                    sink.emit(genExeInstr(coreId, false, false, EXE_OP_CLEAR));
+                } else if (first == last) {
+                    continue;
+                } else {
+                    accessC(sink, coreId, memMap, i, j, false);
+                    sink.emit(genExeInstr(coreId, false, false, EXE_OP_LOAD_ACC));
+                }
+                for (uint32_t p = first; p < last; p++) {
+                    loadB(sink, coreId, memMap, plan.nonzeroK[p], j);
+                    sink.emit(genExeInstr(coreId, false, false, EXE_OP_MAC));
+                }
+                accessC(sink, coreId, memMap, i, j, true);
+                for (int copy : plan.copies[j]) {
+                    accessC(sink, coreId, memMap, i, copy, true);
+                }
+            }
+            kStart = kEnd;
+        }
+    }
+}
+
+// Select element `index` of a matrix stored compactly from row `base`
+static void loadCompact(InstructionSink& sink, int coreId, int base, int64_t index, int rowSize) {
+    sink.emit(genExeInstr(coreId, true, false, static_cast<int>(base + index / rowSize)));
+    sink.emit(genExeInstr(coreId, false, false, static_cast<int>(index % rowSize)));
+}
+
+// Sparse ijk body: row i of A streams as its nonzeros (a segment per memory
+// row of them when they span several), and each C element MACs over the k
+// where column j of B is nonzero too. As in the weight-specialized kernel, a
+// later segment leaves out the elements it has no such k for.
+static void generateSparse(int coreId, int startRow, int endRow,
+                           const MatrixDimensions& dims, const MemoryMap& memMap,
+                           InstructionSink& sink, const SparsePlan& plan) {
+    const bool segmented = memMap.rowsPerMatrixRowA > 1;
+    std::vector<uint32_t> pairs;
+    for (int i = startRow; i <= endRow; i++) {
+        note(sink, NOTE_ROW, i);
+        const uint32_t rowStart = plan.a.rowStart[i];
+        const uint32_t rowEnd = plan.a.rowStart[i + 1];
+        uint32_t first = rowStart;
+        do {
+            uint32_t last = segmented && first < rowEnd ? plan.segmentEnd(i, first, memMap.elementsPerRowA) : rowEnd;
+            if (first < last) {
+                loadCompact(sink, coreId, memMap.baseAddrA, first, memMap.elementsPerRowA);
+            }
+            for (int j = 0; j < dims.N; j++) {
+                plan.pairs(j, first, last, pairs);
+                if (first == rowStart) {
+                    note(sink, NOTE_ELEMENT, i, j);
+                    sink.emit(genExeInstr(coreId, false, false, EXE_OP_CLEAR));
+                } else if (pairs.empty()) {
+                    continue;
+                } else {
+                    accessC(sink, coreId, memMap, i, j, false);
+                    sink.emit(genExeInstr(coreId, false, false, EXE_OP_LOAD_ACC));
+                }
+                for (uint32_t q : pairs) {
+                    loadCompact(sink, coreId, memMap.baseAddrB, plan.indexB(q, j), memMap.elementsPerRowB);
+                    sink.emit(genExeInstr(coreId, false, false, EXE_OP_MAC));
+                }
+                accessC(sink, coreId, memMap, i, j, true);
+            }
+            first = last;
+        } while (first < rowEnd);
+    }
+}
+
+// Software-pipelined ijk body: the first B load of each element (of each
+// segment of it, in a segmented row) is issued ahead of the previous
+// element's store, and of the next row's or segment's A load, so the load
+// overlaps them and the clear. The B load leaves the accumulator and the row
+// of A alone, and the store, A load and clear leave the B operand alone.
+static void generatePipelined(int coreId, int startRow, int endRow,
+                              const MatrixDimensions& dims, const MemoryMap& memMap, InstructionSink& sink) {
+    const bool segmented = memMap.rowsPerMatrixRowA > 1;
+    bool storing = false;   // C[storeI][storeJ] is computed but not yet stored
+    int storeI = 0;
+    int storeJ = 0;
+    for (int i = startRow; i <= endRow; i++) {
+        for (int kStart = 0; kStart < dims.K;) {
+            int kEnd = segmented ? segmentEnd(i, kStart, dims, memMap) : dims.K;
+            for (int j = 0; j < dims.N; j++) {
+                loadB(sink, coreId, memMap, kStart, j);
+                if (storing) {
+                    accessC(sink, coreId, memMap, storeI, storeJ, true);
+                }
+                if (j == 0) {
+                    if (kStart == 0) {
+                        note(sink, NOTE_ROW, i);
+                    }
+                    loadA(sink, coreId, memMap, i, kStart);
+                }
+                if (kStart == 0) {
+                    note(sink, NOTE_ELEMENT, i, j);
+                    sink.emit(genExeInstr(coreId, false, false, EXE_OP_CLEAR));
+                } else {
+                    accessC(sink, coreId, memMap, i, j, false);
+                    sink.emit(genExeInstr(coreId, false, false, EXE_OP_LOAD_ACC));
+                }
+                sink.emit(genExeInstr(coreId, false, false, EXE_OP_MAC));
+                for (int k = kStart + 1; k < kEnd; k++) {
+                    loadB(sink, coreId, memMap, k, j);
+                    sink.emit(genExeInstr(coreId, false, false, EXE_OP_MAC));
+                }
+                storing = true;
+                storeI = i;
+                storeJ = j;
+            }
+            kStart = kEnd;
+        }
+    }
+    if (storing) {
+        accessC(sink, coreId, memMap, storeI, storeJ, true);
+    }
+}
+
+// Memory row and offset of element (r, c) of a tiled matrix: tiles are
+// tileRows x tileCols, stored tile-row-major from `base`, one per memory row
+static void tiledAccess(InstructionSink& sink, int coreId, bool write, int base, int tileRows, int tileCols,
+                        int tilesAcross, int r, int c) {
+    int row = base + (r / tileRows) * tilesAcross + c / tileCols;
+    int offset = (r % tileRows) * tileCols + c % tileCols;
+    sink.emit(genExeInstr(coreId, !write, write, row));
+    sink.emit(genExeInstr(coreId, false, false, offset));
+}
+
+// Tiled body: one M tile of the core's rows at a time, then each N and K tile.
+// Within a pass every access stays in one row of A, B and C.
+static void generateTiled(int coreId, int startRow, int endRow,
+                          const MatrixDimensions& dims, const MemoryMap& memMap, InstructionSink& sink) {
+    const int tileM = memMap.tileM;
+    const int tileN = memMap.tileN;
+    const int tileK = memMap.tileK;
+    const int tilesN = (dims.N + tileN - 1) / tileN;
+    const int tilesK = (dims.K + tileK - 1) / tileK;
+    
+    for (int i0 = startRow; i0 <= endRow;) {
+        int i1 = std::min(endRow, (i0 / tileM + 1) * tileM - 1);
+        for (int j0 = 0; j0 < dims.N; j0 += tileN) {
+            int j1 = std::min(dims.N, j0 + tileN);
+            for (int k0 = 0; k0 < dims.K; k0 += tileK) {
+                int k1 = std::min(dims.K, k0 + tileK);
+                for (int i = i0; i <= i1; i++) {
+                    if (j0 == 0 && k0 == 0) {
+                        note(sink, NOTE_ROW, i);
+                    }
+                    
+                    // Select row i of A for the MACs
+                    tiledAccess(sink, coreId, false, memMap.baseAddrA, tileM, tileK, tilesK, i, k0);
+                    
+                    for (int j = j0; j < j1; j++) {
+                        if (k0 == 0) {
+                            note(sink, NOTE_ELEMENT, i, j);
+                            sink.emit(genExeInstr(coreId, false, false, EXE_OP_CLEAR));
+                        } else {
+                            tiledAccess(sink, coreId, false, memMap.baseAddrC, tileM, tileN, tilesN, i, j);
+                            sink.emit(genExeInstr(coreId, false, false, EXE_OP_LOAD_ACC));
+                        }
+                        for (int k = k0; k < k1; k++) {
+                            tiledAccess(sink, coreId, false, memMap.baseAddrB, tileK, tileN, tilesN, k, j);
+                            sink.emit(genExeInstr(coreId, false, false, EXE_OP_MAC));
+                        }
+                        tiledAccess(sink, coreId, true, memMap.baseAddrC, tileM, tileN, tilesN, i, j);
+                    }
+                }
+            }
+        }
+        i0 = i1 + 1;
+    }
+}
+
+// Generate the complete instruction sequence for a single core. The options
+// name the kernel exactly: a resolved loop order and block width, and only
+// the kernel variants this layout uses (see kernelOptions).
+static void generateCoreSequence(
+    int coreId, int startRow, int endRow, 
+    const MatrixDimensions& dims, const MemoryMap& memMap,
+    InstructionSink& sink, const CodegenOptions& kernel) {
     
     // Extract dimensions for readability
-    int M = dims.M;
     int N = dims.N;
     int K = dims.K;
+    const LoopOrder order = kernel.loopOrder;
+    const ProgramPart part = kernel.part;
+    const EpilogueSpec* epilogue = kernel.epilogue;
     
     // Add comments to show which core this is for
-    instructions.push_back("# Instructions for Core " + std::to_string(coreId) + 
-                          " (Rows " + std::to_string(startRow) + " to " + 
-                          std::to_string(endRow) + ")");
+    note(sink, NOTE_CORE_HEADER, coreId, startRow, endRow);
     
     // Step 1: Program this core for matrix multiplication
-    // We use a unique function ID (1 = matrix multiplication)
-    instructions.push_back(genProgInstr(coreId, true, false, 1));
+    if (!emitCoreSetup(coreId, memMap, part, sink)) {
+        return;
+    }
+    const Instruction end = coreEndInstr(coreId, part);
+    
+    if (memMap.tileK > 0 || order == LOOP_ORDER_KJI || kernel.registerBlock > 1 || kernel.weights ||
+        kernel.sparse || kernel.pipeline) {
+        if (memMap.tileK > 0) {
+            generateTiled(coreId, startRow, endRow, dims, memMap, sink);
+        } else if (kernel.registerBlock > 1) {
+            generateRegisterBlocked(coreId, startRow, endRow, dims, memMap, sink, kernel.registerBlock);
+        } else if (kernel.weights) {
+            generateWeightSpecialized(coreId, startRow, endRow, dims, memMap, sink, *kernel.weights);
+        } else if (kernel.sparse) {
+            generateSparse(coreId, startRow, endRow, dims, memMap, sink, *kernel.sparse);
+        } else if (kernel.pipeline) {
+            generatePipelined(coreId, startRow, endRow, dims, memMap, sink);
+        } else {
+            generateWeightStationary(coreId, startRow, endRow, dims, memMap, sink);
+        }
+        sink.emit(end);
+        return;
+    }
+    
+    // A row of A wider than a memory row is handled one segment at a time
+    const bool segmented = memMap.rowsPerMatrixRowA > 1;
     
     // For each row assigned to this core
     for (int i = startRow; i <= endRow; i++) {
         // Add comment for clarity
-        instructions.push_back("# Processing row " + std::to_string(i));
+        note(sink, NOTE_ROW, i);
         
-        // If a matrix row spans multiple memory rows, we need to handle it specially
-        if (memMap.rowsPerMatrixRowA > 1) {
-            // Base address for this matrix row in memory
-            int aRowBase = memMap.baseAddrA + (i * memMap.rowsPerMatrixRowA);
-            
-            for (int segment = 0; segment < memMap.rowsPerMatrixRowA; segment++) {
-                int aSegmentAddr = aRowBase + segment;
-                
-                // Calculate actual starting offset within the segment 
-                // (in most cases this will be 0 except for the last segment)
-                int startPos = segment * MEMORY_ROW_SIZE;
-                int endPos = std::min(startPos + MEMORY_ROW_SIZE, memMap.rowSizeA);
-                int elementsInSegment = endPos - startPos;
-                
-                // Load this memory row segment
-                instructions.push_back(genExeInstr(coreId, true, false, aSegmentAddr));
-                instructions.push_back(genExeInstr(coreId, false, false, 0)); // Offset is 0 for full rows
-                
-                // Process this segment...
-                // Additional instructions for segment processing would go here
-            }
-        } else {
+        if (!segmented) {
             // Simple case: one matrix row fits in one or fewer memory rows
-            // Calculate memory address for row i of matrix A
-            int aRowAddr = memMap.baseAddrA + (i * memMap.rowSizeA / MEMORY_ROW_SIZE);
-            int aRowOffset = (i * memMap.rowSizeA) % MEMORY_ROW_SIZE;
-            
-            // Load row i from matrix A
-            instructions.push_back(genExeInstr(coreId, true, false, aRowAddr));
-            instructions.push_back(genExeInstr(coreId, false, false, aRowOffset));
+            loadA(sink, coreId, memMap, i, 0);
+        }
+        
+        if (order == LOOP_ORDER_IKJ) {
+            // Sweep row k of B for each A[i][k]; B[k][j..] is contiguous.
+            // A segmented row reloads A as k enters each segment.
+            int nextSegment = 0;
+            for (int k = 0; k < K; k++) {
+                if (segmented && k == nextSegment) {
+                    loadA(sink, coreId, memMap, i, k);
+                    nextSegment = segmentEnd(i, k, dims, memMap);
+                }
+                for (int j = 0; j < N; j++) {
+                    accumulateStep(sink, coreId, memMap, i, j, k);
+                }
+            }
+            continue;
+        }
+        
+        if (order == LOOP_ORDER_BLOCKED) {
+            // Same sweep, one block of C columns at a time
+            for (int jBlock = 0; jBlock < N;) {
+                int jEnd = blockEnd(i, jBlock, dims, memMap, kernel.blockColumns);
+                int nextSegment = 0;
+                for (int k = 0; k < K; k++) {
+                    if (segmented && k == nextSegment) {
+                        loadA(sink, coreId, memMap, i, k);
+                        nextSegment = segmentEnd(i, k, dims, memMap);
+                    }
+                    for (int j = jBlock; j < jEnd; j++) {
+                        accumulateStep(sink, coreId, memMap, i, j, k);
+                    }
+                }
+                jBlock = jEnd;
+            }
+            continue;
+        }
+        
+        if (segmented) {
+            // Stream each segment of A against the matching rows of B. The
+            // first segment starts every element from a cleared accumulator
+            // (or its bias); later ones reload its partial sum from C and add
+            // to it, and the last one runs the output stage.
+            for (int kStart = 0; kStart < K;) {
+                int kEnd = segmentEnd(i, kStart, dims, memMap);
+                loadA(sink, coreId, memMap, i, kStart);
+                for (int j = 0; j < N; j++) {
+                    if (kStart == 0) {
+                        note(sink, NOTE_ELEMENT, i, j);
+                        startElement(sink, coreId, memMap, epilogue, j);
+                    } else {
+                        accessC(sink, coreId, memMap, i, j, false);
+                        sink.emit(genExeInstr(coreId, false, false, EXE_OP_LOAD_ACC));
+                    }
+                    for (int k = kStart; k < kEnd; k++) {
+                        loadB(sink, coreId, memMap, k, j);
+                        sink.emit(genExeInstr(coreId, false, false, EXE_OP_MAC));
+                    }
+                    storeElement(sink, coreId, memMap, epilogue, i, j, kEnd == K);
+                }
+                kStart = kEnd;
+            }
+            continue;
         }
         
         // For each column in the output
         for (int j = 0; j < N; j++) {
             // Add comment for clarity
-            instructions.push_back("# Computing element C[" + std::to_string(i) + 
-                                  "][" + std::to_string(j) + "]");
+            note(sink, NOTE_ELEMENT, i, j);
             
-            // Clear accumulator for this element
-            instructions.push_back(genExeInstr(coreId, false, false, 0));
+            // Clear accumulator for this element (or start it at its bias)
+            startElement(sink, coreId, memMap, epilogue, j);
             
             // For each element in the dot product
             for (int k = 0; k < K; k++) {
-                // Calculate address for B[k][j] using rowSizeB
-                int bIndex = k * memMap.rowSizeB + j;
-                int bAddr = memMap.baseAddrB + (bIndex / MEMORY_ROW_SIZE);
-                int bOffset = bIndex % MEMORY_ROW_SIZE;
-                
                 // Load element from matrix B
-                instructions.push_back(genExeInstr(coreId, true, false, bAddr));
-                instructions.push_back(genExeInstr(coreId, false, false, bOffset));
+                loadB(sink, coreId, memMap, k, j);
                 
                 // Perform multiply-accumulate
-                // This uses a special operation code (2 = multiply-accumulate)
-                instructions.push_back(genExeInstr(coreId, false, false, 2));
+                sink.emit(genExeInstr(coreId, false, false, EXE_OP_MAC));
             }
             
-            // Calculate address for C[i][j] using rowSizeC
-            int cIndex = i * memMap.rowSizeC + j;
-            int cAddr = memMap.baseAddrC + (cIndex / MEMORY_ROW_SIZE);
-            int cOffset = cIndex % MEMORY_ROW_SIZE;
-            
             // Store result to matrix C
-            instructions.push_back(genExeInstr(coreId, false, true, cAddr));
-            instructions.push_back(genExeInstr(coreId, false, false, cOffset));
+            storeElement(sink, coreId, memMap, epilogue, i, j, true);
         }
     }
     
     // Signal completion of this core's work
-    instructions.push_back(genEndInstr(coreId, false, false, 0));
+    sink.emit(end);
+}
+
+// The options resolved for one layout: the loop order and block width
+// chosen, and every kernel variant the layout does not use switched off
+static CodegenOptions kernelOptions(const MatrixDimensions& dims, const MemoryMap& memMap,
+                                    const CodegenOptions& options) {
+    const CodegenOptions resolved = resolveLoopOrder(dims, memMap, options);
+    CodegenOptions kernel = resolved;
+    kernel.blockColumns = blockColumnsFor(dims, resolved);
+    kernel.registerBlock = usesRegisterBlocking(memMap, resolved) ? resolved.registerBlock : 1;
+    kernel.weights = usesWeightSpecialization(memMap, resolved) ? resolved.weights : nullptr;
+    kernel.sparse = usesSparsity(memMap, resolved) ? resolved.sparse : nullptr;
+    kernel.pipeline = usesPipelining(memMap, resolved) ? resolved.pipeline : nullptr;
+    kernel.epilogue = usesEpilogue(memMap, resolved) ? resolved.epilogue : nullptr;
+    return kernel;
+}
+
+void generateCoreInstructions(
+    int coreId, int startRow, int endRow, 
+    const MatrixDimensions& dims, const MemoryMap& memMap,
+    InstructionSink& sink, const CodegenOptions& options) {
+    
+    const CodegenOptions kernel = kernelOptions(dims, memMap, options);
+    
+    auto generate = [&](InstructionSink& target) {
+        if (!options.rowReuse) {
+            generateCoreSequence(coreId, startRow, endRow, dims, memMap, target, kernel);
+            return;
+        }
+        // Drop row-sets that the core's address register already holds
+        RowReuseSink reuse(target);
+        generateCoreSequence(coreId, startRow, endRow, dims, memMap, reuse, kernel);
+        reuse.flush();
+    };
+    
+    if (kernel.pipeline) {
+        // Pad for the latencies once row reuse has settled what is issued
+        HazardPaddingSink padding(sink, memMap, *kernel.pipeline);
+        generate(padding);
+        return;
+    }
+    generate(sink);
+}
+
+InstructionBuffer generateCoreInstructions(
+    int coreId, int startRow, int endRow, 
+    const MatrixDimensions& dims, const MemoryMap& memMap,
+    const CodegenOptions& options) {
+    
+    InstructionBuffer instructions;
+    
+    // Size the buffer once: PROG, the LUT loads and END, per row the A load(s), per element
+    // clear + K * (load B + MAC) + store, or in the ikj and blocked orders
+    // 8 per step after the first (an upper bound with row reuse). kji swaps
+    // the row loads for one load of each B element. Segmented ijk rows spend
+    // 5 more per element and extra segment. Register blocking spends at most
+    // 2 more per k and element on its A loads, and 1 on selecting for a store.
+    // An epilogue spends epilogueInstructionsPerElement more.
+    size_t rows = static_cast<size_t>(endRow - startRow + 1);
+    size_t segments = memMap.rowsPerMatrixRowA > 1 ? static_cast<size_t>(memMap.rowsPerMatrixRowA) + 1 : 1;
+    size_t K = static_cast<size_t>(dims.K);
+    size_t N = static_cast<size_t>(dims.N);
+    CodegenOptions resolved = resolveLoopOrder(dims, memMap, options);
+    size_t perElement = resolved.loopOrder == LOOP_ORDER_IJK ? 3 + 3 * K + 5 * (segments - 1) : 8 * K - 2;
+    if (usesRegisterBlocking(memMap, resolved)) {
+        perElement = 4 + 5 * K;
+    }
+    if (usesEpilogue(memMap, resolved)) {
+        perElement += epilogueInstructionsPerElement(*resolved.epilogue);
+    }
+    size_t perCore = memMap.lutImages +
+                     (resolved.loopOrder == LOOP_ORDER_KJI ? 2 + 2 * N * K : 2 + rows * 2 * segments);
+    if (memMap.tileK > 0) {
+        WorkAssignment work = {coreId, startRow, endRow};
+        instructions.instructions.reserve(tiledCoreInstructions(dims, tilePlanOf(memMap), work, options.rowReuse) +
+                                          memMap.lutImages);
+    } else if (usesSparsity(memMap, resolved)) {
+        WorkAssignment work = {coreId, startRow, endRow};
+        instructions.instructions.reserve(sparseCoreInstructions(dims, memMap, work, *resolved.sparse,
+                                                                 options.rowReuse) + memMap.lutImages);
+    } else {
+        instructions.instructions.reserve(perCore + rows * N * perElement);
+    }
+    instructions.annotations.reserve(1 + rows * (1 + static_cast<size_t>(dims.N)));
     
+    BufferSink sink(instructions);
+    generateCoreInstructions(coreId, startRow, endRow, dims, memMap, sink, resolved);
     return instructions;
 }
\ No newline at end of file
@@ -0,0 +1,330 @@
+#include "pim_compiler.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+static uint32_t getU32(const std::vector<char>& bytes, size_t offset) {
+    return static_cast<uint32_t>(static_cast<unsigned char>(bytes[offset])) |
+           (static_cast<uint32_t>(static_cast<unsigned char>(bytes[offset + 1])) << 8) |
+           (static_cast<uint32_t>(static_cast<unsigned char>(bytes[offset + 2])) << 16) |
+           (static_cast<uint32_t>(static_cast<unsigned char>(bytes[offset + 3])) << 24);
+}
+
+Instruction unpackInstruction(const uint8_t* bytes) {
+    int wordBytes = activeIsa().instructionBytes();
+    uint32_t word = 0;
+    for (int b = 0; b < wordBytes; b++) {
+        word |= static_cast<uint32_t>(bytes[b]) << (8 * b);
+    }
+    return Instruction(word);
+}
+
+// Words are unpacked into blocks of this many, then split into fields
+static const size_t DECODE_BLOCK = 4096;
+
+// Fill the field arrays for words [first, first + count)
+static void splitFields(const uint32_t* words, size_t count, size_t first, DecodedInstructions& out) {
+    const IsaDescriptor& isa = activeIsa();
+    // Raw opcode field to logical opcode, for fields up to 8 bits wide
+    uint8_t logical[256];
+    for (uint32_t raw = 0; raw < 256; raw++) {
+        int op = isa.logicalOpcode(raw);
+        logical[raw] = static_cast<uint8_t>(op < 0 ? 0xFF : op);
+    }
+    bool tableOpcode = isa.opcode.width <= 8;
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t word = words[i];
+        uint32_t raw = isa.opcode.get(word);
+        out.opcode[first + i] = tableOpcode ? logical[raw]
+                                            : static_cast<uint8_t>(isa.logicalOpcode(raw) & 0xFF);
+        out.coreId[first + i] = static_cast<uint16_t>(isa.coreId.get(word));
+        out.read[first + i] = static_cast<uint8_t>(isa.read.get(word));
+        out.write[first + i] = static_cast<uint8_t>(isa.write.get(word));
+        out.addr[first + i] = isa.addr.get(word);
+    }
+}
+
+void decodeInstructions(const uint8_t* packed, size_t count, DecodedInstructions& out) {
+    out.resize(count);
+    int wordBytes = activeIsa().instructionBytes();
+
+    uint32_t words[DECODE_BLOCK];
+    for (size_t first = 0; first < count; first += DECODE_BLOCK) {
+        size_t n = std::min(DECODE_BLOCK, count - first);
+        const uint8_t* bytes = packed + static_cast<size_t>(wordBytes) * first;
+        for (size_t i = 0; i < n; i++) {
+            uint32_t word = 0;
+            for (int b = 0; b < wordBytes; b++) {
+                word |= static_cast<uint32_t>(bytes[b]) << (8 * b);
+            }
+            words[i] = word;
+            bytes += wordBytes;
+        }
+        splitFields(words, n, first, out);
+    }
+}
+
+void decodeInstructions(const std::vector<Instruction>& instructions, DecodedInstructions& out) {
+    size_t count = instructions.size();
+    out.resize(count);
+    uint32_t words[DECODE_BLOCK];
+    for (size_t first = 0; first < count; first += DECODE_BLOCK) {
+        size_t n = std::min(DECODE_BLOCK, count - first);
+        for (size_t i = 0; i < n; i++) {
+            words[i] = instructions[first + i].word;
+        }
+        splitFields(words, n, first, out);
+    }
+}
+
+const char* opcodeName(int opcode) {
+    switch (opcode) {
+        case OPCODE_NOOP: return "NOOP";
+        case OPCODE_PROG: return "PROG";
+        case OPCODE_EXE: return "EXE";
+        case OPCODE_END: return "END";
+        default: return "?";
+    }
+}
+
+std::string disassemble(Instruction instr) {
+    char text[64];
+    if (instr.broadcast()) {
+        std::snprintf(text, sizeof(text), "%-4s core=0-%d R=%d W=%d addr=%d",
+                      opcodeName(instr.opcode()), instr.coreId(),
+                      instr.read() ? 1 : 0, instr.write() ? 1 : 0, instr.addr());
+        return text;
+    }
+    std::snprintf(text, sizeof(text), "%-4s core=%d R=%d W=%d addr=%d",
+                  opcodeName(instr.opcode()), instr.coreId(),
+                  instr.read() ? 1 : 0, instr.write() ? 1 : 0, instr.addr());
+    return text;
+}
+
+bool parseHexInstruction(const std::string& line, Instruction& out) {
+    if (line.empty() || line[0] == '#') {
+        return false;
+    }
+    uint32_t word = 0;
+    size_t digits = 0;
+    for (char c : line) {
+        int value;
+        if (c >= '0' && c <= '9') {
+            value = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            value = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            value = c - 'A' + 10;
+        } else {
+            break;
+        }
+        word = (word << 4) | static_cast<uint32_t>(value);
+        digits++;
+    }
+    if (digits == 0 || digits > 8) {
+        return false;
+    }
+    out = Instruction(word);
+    return true;
+}
+
+// .pimb: header, core table, then packed words
+static bool readBinaryProgram(const std::vector<char>& bytes, const std::string& filename,
+                              LoadedProgram& program) {
+    if (getU32(bytes, 4) != PIMB_VERSION) {
+        std::cerr << "Error: Unsupported binary program version " << getU32(bytes, 4) << std::endl;
+        return false;
+    }
+    // Sizes are checked in 64 bits so that no field can wrap them
+    uint64_t headerSize = getU32(bytes, 8);
+    program.dims.M = getU32(bytes, 12);
+    program.dims.K = getU32(bytes, 16);
+    program.dims.N = getU32(bytes, 20);
+    uint64_t numCores = getU32(bytes, 24);
+    uint64_t total = getU32(bytes, 28);
+    uint32_t wordBytes = getU32(bytes, 32);
+    if (headerSize < 40 + 20 * numCores || bytes.size() < headerSize ||
+        bytes.size() < headerSize + total * wordBytes) {
+        std::cerr << "Error: Truncated binary program " << filename << std::endl;
+        return false;
+    }
+    if (!applyContainerHeader(bytes.data() + 40 + 20 * numCores, bytes.data() + headerSize, program.layout)) {
+        return false;
+    }
+    if (wordBytes != static_cast<uint32_t>(activeIsa().instructionBytes())) {
+        std::cerr << "Error: " << filename << " stores " << wordBytes << "-byte instructions, ISA "
+                  << activeIsa().name << " uses " << activeIsa().instructionBytes() << std::endl;
+        return false;
+    }
+
+    for (size_t c = 0; c < numCores; c++) {
+        size_t entry = 40 + 20 * c;
+        WorkAssignment work;
+        work.coreId = getU32(bytes, entry);
+        work.startRow = getU32(bytes, entry + 4);
+        work.endRow = getU32(bytes, entry + 8);
+        uint64_t firstInstr = getU32(bytes, entry + 12);
+        uint64_t count = getU32(bytes, entry + 16);
+        // Every slice must lie within the stream (an interleaved core's runs
+        // from its first instruction on)
+        if (firstInstr + count > total) {
+            std::cerr << "Error: Core table of " << filename << " gives core " << work.coreId << " instructions "
+                      << firstInstr << " to " << firstInstr + count << ", past the " << total
+                      << " in the stream" << std::endl;
+            return false;
+        }
+        program.assignments.push_back(work);
+        program.firstInstr.push_back(firstInstr);
+        program.counts.push_back(count);
+    }
+
+    const uint8_t* stream = reinterpret_cast<const uint8_t*>(bytes.data()) + headerSize;
+    program.instructions.resize(total);
+    for (size_t i = 0; i < total; i++) {
+        program.instructions[i] = unpackInstruction(stream + static_cast<size_t>(wordBytes) * i);
+    }
+    return true;
+}
+
+// .piml: expand each core's records
+static bool readLoopCompressedProgram(const std::string& filename, LoadedProgram& program) {
+    LoopProgram loops;
+    if (!readLoopProgram(filename, loops)) {
+        return false;
+    }
+    program.dims = loops.dims;
+    program.assignments = loops.assignments;
+    InstructionBuffer expanded;
+    BufferSink sink(expanded);
+    for (size_t c = 0; c < loops.cores.size(); c++) {
+        program.firstInstr.push_back(expanded.size());
+        expandLoops(loops.cores[c], sink);
+        program.counts.push_back(expanded.size() - program.firstInstr.back());
+    }
+    program.instructions.swap(expanded.instructions);
+    return true;
+}
+
+// .pim text: dimensions from the file header, core slices from the core headers
+static bool readTextProgram(const std::string& filename, LoadedProgram& program) {
+    std::ifstream in(filename);
+    if (!in.is_open()) {
+        std::cerr << "Error: Could not open file " << filename << std::endl;
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(in, line)) {
+        Instruction instr;
+        if (parseHexInstruction(line, instr)) {
+            if (program.assignments.empty()) {
+                std::cerr << "Error: Instruction before the first core header in " << filename << std::endl;
+                return false;
+            }
+            program.instructions.push_back(instr);
+            program.counts.back()++;
+            continue;
+        }
+
+        int m, k1, k2, n;
+        WorkAssignment work;
+        if (std::sscanf(line.c_str(), "# Matrix dimensions: %dx%d * %dx%d", &m, &k1, &k2, &n) == 4) {
+            program.dims.M = m;
+            program.dims.K = k1;
+            program.dims.N = n;
+        } else if (line.compare(0, 7, "# ISA: ") == 0) {
+            if (!applyContainerHeader(line.data() + 7, line.data() + line.size(), program.layout)) {
+                return false;
+            }
+        } else if (line.compare(0, 10, "# Layout: ") == 0) {
+            if (!applyContainerHeader(line.data() + 10, line.data() + line.size(), program.layout)) {
+                return false;
+            }
+        } else if (std::sscanf(line.c_str(), "# Instructions for Core %d (Rows %d to %d)",
+                               &work.coreId, &work.startRow, &work.endRow) == 3) {
+            program.assignments.push_back(work);
+            program.firstInstr.push_back(program.instructions.size());
+            program.counts.push_back(0);
+        }
+    }
+    return true;
+}
+
+// Merged stream: gather each core's instructions, in stream order, giving
+// every core of a broadcast group its own copy
+static bool regroupByCore(const std::string& filename, LoadedProgram& program) {
+    std::vector<int> entryOfCore;
+    for (size_t c = 0; c < program.assignments.size(); c++) {
+        int coreId = program.assignments[c].coreId;
+        if (coreId >= static_cast<int>(entryOfCore.size())) {
+            entryOfCore.resize(coreId + 1, -1);
+        }
+        entryOfCore[coreId] = static_cast<int>(c);
+    }
+
+    std::vector<std::vector<Instruction>> cores(program.assignments.size());
+    for (Instruction instr : program.instructions) {
+        int last = instr.coreId();
+        bool broadcast = instr.broadcast();
+        for (int coreId = broadcast ? 0 : last; coreId <= last; coreId++) {
+            if (coreId >= static_cast<int>(entryOfCore.size()) || entryOfCore[coreId] < 0) {
+                std::cerr << "Error: " << filename << " has an instruction for core " << coreId
+                          << ", which has no entry in its core table" << std::endl;
+                return false;
+            }
+            cores[entryOfCore[coreId]].push_back(broadcast ? retargetInstr(instr, coreId) : instr);
+        }
+    }
+
+    program.instructions.clear();
+    for (size_t c = 0; c < cores.size(); c++) {
+        program.firstInstr[c] = program.instructions.size();
+        program.counts[c] = cores[c].size();
+        program.instructions.insert(program.instructions.end(), cores[c].begin(), cores[c].end());
+    }
+    return true;
+}
+
+static bool readAnyProgram(const std::string& filename, LoadedProgram& program) {
+    program.dims.M = 0;
+    program.dims.K = 0;
+    program.dims.N = 0;
+    program.assignments.clear();
+    program.firstInstr.clear();
+    program.counts.clear();
+    program.instructions.clear();
+
+    std::ifstream in(filename, std::ios::binary);
+    if (!in.is_open()) {
+        std::cerr << "Error: Could not open file " << filename << std::endl;
+        return false;
+    }
+    char magic[4] = {0, 0, 0, 0};
+    in.read(magic, 4);
+    std::vector<char> header(magic, magic + 4);
+    uint32_t tag = in.gcount() == 4 ? getU32(header, 0) : 0;
+
+    if (tag == PIML_MAGIC) {
+        return readLoopCompressedProgram(filename, program);
+    }
+    if (tag == PIMB_MAGIC) {
+        in.seekg(0);
+        std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (bytes.size() < 40) {
+            std::cerr << "Error: Truncated binary program " << filename << std::endl;
+            return false;
+        }
+        return readBinaryProgram(bytes, filename, program);
+    }
+    return readTextProgram(filename, program);
+}
+
+bool readProgramFile(const std::string& filename, LoadedProgram& program) {
+    program.layout = ProgramLayout();
+    if (!readAnyProgram(filename, program)) {
+        return false;
+    }
+    return program.layout.schedule == SCHEDULE_CONCAT || regroupByCore(filename, program);
+}
@@ -0,0 +1,102 @@
+#include "pim_compiler.h"
+#include <cstdlib>
+
+int64_t EpilogueSpec::apply(int64_t dot, int64_t biasValue) const {
+    int64_t value = (dot + biasValue) * alpha;
+    // Shift toward minus infinity whatever the sign, as the cores do
+    value = value >= 0 ? value >> shift : -((-value - 1) >> shift) - 1;
+    return std::min<int64_t>(std::max<int64_t>(value, min), max);
+}
+
+// A signed integer that fits an int32
+static bool parseInt32(const std::string& text, int32_t& value) {
+    char* end = nullptr;
+    long long parsed = std::strtoll(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || parsed < INT32_MIN || parsed > INT32_MAX) {
+        return false;
+    }
+    value = static_cast<int32_t>(parsed);
+    return true;
+}
+
+bool parseEpilogue(const std::string& text, EpilogueSpec& out, std::string& error) {
+    EpilogueSpec spec;
+    bool relu = false;
+    std::string seen;
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t comma = text.find(',', start);
+        std::string item = text.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+        start = comma == std::string::npos ? text.size() + 1 : comma + 1;
+
+        std::string key = item.substr(0, item.find('='));
+        std::string value = item.size() > key.size() ? item.substr(key.size() + 1) : "";
+        if (seen.find("," + key + ",") != std::string::npos) {
+            error = "'" + key + "' appears twice";
+            return false;
+        }
+        seen += "," + key + ",";
+
+        bool ok = true;
+        if (item == "bias") {
+            spec.bias = true;
+        } else if (item == "relu") {
+            relu = true;
+        } else if (key == "alpha") {
+            ok = parseInt32(value, spec.alpha);
+        } else if (key == "shift") {
+            int32_t shift = 0;
+            ok = parseInt32(value, shift) && shift >= 0 && shift < MEMORY_SLOT_BITS;
+            spec.shift = shift;
+        } else if (key == "clamp") {
+            size_t colon = value.find(':');
+            ok = colon != std::string::npos && parseInt32(value.substr(0, colon), spec.min) &&
+                 parseInt32(value.substr(colon + 1), spec.max);
+        } else {
+            error = "expected bias, alpha=<n>, shift=<bits>, relu or clamp=<min>:<max>, not '" + item + "'";
+            return false;
+        }
+        if (!ok) {
+            error = "invalid value in '" + item + "'";
+            return false;
+        }
+    }
+    if (relu) {
+        spec.min = std::max<int32_t>(spec.min, 0);
+    }
+    if (spec.min > spec.max) {
+        error = "the clamp's minimum " + std::to_string(spec.min) + " exceeds its maximum " +
+                std::to_string(spec.max);
+        return false;
+    }
+    out = spec;
+    return true;
+}
+
+std::string describeEpilogue(const EpilogueSpec& spec) {
+    std::string text;
+    auto add = [&text](const std::string& item) { text += (text.empty() ? "" : ",") + item; };
+    if (spec.bias) {
+        add("bias");
+    }
+    if (spec.alpha != 1) {
+        add("alpha=" + std::to_string(spec.alpha));
+    }
+    if (spec.shift != 0) {
+        add("shift=" + std::to_string(spec.shift));
+    }
+    if (spec.min == 0 && spec.max == INT32_MAX) {
+        add("relu");
+    } else if (spec.min != INT32_MIN || spec.max != INT32_MAX) {
+        add("clamp=" + std::to_string(spec.min) + ":" + std::to_string(spec.max));
+    }
+    return text;
+}
+
+bool hasEpilogue(const EpilogueSpec& spec) {
+    return spec.bias || spec.hasOutputStage();
+}
+
+int epilogueInstructionsPerElement(const EpilogueSpec& spec) {
+    return (spec.bias ? 2 : 0) + (spec.hasOutputStage() ? 1 : 0);
+}
@@ -0,0 +1,394 @@
+#include "pim_compiler.h"
+#include <iostream>
+
+
+static uint64_t digits(uint64_t value) {
+    uint64_t count = 1;
+    while (value >= 10) {
+        value /= 10;
+        count++;
+    }
+    return count;
+}
+
+// Total decimal digits needed to print every integer in [first, last]
+static uint64_t digitSum(uint64_t first, uint64_t last) {
+    if (first > last) {
+        return 0;
+    }
+    uint64_t total = 0;
+    uint64_t width = digits(first);
+    uint64_t bandStart = first;
+    uint64_t bandEnd = 1;
+    for (uint64_t w = 0; w < width; w++) {
+        bandEnd *= 10;
+    }
+    // Walk bands of equal width: [1, 9], [10, 99], ...
+    while (bandStart <= last) {
+        uint64_t stop = std::min(last, bandEnd - 1);
+        total += (stop - bandStart + 1) * width;
+        bandStart = bandEnd;
+        bandEnd *= 10;
+        width++;
+    }
+    return total;
+}
+
+// Pairs (k - 1, k) among the flat positions p = (k - 1) * N + j below
+// `positions` whose B loads share a memory row: p % rowSize < rowSize - N
+static uint64_t reusablePairs(uint64_t positions, uint64_t N, uint64_t rowSize) {
+    uint64_t window = rowSize - N;
+    return positions / rowSize * window + std::min(positions % rowSize, window);
+}
+
+// B loads per output row that the row reuse pass merges: load k > 0 of an
+// element reuses the row of load k - 1 when both B offsets, rowSizeB apart,
+// fall in the same memory row. Over the flat positions p = (k - 1) * N + j
+// that holds exactly when p % rowSize < rowSize - N.
+static uint64_t reusedLoadsPerRow(uint64_t N, uint64_t K, uint64_t rowSize) {
+    if (N >= rowSize || K < 2) {
+        return 0;
+    }
+    return reusablePairs((K - 1) * N, N, rowSize);
+}
+
+// Instructions for row i of A when it is split into segments (K wider than a
+// memory row). ikj and blocked reload A as k enters each segment, blocked
+// once per block; their steps cost what they do unsegmented. ijk streams
+// each segment over the whole C row: per element and segment a clear or a
+// partial-sum reload (1 or 3), 3 per k and a store, which merges only B
+// loads within a segment.
+static uint64_t segmentedRowInstructions(int i, const MatrixDimensions& dims, const MemoryMap& memMap,
+                                         LoopOrder order, int blockColumns, bool rowReuse) {
+    const uint64_t N = dims.N;
+    const uint64_t K = dims.K;
+    const uint64_t rowSize = memMap.elementsPerRowB;
+    const uint64_t segments = segmentsInRow(i, dims, memMap);
+    if (order == LOOP_ORDER_IKJ) {
+        return 2 * segments + N * (6 + 8 * (K - 1));
+    }
+    if (order == LOOP_ORDER_BLOCKED) {
+        uint64_t blocks = 0;
+        for (int jBlock = 0; jBlock < dims.N; jBlock = blockEnd(i, jBlock, dims, memMap, blockColumns)) {
+            blocks++;
+        }
+        return 2 * segments * blocks + N * (6 + 8 * (K - 1));
+    }
+
+    uint64_t instructions = 2 * segments + N * (5 * segments + 3 * K - 2);
+    if (rowReuse && N < rowSize) {
+        uint64_t reused = reusedLoadsPerRow(N, K, rowSize);
+        for (int k = segmentEnd(i, 0, dims, memMap); k < dims.K; k = segmentEnd(i, k, dims, memMap)) {
+            // The first load of a segment follows a partial-sum reload
+            uint64_t first = (k - 1) * N;
+            reused -= reusablePairs(first + N, N, rowSize) - reusablePairs(first, N, rowSize);
+        }
+        instructions -= reused;
+    }
+    return instructions;
+}
+
+// Element positions p in (first, first + count) where p is a multiple of
+// rowSize and p - first is not a multiple of registerBlock: the accesses in a
+// run of a register block that cannot reuse the row of the one before
+static uint64_t blockRowBreaks(uint64_t first, uint64_t count, uint64_t rowSize, uint64_t registerBlock,
+                               uint64_t period) {
+    uint64_t breaks = 0;
+    for (uint64_t p = (first / rowSize + 1) * rowSize; p < first + count; p += rowSize) {
+        if ((p - first) % period % registerBlock != 0) {
+            breaks++;
+        }
+    }
+    return breaks;
+}
+
+// Per row and block of width w: w clears, for each k an A load (2) and w
+// B loads and MACs (3 each), w - 1 selects and w stores. With row reuse,
+// every B load but the first of a k follows a load of the same B row unless
+// a row boundary falls between them; likewise every store but the first of
+// a block. A loads always follow another subarray's row.
+uint64_t registerBlockedCoreInstructions(const MatrixDimensions& dims, const MemoryMap& memMap,
+                                         const WorkAssignment& work, int registerBlock, bool rowReuse) {
+    const uint64_t N = dims.N;
+    const uint64_t K = dims.K;
+    const uint64_t r = registerBlock;
+    const uint64_t blocks = (N + r - 1) / r;
+    const uint64_t rows = static_cast<uint64_t>(work.endRow - work.startRow + 1);
+
+    uint64_t instructions = 2 + rows * (4 * N - blocks + K * (2 * blocks + 3 * N));
+    if (!rowReuse) {
+        return instructions;
+    }
+    // B loads: the same for every row; row k of B starts at k * N
+    uint64_t bMerges = K * (N - blocks) - blockRowBreaks(0, K * N, memMap.elementsPerRowB, r, N);
+    instructions -= rows * bMerges;
+    for (int i = work.startRow; i <= work.endRow; i++) {
+        uint64_t cStart = static_cast<uint64_t>(i) * memMap.rowSizeC;
+        instructions -= (N - blocks) - blockRowBreaks(cStart, N, memMap.elementsPerRowC, r, N);
+    }
+    return instructions;
+}
+
+// Walks one core's accesses in program order, tracking its latched row and
+// direction as RowReuseSink does: an access costs 1 instruction when it
+// reuses the latch and 2 otherwise. The B loads of an element only follow one
+// another, so their merges come from per-column prefix sums.
+uint64_t weightedCoreInstructions(const MatrixDimensions& dims, const MemoryMap& memMap,
+                                  const WorkAssignment& work, const WeightPlan& plan, bool rowReuse) {
+    const bool segmented = memMap.rowsPerMatrixRowA > 1;
+    auto rowOf = [](int base, int64_t index, int64_t rowSize) { return base + index / rowSize; };
+    auto rowOfB = [&](uint32_t p, int j) {
+        return rowOf(memMap.baseAddrB, static_cast<int64_t>(plan.nonzeroK[p]) * memMap.rowSizeB + j,
+                     memMap.elementsPerRowB);
+    };
+    auto rowOfC = [&](int i, int j) {
+        return rowOf(memMap.baseAddrC, static_cast<int64_t>(i) * memMap.rowSizeC + j, memMap.elementsPerRowC);
+    };
+
+    // merges[p]: loads among the first p nonzero weights that share the B row of the one before
+    std::vector<uint64_t> merges(plan.nonzeroK.size() + 1, 0);
+    for (int j = 0; j < plan.N; j++) {
+        for (uint32_t p = plan.columnStart[j]; p < plan.columnStart[j + 1]; p++) {
+            bool merged = p > plan.columnStart[j] && rowOfB(p, j) == rowOfB(p - 1, j);
+            merges[p + 1] = merges[p] + (merged ? 1 : 0);
+        }
+    }
+
+    int64_t latchedRow = -1;
+    bool latchedWrite = false;
+    auto access = [&](int64_t row, bool write) -> uint64_t {
+        bool reused = rowReuse && row == latchedRow && write == latchedWrite;
+        latchedRow = row;
+        latchedWrite = write;
+        return reused ? 1 : 2;
+    };
+
+    uint64_t instructions = 2;  // PROG and END
+    for (int i = work.startRow; i <= work.endRow; i++) {
+        for (int kStart = 0; kStart < dims.K;) {
+            int kEnd = segmented ? segmentEnd(i, kStart, dims, memMap) : dims.K;
+            instructions += access(rowOf(memMap.baseAddrA, static_cast<int64_t>(i) * memMap.rowSizeA + kStart,
+                                         memMap.elementsPerRowA), false);
+            for (int j : plan.computed) {
+                uint32_t first, last;
+                plan.nonzeroRange(j, kStart, kEnd, first, last);
+                if (kStart == 0) {
+                    instructions += 1;
+                } else if (first == last) {
+                    continue;
+                } else {
+                    instructions += access(rowOfC(i, j), false) + 1;
+                }
+                if (first < last) {
+                    // The first load, then 2 per later one less its merges, and a MAC each
+                    instructions += access(rowOfB(first, j), false) + 2 * (last - first - 1) + (last - first);
+                    if (rowReuse) {
+                        instructions -= merges[last] - merges[first + 1];
+                    }
+                    latchedRow = rowOfB(last - 1, j);
+                }
+                instructions += access(rowOfC(i, j), true);
+                for (int copy : plan.copies[j]) {
+                    instructions += access(rowOfC(i, copy), true);
+                }
+            }
+            kStart = kEnd;
+        }
+    }
+    return instructions;
+}
+
+// The sparse kernel pairs nonzeros element by element, so its count walks
+// the pairs, following the latch as weightedCoreInstructions does
+uint64_t sparseCoreInstructions(const MatrixDimensions& dims, const MemoryMap& memMap,
+                                const WorkAssignment& work, const SparsePlan& plan, bool rowReuse) {
+    const bool segmented = memMap.rowsPerMatrixRowA > 1;
+    auto rowOfC = [&](int i, int j) {
+        return memMap.baseAddrC + (static_cast<int64_t>(i) * memMap.rowSizeC + j) / memMap.elementsPerRowC;
+    };
+
+    int64_t latchedRow = -1;
+    bool latchedWrite = false;
+    auto access = [&](int64_t row, bool write) -> uint64_t {
+        bool reused = rowReuse && row == latchedRow && write == latchedWrite;
+        latchedRow = row;
+        latchedWrite = write;
+        return reused ? 1 : 2;
+    };
+
+    uint64_t instructions = 2;  // PROG and END
+    std::vector<uint32_t> pairs;
+    for (int i = work.startRow; i <= work.endRow; i++) {
+        const uint32_t rowStart = plan.a.rowStart[i];
+        const uint32_t rowEnd = plan.a.rowStart[i + 1];
+        uint32_t first = rowStart;
+        do {
+            uint32_t last = segmented && first < rowEnd ? plan.segmentEnd(i, first, memMap.elementsPerRowA) : rowEnd;
+            if (first < last) {
+                instructions += access(memMap.baseAddrA + first / memMap.elementsPerRowA, false);
+            }
+            for (int j = 0; j < dims.N; j++) {
+                plan.pairs(j, first, last, pairs);
+                if (first == rowStart) {
+                    instructions += 1;
+                } else if (pairs.empty()) {
+                    continue;
+                } else {
+                    instructions += access(rowOfC(i, j), false) + 1;
+                }
+                for (uint32_t q : pairs) {
+                    instructions += access(memMap.baseAddrB + plan.indexB(q, j) / memMap.elementsPerRowB, false) + 1;
+                }
+                instructions += access(rowOfC(i, j), true);
+            }
+            first = last;
+        } while (first < rowEnd);
+    }
+    return instructions;
+}
+
+CompileEstimate estimateCompile(const MatrixDimensions& dims,
+                                const std::vector<WorkAssignment>& assignments,
+                                const MemoryMap& memMap,
+                                const CodegenOptions& options) {
+    CompileEstimate estimate;
+    estimate.totalInstructions = 0;
+    estimate.totalAnnotations = 0;
+    estimate.parallelCycles = 0;
+
+    const uint64_t N = dims.N;
+    const uint64_t K = dims.K;
+    const IsaDescriptor& isa = activeIsa();
+    
+    // Bytes in "<hex> # Binary: <bits>\n"
+    const uint64_t textInstructionBytes = isa.hexDigits() + 11 + isa.wordBits + 1;
+
+    // Mirrors generateCoreInstructions: 2 instructions per A row load, then
+    // per C element a clear,
+    // K x (load B + MAC) and a store. The ikj and blocked orders spend the same
+    // 6 on the first step of an element; each later step also reloads the
+    // partial sum (read C + load accumulator), 8 in all. kji has no row loads:
+    // it loads each B element once per core (2) and A within each step, so its
+    // steps cost the same 6 and 8. Segmented rows are counted one by one.
+    CodegenOptions resolved = resolveLoopOrder(dims, memMap, options);
+    LoopOrder order = resolved.loopOrder;
+    bool segmented = memMap.rowsPerMatrixRowA > 1 && order != LOOP_ORDER_KJI;
+    uint64_t rowLoads = order == LOOP_ORDER_KJI ? 0 : 2;
+    uint64_t perElement = order == LOOP_ORDER_IJK ? 1 + 3 * K + 2 : 6 + 8 * (K - 1);
+    uint64_t perRow = rowLoads + N * perElement;
+    uint64_t perCore = order == LOOP_ORDER_KJI ? 2 + 2 * N * K : 2;
+    
+    // With row reuse every merged access saves its row-set. A loads and C
+    // stores always follow an access in the other direction, so only B loads
+    // merge, and only loads k > 0 of an element in ijk. (In ikj, blocked and
+    // kji every B load follows a C access, an A load or PROG.)
+    uint64_t reusedPerRow = 0;
+    if (options.rowReuse && order == LOOP_ORDER_IJK) {
+        reusedPerRow = reusedLoadsPerRow(N, K, memMap.elementsPerRowB);
+    }
+
+    // Text: header lines, then per core a blank line, the core header, and
+    // "# Processing row i" / "# Computing element C[i][j]" comments
+    std::string dimsLine = "# Matrix dimensions: " + std::to_string(dims.M) + "x" +
+                           std::to_string(dims.K) + " * " + std::to_string(dims.K) +
+                           "x" + std::to_string(dims.N);
+    std::string coresLine = "# Using " + std::to_string(assignments.size()) + " cores";
+    uint64_t textBytes = std::string("# PIM Instructions for Matrix Multiplication").size() + 1 +
+                         dimsLine.size() + 1 + coresLine.size() + 1;
+    if (!isDefaultIsa(isa)) {
+        textBytes += std::string("# ISA: ").size() + describeIsa(isa).size() + 1;
+    }
+    std::string layout = layoutTokens(options);
+    if (!layout.empty()) {
+        textBytes += std::string("# Layout: ").size() + layout.size() + 1;
+    }
+    uint64_t columnDigits = N > 0 ? digitSum(0, N - 1) : 0;
+    
+    // Elements with a comment per row: all of them, or the columns a
+    // weight-specialized kernel computes
+    uint64_t elements = N;
+    if (usesWeightSpecialization(memMap, resolved)) {
+        elements = resolved.weights->computed.size();
+        columnDigits = 0;
+        for (int j : resolved.weights->computed) {
+            columnDigits += digits(j);
+        }
+    }
+
+    for (const auto& work : assignments) {
+        CoreEstimate core;
+        core.coreId = work.coreId;
+        core.startRow = work.startRow;
+        core.endRow = work.endRow;
+
+        uint64_t rows = static_cast<uint64_t>(work.endRow - work.startRow + 1);
+        core.instructions = perCore + rows * (perRow - reusedPerRow);
+        if (segmented) {
+            core.instructions = perCore;
+            for (int i = work.startRow; i <= work.endRow; i++) {
+                core.instructions += segmentedRowInstructions(i, dims, memMap, order,
+                                                              blockColumnsFor(dims, resolved), options.rowReuse);
+            }
+        }
+        if (memMap.tileK > 0) {
+            core.instructions = tiledCoreInstructions(dims, tilePlanOf(memMap), work, options.rowReuse);
+        } else if (usesRegisterBlocking(memMap, resolved)) {
+            core.instructions = registerBlockedCoreInstructions(dims, memMap, work, resolved.registerBlock,
+                                                                options.rowReuse);
+        } else if (usesWeightSpecialization(memMap, resolved)) {
+            core.instructions = weightedCoreInstructions(dims, memMap, work, *resolved.weights, options.rowReuse);
+        } else if (usesSparsity(memMap, resolved)) {
+            core.instructions = sparseCoreInstructions(dims, memMap, work, *resolved.sparse, options.rowReuse);
+        } else if (usesEpilogue(memMap, resolved)) {
+            core.instructions += rows * N * epilogueInstructionsPerElement(*resolved.epilogue);
+        }
+        // Each core loads its own copy of every LUT image after PROG; the
+        // invocations of a persistent kernel leave both to its setup program
+        if (options.part == PROGRAM_INVOCATION) {
+            core.instructions -= 1;
+        } else {
+            core.instructions += memMap.lutImages;
+        }
+        core.annotations = 1 + rows * (1 + elements);
+
+        uint64_t rowDigits = digitSum(work.startRow, work.endRow);
+        std::string header = "# Instructions for Core " + std::to_string(work.coreId) +
+                             " (Rows " + std::to_string(work.startRow) + " to " +
+                             std::to_string(work.endRow) + ")";
+        textBytes += 1 + header.size() + 1;
+        textBytes += rows * 18 + rowDigits;                           // "# Processing row i\n"
+        textBytes += rows * elements * 26 + elements * rowDigits + rows * columnDigits;  // "# Computing element C[i][j]\n"
+        textBytes += core.instructions * textInstructionBytes;
+
+        estimate.totalInstructions += core.instructions;
+        estimate.totalAnnotations += core.annotations;
+        estimate.parallelCycles = std::max(estimate.parallelCycles, core.instructions);
+        estimate.cores.push_back(core);
+    }
+
+    uint64_t headerBytes = (40 + 20 * static_cast<uint64_t>(assignments.size()) +
+                            containerHeaderBlock(options).size() + 7) & ~7ull;
+    estimate.textBytes = textBytes;
+    estimate.binaryBytes = headerBytes + estimate.totalInstructions * isa.instructionBytes();
+
+    // The simulator retires one instruction per cycle from a single stream
+    estimate.serialCycles = estimate.totalInstructions;
+    return estimate;
+}
+
+void printEstimate(const CompileEstimate& estimate) {
+    std::cout << "Compile estimate:" << std::endl;
+    for (const auto& core : estimate.cores) {
+        std::cout << "  Core " << core.coreId << " (Rows " << core.startRow << " to "
+                  << core.endRow << "): " << core.instructions << " instructions" << std::endl;
+    }
+    std::cout << "  Total instructions: " << estimate.totalInstructions << std::endl;
+    std::cout << "  Output size (text .pim): " << estimate.textBytes << " bytes" << std::endl;
+    std::cout << "  Output size (bin .pimb): " << estimate.binaryBytes << " bytes" << std::endl;
+    std::cout << "  Output size (loop .piml): not estimated, depends on how the records fold"
+              << std::endl;
+    std::cout << "  Predicted makespan (single controller stream): " << estimate.serialCycles
+              << " cycles" << std::endl;
+    std::cout << "  Predicted makespan (cores issuing in parallel): " << estimate.parallelCycles
+              << " cycles" << std::endl;
+}
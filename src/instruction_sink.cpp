@@ -0,0 +1,34 @@
+#include "pim_compiler.h"
+
+// Render a comment marker as the line that precedes its instruction
+std::string formatAnnotation(const Annotation& note) {
+    switch (note.kind) {
+        case NOTE_CORE_HEADER:
+            return "# Instructions for Core " + std::to_string(note.a) +
+                   " (Rows " + std::to_string(note.b) + " to " +
+                   std::to_string(note.c) + ")";
+        case NOTE_ROW:
+            return "# Processing row " + std::to_string(note.a);
+        case NOTE_ELEMENT:
+            return "# Computing element C[" + std::to_string(note.a) +
+                   "][" + std::to_string(note.b) + "]";
+    }
+    return "#";
+}
+
+void replayBuffer(const InstructionBuffer& buffer, InstructionSink& sink) {
+    size_t nextNote = 0;
+    const std::vector<Annotation>& notes = buffer.annotations;
+
+    for (size_t i = 0; i <= buffer.instructions.size(); i++) {
+        // Comments recorded before instruction i
+        while (nextNote < notes.size() && notes[nextNote].position == i) {
+            sink.annotate(notes[nextNote]);
+            nextNote++;
+        }
+        if (i == buffer.instructions.size()) {
+            break;
+        }
+        sink.emit(buffer.instructions[i]);
+    }
+}
@@ -0,0 +1,457 @@
+#include "pim_compiler.h"
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <cctype>
+
+IsaDescriptor defaultIsa() {
+    IsaDescriptor isa;
+    isa.name = "pim24";
+    isa.wordBits = 24;
+    isa.opcode = {17, 2};
+    isa.coreId = {11, 6};
+    isa.read = {10, 1};
+    isa.write = {9, 1};
+    isa.addr = {0, 9};
+    isa.broadcast = {0, 0};
+    isa.opcodeValues[OPCODE_NOOP] = 0;
+    isa.opcodeValues[OPCODE_PROG] = 1;
+    isa.opcodeValues[OPCODE_EXE] = 2;
+    isa.opcodeValues[OPCODE_END] = 3;
+    isa.memoryRowSize = MEMORY_ROW_SIZE;
+    isa.accumulators = 1;
+    return isa;
+}
+
+bool isaByName(const std::string& name, IsaDescriptor& out) {
+    if (name == "pim24") {
+        out = defaultIsa();
+        return true;
+    }
+    if (name == "pim24b") {
+        // pim24 with a broadcast bit in the otherwise unused bits above the opcode
+        out = defaultIsa();
+        out.name = "pim24b";
+        out.broadcast = {19, 1};
+        return true;
+    }
+    if (name == "pim32") {
+        // Full 32-bit word: 10-bit core pointer, 18-bit row address
+        out = defaultIsa();
+        out.name = "pim32";
+        out.wordBits = 32;
+        out.opcode = {30, 2};
+        out.coreId = {20, 10};
+        out.read = {19, 1};
+        out.write = {18, 1};
+        out.addr = {0, 18};
+        return true;
+    }
+    return false;
+}
+
+static bool parseField(const std::string& value, IsaField& field, bool singleBit) {
+    int shift = 0;
+    int width = 1;
+    char colon = 0;
+    std::istringstream in(value);
+    if (!(in >> shift)) {
+        return false;
+    }
+    if (!singleBit && !(in >> colon >> width && colon == ':')) {
+        return false;
+    }
+    field.shift = shift;
+    field.width = width;
+    return in.eof() || (in >> std::ws).eof();
+}
+
+static bool parseOpcodes(const std::string& value, uint32_t* codes) {
+    std::istringstream in(value);
+    for (int op = 0; op < 4; op++) {
+        long long code;
+        if (!(in >> code) || code < 0) {
+            return false;
+        }
+        codes[op] = static_cast<uint32_t>(code);
+        char comma;
+        if (op < 3 && !(in >> comma && comma == ',')) {
+            return false;
+        }
+    }
+    return (in >> std::ws).eof();
+}
+
+static bool applyIsaKey(const std::string& key, const std::string& value, IsaDescriptor& isa,
+                        std::string& error) {
+    bool ok = true;
+    if (key == "name") {
+        isa.name = value;
+    } else if (key == "word") {
+        ok = std::istringstream(value) >> isa.wordBits ? true : false;
+    } else if (key == "opcode") {
+        ok = parseField(value, isa.opcode, false);
+    } else if (key == "core") {
+        ok = parseField(value, isa.coreId, false);
+    } else if (key == "read") {
+        ok = parseField(value, isa.read, true);
+    } else if (key == "write") {
+        ok = parseField(value, isa.write, true);
+    } else if (key == "addr") {
+        ok = parseField(value, isa.addr, false);
+    } else if (key == "broadcast") {
+        ok = parseField(value, isa.broadcast, true);
+    } else if (key == "ops") {
+        ok = parseOpcodes(value, isa.opcodeValues);
+    } else if (key == "row") {
+        ok = std::istringstream(value) >> isa.memoryRowSize ? true : false;
+    } else if (key == "acc") {
+        ok = std::istringstream(value) >> isa.accumulators ? true : false;
+    } else {
+        error = "unknown ISA key '" + key + "'";
+        return false;
+    }
+    if (!ok) {
+        error = "bad value '" + value + "' for ISA key '" + key + "'";
+    }
+    return ok;
+}
+
+bool parseIsaDescription(const std::string& text, IsaDescriptor& out, std::string& error) {
+    IsaDescriptor isa = defaultIsa();
+    isa.name = "custom";
+    std::istringstream tokens(text);
+    std::string token;
+    while (tokens >> token) {
+        size_t equals = token.find('=');
+        if (equals == std::string::npos) {
+            error = "expected key=value, got '" + token + "'";
+            return false;
+        }
+        if (!applyIsaKey(token.substr(0, equals), token.substr(equals + 1), isa, error)) {
+            return false;
+        }
+    }
+    if (!validateIsa(isa, error)) {
+        return false;
+    }
+    out = isa;
+    return true;
+}
+
+std::string describeIsa(const IsaDescriptor& isa) {
+    std::ostringstream text;
+    text << "name=" << isa.name << " word=" << isa.wordBits
+         << " opcode=" << isa.opcode.shift << ":" << isa.opcode.width
+         << " core=" << isa.coreId.shift << ":" << isa.coreId.width
+         << " read=" << isa.read.shift << " write=" << isa.write.shift
+         << " addr=" << isa.addr.shift << ":" << isa.addr.width
+         << " ops=" << isa.opcodeValues[0] << "," << isa.opcodeValues[1] << ","
+         << isa.opcodeValues[2] << "," << isa.opcodeValues[3]
+         << " row=" << isa.memoryRowSize;
+    if (isa.hasBroadcast()) {
+        text << " broadcast=" << isa.broadcast.shift;
+    }
+    if (isa.accumulators != 1) {
+        text << " acc=" << isa.accumulators;
+    }
+    return text.str();
+}
+
+bool validateIsa(const IsaDescriptor& isa, std::string& error) {
+    if (isa.name.empty()) {
+        error = "ISA has no name";
+        return false;
+    }
+    if (isa.wordBits < 1 || isa.wordBits > 32) {
+        error = "word width must be 1 to 32 bits";
+        return false;
+    }
+
+    const IsaField* fields[] = {&isa.opcode, &isa.coreId, &isa.read, &isa.write, &isa.addr, &isa.broadcast};
+    const char* names[] = {"opcode", "core", "read", "write", "addr", "broadcast"};
+    int numFields = isa.hasBroadcast() ? 6 : 5;
+    uint64_t used = 0;
+    for (int f = 0; f < numFields; f++) {
+        const IsaField& field = *fields[f];
+        if (field.width < 1 || field.shift < 0 || field.shift + field.width > isa.wordBits) {
+            error = std::string(names[f]) + " field does not fit in a " +
+                    std::to_string(isa.wordBits) + "-bit word";
+            return false;
+        }
+        uint64_t bits = static_cast<uint64_t>(field.mask()) << field.shift;
+        if (used & bits) {
+            error = std::string(names[f]) + " field overlaps another field";
+            return false;
+        }
+        used |= bits;
+    }
+    if (isa.read.width != 1 || isa.write.width != 1 || isa.broadcast.width > 1) {
+        error = "read, write and broadcast fields must be single bits";
+        return false;
+    }
+
+    for (int op = 0; op < 4; op++) {
+        if (!isa.opcode.fits(isa.opcodeValues[op])) {
+            error = "opcode value " + std::to_string(isa.opcodeValues[op]) + " does not fit the opcode field";
+            return false;
+        }
+        for (int other = 0; other < op; other++) {
+            if (isa.opcodeValues[op] == isa.opcodeValues[other]) {
+                error = "opcode values must be distinct";
+                return false;
+            }
+        }
+    }
+
+    // Row offsets travel in the address field
+    if (isa.memoryRowSize < 1 || !isa.addr.fits(isa.memoryRowSize - 1)) {
+        error = "memory row size must be at least 1 and its offsets must fit the address field";
+        return false;
+    }
+    
+    // Operations name their accumulator in the address bits above the operation
+    if (isa.accumulators < 1 || !isa.addr.fits(exeOperand(EXE_OP_SELECT, isa.accumulators - 1))) {
+        error = "a core needs at least 1 accumulator, and every accumulator number must fit the address "
+                "field above the 2 operation bits";
+        return false;
+    }
+    return true;
+}
+
+bool isDefaultIsa(const IsaDescriptor& isa) {
+    return describeIsa(isa) == describeIsa(defaultIsa());
+}
+
+bool loadIsa(const std::string& nameOrPath, IsaDescriptor& out) {
+    if (isaByName(nameOrPath, out)) {
+        return true;
+    }
+
+    std::ifstream file(nameOrPath);
+    if (!file.is_open()) {
+        std::cerr << "Error: Unknown ISA '" << nameOrPath
+                  << "' (not a built-in name: pim24, pim24b, pim32; and no such file)" << std::endl;
+        return false;
+    }
+
+    // "key = value" per line; '#' starts a comment
+    std::string description;
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+        size_t equals = line.find('=');
+        if (equals == std::string::npos) {
+            continue;
+        }
+        std::string key = line.substr(0, equals);
+        std::string value = line.substr(equals + 1);
+        key.erase(std::remove_if(key.begin(), key.end(), ::isspace), key.end());
+        value.erase(std::remove_if(value.begin(), value.end(), ::isspace), value.end());
+        description += key + "=" + value + " ";
+    }
+
+    std::string error;
+    if (!parseIsaDescription(description, out, error)) {
+        std::cerr << "Error: Invalid ISA in " << nameOrPath << ": " << error << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static IsaDescriptor& activeIsaStorage() {
+    static IsaDescriptor isa = defaultIsa();
+    return isa;
+}
+
+const IsaDescriptor& activeIsa() {
+    return activeIsaStorage();
+}
+
+void setActiveIsa(const IsaDescriptor& isa) {
+    activeIsaStorage() = isa;
+}
+
+std::string layoutTokens(const CodegenOptions& options) {
+    std::string tokens;
+    if (options.tiling && isTiled(options.tiles)) {
+        tokens = "tiles=" + describeTilePlan(options.tiles);
+    }
+    if (options.schedule != SCHEDULE_CONCAT) {
+        tokens += (tokens.empty() ? "" : " ") + std::string("schedule=") + scheduleName(options.schedule);
+    }
+    if (options.lutPrecision > 0) {
+        tokens += (tokens.empty() ? "" : " ") + std::string("lut=") + std::to_string(options.lutPrecision);
+    }
+    if (isPacked(options.precision)) {
+        tokens += (tokens.empty() ? "" : " ") + std::string("precision=") +
+                  describeElementPrecision(options.precision);
+    }
+    if (options.weights && !options.weights->source.empty()) {
+        tokens += (tokens.empty() ? "" : " ") + std::string("weights=") + options.weights->source;
+    }
+    if (options.pipeline) {
+        tokens += (tokens.empty() ? "" : " ") + std::string("pipeline=") + describeLatencyModel(*options.pipeline);
+    }
+    if (options.part != PROGRAM_WHOLE) {
+        tokens += (tokens.empty() ? "" : " ") + std::string("persistent=") + programPartName(options.part);
+    }
+    if (options.sparse && options.sparse->sparseA()) {
+        tokens += (tokens.empty() ? "" : " ") + std::string("sparse-a=") + options.sparse->sourceA;
+    }
+    if (options.sparse && options.sparse->sparseB()) {
+        tokens += (tokens.empty() ? "" : " ") + std::string("sparse-b=") + options.sparse->sourceB;
+    }
+    if (options.epilogue && hasEpilogue(*options.epilogue)) {
+        tokens += (tokens.empty() ? "" : " ") + std::string("epilogue=") + describeEpilogue(*options.epilogue);
+    }
+    return tokens;
+}
+
+std::string containerHeaderBlock(const CodegenOptions& options) {
+    std::string block = isDefaultIsa(activeIsa()) ? "" : describeIsa(activeIsa());
+    std::string layout = layoutTokens(options);
+    if (!layout.empty()) {
+        block += (block.empty() ? "" : " ") + layout;
+    }
+    return block;
+}
+
+CodegenOptions ProgramLayout::options() const {
+    CodegenOptions options;
+    options.tiling = isTiled(tiles);
+    options.tiles = tiles;
+    options.schedule = schedule;
+    options.lutPrecision = lutPrecision;
+    options.precision = precision;
+    options.weights = weights.source.empty() ? nullptr : &weights;
+    options.pipeline = pipelined ? &pipeline : nullptr;
+    options.part = part;
+    options.sparse = isSparse(sparse) ? &sparse : nullptr;
+    options.epilogue = hasEpilogue(epilogue) ? &epilogue : nullptr;
+    return options;
+}
+
+bool applyContainerHeader(const char* begin, const char* end, ProgramLayout& layout) {
+    while (end > begin && end[-1] == '\0') {
+        end--;
+    }
+    
+    // The tile plan, schedule, LUT precision, packing, weight file, pipeline
+    // latencies, persistent kernel part, sparse pattern files and epilogue
+    // travel as their own tokens; everything else describes the ISA
+    std::istringstream tokens(std::string(begin, end));
+    std::string token;
+    std::string description;
+    layout = ProgramLayout();
+    while (tokens >> token) {
+        if (token.compare(0, 6, "tiles=") == 0) {
+            if (!parseTilePlan(token.substr(6), layout.tiles) || !isTiled(layout.tiles)) {
+                std::cerr << "Error: Invalid tile plan in program header: " << token << std::endl;
+                return false;
+            }
+        } else if (token.compare(0, 9, "schedule=") == 0) {
+            if (!parseSchedule(token.substr(9), layout.schedule)) {
+                std::cerr << "Error: Invalid schedule in program header: " << token << std::endl;
+                return false;
+            }
+        } else if (token.compare(0, 4, "lut=") == 0) {
+            if (!parseLutPrecision(token.substr(4), layout.lutPrecision)) {
+                std::cerr << "Error: Invalid LUT precision in program header: " << token << std::endl;
+                return false;
+            }
+        } else if (token.compare(0, 10, "precision=") == 0) {
+            if (!parseElementPrecision(token.substr(10), layout.precision)) {
+                std::cerr << "Error: Invalid precision in program header: " << token << std::endl;
+                return false;
+            }
+        } else if (token.compare(0, 8, "weights=") == 0) {
+            layout.weights.source = token.substr(8);
+        } else if (token.compare(0, 9, "pipeline=") == 0) {
+            std::string error;
+            if (!parseLatencyModel(token.substr(9), layout.pipeline, error)) {
+                std::cerr << "Error: Invalid pipeline latencies in program header: " << error << std::endl;
+                return false;
+            }
+            layout.pipelined = true;
+        } else if (token.compare(0, 11, "persistent=") == 0) {
+            if (!parseProgramPart(token.substr(11), layout.part) || layout.part == PROGRAM_WHOLE) {
+                std::cerr << "Error: Invalid persistent kernel part in program header: " << token << std::endl;
+                return false;
+            }
+        } else if (token.compare(0, 9, "sparse-a=") == 0) {
+            layout.sparse.sourceA = token.substr(9);
+        } else if (token.compare(0, 9, "sparse-b=") == 0) {
+            layout.sparse.sourceB = token.substr(9);
+        } else if (token.compare(0, 9, "epilogue=") == 0) {
+            std::string error;
+            if (!parseEpilogue(token.substr(9), layout.epilogue, error)) {
+                std::cerr << "Error: Invalid epilogue in program header: " << error << std::endl;
+                return false;
+            }
+        } else {
+            description += (description.empty() ? "" : " ") + token;
+        }
+    }
+    if (description.empty()) {
+        return true;
+    }
+    IsaDescriptor isa;
+    std::string error;
+    if (!parseIsaDescription(description, isa, error)) {
+        std::cerr << "Error: Invalid ISA in program header: " << error << std::endl;
+        return false;
+    }
+    setActiveIsa(isa);
+    return true;
+}
+
+bool checkProgramFitsIsa(const std::vector<WorkAssignment>& assignments,
+                         const MemoryMap& memMap, const MatrixDimensions& dims,
+                         std::string& error) {
+    const IsaDescriptor& isa = activeIsa();
+    for (const auto& work : assignments) {
+        if (!isa.coreId.fits(work.coreId)) {
+            error = "core " + std::to_string(work.coreId) + " exceeds the " +
+                    std::to_string(isa.maxCores()) + " cores addressable by ISA " + isa.name;
+            return false;
+        }
+    }
+
+    int64_t rowsC = (static_cast<int64_t>(dims.M) * dims.N + memMap.elementsPerRowC - 1) / memMap.elementsPerRowC;
+    if (memMap.tileK > 0) {
+        rowsC = static_cast<int64_t>((dims.M + memMap.tileM - 1) / memMap.tileM) *
+                ((dims.N + memMap.tileN - 1) / memMap.tileN);
+    }
+    int64_t lastRow = memMap.baseAddrC + std::max<int64_t>(rowsC, 1) - 1 + memMap.biasRows + memMap.outputStages +
+                      memMap.lutImages;
+    if (memMap.lutImages > 0 && isa.memoryRowSize < 256) {
+        error = "LUT images of 256 entries do not fit the " + std::to_string(isa.memoryRowSize) +
+                "-element memory rows of ISA " + isa.name;
+        return false;
+    }
+    if (!isa.addr.fits(lastRow)) {
+        error = "memory row " + std::to_string(lastRow) + " exceeds the " +
+                std::to_string(isa.maxRows()) + " rows addressable by ISA " + isa.name;
+        return false;
+    }
+    
+    // Offsets count elements, so a packed row needs offsets past its slots
+    if (memMap.tileK == 0) {
+        const int64_t sizes[] = {static_cast<int64_t>(dims.M) * dims.K, static_cast<int64_t>(dims.K) * dims.N,
+                                 static_cast<int64_t>(dims.M) * dims.N};
+        const int64_t perRow[] = {memMap.elementsPerRowA, memMap.elementsPerRowB, memMap.elementsPerRowC};
+        for (int m = 0; m < 3; m++) {
+            int64_t lastOffset = std::min(sizes[m], perRow[m]) - 1;
+            if (!isa.addr.fits(lastOffset)) {
+                error = "offset " + std::to_string(lastOffset) + " of a packed memory row exceeds the " +
+                        std::to_string(isa.maxRows()) + " offsets addressable by ISA " + isa.name;
+                return false;
+            }
+        }
+    }
+    return true;
+}
@@ -1,83 +1,106 @@
 #include "pim_compiler.h"
+#include <atomic>
 #include <cstdint>
 #include <iomanip>
+#include <iostream>
 #include <sstream>
 
-// Helper function to convert a 24-bit value to a 6-character hex string
+// Encoders run on several threads under -j
+static std::atomic<size_t> overflowCount(0);
+
+size_t isaOverflowCount() {
+    return overflowCount.load();
+}
+
+// Report the first few values that do not fit; the driver fails the compile
+static void reportOverflow(const char* field, int value) {
+    size_t seen = overflowCount++;
+    if (seen < 5) {
+        const IsaDescriptor& isa = activeIsa();
+        std::cerr << "Error: " << field << " value " << value << " does not fit ISA " << isa.name
+                  << std::endl;
+    }
+}
+
+// Helper function to convert an instruction word to a hex string of the ISA's width
 std::string to_hex_string(int value) {
+    const IsaDescriptor& isa = activeIsa();
+    uint32_t mask = isa.wordBits >= 32 ? 0xFFFFFFFFu : ((1u << isa.wordBits) - 1);
     std::stringstream ss;
-    ss << std::hex << std::setw(6) << std::setfill('0') << (value & 0xFFFFFF);
+    ss << std::hex << std::setw(isa.hexDigits()) << std::setfill('0') << (static_cast<uint32_t>(value) & mask);
     return ss.str();
 }
 
-// Generate a NoOp instruction
-std::string genNoOpInstr() {
-    // Instruction format: 00 in bits 18-17 (NoOp)
-    uint32_t instruction = 0;
+// Place each field where the active ISA puts it
+static Instruction encode(int opcode, int coreId, bool read, bool write, int addr) {
+    const IsaDescriptor& isa = activeIsa();
     
-    // Build instruction - NoOp is 00 in bits 18-17
-    instruction |= (0 << 17);  // Type: NoOp = 00 at bits 18-17
+    // Values that do not fit are reported rather than silently wrapped
+    if (!isa.coreId.fits(coreId)) {
+        reportOverflow("core pointer", coreId);
+    }
+    if (!isa.addr.fits(addr)) {
+        reportOverflow("address", addr);
+    }
     
-    // Convert to hex string
-    return to_hex_string(instruction);
+    uint32_t instruction = 0;
+    instruction |= isa.opcodeValues[opcode] << isa.opcode.shift;
+    instruction |= (static_cast<uint32_t>(coreId) & isa.coreId.mask()) << isa.coreId.shift;
+    instruction |= (read ? 1u : 0u) << isa.read.shift;
+    instruction |= (write ? 1u : 0u) << isa.write.shift;
+    instruction |= (static_cast<uint32_t>(addr) & isa.addr.mask()) << isa.addr.shift;
+    return Instruction(instruction);
+}
+
+// Generate a NoOp instruction
+Instruction genNoOpInstr(int coreId) {
+    // NoOp is 00 in bits 18-17 under the default ISA
+    return encode(OPCODE_NOOP, coreId, false, false, 0);
 }
 
 // Generate a PROG instruction - used to program a core
-std::string genProgInstr(int coreId, bool read, bool write, int addr) {
-    // Instruction format: 01 in bits 18-17 (PROG)
-    uint32_t instruction = 0;
-    
-    // Ensure values are within valid ranges
-    coreId &= 0x3F;     // 6 bits for core pointer
-    addr &= 0x1FF;      // 9 bits for address
-    
-    // Build instruction
-    instruction |= (1 << 17);                // Type: PROG = 01 (bit 17 set, bit 18 unset)
-    instruction |= (coreId << 11);           // 6-bit pointer field at bits 16-11
-    instruction |= ((read ? 1 : 0) << 10);   // Read bit at bit 10
-    instruction |= ((write ? 1 : 0) << 9);   // Write bit at bit 9
-    instruction |= addr;                     // 9-bit address at bits 8-0
-    
-    // Convert to hex string
-    return to_hex_string(instruction);
+Instruction genProgInstr(int coreId, bool read, bool write, int addr) {
+    // PROG is 01 in bits 18-17 under the default ISA
+    return encode(OPCODE_PROG, coreId, read, write, addr);
 }
 
 // Generate an EXE instruction - used to execute an operation
-std::string genExeInstr(int coreId, bool read, bool write, int addr) {
-    // Instruction format: 10 in bits 18-17 (EXE)
-    uint32_t instruction = 0;
-    
-    // Ensure values are within valid ranges
-    coreId &= 0x3F;     // 6 bits for core pointer
-    addr &= 0x1FF;      // 9 bits for address
-    
-    // Build instruction
-    instruction |= (2 << 17);                // Type: EXE = 10 (bit 18 set, bit 17 unset)
-    instruction |= (coreId << 11);           // 6-bit pointer field at bits 16-11
-    instruction |= ((read ? 1 : 0) << 10);   // Read bit at bit 10
-    instruction |= ((write ? 1 : 0) << 9);   // Write bit at bit 9
-    instruction |= addr;                     // 9-bit address at bits 8-0
-    
-    // Convert to hex string
-    return to_hex_string(instruction);
+Instruction genExeInstr(int coreId, bool read, bool write, int addr) {
+    // EXE is 10 in bits 18-17 under the default ISA
+    return encode(OPCODE_EXE, coreId, read, write, addr);
 }
 
 // Generate an END instruction - terminates an operation
-std::string genEndInstr(int coreId, bool read, bool write, int addr) {
-    // Instruction format: 11 in bits 18-17 (END)
-    uint32_t instruction = 0;
-    
-    // Ensure values are within valid ranges
-    coreId &= 0x3F;     // 6 bits for core pointer
-    addr &= 0x1FF;      // 9 bits for address
-    
-    // Build instruction
-    instruction |= (3 << 17);                // Type: END = 11 (both bits 17 and 18 set)
-    instruction |= (coreId << 11);           // 6-bit pointer field at bits 16-11
-    instruction |= ((read ? 1 : 0) << 10);   // Read bit at bit 10
-    instruction |= ((write ? 1 : 0) << 9);   // Write bit at bit 9
-    instruction |= addr;                     // 9-bit address at bits 8-0
-    
-    // Convert to hex string
-    return to_hex_string(instruction);
-}
\ No newline at end of file
+Instruction genEndInstr(int coreId, bool read, bool write, int addr) {
+    // END is 11 in bits 18-17 under the default ISA
+    return encode(OPCODE_END, coreId, read, write, addr);
+}
+
+// Generate a parking END - stops a core that stays programmed
+Instruction genParkInstr(int coreId) {
+    return encode(OPCODE_END, coreId, true, false, 0);
+}
+
+// Generate an output stage - runs the epilogue parameters in `row` on the accumulator
+Instruction genOutputStageInstr(int coreId, int row) {
+    return encode(OPCODE_PROG, coreId, false, true, row);
+}
+
+bool isOutputStage(Instruction instr) {
+    return instr.opcode() == OPCODE_PROG && !instr.read() && instr.write();
+}
+
+Instruction retargetInstr(Instruction instr, int coreId, bool broadcast) {
+    const IsaDescriptor& isa = activeIsa();
+    if (!isa.coreId.fits(coreId)) {
+        reportOverflow("core pointer", coreId);
+    }
+    uint32_t word = instr.word;
+    word &= ~(isa.coreId.mask() << isa.coreId.shift);
+    word &= ~(isa.broadcast.mask() << isa.broadcast.shift);
+    word |= (static_cast<uint32_t>(coreId) & isa.coreId.mask()) << isa.coreId.shift;
+    if (broadcast) {
+        word |= isa.broadcast.mask() << isa.broadcast.shift;
+    }
+    return Instruction(word);
+}
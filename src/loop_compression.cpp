@@ -0,0 +1,483 @@
+#include "pim_compiler.h"
+#include <fstream>
+#include <iostream>
+
+// Only the address field (as placed by the active ISA) varies between
+// repeats; every other bit must match
+static uint32_t addrFieldBits() {
+    const IsaField& field = activeIsa().addr;
+    return field.mask() << field.shift;
+}
+
+static uint32_t addrOf(uint32_t word) {
+    return activeIsa().addr.get(word);
+}
+
+static uint32_t withAddr(uint32_t word, uint32_t addr) {
+    const IsaField& field = activeIsa().addr;
+    return (word & ~addrFieldBits()) | ((addr & field.mask()) << field.shift);
+}
+
+// Longest repeat body (in tokens) the compressor searches for
+static const size_t MAX_PERIOD = 8;
+
+// Repeat nesting depth; one level per loop of the generated program
+static const int MAX_LEVELS = 4;
+
+static const uint32_t REPEAT_TAG = 0x80000000u;
+
+static LoopToken makeLeaf(uint32_t word) {
+    LoopToken token;
+    token.repeat = false;
+    token.word = word;
+    token.count = 1;
+    token.leaves = 1;
+    return token;
+}
+
+// Two tokens can be repeats of each other if they differ only in leaf addresses
+static bool sameShape(const LoopToken& a, const LoopToken& b) {
+    if (a.repeat != b.repeat) {
+        return false;
+    }
+    if (!a.repeat) {
+        return (a.word & ~addrFieldBits()) == (b.word & ~addrFieldBits());
+    }
+    if (a.count != b.count || a.body.size() != b.body.size() || a.strides != b.strides) {
+        return false;
+    }
+    for (size_t t = 0; t < a.body.size(); t++) {
+        if (!sameShape(a.body[t], b.body[t])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Append the base address of every leaf in preorder
+static void leafAddresses(const LoopToken& token, std::vector<int32_t>& out) {
+    if (!token.repeat) {
+        out.push_back(static_cast<int32_t>(addrOf(token.word)));
+        return;
+    }
+    for (const LoopToken& child : token.body) {
+        leafAddresses(child, out);
+    }
+}
+
+// 32-bit words this token occupies in the encoded stream
+static size_t encodedWords(const LoopToken& token) {
+    if (!token.repeat) {
+        return 1;
+    }
+    size_t words = 2 + token.leaves;
+    for (const LoopToken& child : token.body) {
+        words += encodedWords(child);
+    }
+    return words;
+}
+
+// One pass of repeat detection over a token list: a run of `count` copies of a
+// `period`-token body, where each leaf address moves by a fixed stride per copy
+static std::vector<LoopToken> compressLevel(const std::vector<LoopToken>& tokens) {
+    std::vector<LoopToken> out;
+    std::vector<int32_t> base;
+    std::vector<int32_t> next;
+    std::vector<int32_t> stride;
+
+    size_t i = 0;
+    while (i < tokens.size()) {
+        size_t bestPeriod = 0;
+        size_t bestCount = 0;
+        long bestGain = 0;
+        std::vector<int32_t> bestStride;
+
+        for (size_t period = 1; period <= MAX_PERIOD && i + 2 * period <= tokens.size(); period++) {
+            base.clear();
+            for (size_t t = 0; t < period; t++) {
+                leafAddresses(tokens[i + t], base);
+            }
+
+            // The second copy fixes the stride; later copies must follow it
+            size_t count = 1;
+            while (i + (count + 1) * period <= tokens.size()) {
+                size_t start = i + count * period;
+                bool matches = true;
+                for (size_t t = 0; t < period && matches; t++) {
+                    matches = sameShape(tokens[i + t], tokens[start + t]);
+                }
+                if (!matches) {
+                    break;
+                }
+                next.clear();
+                for (size_t t = 0; t < period; t++) {
+                    leafAddresses(tokens[start + t], next);
+                }
+                if (count == 1) {
+                    stride.resize(base.size());
+                    for (size_t l = 0; l < base.size(); l++) {
+                        stride[l] = next[l] - base[l];
+                    }
+                } else {
+                    for (size_t l = 0; l < base.size() && matches; l++) {
+                        matches = next[l] == base[l] + static_cast<int32_t>(count) * stride[l];
+                    }
+                    if (!matches) {
+                        break;
+                    }
+                }
+                count++;
+            }
+            if (count < 2) {
+                continue;
+            }
+
+            size_t bodyWords = 0;
+            for (size_t t = 0; t < period; t++) {
+                bodyWords += encodedWords(tokens[i + t]);
+            }
+            long gain = static_cast<long>((count - 1) * bodyWords) - static_cast<long>(2 + base.size());
+            if (gain > bestGain) {
+                bestGain = gain;
+                bestPeriod = period;
+                bestCount = count;
+                bestStride = stride;
+            }
+        }
+
+        if (bestPeriod == 0) {
+            out.push_back(tokens[i]);
+            i++;
+            continue;
+        }
+
+        LoopToken record;
+        record.repeat = true;
+        record.word = 0;
+        record.count = static_cast<uint32_t>(bestCount);
+        record.body.assign(tokens.begin() + i, tokens.begin() + i + bestPeriod);
+        record.strides = bestStride;
+        record.leaves = static_cast<uint32_t>(bestStride.size());
+        out.push_back(record);
+        i += bestPeriod * bestCount;
+    }
+    return out;
+}
+
+std::vector<LoopToken> compressLoops(const std::vector<Instruction>& instructions) {
+    std::vector<LoopToken> tokens;
+    tokens.reserve(instructions.size());
+    for (const Instruction& instr : instructions) {
+        tokens.push_back(makeLeaf(instr.word));
+    }
+
+    // Each pass folds one more loop level into repeat records
+    for (int level = 0; level < MAX_LEVELS; level++) {
+        size_t before = tokens.size();
+        tokens = compressLevel(tokens);
+        if (tokens.size() == before) {
+            break;
+        }
+    }
+    return tokens;
+}
+
+// Emit a token's expansion; `offsets` holds the extra address for each of its leaves
+static void expandToken(const LoopToken& token, const int32_t* offsets, InstructionSink& sink) {
+    if (!token.repeat) {
+        sink.emit(Instruction(withAddr(token.word, addrOf(token.word) + offsets[0])));
+        return;
+    }
+
+    std::vector<int32_t> current(offsets, offsets + token.leaves);
+    for (uint32_t r = 0; r < token.count; r++) {
+        const int32_t* childOffsets = current.data();
+        for (const LoopToken& child : token.body) {
+            expandToken(child, childOffsets, sink);
+            childOffsets += child.leaves;
+        }
+        for (uint32_t l = 0; l < token.leaves; l++) {
+            current[l] += token.strides[l];
+        }
+    }
+}
+
+void expandLoops(const std::vector<LoopToken>& tokens, InstructionSink& sink) {
+    const int32_t zero = 0;
+    std::vector<int32_t> offsets;
+    for (const LoopToken& token : tokens) {
+        if (!token.repeat) {
+            expandToken(token, &zero, sink);
+            continue;
+        }
+        offsets.assign(token.leaves, 0);
+        expandToken(token, offsets.data(), sink);
+    }
+}
+
+// Token lists are stored as chunks: a literal run (tag = n, then n words) or a
+// repeat (tag = REPEAT_TAG | body tokens, count, body chunks, one stride per leaf)
+void encodeLoops(const std::vector<LoopToken>& tokens, std::vector<uint32_t>& out) {
+    size_t i = 0;
+    while (i < tokens.size()) {
+        if (!tokens[i].repeat) {
+            size_t runStart = i;
+            while (i < tokens.size() && !tokens[i].repeat) {
+                i++;
+            }
+            out.push_back(static_cast<uint32_t>(i - runStart));
+            for (size_t t = runStart; t < i; t++) {
+                out.push_back(tokens[t].word);
+            }
+            continue;
+        }
+
+        const LoopToken& record = tokens[i];
+        out.push_back(REPEAT_TAG | static_cast<uint32_t>(record.body.size()));
+        out.push_back(record.count);
+        encodeLoops(record.body, out);
+        for (int32_t stride : record.strides) {
+            out.push_back(static_cast<uint32_t>(stride));
+        }
+        i++;
+    }
+}
+
+// Read chunks until `numTokens` tokens are decoded; returns false on truncated input
+static bool decodeTokens(const uint32_t*& data, const uint32_t* end, size_t numTokens,
+                         std::vector<LoopToken>& out) {
+    size_t decoded = 0;
+    while (decoded < numTokens) {
+        if (data >= end) {
+            return false;
+        }
+        uint32_t tag = *data++;
+
+        if ((tag & REPEAT_TAG) == 0) {
+            // The encoder never writes an empty literal run
+            if (tag == 0 || static_cast<size_t>(end - data) < tag) {
+                return false;
+            }
+            for (uint32_t w = 0; w < tag; w++) {
+                out.push_back(makeLeaf(*data++));
+            }
+            decoded += tag;
+            continue;
+        }
+
+        if (data >= end) {
+            return false;
+        }
+        LoopToken record;
+        record.repeat = true;
+        record.word = 0;
+        record.count = *data++;
+        if (!decodeTokens(data, end, tag & ~REPEAT_TAG, record.body)) {
+            return false;
+        }
+        record.leaves = 0;
+        for (const LoopToken& child : record.body) {
+            record.leaves += child.leaves;
+        }
+        if (static_cast<size_t>(end - data) < record.leaves) {
+            return false;
+        }
+        for (uint32_t l = 0; l < record.leaves; l++) {
+            record.strides.push_back(static_cast<int32_t>(*data++));
+        }
+        out.push_back(record);
+        decoded++;
+    }
+    return true;
+}
+
+bool decodeLoops(const uint32_t* data, size_t numWords, std::vector<LoopToken>& out) {
+    const uint32_t* end = data + numWords;
+    while (data < end) {
+        // Top level: decode one chunk at a time until the stream is consumed
+        uint32_t tag = *data;
+        if (tag == 0) {
+            // An empty literal run would decode nothing and never advance
+            return false;
+        }
+        size_t tokens = (tag & REPEAT_TAG) ? 1 : tag;
+        if (!decodeTokens(data, end, tokens, out)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Append a little-endian uint32 to a byte buffer
+static void putU32(std::vector<char>& bytes, uint32_t value) {
+    bytes.push_back(static_cast<char>(value & 0xFF));
+    bytes.push_back(static_cast<char>((value >> 8) & 0xFF));
+    bytes.push_back(static_cast<char>((value >> 16) & 0xFF));
+    bytes.push_back(static_cast<char>((value >> 24) & 0xFF));
+}
+
+static uint32_t getU32(const std::vector<char>& bytes, size_t offset) {
+    return static_cast<uint32_t>(static_cast<unsigned char>(bytes[offset])) |
+           (static_cast<uint32_t>(static_cast<unsigned char>(bytes[offset + 1])) << 8) |
+           (static_cast<uint32_t>(static_cast<unsigned char>(bytes[offset + 2])) << 16) |
+           (static_cast<uint32_t>(static_cast<unsigned char>(bytes[offset + 3])) << 24);
+}
+
+// Fixed header, core table and description block, padded to an 8-byte boundary
+static size_t loopHeaderSize(size_t numCores, size_t isaBytes) {
+    size_t headerSize = 40 + 24 * numCores + isaBytes;
+    return (headerSize + 7) & ~static_cast<size_t>(7);
+}
+
+LoopFileSink::LoopFileSink(const std::string& filename, const MatrixDimensions& dims,
+                           const std::vector<WorkAssignment>& assignments, const CodegenOptions& options)
+    : out(filename, std::ios::binary), dimensions(dims), cores(assignments),
+      firstInstr(assignments.size(), 0), counts(assignments.size(), 0),
+      recordOffsets(assignments.size(), 0), headerBlock(containerHeaderBlock(options)), total(0),
+      recordWords(0), current(-1) {
+    if (!out.is_open()) {
+        std::cerr << "Error: Could not open output file " << filename << std::endl;
+        return;
+    }
+    // Reserve the header; finish() writes it once totals are known
+    std::vector<char> header(loopHeaderSize(cores.size(), headerBlock.size()), 0);
+    out.write(header.data(), header.size());
+}
+
+void LoopFileSink::beginCore(const WorkAssignment& work) {
+    current = -1;
+    for (size_t c = 0; c < cores.size(); c++) {
+        if (cores[c].coreId == work.coreId) {
+            current = static_cast<int>(c);
+        }
+    }
+    program.clear();
+}
+
+void LoopFileSink::emit(Instruction instr) {
+    program.push_back(instr);
+}
+
+void LoopFileSink::endCore() {
+    // A core's program is compressed as a unit and written out before the next begins
+    std::vector<uint32_t> encoded;
+    encodeLoops(compressLoops(program), encoded);
+
+    if (current >= 0) {
+        firstInstr[current] = total;
+        counts[current] = static_cast<uint32_t>(program.size());
+        recordOffsets[current] = recordWords * 4;
+    }
+    total += static_cast<uint32_t>(program.size());
+    recordWords += static_cast<uint32_t>(encoded.size());
+
+    std::vector<char> bytes;
+    bytes.reserve(encoded.size() * 4);
+    for (uint32_t word : encoded) {
+        putU32(bytes, word);
+    }
+    out.write(bytes.data(), bytes.size());
+    program.clear();
+    program.shrink_to_fit();
+}
+
+bool LoopFileSink::finish() {
+    uint32_t headerSize = static_cast<uint32_t>(loopHeaderSize(cores.size(), headerBlock.size()));
+    std::vector<char> header;
+    putU32(header, PIML_MAGIC);
+    putU32(header, PIML_VERSION);
+    putU32(header, headerSize);
+    putU32(header, dimensions.M);
+    putU32(header, dimensions.K);
+    putU32(header, dimensions.N);
+    putU32(header, static_cast<uint32_t>(cores.size()));
+    putU32(header, total);
+    putU32(header, activeIsa().instructionBytes());
+    putU32(header, recordWords * 4);
+    for (size_t c = 0; c < cores.size(); c++) {
+        putU32(header, cores[c].coreId);
+        putU32(header, cores[c].startRow);
+        putU32(header, cores[c].endRow);
+        putU32(header, firstInstr[c]);
+        putU32(header, counts[c]);
+        putU32(header, recordOffsets[c]);
+    }
+    header.insert(header.end(), headerBlock.begin(), headerBlock.end());
+    out.seekp(0);
+    out.write(header.data(), header.size());
+    out.close();
+
+    std::cout << "Loop-compressed program: " << total << " instructions in "
+              << (headerSize + recordWords * 4) << " bytes" << std::endl;
+    return !out.fail();
+}
+
+bool readLoopProgram(const std::string& filename, LoopProgram& program) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in.is_open()) {
+        std::cerr << "Error: Could not open file " << filename << std::endl;
+        return false;
+    }
+    std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (bytes.size() < 40 || getU32(bytes, 0) != PIML_MAGIC) {
+        std::cerr << "Error: " << filename << " is not a loop-compressed program" << std::endl;
+        return false;
+    }
+    if (getU32(bytes, 4) != PIML_VERSION) {
+        std::cerr << "Error: Unsupported loop-compressed program version " << getU32(bytes, 4) << std::endl;
+        return false;
+    }
+
+    // Sizes are checked in size_t so that no field can wrap them
+    size_t headerSize = getU32(bytes, 8);
+    program.dims.M = getU32(bytes, 12);
+    program.dims.K = getU32(bytes, 16);
+    program.dims.N = getU32(bytes, 20);
+    size_t numCores = getU32(bytes, 24);
+    size_t streamBytes = getU32(bytes, 36);
+    if (headerSize < loopHeaderSize(numCores, 0) || bytes.size() < headerSize + streamBytes) {
+        std::cerr << "Error: Truncated loop-compressed program " << filename << std::endl;
+        return false;
+    }
+    // Records are laid out for the ISA the program was compiled for
+    if (!applyContainerHeader(bytes.data() + 40 + 24 * numCores, bytes.data() + headerSize, program.layout)) {
+        return false;
+    }
+
+    program.assignments.clear();
+    program.cores.clear();
+    std::vector<size_t> offsets;
+    for (size_t c = 0; c < numCores; c++) {
+        size_t entry = 40 + 24 * c;
+        WorkAssignment work;
+        work.coreId = getU32(bytes, entry);
+        work.startRow = getU32(bytes, entry + 4);
+        work.endRow = getU32(bytes, entry + 8);
+        program.assignments.push_back(work);
+        offsets.push_back(getU32(bytes, entry + 20));
+    }
+    offsets.push_back(streamBytes);
+
+    // Each core's records run up to the next core's offset
+    for (size_t c = 0; c < numCores; c++) {
+        if (offsets[c] > offsets[c + 1]) {
+            std::cerr << "Error: Core table of " << filename << " has records out of order or past the "
+                      << streamBytes << "-byte record stream" << std::endl;
+            return false;
+        }
+    }
+    for (size_t c = 0; c < numCores; c++) {
+        size_t begin = offsets[c];
+        size_t end = offsets[c + 1];
+        std::vector<uint32_t> words;
+        for (size_t b = begin; b + 4 <= end; b += 4) {
+            words.push_back(getU32(bytes, headerSize + b));
+        }
+        program.cores.push_back(std::vector<LoopToken>());
+        if (!decodeLoops(words.data(), words.size(), program.cores.back())) {
+            std::cerr << "Error: Corrupt records for core " << program.assignments[c].coreId << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,441 @@
+#include "pim_compiler.h"
+#include <unordered_map>
+
+const char* loopOrderName(LoopOrder order) {
+    switch (order) {
+        case LOOP_ORDER_AUTO: return "auto";
+        case LOOP_ORDER_IJK: return "ijk";
+        case LOOP_ORDER_IKJ: return "ikj";
+        case LOOP_ORDER_BLOCKED: return "blocked";
+        case LOOP_ORDER_KJI: return "kji";
+        default: return "?";
+    }
+}
+
+bool parseLoopOrder(const std::string& name, LoopOrder& out) {
+    const LoopOrder orders[] = {LOOP_ORDER_AUTO, LOOP_ORDER_IJK, LOOP_ORDER_IKJ, LOOP_ORDER_BLOCKED,
+                                LOOP_ORDER_KJI};
+    for (LoopOrder order : orders) {
+        if (name == loopOrderName(order)) {
+            out = order;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* dataflowName(Dataflow dataflow) {
+    switch (dataflow) {
+        case DATAFLOW_ANY: return "any";
+        case DATAFLOW_OUTPUT: return "output";
+        case DATAFLOW_INPUT: return "input";
+        case DATAFLOW_WEIGHT: return "weight";
+        default: return "?";
+    }
+}
+
+bool parseDataflow(const std::string& name, Dataflow& out) {
+    const Dataflow dataflows[] = {DATAFLOW_ANY, DATAFLOW_OUTPUT, DATAFLOW_INPUT, DATAFLOW_WEIGHT};
+    for (Dataflow dataflow : dataflows) {
+        if (name == dataflowName(dataflow)) {
+            out = dataflow;
+            return true;
+        }
+    }
+    return false;
+}
+
+Dataflow dataflowOf(LoopOrder order) {
+    switch (order) {
+        case LOOP_ORDER_IJK: return DATAFLOW_OUTPUT;
+        case LOOP_ORDER_IKJ:
+        case LOOP_ORDER_BLOCKED: return DATAFLOW_INPUT;
+        case LOOP_ORDER_KJI: return DATAFLOW_WEIGHT;
+        default: return DATAFLOW_ANY;
+    }
+}
+
+int blockColumnsFor(const MatrixDimensions& dims, const CodegenOptions& options) {
+    int columns = options.blockColumns > 0 ? options.blockColumns : activeIsa().memoryRowSize;
+    return std::max(1, std::min(columns, dims.N));
+}
+
+// The rows one subarray is asked for, in order: the first and last row and
+// how often the row changes in between
+struct RowRun {
+    int64_t first = -1;
+    int64_t last = -1;
+    uint64_t changes = 0;
+
+    void visit(int64_t row) {
+        if (first < 0) {
+            first = row;
+        } else if (row != last) {
+            changes++;
+        }
+        last = row;
+    }
+    void append(const RowRun& next) {
+        if (next.first < 0) {
+            return;
+        }
+        if (first < 0) {
+            *this = next;
+            return;
+        }
+        changes += next.changes + (next.first != last ? 1 : 0);
+        last = next.last;
+    }
+    RowRun repeated(uint64_t times) const {
+        RowRun run = *this;
+        if (first >= 0 && times > 0) {
+            run.changes = times * changes + (times - 1) * (first != last ? 1 : 0);
+        }
+        return run;
+    }
+    // The first access opens a row, each change opens another
+    uint64_t activations() const { return first < 0 ? 0 : 1 + changes; }
+};
+
+int blockEnd(int i, int jBlock, const MatrixDimensions& dims, const MemoryMap& memMap, int blockColumns) {
+    const int64_t rowSize = memMap.elementsPerRowC;
+    int64_t cIndex = static_cast<int64_t>(i) * memMap.rowSizeC + jBlock;
+    int64_t rowEnd = jBlock + (rowSize - cIndex % rowSize);
+    return static_cast<int>(std::min<int64_t>(std::min(jBlock + blockColumns, dims.N), rowEnd));
+}
+
+int segmentEnd(int i, int k, const MatrixDimensions& dims, const MemoryMap& memMap) {
+    const int64_t rowSize = memMap.elementsPerRowA;
+    int64_t aIndex = static_cast<int64_t>(i) * memMap.rowSizeA + k;
+    return static_cast<int>(std::min<int64_t>(dims.K, k + (rowSize - aIndex % rowSize)));
+}
+
+int segmentsInRow(int i, const MatrixDimensions& dims, const MemoryMap& memMap) {
+    const int64_t rowSize = memMap.elementsPerRowA;
+    int64_t rowStart = static_cast<int64_t>(i) * memMap.rowSizeA;
+    return static_cast<int>((rowStart + dims.K - 1) / rowSize - rowStart / rowSize + 1);
+}
+
+// Rows touched walking elements [first, end) of a matrix stored from row `base`
+static RowRun sweep(int64_t base, int64_t first, int64_t end, int64_t rowSize) {
+    RowRun run;
+    if (first < end) {
+        run.first = base + first / rowSize;
+        run.last = base + (end - 1) / rowSize;
+        run.changes = static_cast<uint64_t>(run.last - run.first);
+    }
+    return run;
+}
+
+// B rows for columns [j0, j1) of every row k of B, k outermost
+static RowRun sweepB(const MatrixDimensions& dims, const MemoryMap& memMap, int j0, int j1) {
+    RowRun run;
+    for (int k = 0; k < dims.K; k++) {
+        int64_t rowStart = static_cast<int64_t>(k) * memMap.rowSizeB;
+        run.append(sweep(memMap.baseAddrB, rowStart + j0, rowStart + j1, memMap.elementsPerRowB));
+    }
+    return run;
+}
+
+uint64_t countRowActivations(const MatrixDimensions& dims,
+                             const std::vector<WorkAssignment>& assignments,
+                             const MemoryMap& memMap, LoopOrder order, int blockColumns) {
+    // Elements per memory row of A, B and C (more than the row size when packed)
+    const int64_t rowA = memMap.elementsPerRowA;
+    const int64_t rowB = memMap.elementsPerRowB;
+    const int64_t rowC = memMap.elementsPerRowC;
+    const int N = dims.N;
+    const int K = dims.K;
+
+    // ijk walks each column of B, the same way for every output row
+    RowRun bColumns;
+    if (order == LOOP_ORDER_IJK && memMap.rowsPerMatrixRowA <= 1) {
+        for (int j = 0; j < N; j++) {
+            for (int k = 0; k < K; k++) {
+                bColumns.visit(memMap.baseAddrB + (static_cast<int64_t>(k) * memMap.rowSizeB + j) / rowB);
+            }
+        }
+    }
+    RowRun bRows = order == LOOP_ORDER_IKJ || order == LOOP_ORDER_KJI ? sweepB(dims, memMap, 0, N)
+                                                                      : RowRun();
+
+    // Blocked: a row's blocks depend only on where it starts within a C row
+    std::unordered_map<int64_t, RowRun> bBlocksByPhase;
+    
+    // Segmented ijk: each segment walks its slice of every column of B. The
+    // segments depend only on where the row starts within an A row.
+    const bool segmented = memMap.rowsPerMatrixRowA > 1;
+    std::unordered_map<int64_t, RowRun> bSlicesByPhase;
+
+    uint64_t activations = 0;
+    for (const auto& work : assignments) {
+        RowRun a;
+        RowRun b;
+        RowRun c;
+        if (order == LOOP_ORDER_KJI) {
+            // B once in storage order; for each (k, j) the core's rows walk
+            // column k of A and column j of C
+            b = bRows;
+            for (int k = 0; k < K; k++) {
+                RowRun column;
+                for (int i = work.startRow; i <= work.endRow; i++) {
+                    column.visit(memMap.baseAddrA + (static_cast<int64_t>(i) * memMap.rowSizeA + k) / rowA);
+                }
+                a.append(column.repeated(N));
+            }
+            RowRun columns;
+            for (int j = 0; j < N; j++) {
+                for (int i = work.startRow; i <= work.endRow; i++) {
+                    columns.visit(memMap.baseAddrC + (static_cast<int64_t>(i) * memMap.rowSizeC + j) / rowC);
+                }
+            }
+            c = columns.repeated(K);
+            activations += a.activations() + b.activations() + c.activations();
+            continue;
+        }
+        for (int i = work.startRow; i <= work.endRow; i++) {
+            // Segments are loaded in order, each from its own memory row; the
+            // blocked order loads them again for every block
+            int64_t aStart = static_cast<int64_t>(i) * memMap.rowSizeA;
+            RowRun aRow = sweep(memMap.baseAddrA, aStart, aStart + (segmented ? K : 1), rowA);
+            if (order != LOOP_ORDER_BLOCKED) {
+                a.append(aRow);
+            }
+
+            int64_t cStart = static_cast<int64_t>(i) * memMap.rowSizeC;
+            if (order == LOOP_ORDER_IJK && segmented) {
+                // Each segment goes over the whole C row again
+                int64_t phase = aStart % rowA;
+                auto cached = bSlicesByPhase.find(phase);
+                if (cached == bSlicesByPhase.end()) {
+                    RowRun slices;
+                    for (int kStart = 0; kStart < K;) {
+                        int kEnd = segmentEnd(i, kStart, dims, memMap);
+                        for (int j = 0; j < N; j++) {
+                            // Rows of column j only grow with k
+                            RowRun slice;
+                            slice.first = memMap.baseAddrB +
+                                          (static_cast<int64_t>(kStart) * memMap.rowSizeB + j) / rowB;
+                            slice.last = memMap.baseAddrB +
+                                         (static_cast<int64_t>(kEnd - 1) * memMap.rowSizeB + j) / rowB;
+                            slice.changes = static_cast<uint64_t>(slice.last - slice.first);
+                            slices.append(slice);
+                        }
+                        kStart = kEnd;
+                    }
+                    cached = bSlicesByPhase.emplace(phase, slices).first;
+                }
+                b.append(cached->second);
+                RowRun cRow = sweep(memMap.baseAddrC, cStart, cStart + N, rowC);
+                c.append(cRow.repeated(segmentsInRow(i, dims, memMap)));
+            } else if (order == LOOP_ORDER_IJK) {
+                b.append(bColumns);
+                c.append(sweep(memMap.baseAddrC, cStart, cStart + N, rowC));
+            } else if (order == LOOP_ORDER_IKJ) {
+                // Each k reads and writes back the whole C row
+                b.append(bRows);
+                c.append(sweep(memMap.baseAddrC, cStart, cStart + N, rowC).repeated(K));
+            } else {
+                int64_t phase = cStart % rowC;
+                auto cached = bBlocksByPhase.find(phase);
+                bool known = cached != bBlocksByPhase.end();
+                RowRun bBlocks = known ? cached->second : RowRun();
+                for (int jBlock = 0; jBlock < N;) {
+                    int jEnd = blockEnd(i, jBlock, dims, memMap, blockColumns);
+                    a.append(aRow);
+                    if (!known) {
+                        bBlocks.append(sweepB(dims, memMap, jBlock, jEnd));
+                    }
+                    c.append(sweep(memMap.baseAddrC, cStart + jBlock, cStart + jEnd, rowC).repeated(K));
+                    jBlock = jEnd;
+                }
+                if (!known) {
+                    bBlocksByPhase[phase] = bBlocks;
+                }
+                b.append(bBlocks);
+            }
+        }
+        activations += a.activations() + b.activations() + c.activations();
+    }
+    return activations;
+}
+
+std::vector<LoopOrderCost> compareLoopOrders(const MatrixDimensions& dims, const MemoryMap& memMap,
+                                             const CodegenOptions& options) {
+    std::vector<WorkAssignment> whole(1);
+    whole[0].coreId = 0;
+    whole[0].startRow = 0;
+    whole[0].endRow = dims.M - 1;
+
+    std::vector<LoopOrderCost> costs;
+    const LoopOrder orders[] = {LOOP_ORDER_IJK, LOOP_ORDER_IKJ, LOOP_ORDER_BLOCKED, LOOP_ORDER_KJI};
+    for (LoopOrder order : orders) {
+        if (options.dataflow != DATAFLOW_ANY && dataflowOf(order) != options.dataflow) {
+            continue;
+        }
+        CodegenOptions concrete = options;
+        concrete.loopOrder = order;
+        concrete.registerBlock = 1;
+        concrete.weights = nullptr;
+        concrete.pipeline = nullptr;
+        concrete.sparse = nullptr;
+        concrete.epilogue = nullptr;
+        LoopOrderCost cost;
+        cost.order = order;
+        cost.activations = countRowActivations(dims, whole, memMap, order, blockColumnsFor(dims, concrete));
+        cost.instructions = estimateCompile(dims, whole, memMap, concrete).totalInstructions;
+        cost.cycles = cost.instructions + static_cast<uint64_t>(ROW_ACTIVATION_CYCLES) * cost.activations;
+        costs.push_back(cost);
+    }
+    return costs;
+}
+
+AccessCounts countAccesses(const MatrixDimensions& dims, const std::vector<WorkAssignment>& assignments,
+                           const MemoryMap& memMap, LoopOrder order, int blockColumns) {
+    const uint64_t N = dims.N;
+    const uint64_t K = dims.K;
+    const bool segmented = memMap.rowsPerMatrixRowA > 1;
+
+    AccessCounts counts = {0, 0, 0, 0, 0, 0};
+    for (const auto& work : assignments) {
+        uint64_t rows = static_cast<uint64_t>(work.endRow - work.startRow + 1);
+        uint64_t steps = rows * N * K;
+        counts.macs += steps;
+        if (order == LOOP_ORDER_KJI) {
+            // Each B element once per core, A once per step
+            counts.aLoads += steps;
+            counts.bLoads += N * K;
+        } else {
+            counts.bLoads += steps;
+        }
+        if (order != LOOP_ORDER_IJK) {
+            // Partial sums go back to C after every step
+            counts.cLoads += rows * N * (K - 1);
+            counts.cStores += steps;
+        }
+        if (order == LOOP_ORDER_KJI) {
+            continue;
+        }
+
+        for (int i = work.startRow; i <= work.endRow; i++) {
+            // One A load per segment, in the blocked order once per block
+            uint64_t segments = segmented ? segmentsInRow(i, dims, memMap) : 1;
+            uint64_t passes = 1;
+            if (order == LOOP_ORDER_BLOCKED && segmented) {
+                passes = 0;
+                for (int jBlock = 0; jBlock < dims.N; jBlock = blockEnd(i, jBlock, dims, memMap, blockColumns)) {
+                    passes++;
+                }
+            }
+            counts.aLoads += segments * passes;
+            // Only the MACs at the first k of a segment find A[i][k] loaded
+            counts.aMacReads += N * (K - segments);
+            if (order == LOOP_ORDER_IJK) {
+                // Every segment after the first reloads the partial sums
+                counts.cLoads += N * (segments - 1);
+                counts.cStores += N * segments;
+            }
+        }
+    }
+    return counts;
+}
+
+AccessCounts countRegisterBlockedAccesses(const MatrixDimensions& dims,
+                                          const std::vector<WorkAssignment>& assignments, int registerBlock) {
+    const uint64_t N = dims.N;
+    const uint64_t K = dims.K;
+    const uint64_t blocks = (N + registerBlock - 1) / registerBlock;
+
+    AccessCounts counts = {0, 0, 0, 0, 0, 0};
+    for (const auto& work : assignments) {
+        uint64_t rows = static_cast<uint64_t>(work.endRow - work.startRow + 1);
+        counts.macs += rows * N * K;
+        counts.aLoads += rows * blocks * K;
+        counts.bLoads += rows * N * K;
+        counts.cStores += rows * N;
+    }
+    return counts;
+}
+
+AccessCounts countWeightedAccesses(const MatrixDimensions& dims, const std::vector<WorkAssignment>& assignments,
+                                   const MemoryMap& memMap, const WeightPlan& plan) {
+    const bool segmented = memMap.rowsPerMatrixRowA > 1;
+
+    AccessCounts counts = {0, 0, 0, 0, 0, 0};
+    for (const auto& work : assignments) {
+        for (int i = work.startRow; i <= work.endRow; i++) {
+            for (int kStart = 0; kStart < dims.K;) {
+                int kEnd = segmented ? segmentEnd(i, kStart, dims, memMap) : dims.K;
+                counts.aLoads++;
+                for (int j : plan.computed) {
+                    uint32_t first, last;
+                    plan.nonzeroRange(j, kStart, kEnd, first, last);
+                    if (kStart > 0 && first == last) {
+                        continue;
+                    }
+                    counts.cLoads += kStart > 0 ? 1 : 0;
+                    counts.bLoads += last - first;
+                    counts.macs += last - first;
+                    // Only a MAC at the segment's first k finds A[i][k] loaded
+                    counts.aMacReads += last - first - (first < last && plan.nonzeroK[first] == kStart ? 1 : 0);
+                    counts.cStores += 1 + plan.copies[j].size();
+                }
+                kStart = kEnd;
+            }
+        }
+    }
+    return counts;
+}
+
+bool usesWeightSpecialization(const MemoryMap& memMap, const CodegenOptions& options) {
+    return options.weights != nullptr && options.loopOrder == LOOP_ORDER_IJK && memMap.tileK == 0 &&
+           !usesRegisterBlocking(memMap, options);
+}
+
+bool usesRegisterBlocking(const MemoryMap& memMap, const CodegenOptions& options) {
+    return options.registerBlock > 1 && options.loopOrder == LOOP_ORDER_IJK && memMap.tileK == 0;
+}
+
+bool usesSparsity(const MemoryMap& memMap, const CodegenOptions& options) {
+    return options.sparse != nullptr && options.loopOrder == LOOP_ORDER_IJK && memMap.tileK == 0 &&
+           !usesRegisterBlocking(memMap, options) && !usesWeightSpecialization(memMap, options);
+}
+
+bool usesEpilogue(const MemoryMap& memMap, const CodegenOptions& options) {
+    return options.epilogue != nullptr && hasEpilogue(*options.epilogue) &&
+           options.loopOrder == LOOP_ORDER_IJK && memMap.tileK == 0 && !usesRegisterBlocking(memMap, options) &&
+           !usesWeightSpecialization(memMap, options) && !usesSparsity(memMap, options);
+}
+
+bool usesPipelining(const MemoryMap& memMap, const CodegenOptions& options) {
+    return options.pipeline != nullptr && options.loopOrder == LOOP_ORDER_IJK && memMap.tileK == 0 &&
+           !usesRegisterBlocking(memMap, options) && !usesWeightSpecialization(memMap, options) &&
+           !usesSparsity(memMap, options) && !usesEpilogue(memMap, options);
+}
+
+CodegenOptions resolveLoopOrder(const MatrixDimensions& dims, const MemoryMap& memMap,
+                                const CodegenOptions& options) {
+    if (options.loopOrder != LOOP_ORDER_AUTO) {
+        return options;
+    }
+    // The register-blocked, weight-specialized, sparse and pipelined kernels
+    // are ijk ones, and only ijk fuses an epilogue
+    if (options.registerBlock > 1 || options.weights != nullptr || options.sparse != nullptr ||
+        options.pipeline != nullptr || (options.epilogue != nullptr && hasEpilogue(*options.epilogue))) {
+        CodegenOptions resolved = options;
+        resolved.loopOrder = LOOP_ORDER_IJK;
+        return resolved;
+    }
+    // Ties go to the earlier order in compareLoopOrders
+    std::vector<LoopOrderCost> costs = compareLoopOrders(dims, memMap, options);
+    CodegenOptions resolved = options;
+    resolved.loopOrder = costs[0].order;
+    uint64_t best = costs[0].cycles;
+    for (const auto& cost : costs) {
+        if (cost.cycles < best) {
+            best = cost.cycles;
+            resolved.loopOrder = cost.order;
+        }
+    }
+    return resolved;
+}
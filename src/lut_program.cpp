@@ -0,0 +1,54 @@
+#include "pim_compiler.h"
+
+const char* lutFunctionName(LutFunction function) {
+    switch (function) {
+        case LUT_MUL_UU: return "mul_uu";
+        case LUT_MUL_SU: return "mul_su";
+        case LUT_MUL_SS: return "mul_ss";
+        case LUT_ADD: return "add";
+        case LUT_ADDC: return "addc";
+        default: return "?";
+    }
+}
+
+bool parseLutPrecision(const std::string& text, int& out) {
+    const char* precisions[] = {"4", "8", "16"};
+    for (const char* precision : precisions) {
+        if (text == precision) {
+            out = std::stoi(text);
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<LutFunction> lutFunctions(int precision) {
+    if (precision <= 0) {
+        return {};
+    }
+    if (precision <= 4) {
+        return {LUT_MUL_SS, LUT_ADD, LUT_ADDC};
+    }
+    return {LUT_MUL_UU, LUT_MUL_SU, LUT_MUL_SS, LUT_ADD, LUT_ADDC};
+}
+
+// A 4-bit field as a signed digit
+static int signedDigit(int x) {
+    return x >= 8 ? x - 16 : x;
+}
+
+int lutEntry(LutFunction function, int x, int y) {
+    switch (function) {
+        case LUT_MUL_UU: return x * y;
+        case LUT_MUL_SU: return (signedDigit(x) * y) & 0xFF;
+        case LUT_MUL_SS: return (signedDigit(x) * signedDigit(y)) & 0xFF;
+        case LUT_ADD: return x + y;
+        case LUT_ADDC: return x + y + 1;
+        default: return 0;
+    }
+}
+
+int lutLookupsPerMac(int precision) {
+    int digits = (precision + 3) / 4;
+    return digits * digits * (1 + 2 * digits);
+}
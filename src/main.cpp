@@ -4,35 +4,10 @@
 #include <string>
 #include <vector>
 #include <chrono>
-#include <bitset>
-
-// Convert hex string to binary string for verification
-std::string hexToBinary(const std::string& hex) {
-    std::string binary;
-    for (char c : hex) {
-        // Convert each hex character to 4 binary digits
-        switch(toupper(c)) {
-            case '0': binary += "0000"; break;
-            case '1': binary += "0001"; break;
-            case '2': binary += "0010"; break;
-            case '3': binary += "0011"; break;
-            case '4': binary += "0100"; break;
-            case '5': binary += "0101"; break;
-            case '6': binary += "0110"; break;
-            case '7': binary += "0111"; break;
-            case '8': binary += "1000"; break;
-            case '9': binary += "1001"; break;
-            case 'A': binary += "1010"; break;
-            case 'B': binary += "1011"; break;
-            case 'C': binary += "1100"; break;
-            case 'D': binary += "1101"; break;
-            case 'E': binary += "1110"; break;
-            case 'F': binary += "1111"; break;
-            default: binary += "????"; // For any invalid characters
-        }
-    }
-    return binary;
-}
+#include <memory>
+#include <cstdlib>
+#include <cstdio>
+#include <iomanip>
 
 // Write three-address code to a separate file
 void writeThreeAddressCodeToFile(const ThreeAddressCode& tac, const std::string& filename) {
@@ -53,6 +28,34 @@ void writeThreeAddressCodeToFile(const ThreeAddressCode& tac, const std::string&
     std::cout << "Three-address code written to " << filename << std::endl;
 }
 
+// Output sink for one program file in the chosen format; null if the file
+// cannot be opened. Text programs are written through textFile.
+static std::unique_ptr<InstructionSink> openProgramFile(const std::string& format, const std::string& path,
+                                                        const MatrixDimensions& dims,
+                                                        const std::vector<WorkAssignment>& assignments,
+                                                        const CodegenOptions& options, std::ofstream& textFile) {
+    if (format == "bin") {
+        std::unique_ptr<BinaryFileSink> binarySink(new BinaryFileSink(path, dims, assignments, options));
+        if (!binarySink->isOpen()) {
+            return nullptr;
+        }
+        return binarySink;
+    }
+    if (format == "loop") {
+        std::unique_ptr<LoopFileSink> loopSink(new LoopFileSink(path, dims, assignments, options));
+        if (!loopSink->isOpen()) {
+            return nullptr;
+        }
+        return loopSink;
+    }
+    textFile.open(path);
+    if (!textFile.is_open()) {
+        std::cerr << "Error: Could not open output file " << path << std::endl;
+        return nullptr;
+    }
+    return std::unique_ptr<InstructionSink>(new TextFileSink(textFile, dims, assignments.size(), options));
+}
+
 void printHelp(const char* programName) {
     std::cout << "PIM Matrix Multiplication Compiler" << std::endl;
     std::cout << "Usage: " << programName << " <input_file> [options]" << std::endl;
@@ -63,9 +66,80 @@ void printHelp(const char* programName) {
     std::cout << "  -K <value>      Columns in matrix A / Rows in matrix B (overrides value in input file)" << std::endl;
     std::cout << "  -c <value>      Number of cores to use (default: 4)" << std::endl;
     std::cout << "  -p <value>      Parser to use (0=basic, 1=enhanced [default])" << std::endl;
+    std::cout << "  -j <value>      Code generation threads (default: 1, 0=all hardware threads)" << std::endl;
+    std::cout << "  --format=<fmt>  Output format: text (hex .pim [default]), bin (packed .pimb)" << std::endl;
+    std::cout << "                  or loop (loop-compressed .piml)" << std::endl;
+    std::cout << "  --estimate      Predict instruction counts, output sizes and cycles, then exit" << std::endl;
+    std::cout << "  --isa <name>    Target ISA: pim24 [default], pim24b (with broadcast), pim32, or a descriptor file" << std::endl;
+    std::cout << "  --loop-order=<o> Loop nest: ijk, ikj, blocked, kji, or auto [default] (row activation model)" << std::endl;
+    std::cout << "  --block-cols=<n> C columns per block in the blocked order (default: one memory row)" << std::endl;
+    std::cout << "  --dataflow=<d>  What stays resident: output (ijk), input (ikj, blocked) or weight (kji);" << std::endl;
+    std::cout << "                  auto picks the cheapest order of that dataflow (default: any)" << std::endl;
+    std::cout << "  --tiles=<t>     Tiled layout and sequences: auto, or M,N,K tile sizes (0 = planner's choice)" << std::endl;
+    std::cout << "  --schedule=<s>  Controller stream: concat (each core's program in turn [default]), interleave" << std::endl;
+    std::cout << "                  (merged by the latency-aware scheduler) or broadcast (lockstep, shared" << std::endl;
+    std::cout << "                  instructions sent once to a core group; needs an ISA with a broadcast bit)." << std::endl;
+    std::cout << "                  Merged schedules are text and bin only" << std::endl;
+    std::cout << "  --lut-precision=<b> Load the multiply/add LUTs for <b>-bit operands (4, 8 or 16) at the" << std::endl;
+    std::cout << "                  start of every core's program (default: LUTs assumed preloaded)" << std::endl;
+    std::cout << "  --precision=<p> Element type of A and B: int32 [default], or int8 / int4 packed 4 / 8 per" << std::endl;
+    std::cout << "                  memory slot, with C packed at the narrowest accumulator safe over K." << std::endl;
+    std::cout << "                  Offsets count packed elements, so beyond 512 elements per matrix a packed" << std::endl;
+    std::cout << "                  program needs a wider address field than pim24's (e.g. --isa pim32)" << std::endl;
+    std::cout << "  --register-block=<r> Compute r C elements per A load in ijk, one accumulator each (at most" << std::endl;
+    std::cout << "                  the accumulators the ISA's cores expose; default: 1)" << std::endl;
+    std::cout << "  --weights=<f>   B is this weight matrix (.npy or raw int32, K x N): specialize the ijk" << std::endl;
+    std::cout << "                  kernel to it, dropping MACs with zero weights and computing repeated" << std::endl;
+    std::cout << "                  columns once" << std::endl;
+    std::cout << "  --sparse-a=<f>  A is sparse with this pattern: a csr/csc/bsr/mask description or the" << std::endl;
+    std::cout << "                  matrix (.npy or raw int32, M x K). Only its nonzeros are stored, in CSR" << std::endl;
+    std::cout << "                  order, and the ijk kernel MACs only where A and B are both nonzero" << std::endl;
+    std::cout << "  --sparse-b=<f>  B is sparse with this pattern (K x N), stored as its nonzeros in CSC order" << std::endl;
+    std::cout << "  --epilogue=<e>  Fuse C = clamp(((A * B + bias) * alpha) >> shift) into the ijk kernel, e.g." << std::endl;
+    std::cout << "                  bias,alpha=3,shift=8,relu or clamp=-128:127 (items in any order; the bias" << std::endl;
+    std::cout << "                  vector is placed after C and starts each element's accumulator)" << std::endl;
+    std::cout << "  --pipeline[=<t>] Software-pipeline the ijk kernel (each element's first B load ahead of the" << std::endl;
+    std::cout << "                  store before it) and pad it with NOOPs to run hazard-free without interlocks" << std::endl;
+    std::cout << "                  under latency table <t>: a file or e.g. access=6,mac=3 (keys issue, access," << std::endl;
+    std::cout << "                  activation, mac, program; default: the scheduler's latency model)" << std::endl;
+    std::cout << "  --persistent    Split the program into a setup program run once (PROG and the LUT loads," << std::endl;
+    std::cout << "                  written to <output>.setup) and a per-invocation program that computes C" << std::endl;
+    std::cout << "                  for a new A on the cores the setup left programmed" << std::endl;
+    std::cout << "  --no-row-reuse  Keep every row-address instruction (row reuse pass is on by default)" << std::endl;
+    std::cout << "  --cache-dir <d> Reuse programs from a compile cache in <d> (default: $PIM_CACHE_DIR)" << std::endl;
+    std::cout << "  --no-cache      Compile without reading or writing the cache" << std::endl;
     std::cout << "  -h, --help      Show this help message" << std::endl;
 }
 
+// A kernel that replaces or changes plain ijk, and the option selecting it
+struct SpecializedKernel {
+    const char* option;
+    const char* description;
+};
+
+// The specialized kernels the options select, in the order
+// generateCoreSequence prefers them; the epilogue is fused into plain ijk,
+// which comes last
+static std::vector<SpecializedKernel> specializedKernels(const CodegenOptions& options) {
+    std::vector<SpecializedKernel> kernels;
+    if (options.registerBlock > 1) {
+        kernels.push_back({"--register-block", "the register-blocked kernel"});
+    }
+    if (options.weights) {
+        kernels.push_back({"--weights", "the weight-specialized kernel"});
+    }
+    if (options.sparse) {
+        kernels.push_back({options.sparse->sparseA() ? "--sparse-a" : "--sparse-b", "the sparse kernel"});
+    }
+    if (options.pipeline) {
+        kernels.push_back({"--pipeline", "the pipelined kernel"});
+    }
+    if (options.epilogue) {
+        kernels.push_back({"--epilogue", "fusing the epilogue"});
+    }
+    return kernels;
+}
+
 int main(int argc, char* argv[]) {
     // Default values
     std::string inputFile = "";
@@ -75,6 +149,20 @@ int main(int argc, char* argv[]) {
     int overrideN = -1;
     int overrideK = -1;
     int parserType = 1;  // Default to enhanced parser
+    int numThreads = 1;
+    std::string outputFormat = "text";
+    bool outputFileSet = false;
+    bool estimateOnly = false;
+    const char* cacheEnv = std::getenv("PIM_CACHE_DIR");
+    std::string cacheDir = cacheEnv ? cacheEnv : "";
+    std::string isaName = "pim24";
+    std::string weightFile;
+    WeightPlan weightPlan;
+    SparsePlan sparsePlan;
+    EpilogueSpec epilogue;
+    LatencyModel pipelineLatency;
+    bool persistent = false;
+    CodegenOptions codegenOptions;
     
     // Parse command line arguments
     for (int i = 1; i < argc; i++) {
@@ -84,6 +172,7 @@ int main(int argc, char* argv[]) {
             return 0;
         } else if (arg == "-o" && i + 1 < argc) {
             outputFile = argv[++i];
+            outputFileSet = true;
         } else if (arg == "-M" && i + 1 < argc) {
             overrideM = std::stoi(argv[++i]);
         } else if (arg == "-N" && i + 1 < argc) {
@@ -94,6 +183,89 @@ int main(int argc, char* argv[]) {
             numCores = std::stoi(argv[++i]);
         } else if (arg == "-p" && i + 1 < argc) {
             parserType = std::stoi(argv[++i]);
+        } else if (arg == "-j" && i + 1 < argc) {
+            numThreads = std::stoi(argv[++i]);
+        } else if (arg == "--estimate") {
+            estimateOnly = true;
+        } else if (arg == "--isa" && i + 1 < argc) {
+            isaName = argv[++i];
+        } else if (arg == "--persistent") {
+            persistent = true;
+        } else if (arg == "--no-row-reuse") {
+            codegenOptions.rowReuse = false;
+        } else if (arg == "--cache-dir" && i + 1 < argc) {
+            cacheDir = argv[++i];
+        } else if (arg == "--no-cache") {
+            cacheDir.clear();
+        } else if (arg.compare(0, 13, "--loop-order=") == 0) {
+            if (!parseLoopOrder(arg.substr(13), codegenOptions.loopOrder)) {
+                std::cerr << "Error: Unknown loop order: " << arg.substr(13) << std::endl;
+                return 1;
+            }
+        } else if (arg.compare(0, 11, "--dataflow=") == 0) {
+            if (!parseDataflow(arg.substr(11), codegenOptions.dataflow)) {
+                std::cerr << "Error: Unknown dataflow: " << arg.substr(11) << std::endl;
+                return 1;
+            }
+        } else if (arg.compare(0, 8, "--tiles=") == 0) {
+            codegenOptions.tiling = true;
+            if (!parseTilePlan(arg.substr(8), codegenOptions.tiles)) {
+                std::cerr << "Error: Tiles must be auto or M,N,K: " << arg.substr(8) << std::endl;
+                return 1;
+            }
+        } else if (arg.compare(0, 11, "--schedule=") == 0) {
+            if (!parseSchedule(arg.substr(11), codegenOptions.schedule)) {
+                std::cerr << "Error: Unknown schedule: " << arg.substr(11) << std::endl;
+                return 1;
+            }
+        } else if (arg.compare(0, 16, "--lut-precision=") == 0) {
+            if (!parseLutPrecision(arg.substr(16), codegenOptions.lutPrecision)) {
+                std::cerr << "Error: LUT precision must be 4, 8 or 16 bits: " << arg.substr(16) << std::endl;
+                return 1;
+            }
+        } else if (arg.compare(0, 12, "--precision=") == 0) {
+            if (!parseDataPrecision(arg.substr(12), codegenOptions.precision.dataBits)) {
+                std::cerr << "Error: Precision must be int4, int8 or int32: " << arg.substr(12) << std::endl;
+                return 1;
+            }
+        } else if (arg.compare(0, 17, "--register-block=") == 0) {
+            codegenOptions.registerBlock = std::stoi(arg.substr(17));
+            if (codegenOptions.registerBlock <= 0) {
+                std::cerr << "Error: Register block must be positive" << std::endl;
+                return 1;
+            }
+        } else if (arg.compare(0, 10, "--weights=") == 0) {
+            weightFile = arg.substr(10);
+            codegenOptions.weights = &weightPlan;
+        } else if (arg.compare(0, 11, "--sparse-a=") == 0 || arg.compare(0, 11, "--sparse-b=") == 0) {
+            (arg[9] == 'a' ? sparsePlan.sourceA : sparsePlan.sourceB) = arg.substr(11);
+            codegenOptions.sparse = &sparsePlan;
+        } else if (arg.compare(0, 11, "--epilogue=") == 0) {
+            std::string epilogueError;
+            if (!parseEpilogue(arg.substr(11), epilogue, epilogueError)) {
+                std::cerr << "Error: Invalid epilogue: " << epilogueError << std::endl;
+                return 1;
+            }
+            codegenOptions.epilogue = hasEpilogue(epilogue) ? &epilogue : nullptr;
+        } else if (arg == "--pipeline" || arg.compare(0, 11, "--pipeline=") == 0) {
+            std::string latencyError;
+            if (arg.size() > 11 && !loadLatencyModel(arg.substr(11), pipelineLatency, latencyError)) {
+                std::cerr << "Error: Invalid latency table: " << latencyError << std::endl;
+                return 1;
+            }
+            codegenOptions.pipeline = &pipelineLatency;
+        } else if (arg.compare(0, 13, "--block-cols=") == 0) {
+            codegenOptions.blockColumns = std::stoi(arg.substr(13));
+            if (codegenOptions.blockColumns <= 0) {
+                std::cerr << "Error: Block columns must be positive" << std::endl;
+                return 1;
+            }
+        } else if (arg.compare(0, 9, "--format=") == 0) {
+            outputFormat = arg.substr(9);
+            if (outputFormat != "text" && outputFormat != "bin" && outputFormat != "loop") {
+                std::cerr << "Error: Unknown output format: " << outputFormat << std::endl;
+                return 1;
+            }
         } else if (inputFile.empty()) {
             inputFile = arg;
         } else {
@@ -103,20 +275,157 @@ int main(int argc, char* argv[]) {
         }
     }
     
+    if (codegenOptions.loopOrder != LOOP_ORDER_AUTO && codegenOptions.dataflow != DATAFLOW_ANY &&
+        dataflowOf(codegenOptions.loopOrder) != codegenOptions.dataflow) {
+        std::cerr << "Error: Loop order " << loopOrderName(codegenOptions.loopOrder) << " is not "
+                  << dataflowName(codegenOptions.dataflow) << "-stationary" << std::endl;
+        return 1;
+    }
+    
+    if (codegenOptions.tiling &&
+        (codegenOptions.loopOrder != LOOP_ORDER_AUTO || codegenOptions.dataflow != DATAFLOW_ANY)) {
+        std::cerr << "Error: --loop-order and --dataflow apply to the untiled layout only" << std::endl;
+        return 1;
+    }
+    
+    // Each specialized kernel replaces or changes the plain untiled,
+    // output-stationary ijk one, so it combines with no other kernel, layout
+    // or loop order
+    std::vector<SpecializedKernel> kernels = specializedKernels(codegenOptions);
+    if (kernels.size() > 1) {
+        std::cerr << "Error: " << kernels[0].option << " and " << kernels[1].option
+                  << " select different kernels" << std::endl;
+        return 1;
+    }
+    if (!kernels.empty() &&
+        (codegenOptions.tiling ||
+         (codegenOptions.loopOrder != LOOP_ORDER_AUTO && codegenOptions.loopOrder != LOOP_ORDER_IJK) ||
+         (codegenOptions.dataflow != DATAFLOW_ANY && codegenOptions.dataflow != DATAFLOW_OUTPUT))) {
+        std::cerr << "Error: " << kernels[0].option << " applies to the untiled ijk order only" << std::endl;
+        return 1;
+    }
+    
+    // The header records the weight file as one token, so its path cannot
+    // hold spaces
+    if (weightFile.find_first_of(" \t") != std::string::npos) {
+        std::cerr << "Error: The weight file path is recorded in the program header and cannot contain spaces"
+                  << std::endl;
+        return 1;
+    }
+    
+    // The sparse kernel stores int32 elements, and its headers record the
+    // pattern files as tokens too
+    const std::string sparseFiles[2] = {sparsePlan.sourceA, sparsePlan.sourceB};   // A, B
+    if (codegenOptions.sparse && codegenOptions.precision.dataBits < MEMORY_SLOT_BITS) {
+        std::cerr << "Error: Sparse operands are stored unpacked; --precision=int"
+                  << codegenOptions.precision.dataBits << " does not apply" << std::endl;
+        return 1;
+    }
+    if (sparseFiles[0].find_first_of(" \t") != std::string::npos ||
+        sparseFiles[1].find_first_of(" \t") != std::string::npos) {
+        std::cerr << "Error: Sparse pattern paths are recorded in the program header and cannot contain spaces"
+                  << std::endl;
+        return 1;
+    }
+    
+    // The padding of a pipelined kernel depends on the row activations of
+    // the schedule, which the estimator does not follow
+    if (codegenOptions.pipeline && estimateOnly) {
+        std::cerr << "Error: --estimate cannot predict the padding of a --pipeline program" << std::endl;
+        return 1;
+    }
+    if (persistent) {
+        codegenOptions.part = PROGRAM_INVOCATION;
+    }
+    
+    // The tiling planner sizes tiles in unpacked elements
+    if (codegenOptions.tiling && codegenOptions.precision.dataBits < MEMORY_SLOT_BITS) {
+        std::cerr << "Error: --precision=int" << codegenOptions.precision.dataBits << " packs the untiled layout only"
+                  << std::endl;
+        return 1;
+    }
+    // The multiply tables must take the whole operand
+    if (codegenOptions.lutPrecision > 0 && codegenOptions.lutPrecision < codegenOptions.precision.dataBits &&
+        codegenOptions.precision.dataBits < MEMORY_SLOT_BITS) {
+        std::cerr << "Error: --lut-precision=" << codegenOptions.lutPrecision << " cannot multiply int"
+                  << codegenOptions.precision.dataBits << " operands" << std::endl;
+        return 1;
+    }
+    
     if (inputFile.empty()) {
         std::cerr << "Error: No input file specified." << std::endl;
         printHelp(argv[0]);
         return 1;
     }
     
+    // Loop-compressed programs fold each core's program separately
+    if (codegenOptions.schedule != SCHEDULE_CONCAT && outputFormat == "loop") {
+        std::cerr << "Error: --schedule=" << scheduleName(codegenOptions.schedule)
+                  << " needs --format=text or --format=bin" << std::endl;
+        return 1;
+    }
+    // How many instructions a broadcast stream saves depends on how the
+    // programs line up, which only merging them shows
+    if (codegenOptions.schedule == SCHEDULE_BROADCAST && estimateOnly) {
+        std::cerr << "Error: --estimate cannot predict a --schedule=broadcast stream" << std::endl;
+        return 1;
+    }
+    
+    if (outputFormat == "bin" && !outputFileSet) {
+        outputFile = "output.pimb";
+    } else if (outputFormat == "loop" && !outputFileSet) {
+        outputFile = "output.piml";
+    }
+    std::string setupFile = outputFile + ".setup";
+    
+    IsaDescriptor isa;
+    if (!loadIsa(isaName, isa)) {
+        return 1;
+    }
+    setActiveIsa(isa);
+    if (codegenOptions.schedule == SCHEDULE_BROADCAST && !isa.hasBroadcast()) {
+        std::cerr << "Error: --schedule=broadcast needs an ISA with a broadcast bit (e.g. --isa pim24b); "
+                  << isa.name << " has none" << std::endl;
+        return 1;
+    }
+    if (codegenOptions.registerBlock > isa.accumulators) {
+        std::cerr << "Error: --register-block=" << codegenOptions.registerBlock << " needs as many accumulators; "
+                  << "the cores of ISA " << isa.name << " expose " << isa.accumulators
+                  << " (set acc in an ISA descriptor)" << std::endl;
+        return 1;
+    }
+    
     // Start timing
     auto startTime = std::chrono::high_resolution_clock::now();
     
     std::cout << "=== PIM Matrix Multiplication Compiler ===" << std::endl;
     std::cout << "Input file: " << inputFile << std::endl;
     std::cout << "Output file: " << outputFile << std::endl;
+    std::cout << "Output format: " << outputFormat << std::endl;
     std::cout << "Number of cores: " << numCores << std::endl;
+    std::cout << "Code generation threads: " << numThreads << std::endl;
     std::cout << "Parser type: " << (parserType == 0 ? "Basic" : "Enhanced") << std::endl;
+    std::cout << "Row address reuse: " << (codegenOptions.rowReuse ? "on" : "off") << std::endl;
+    std::cout << "Stream schedule: " << scheduleName(codegenOptions.schedule) << std::endl;
+    if (codegenOptions.registerBlock > 1) {
+        std::cout << "Register block: " << codegenOptions.registerBlock << " accumulators" << std::endl;
+    }
+    if (codegenOptions.pipeline) {
+        std::cout << "Software pipelining: on, padded for latencies " << describeLatencyModel(pipelineLatency)
+                  << std::endl;
+    }
+    if (persistent) {
+        std::cout << "Persistent kernel: setup program " << setupFile << ", per-invocation program " << outputFile
+                  << std::endl;
+    }
+    if (codegenOptions.lutPrecision > 0) {
+        std::cout << "LUT precision: " << codegenOptions.lutPrecision << "-bit operands" << std::endl;
+    } else {
+        std::cout << "LUT precision: preloaded" << std::endl;
+    }
+    std::cout << "ISA: " << isa.name << " (" << isa.wordBits << "-bit words, up to " 
+              << isa.maxCores() << " cores and " << isa.maxRows() << " memory rows of " 
+              << isa.memoryRowSize << " elements)" << std::endl;
     
     // Step 1: Parse the input file to get matrix dimensions
     MatrixDimensions dims;
@@ -139,76 +448,412 @@ int main(int argc, char* argv[]) {
     if (overrideN > 0) dims.N = overrideN;
     if (overrideK > 0) dims.K = overrideK;
     
-    // Step 2: Generate three-address code
-    std::cout << "\nGenerating three-address code..." << std::endl;
-    ThreeAddressCode threeAddressCode = generateThreeAddressCode(dims);
+    // Packed operands get the narrowest accumulator no K-term sum overflows
+    if (codegenOptions.precision.dataBits < MEMORY_SLOT_BITS) {
+        ElementPrecision precision;
+        std::string precisionError;
+        if (!choosePrecision(codegenOptions.precision.dataBits, dims.K, precision, precisionError)) {
+            std::cerr << "Error: Cannot pack this program: " << precisionError << std::endl;
+            return 1;
+        }
+        codegenOptions.precision = precision;
+        std::cout << "Precision: int" << precision.dataBits << " operands, "
+                  << elementsPerSlot(precision.dataBits) << " per memory slot; a " << dims.K
+                  << "-term dot product needs " << accumulatorBitsNeeded(precision.dataBits, dims.K)
+                  << " accumulator bits, so C is int" << precision.accumulatorBits << " ("
+                  << elementsPerSlot(precision.accumulatorBits) << " per slot)" << std::endl;
+    }
+    
+    // A known B: read it and plan the specialized kernel
+    if (!weightFile.empty()) {
+        WeightMatrix weights;
+        std::string weightError;
+        if (!readWeightFile(weightFile, dims.K, dims.N, weights, weightError)) {
+            std::cerr << "Error: Cannot use weights " << weightFile << ": " << weightError << std::endl;
+            return 1;
+        }
+        // Packed elements and programmed LUTs take narrower operands
+        int operandBits = std::min(codegenOptions.precision.dataBits, MEMORY_SLOT_BITS);
+        if (codegenOptions.lutPrecision > 0) {
+            operandBits = std::min(operandBits, codegenOptions.lutPrecision);
+        }
+        if (!weightsFit(weights, operandBits)) {
+            std::cerr << "Error: Weights in " << weightFile << " do not fit " << operandBits << "-bit operands"
+                      << std::endl;
+            return 1;
+        }
+        weightPlan = planWeights(weights);
+        weightPlan.source = weightFile;
+        
+        uint64_t total = static_cast<uint64_t>(dims.K) * dims.N;
+        uint64_t copies = dims.N - weightPlan.computed.size();
+        std::cout << std::fixed << std::setprecision(1);
+        std::cout << "Weights: " << weightFile << ", " << weightPlan.zeros << " of " << total << " zero ("
+                  << 100.0 * weightPlan.zeros / total << "%), " << weightPlan.distinctValues
+                  << " distinct nonzero values, " << weightPlan.powersOfTwo << " powers of two, " << copies
+                  << " columns repeating an earlier one" << std::endl;
+        std::cout << "Weight specialization: " << weightPlan.macsPerRow << " MACs per row of A instead of "
+                  << total << ", " << (total - weightPlan.macsPerRow) * dims.M << " of " << total * dims.M
+                  << " MACs eliminated (" << 100.0 * (total - weightPlan.macsPerRow) / total << "%)" << std::endl;
+        std::cout.unsetf(std::ios::floatfield);
+        std::cout << std::setprecision(6);
+    }
+    
+    // Sparse operands: read their patterns and plan the compact layout
+    if (codegenOptions.sparse) {
+        SparsityPattern patterns[2];
+        const int rows[2] = {dims.M, dims.K};
+        const int cols[2] = {dims.K, dims.N};
+        for (int m = 0; m < 2; m++) {
+            std::string patternError;
+            if (!sparseFiles[m].empty() &&
+                !readSparsityPattern(sparseFiles[m], rows[m], cols[m], patterns[m], patternError)) {
+                std::cerr << "Error: Cannot use the sparsity pattern " << sparseFiles[m] << " of "
+                          << (m == 0 ? "A" : "B") << ": " << patternError << std::endl;
+                return 1;
+            }
+        }
+        sparsePlan = planSparsity(dims, sparseFiles[0].empty() ? nullptr : &patterns[0], sparseFiles[0],
+                                  sparseFiles[1].empty() ? nullptr : &patterns[1], sparseFiles[1]);
+        
+        uint64_t denseMacs = static_cast<uint64_t>(dims.M) * dims.N * dims.K;
+        std::cout << std::fixed << std::setprecision(1);
+        for (int m = 0; m < 2; m++) {
+            if (sparseFiles[m].empty()) {
+                continue;
+            }
+            uint64_t total = static_cast<uint64_t>(rows[m]) * cols[m];
+            uint64_t nonzeros = patterns[m].nonzeros();
+            std::cout << "Sparse " << (m == 0 ? "A" : "B") << ": " << sparseFiles[m] << ", " << nonzeros
+                      << " of " << total << " elements nonzero (" << 100.0 * (total - nonzeros) / total
+                      << "% zeros)" << std::endl;
+        }
+        std::cout << "Sparse kernel: " << sparsePlan.macs << " MACs instead of " << denseMacs << ", "
+                  << denseMacs - sparsePlan.macs << " eliminated (" << 100.0 * (denseMacs - sparsePlan.macs) / denseMacs
+                  << "%)" << std::endl;
+        std::cout.unsetf(std::ios::floatfield);
+        std::cout << std::setprecision(6);
+    }
+    
+    // The epilogue places its rows after C and travels in the header
+    if (codegenOptions.epilogue) {
+        std::cout << "Epilogue: " << describeEpilogue(epilogue) << ", fused before the C stores ("
+                  << epilogueInstructionsPerElement(epilogue) << " more instructions per element); the host "
+                  << "skips a pass reading and writing the " << static_cast<uint64_t>(dims.M) * dims.N
+                  << " elements of C" << std::endl;
+    }
     
-    // Write three-address code to a separate file
     std::string tacFilename = outputFile + ".tac";
-    writeThreeAddressCodeToFile(threeAddressCode, tacFilename);
+    
+    // A cached program for the same inputs skips everything below
+    bool useCache = !cacheDir.empty() && !estimateOnly;
+    std::string cacheKey = compileCacheKey(dims, numCores, outputFormat, codegenOptions);
+    // A persistent kernel's setup program is an entry of its own
+    CodegenOptions setupOptions = codegenOptions;
+    setupOptions.part = PROGRAM_SETUP;
+    std::string setupCacheKey = compileCacheKey(dims, numCores, outputFormat, setupOptions);
+    if (useCache) {
+        CacheEntryInfo cached;
+        CacheEntryInfo setupCached;
+        if (fetchFromCache(cacheDir, cacheKey, outputFile, tacFilename, cached) &&
+            (!persistent || fetchFromCache(cacheDir, setupCacheKey, setupFile, tacFilename, setupCached))) {
+            auto endTime = std::chrono::high_resolution_clock::now();
+            auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
+            
+            std::cout << "\nCompile cache hit (" << compileCacheHash(cacheKey) << " in " 
+                      << cacheDir << ")" << std::endl;
+            std::cout << "\nCompilation complete!" << std::endl;
+            std::cout << "Total instructions: " << (cached.instructions + cached.commentLines) 
+                      << " (including " << cached.commentLines << " comments)" << std::endl;
+            std::cout << "Actual instructions: " << cached.instructions << std::endl;
+            std::cout << "Three-address code available in: " << tacFilename << std::endl;
+            std::cout << "Time taken: " << duration.count() << " ms" << std::endl;
+            return 0;
+        }
+        std::cout << "\nCompile cache miss (" << compileCacheHash(cacheKey) << ")" << std::endl;
+    }
+    
+    // Step 2: Generate three-address code
+    if (!estimateOnly) {
+        std::cout << "\nGenerating three-address code..." << std::endl;
+        ThreeAddressCode threeAddressCode = generateThreeAddressCode(dims);
+        
+        // Write three-address code to a separate file
+        writeThreeAddressCodeToFile(threeAddressCode, tacFilename);
+    }
     
     // Step 3: Distribute work among cores
     std::cout << "\nDistributing work among cores..." << std::endl;
     std::vector<WorkAssignment> workAssignments = distributeWork(dims, numCores);
     
+    // Tile sizes have to be known before the layout
+    TilePlan requestedTiles = codegenOptions.tiles;
+    if (codegenOptions.tiling) {
+        TilePlan plan;
+        std::string tileError;
+        if (!planTiles(dims, workAssignments, codegenOptions, plan, tileError)) {
+            std::cerr << "Error: Cannot tile this program: " << tileError << std::endl;
+            return 1;
+        }
+        codegenOptions.tiles = plan;
+    }
+    
     // Step 4: Optimize memory layout
     std::cout << "\nOptimizing memory layout..." << std::endl;
-    MemoryMap memoryMap = optimizeMemoryLayout(dims);
-    
-    // Step 5: Generate PIM instructions for each core
-    std::cout << "\nGenerating PIM instructions..." << std::endl;
-    std::vector<std::string> allInstructions;
-    
-    // Add header comment
-    allInstructions.push_back("# PIM Instructions for Matrix Multiplication");
-    allInstructions.push_back("# Matrix dimensions: " + std::to_string(dims.M) + "x" + 
-                             std::to_string(dims.K) + " * " + std::to_string(dims.K) + 
-                             "x" + std::to_string(dims.N));
-    allInstructions.push_back("# Using " + std::to_string(workAssignments.size()) + " cores");
-    allInstructions.push_back("");
-    
-    // Generate instructions for each core
-    for (const auto& work : workAssignments) {
-        std::vector<std::string> coreInstructions = generateCoreInstructions(
-            work.coreId, work.startRow, work.endRow, dims, memoryMap);
-        
-        // Add a blank line between cores for readability
-        if (!allInstructions.empty() && !allInstructions.back().empty()) {
-            allInstructions.push_back("");
+    MemoryMap memoryMap = optimizeMemoryLayout(dims, codegenOptions);
+    
+    // Refuse programs whose core ids or memory rows the ISA cannot encode
+    std::string isaError;
+    if (!checkProgramFitsIsa(workAssignments, memoryMap, dims, isaError)) {
+        std::cerr << "Error: Program does not fit the target ISA: " << isaError << std::endl;
+        std::cerr << "Use --isa to select a wider instruction format." << std::endl;
+        return 1;
+    }
+    
+    if (isPacked(codegenOptions.precision)) {
+        // Rows the same matrices take one element per slot
+        int64_t unpacked = 0;
+        const int64_t sizes[] = {static_cast<int64_t>(dims.M) * dims.K, static_cast<int64_t>(dims.K) * dims.N,
+                                 static_cast<int64_t>(dims.M) * dims.N};
+        for (int64_t size : sizes) {
+            unpacked += (size + isa.memoryRowSize - 1) / isa.memoryRowSize;
+        }
+        int64_t packed = memoryMap.baseAddrBias;
+        std::cout << "Packing: A, B and C take " << packed << " memory rows instead of " << unpacked << " ("
+                  << std::fixed << std::setprecision(2) << static_cast<double>(unpacked) / packed
+                  << "x fewer)" << std::endl;
+        std::cout.unsetf(std::ios::floatfield);
+        std::cout << std::setprecision(6);
+    }
+    
+    CodegenOptions resolvedOptions = codegenOptions;
+    if (memoryMap.tileK > 0) {
+        // Tiles replace the loop order; report the plan under the same model
+        TilePlan plan = tilePlanOf(memoryMap);
+        uint64_t activations = countTiledRowActivations(dims, plan, workAssignments);
+        uint64_t instructions = 0;
+        for (const auto& work : workAssignments) {
+            instructions += tiledCoreInstructions(dims, plan, work, codegenOptions.rowReuse);
         }
+        std::cout << "\nTiles: " << plan.tileM << " rows x " << plan.tileN << " columns x " << plan.tileK
+                  << " k per tile";
+        if (!requestedTiles.tileM || !requestedTiles.tileN || !requestedTiles.tileK) {
+            std::cout << " (chosen by the tiling planner)";
+        }
+        std::cout << std::endl;
+        std::cout << "  tiled: " << activations << " row activations, " << instructions << " instructions, "
+                  << instructions + static_cast<uint64_t>(ROW_ACTIVATION_CYCLES) * activations << " cycles"
+                  << std::endl;
+    } else {
+        // Pick the loop nest; the model's numbers are printed either way
+        std::vector<LoopOrderCost> orderCosts = compareLoopOrders(dims, memoryMap, codegenOptions);
+        resolvedOptions = resolveLoopOrder(dims, memoryMap, codegenOptions);
+        std::cout << "\nLoop order: " << loopOrderName(resolvedOptions.loopOrder);
+        if (codegenOptions.loopOrder == LOOP_ORDER_AUTO && !kernels.empty()) {
+            std::cout << " (" << kernels[0].description << ")";
+        } else if (codegenOptions.loopOrder == LOOP_ORDER_AUTO) {
+            std::cout << " (chosen by the row activation model)";
+        }
+        if (resolvedOptions.loopOrder == LOOP_ORDER_BLOCKED) {
+            std::cout << ", " << blockColumnsFor(dims, resolvedOptions) << " columns per block";
+        }
+        std::cout << std::endl;
+        for (const auto& cost : orderCosts) {
+            std::cout << "  " << loopOrderName(cost.order) << ": " << cost.activations << " row activations, "
+                      << cost.instructions << " instructions, " << cost.cycles << " cycles" << std::endl;
+        }
+    
+        // Operand traffic of each dataflow on this work split, and of the
+        // register-blocked or weight-specialized kernel if selected
+        std::cout << "Dataflow: " << dataflowName(dataflowOf(resolvedOptions.loopOrder)) << "-stationary"
+                  << std::endl;
+        const LoopOrder representatives[] = {LOOP_ORDER_IJK, LOOP_ORDER_IKJ, LOOP_ORDER_KJI};
+        std::vector<std::pair<std::string, AccessCounts>> traffic;
+        for (LoopOrder order : representatives) {
+            traffic.push_back(std::make_pair(std::string(dataflowName(dataflowOf(order))) + "-stationary",
+                                             countAccesses(dims, workAssignments, memoryMap, order,
+                                                           blockColumnsFor(dims, resolvedOptions))));
+        }
+        if (usesRegisterBlocking(memoryMap, resolvedOptions)) {
+            traffic.push_back(std::make_pair("register-blocked (" + std::to_string(resolvedOptions.registerBlock) +
+                                             " accumulators)",
+                                             countRegisterBlockedAccesses(dims, workAssignments,
+                                                                          resolvedOptions.registerBlock)));
+        }
+        if (usesWeightSpecialization(memoryMap, resolvedOptions)) {
+            traffic.push_back(std::make_pair("weight-specialized",
+                                             countWeightedAccesses(dims, workAssignments, memoryMap,
+                                                                   *resolvedOptions.weights)));
+        }
+        std::cout << std::fixed << std::setprecision(3);
+        for (const auto& entry : traffic) {
+            const AccessCounts& counts = entry.second;
+            double macs = static_cast<double>(std::max<uint64_t>(counts.macs, 1));
+            std::cout << "  " << entry.first << ": "
+                      << counts.loads() / macs << " loads/MAC (A " << counts.aLoads / macs
+                      << ", B " << counts.bLoads / macs << ", C " << counts.cLoads / macs << ") + "
+                      << counts.aMacReads / macs << " A reads by the MAC, "
+                      << counts.cStores / macs << " stores/MAC" << std::endl;
+        }
+        std::cout.unsetf(std::ios::floatfield);
+        std::cout << std::setprecision(6);
+    }
+    
+    // Loading the tables is paid once per core; the lookups on every MAC
+    if (memoryMap.lutImages > 0) {
+        LatencyModel latency;
+        uint64_t loads = static_cast<uint64_t>(memoryMap.lutImages) * workAssignments.size();
+        uint64_t macs = static_cast<uint64_t>(dims.M) *
+                        (codegenOptions.weights ? weightPlan.macsPerRow : static_cast<uint64_t>(dims.N) * dims.K);
+        if (codegenOptions.sparse) {
+            macs = codegenOptions.sparse->macs;
+        }
+        int lookups = lutLookupsPerMac(codegenOptions.lutPrecision);
+        std::cout << "LUT programming: " << memoryMap.lutImages << " tables per core, " << loads
+                  << " PROG loads x " << latency.program << " cycles = " << loads * latency.program
+                  << " cycles, vs " << macs << " MACs x " << lookups << " lookups = " << macs * lookups
+                  << " lookup cycles" << std::endl;
+    }
+    
+    // Dry run: report what generation would produce without generating it
+    if (estimateOnly) {
+        auto estimateStart = std::chrono::high_resolution_clock::now();
+        CompileEstimate estimate = estimateCompile(dims, workAssignments, memoryMap, resolvedOptions);
+        auto estimateEnd = std::chrono::high_resolution_clock::now();
         
-        // Add this core's instructions to the master list
-        allInstructions.insert(allInstructions.end(), 
-                              coreInstructions.begin(), 
-                              coreInstructions.end());
+        std::cout << std::endl;
+        printEstimate(estimate);
+        if (persistent) {
+            std::cout << "  (the per-invocation program; the setup program is PROG, "
+                      << memoryMap.lutImages << " table loads and END per core, "
+                      << workAssignments.size() * (2 + memoryMap.lutImages) << " instructions)" << std::endl;
+        }
+        std::cout << "Estimate computed in " 
+                  << std::chrono::duration_cast<std::chrono::microseconds>(estimateEnd - estimateStart).count()
+                  << " us" << std::endl;
+        return 0;
     }
     
-    // Step 6: Write instructions to output file
-    std::cout << "\nWriting " << allInstructions.size() << " instructions to " 
-              << outputFile << "..." << std::endl;
+    // Step 5: Generate PIM instructions for each core, streaming them
+    // straight to the output file
+    CountingSink setupCounter;
+    if (persistent) {
+        // The setup program first, through the same schedule
+        std::cout << "\nGenerating the setup program and writing it to " << setupFile << "..." << std::endl;
+        CodegenOptions setupResolved = resolvedOptions;
+        setupResolved.part = PROGRAM_SETUP;
+        std::ofstream setupText;
+        std::unique_ptr<InstructionSink> setupOutput =
+            openProgramFile(outputFormat, setupFile, dims, workAssignments, setupResolved, setupText);
+        if (!setupOutput) {
+            return 1;
+        }
+        TeeSink setupSink(*setupOutput, setupCounter);
+        std::unique_ptr<InstructionSink> setupMerger;
+        if (codegenOptions.schedule == SCHEDULE_INTERLEAVE) {
+            setupMerger.reset(new InterleavingSink(setupSink, memoryMap));
+        } else if (codegenOptions.schedule == SCHEDULE_BROADCAST) {
+            setupMerger.reset(new BroadcastSink(setupSink));
+        }
+        InstructionSink& setupTarget = setupMerger ? *setupMerger : static_cast<InstructionSink&>(setupSink);
+        generateCoresParallel(workAssignments, dims, memoryMap, 1, setupTarget, setupResolved);
+        if (!setupTarget.finish()) {
+            std::cerr << "Error: Failed writing setup program " << setupFile << std::endl;
+            return 1;
+        }
+    }
     
-    std::ofstream outFile(outputFile);
-    if (!outFile.is_open()) {
-        std::cerr << "Error: Could not open output file " << outputFile << std::endl;
+    std::cout << "\nGenerating PIM instructions and writing them to " << outputFile << "..." << std::endl;
+    std::ofstream textFile;
+    std::unique_ptr<InstructionSink> output =
+        openProgramFile(outputFormat, outputFile, dims, workAssignments, resolvedOptions, textFile);
+    if (!output) {
         return 1;
     }
     
-    for (const auto& instr : allInstructions) {
-        if (!instr.empty() && instr[0] != '#') {
-            // This is an actual instruction, not a comment
-            outFile << instr << " # Binary: " << hexToBinary(instr) << std::endl;
-        } else {
-            // This is a comment or empty line
-            outFile << instr << std::endl;
+    CountingSink counter;
+    TeeSink sink(*output, counter);
+    InstructionSink* target = &sink;
+    std::unique_ptr<InterleavingSink> interleaver;
+    std::unique_ptr<BroadcastSink> broadcaster;
+    if (codegenOptions.schedule == SCHEDULE_INTERLEAVE) {
+        interleaver.reset(new InterleavingSink(sink, memoryMap));
+        target = interleaver.get();
+    } else if (codegenOptions.schedule == SCHEDULE_BROADCAST) {
+        broadcaster.reset(new BroadcastSink(sink));
+        target = broadcaster.get();
+    }
+    generateCoresParallel(workAssignments, dims, memoryMap, numThreads, *target, resolvedOptions);
+    
+    // Step 6: Complete the output file
+    if (!target->finish()) {
+        std::cerr << "Error: Failed writing output file " << outputFile << std::endl;
+        return 1;
+    }
+    if (interleaver) {
+        const ScheduleReport& schedule = interleaver->scheduleReport();
+        std::cout << "Schedule: " << schedule.instructions << " instructions, predicted makespan "
+                  << schedule.interleaveCycles << " cycles interleaved vs " << schedule.concatCycles
+                  << " concatenated (" << std::fixed << std::setprecision(2)
+                  << static_cast<double>(schedule.concatCycles) / std::max<uint64_t>(schedule.interleaveCycles, 1)
+                  << "x)" << std::endl;
+        std::cout.unsetf(std::ios::floatfield);
+        std::cout << std::setprecision(6);
+    }
+    if (broadcaster) {
+        // Controller bus traffic: every instruction is one word
+        const BroadcastReport& broadcast = broadcaster->broadcastReport();
+        uint64_t wordBytes = isa.instructionBytes();
+        std::cout << "Broadcast: " << broadcast.emitted << " instructions on the controller bus instead of "
+                  << broadcast.instructions << " (" << broadcast.broadcasts << " broadcast to a core group), "
+                  << broadcast.emitted * wordBytes << " bytes vs " << broadcast.instructions * wordBytes
+                  << " (" << std::fixed << std::setprecision(1)
+                  << 100.0 * (broadcast.instructions - broadcast.emitted) / std::max<uint64_t>(broadcast.instructions, 1)
+                  << "% less)" << std::endl;
+        std::cout.unsetf(std::ios::floatfield);
+        std::cout << std::setprecision(6);
+    }
+    if (codegenOptions.pipeline) {
+        std::cout << "Pipeline: " << counter.noops << " of " << counter.instructions
+                  << " instructions are NOOPs that keep every core hazard-free without interlocks" << std::endl;
+    }
+    if (persistent) {
+        // Every core is programmed once rather than on each invocation
+        LatencyModel latency;
+        uint64_t skipped = workAssignments.size() * (1 + static_cast<uint64_t>(memoryMap.lutImages));
+        std::cout << "Persistent kernel: setup program of " << setupCounter.instructions << " instructions written to "
+                  << setupFile << "; each invocation skips " << skipped << " PROG instructions ("
+                  << skipped * latency.program << " cycles) and leaves B in place" << std::endl;
+    }
+    if (isaOverflowCount() > 0) {
+        std::cerr << "Error: " << isaOverflowCount() << " instruction fields overflowed ISA " 
+                  << isa.name << "; removing " << outputFile << std::endl;
+        std::remove(outputFile.c_str());
+        if (persistent) {
+            std::remove(setupFile.c_str());
         }
+        return 1;
+    }
+    
+    size_t dataInstructions = counter.instructions;
+    size_t commentLines = counter.annotations;
+    size_t setupCommentLines = setupCounter.annotations;
+    if (outputFormat == "text") {
+        // Header comment lines plus one blank separator line per core
+        commentLines += 3 + workAssignments.size();
+        setupCommentLines += 3 + workAssignments.size();
     }
-    outFile.close();
     
-    // Calculate and display statistics
-    int dataInstructions = 0;
-    for (const auto& instr : allInstructions) {
-        if (!instr.empty() && instr[0] != '#') {
-            dataInstructions++;
+    if (useCache) {
+        CacheEntryInfo entry;
+        entry.instructions = dataInstructions;
+        entry.commentLines = commentLines;
+        CacheEntryInfo setupEntry;
+        setupEntry.instructions = setupCounter.instructions;
+        setupEntry.commentLines = setupCommentLines;
+        if (storeInCache(cacheDir, cacheKey, outputFile, tacFilename, entry) &&
+            (!persistent || storeInCache(cacheDir, setupCacheKey, setupFile, tacFilename, setupEntry))) {
+            std::cout << "Stored in compile cache " << cacheDir << std::endl;
         }
     }
     
@@ -216,8 +861,8 @@ int main(int argc, char* argv[]) {
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(endTime - startTime);
     
     std::cout << "\nCompilation complete!" << std::endl;
-    std::cout << "Total instructions: " << allInstructions.size() << " (including " 
-              << (allInstructions.size() - dataInstructions) << " comments)" << std::endl;
+    std::cout << "Total instructions: " << (dataInstructions + commentLines) << " (including " 
+              << commentLines << " comments)" << std::endl;
     std::cout << "Actual instructions: " << dataInstructions << std::endl;
     std::cout << "Three-address code available in: " << tacFilename << std::endl;
     std::cout << "Time taken: " << duration.count() << " ms" << std::endl;
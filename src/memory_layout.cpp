@@ -1,29 +1,84 @@
 #include "pim_compiler.h"
+#include <algorithm>
 #include <iostream>
 
 MemoryMap optimizeMemoryLayout(const MatrixDimensions& dims) {
+    return optimizeMemoryLayout(dims, CodegenOptions());
+}
+
+MemoryMap optimizeMemoryLayout(const MatrixDimensions& dims, const CodegenOptions& options) {
     MemoryMap map;
+    const int rowSize = activeIsa().memoryRowSize;
+    
+    // Low-precision elements share the slots of a row: A and B at the data
+    // width, C at the accumulator width
+    const ElementPrecision& precision = options.precision;
+    map.elementsPerRowA = rowSize * elementsPerSlot(precision.dataBits);
+    map.elementsPerRowB = map.elementsPerRowA;
+    map.elementsPerRowC = rowSize * elementsPerSlot(precision.accumulatorBits);
     
     // Calculate total elements in each matrix
     int sizeA = dims.M * dims.K;
     int sizeB = dims.K * dims.N;
     int sizeC = dims.M * dims.N;
     
+    // A sparse operand keeps its nonzeros only, packed from its base row
+    const SparsePlan dense = SparsePlan();
+    const SparsePlan& sparse = options.sparse ? *options.sparse : dense;
+    if (sparse.sparseA()) {
+        sizeA = static_cast<int>(sparse.a.nonzeros());
+    }
+    if (sparse.sparseB()) {
+        sizeB = static_cast<int>(sparse.b.nonzeros());
+    }
+    
     // Calculate how many memory rows each matrix requires
-    int rowsA = (sizeA + MEMORY_ROW_SIZE - 1) / MEMORY_ROW_SIZE;
-    int rowsB = (sizeB + MEMORY_ROW_SIZE - 1) / MEMORY_ROW_SIZE;
-    int rowsC = (sizeC + MEMORY_ROW_SIZE - 1) / MEMORY_ROW_SIZE;
+    int rowsA = (sizeA + map.elementsPerRowA - 1) / map.elementsPerRowA;
+    int rowsB = (sizeB + map.elementsPerRowB - 1) / map.elementsPerRowB;
+    int rowsC = (sizeC + map.elementsPerRowC - 1) / map.elementsPerRowC;
+    
+    // A tiled layout gives every tile a row of its own, edge tiles padded
+    const TilePlan& plan = options.tiles;
+    bool tiled = options.tiling && isTiled(plan);
+    map.tileM = map.tileN = map.tileK = 0;
+    if (tiled) {
+        int tilesM = (dims.M + plan.tileM - 1) / plan.tileM;
+        int tilesN = (dims.N + plan.tileN - 1) / plan.tileN;
+        int tilesK = (dims.K + plan.tileK - 1) / plan.tileK;
+        rowsA = tilesM * tilesK;
+        rowsB = tilesK * tilesN;
+        rowsC = tilesM * tilesN;
+        map.tileM = plan.tileM;
+        map.tileN = plan.tileN;
+        map.tileK = plan.tileK;
+    }
     
     // Calculate how many memory rows each matrix row requires
-    map.rowsPerMatrixRowA = (dims.K + MEMORY_ROW_SIZE - 1) / MEMORY_ROW_SIZE;
-    map.rowsPerMatrixRowB = (dims.N + MEMORY_ROW_SIZE - 1) / MEMORY_ROW_SIZE;
-    map.rowsPerMatrixRowC = (dims.N + MEMORY_ROW_SIZE - 1) / MEMORY_ROW_SIZE;
+    map.rowsPerMatrixRowA = (dims.K + map.elementsPerRowA - 1) / map.elementsPerRowA;
+    map.rowsPerMatrixRowB = (dims.N + map.elementsPerRowB - 1) / map.elementsPerRowB;
+    map.rowsPerMatrixRowC = (dims.N + map.elementsPerRowC - 1) / map.elementsPerRowC;
+    if (sparse.sparseA()) {
+        map.rowsPerMatrixRowA = std::max(1, (sparse.maxRowNonzerosA + map.elementsPerRowA - 1) / map.elementsPerRowA);
+    }
     
     // Assign base addresses (row numbers)
     map.baseAddrA = 0;
     map.baseAddrB = rowsA;
     map.baseAddrC = rowsA + rowsB;
     
+    // The epilogue's bias follows C, stored as C is, then its output stage
+    // parameters in a row of their own
+    const EpilogueSpec noEpilogue = EpilogueSpec();
+    const EpilogueSpec& epilogue = options.epilogue ? *options.epilogue : noEpilogue;
+    map.baseAddrBias = map.baseAddrC + rowsC;
+    map.biasRows = epilogue.bias ? (dims.N + map.elementsPerRowC - 1) / map.elementsPerRowC : 0;
+    map.baseAddrOutputStage = map.baseAddrBias + map.biasRows;
+    map.outputStages = epilogue.hasOutputStage() ? 1 : 0;
+    
+    // LUT images follow, one per row, shared by every core
+    map.baseAddrLut = map.baseAddrOutputStage + map.outputStages;
+    map.lutImages = static_cast<int>(lutFunctions(options.lutPrecision).size());
+    
     // Store individual row sizes
     map.rowSizeA = dims.K;  // Each row of A has K elements
     map.rowSizeB = dims.N;  // Each row of B has N elements
@@ -40,6 +95,42 @@ MemoryMap optimizeMemoryLayout(const MatrixDimensions& dims) {
               << ", B=" << map.rowsPerMatrixRowB 
               << ", C=" << map.rowsPerMatrixRowC 
               << " memory rows per matrix row" << std::endl;
+    if (isPacked(precision)) {
+        std::cout << "  Packed: A and B as int" << precision.dataBits << ", "
+                  << elementsPerSlot(precision.dataBits) << " per slot (" << map.elementsPerRowA
+                  << " per row); C as int" << precision.accumulatorBits << ", "
+                  << elementsPerSlot(precision.accumulatorBits) << " per slot (" << map.elementsPerRowC
+                  << " per row)" << std::endl;
+    }
+    if (hasEpilogue(epilogue)) {
+        std::cout << "  Epilogue:";
+        if (map.biasRows > 0) {
+            std::cout << " bias at base address " << map.baseAddrBias << " (" << map.biasRows << " rows)";
+        }
+        if (map.outputStages > 0) {
+            std::cout << (map.biasRows > 0 ? "," : "") << " output stage parameters in row "
+                      << map.baseAddrOutputStage;
+        }
+        std::cout << std::endl;
+    }
+    if (map.lutImages > 0) {
+        std::cout << "  LUT images: Base address = " << map.baseAddrLut << ", " << map.lutImages
+                  << " tables for " << options.lutPrecision << "-bit operands (" << map.lutImages
+                  << " rows)" << std::endl;
+    }
+    if (tiled) {
+        std::cout << "  Tiled: A in " << plan.tileM << "x" << plan.tileK << ", B in " << plan.tileK
+                  << "x" << plan.tileN << ", C in " << plan.tileM << "x" << plan.tileN
+                  << " tiles, one memory row each" << std::endl;
+    }
+    if (isSparse(sparse)) {
+        std::cout << "  Sparse: A " << (sparse.sparseA() ? "as its nonzeros in CSR order" : "dense")
+                  << ", B " << (sparse.sparseB() ? "as its nonzeros in CSC order" : "dense") << " ("
+                  << rowsA + rowsB << " rows instead of "
+                  << (dims.M * dims.K + map.elementsPerRowA - 1) / map.elementsPerRowA +
+                     (dims.K * dims.N + map.elementsPerRowB - 1) / map.elementsPerRowB
+                  << ")" << std::endl;
+    }
     
     return map;
 }
\ No newline at end of file
@@ -0,0 +1,100 @@
+#include "pim_compiler.h"
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// Work queue shared by the generator threads and the writer
+struct CodegenQueue {
+    std::mutex lock;
+    std::condition_variable changed;
+    size_t nextToGenerate = 0;
+    size_t nextToWrite = 0;
+    std::vector<std::unique_ptr<InstructionBuffer>> finished;
+};
+
+void generateCoresParallel(const std::vector<WorkAssignment>& assignments,
+                           const MatrixDimensions& dims, const MemoryMap& memMap,
+                           int numThreads, InstructionSink& sink,
+                           const CodegenOptions& options) {
+    if (numThreads <= 0) {
+        numThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    size_t numPrograms = assignments.size();
+    numThreads = static_cast<int>(std::min<size_t>(numThreads, numPrograms));
+
+    if (numThreads <= 1) {
+        // Nothing to overlap, stream directly
+        for (const auto& work : assignments) {
+            sink.beginCore(work);
+            generateCoreInstructions(work.coreId, work.startRow, work.endRow, dims, memMap, sink, options);
+            sink.endCore();
+        }
+        return;
+    }
+
+    // Workers may run at most this many programs ahead of the writer, which
+    // bounds how many finished buffers are held at once
+    const size_t window = 2 * static_cast<size_t>(numThreads);
+
+    CodegenQueue queue;
+    queue.finished.resize(numPrograms);
+
+    auto worker = [&]() {
+        while (true) {
+            size_t index;
+            {
+                std::unique_lock<std::mutex> guard(queue.lock);
+                queue.changed.wait(guard, [&]() {
+                    return queue.nextToGenerate >= numPrograms ||
+                           queue.nextToGenerate < queue.nextToWrite + window;
+                });
+                if (queue.nextToGenerate >= numPrograms) {
+                    return;
+                }
+                index = queue.nextToGenerate++;
+            }
+
+            const WorkAssignment& work = assignments[index];
+            std::unique_ptr<InstructionBuffer> program(new InstructionBuffer(
+                generateCoreInstructions(work.coreId, work.startRow, work.endRow, dims, memMap, options)));
+
+            {
+                std::lock_guard<std::mutex> guard(queue.lock);
+                queue.finished[index] = std::move(program);
+            }
+            queue.changed.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; t++) {
+        threads.emplace_back(worker);
+    }
+
+    // Write programs strictly in core order so the output matches a serial run
+    for (size_t index = 0; index < numPrograms; index++) {
+        std::unique_ptr<InstructionBuffer> program;
+        {
+            std::unique_lock<std::mutex> guard(queue.lock);
+            queue.changed.wait(guard, [&]() { return queue.finished[index] != nullptr; });
+            program = std::move(queue.finished[index]);
+        }
+
+        sink.beginCore(assignments[index]);
+        replayBuffer(*program, sink);
+        sink.endCore();
+        program.reset();
+
+        {
+            std::lock_guard<std::mutex> guard(queue.lock);
+            queue.nextToWrite = index + 1;
+        }
+        queue.changed.notify_all();
+    }
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
@@ -0,0 +1,44 @@
+#include "pim_compiler.h"
+
+const char* programPartName(ProgramPart part) {
+    switch (part) {
+        case PROGRAM_WHOLE: return "whole";
+        case PROGRAM_SETUP: return "setup";
+        case PROGRAM_INVOCATION: return "invocation";
+        default: return "?";
+    }
+}
+
+bool parseProgramPart(const std::string& name, ProgramPart& out) {
+    const ProgramPart parts[] = {PROGRAM_WHOLE, PROGRAM_SETUP, PROGRAM_INVOCATION};
+    for (ProgramPart part : parts) {
+        if (name == programPartName(part)) {
+            out = part;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool emitCoreSetup(int coreId, const MemoryMap& memMap, ProgramPart part, InstructionSink& sink) {
+    // We use a unique function ID (1 = matrix multiplication). A persistent
+    // kernel's invocations find the core programmed by its setup program.
+    if (part != PROGRAM_INVOCATION) {
+        sink.emit(genProgInstr(coreId, true, false, 1));
+        
+        // Then load the multiply and add tables, if the program supplies them
+        for (int image = 0; image < memMap.lutImages; image++) {
+            sink.emit(genProgInstr(coreId, true, true, memMap.baseAddrLut + image));
+        }
+    }
+    if (part == PROGRAM_SETUP) {
+        sink.emit(genParkInstr(coreId));
+        return false;
+    }
+    return true;
+}
+
+Instruction coreEndInstr(int coreId, ProgramPart part) {
+    // Invocations park the core again rather than end
+    return part == PROGRAM_INVOCATION ? genParkInstr(coreId) : genEndInstr(coreId, false, false, 0);
+}
@@ -0,0 +1,59 @@
+#include "pim_compiler.h"
+
+bool parseDataPrecision(const std::string& text, int& bits) {
+    const char* names[] = {"int4", "int8", "int32"};
+    for (const char* name : names) {
+        if (text == name) {
+            bits = std::stoi(text.substr(3));
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string describeElementPrecision(const ElementPrecision& precision) {
+    return std::to_string(precision.dataBits) + "," + std::to_string(precision.accumulatorBits);
+}
+
+bool parseElementPrecision(const std::string& text, ElementPrecision& out) {
+    std::istringstream in(text);
+    ElementPrecision precision;
+    char comma = 0;
+    if (!(in >> precision.dataBits >> comma >> precision.accumulatorBits) || comma != ',' ||
+        !(in >> std::ws).eof()) {
+        return false;
+    }
+    bool dataValid = precision.dataBits == 4 || precision.dataBits == 8 ||
+                     precision.dataBits == MEMORY_SLOT_BITS;
+    bool accumulatorValid = precision.accumulatorBits == 8 || precision.accumulatorBits == 16 ||
+                            precision.accumulatorBits == MEMORY_SLOT_BITS;
+    if (!dataValid || !accumulatorValid) {
+        return false;
+    }
+    out = precision;
+    return true;
+}
+
+int accumulatorBitsNeeded(int dataBits, int K) {
+    int bits = 2 * dataBits;
+    for (int terms = K; terms > 1; terms >>= 1) {
+        bits++;
+    }
+    return bits;
+}
+
+bool choosePrecision(int dataBits, int K, ElementPrecision& out, std::string& error) {
+    int needed = accumulatorBitsNeeded(dataBits, K);
+    const int widths[] = {8, 16, MEMORY_SLOT_BITS};
+    for (int width : widths) {
+        if (width >= needed) {
+            out.dataBits = dataBits;
+            out.accumulatorBits = width;
+            return true;
+        }
+    }
+    error = "a " + std::to_string(K) + "-term sum of int" + std::to_string(dataBits) + " products needs a " +
+            std::to_string(needed) + "-bit accumulator, wider than the " + std::to_string(MEMORY_SLOT_BITS) +
+            "-bit memory slot";
+    return false;
+}
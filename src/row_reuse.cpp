@@ -0,0 +1,73 @@
+#include "pim_compiler.h"
+
+void RowReuseSink::beginCore(const WorkAssignment& work) {
+    flush();
+    latched = false;
+    next.beginCore(work);
+}
+
+void RowReuseSink::emit(Instruction instr) {
+    int opcode = instr.opcode();
+    bool read = instr.read();
+    bool write = instr.write();
+
+    if (holding) {
+        holding = false;
+        if (opcode == OPCODE_EXE && !read && !write) {
+            // The offset completing the held row-set
+            int row = held.addr();
+            bool toWrite = held.write();
+            if (latched && row == latchedRow && toWrite == latchedWrite) {
+                next.emit(genExeInstr(instr.coreId(), true, true, instr.addr()));
+                removed++;
+            } else {
+                next.emit(held);
+                next.emit(instr);
+            }
+            latched = true;
+            latchedRow = row;
+            latchedWrite = toWrite;
+            return;
+        }
+        next.emit(held);
+        latched = true;
+        latchedRow = held.addr();
+        latchedWrite = held.write();
+    }
+
+    if (opcode == OPCODE_EXE && read != write) {
+        // Row-set: wait to see whether its offset follows
+        held = instr;
+        holding = true;
+        return;
+    }
+    if (opcode == OPCODE_PROG || opcode == OPCODE_END) {
+        latched = false;
+    }
+    next.emit(instr);
+}
+
+void RowReuseSink::annotate(const Annotation& note) {
+    flush();
+    next.annotate(note);
+}
+
+void RowReuseSink::endCore() {
+    flush();
+    next.endCore();
+}
+
+bool RowReuseSink::finish() {
+    flush();
+    return next.finish();
+}
+
+void RowReuseSink::flush() {
+    if (holding) {
+        holding = false;
+        next.emit(held);
+        latched = true;
+        latchedRow = held.addr();
+        latchedWrite = held.write();
+    }
+}
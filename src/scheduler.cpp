@@ -0,0 +1,466 @@
+#include "pim_compiler.h"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <queue>
+
+const char* scheduleName(StreamSchedule schedule) {
+    switch (schedule) {
+        case SCHEDULE_CONCAT: return "concat";
+        case SCHEDULE_INTERLEAVE: return "interleave";
+        case SCHEDULE_BROADCAST: return "broadcast";
+        default: return "?";
+    }
+}
+
+bool parseSchedule(const std::string& name, StreamSchedule& out) {
+    const StreamSchedule schedules[] = {SCHEDULE_CONCAT, SCHEDULE_INTERLEAVE, SCHEDULE_BROADCAST};
+    for (StreamSchedule schedule : schedules) {
+        if (name == scheduleName(schedule)) {
+            out = schedule;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<uint32_t> instructionLatencies(const std::vector<Instruction>& program,
+                                           const MemoryMap& memMap, const LatencyModel& model) {
+    std::vector<uint32_t> latencies;
+    latencies.reserve(program.size());
+    bool pending = false;
+    int latchedRow = -1;
+    int openRow[3] = {-1, -1, -1};
+
+    // An element access, opening its row first if the subarray has another open
+    auto access = [&](int row) {
+        int subarray = row < memMap.baseAddrB ? 0 : row < memMap.baseAddrC ? 1 : 2;
+        uint32_t cycles = model.access;
+        if (openRow[subarray] != row) {
+            openRow[subarray] = row;
+            cycles += model.rowActivation;
+        }
+        return cycles;
+    };
+
+    for (Instruction instr : program) {
+        uint32_t cycles = model.issue;
+        if (isOutputStage(instr)) {
+            // Works on the accumulator as a MAC does
+            cycles = model.mac;
+        } else if (instr.opcode() == OPCODE_PROG) {
+            cycles = model.program;
+            pending = false;
+        } else if (instr.opcode() == OPCODE_EXE) {
+            if (instr.read() && instr.write()) {
+                cycles = access(latchedRow);
+            } else if (instr.read() || instr.write()) {
+                latchedRow = instr.addr();
+                pending = true;
+            } else if (pending) {
+                cycles = access(latchedRow);
+                pending = false;
+            } else if (exeOperation(instr.addr()) == EXE_OP_MAC) {
+                cycles = model.mac;
+            }
+        }
+        latencies.push_back(std::max<uint32_t>(cycles, model.issue));
+    }
+    return latencies;
+}
+
+// Fields of a latency table, by key
+static int* latencyField(LatencyModel& model, const std::string& key) {
+    if (key == "issue") return &model.issue;
+    if (key == "access") return &model.access;
+    if (key == "activation") return &model.rowActivation;
+    if (key == "mac") return &model.mac;
+    if (key == "program") return &model.program;
+    return nullptr;
+}
+
+bool parseLatencyModel(const std::string& text, LatencyModel& out, std::string& error) {
+    LatencyModel model = out;
+    std::string token;
+    for (size_t pos = 0; pos <= text.size(); pos++) {
+        char c = pos < text.size() ? text[pos] : '\n';
+        if (c == '#') {
+            // Comment to the end of the line
+            while (pos < text.size() && text[pos] != '\n') {
+                pos++;
+            }
+            c = '\n';
+        }
+        if (c != ',' && !::isspace(static_cast<unsigned char>(c))) {
+            token += c;
+            continue;
+        }
+        if (token.empty()) {
+            continue;
+        }
+        size_t equals = token.find('=');
+        int* field = equals == std::string::npos ? nullptr : latencyField(model, token.substr(0, equals));
+        if (!field) {
+            error = "expected issue, access, activation, mac or program=<cycles>, not '" + token + "'";
+            return false;
+        }
+        std::string value = token.substr(equals + 1);
+        if (value.empty() || value.size() > 6 || value.find_first_not_of("0123456789") != std::string::npos) {
+            error = "latency '" + token + "' is not a number of cycles";
+            return false;
+        }
+        *field = std::stoi(value);
+        token.clear();
+    }
+    // One instruction issues per cycle, so nothing completes sooner
+    if (model.issue < 1 || model.access < 1 || model.mac < 1 || model.program < 1) {
+        error = "latencies must be at least 1 cycle (activation may be 0)";
+        return false;
+    }
+    out = model;
+    return true;
+}
+
+std::string describeLatencyModel(const LatencyModel& model) {
+    return "issue=" + std::to_string(model.issue) + ",access=" + std::to_string(model.access) +
+           ",activation=" + std::to_string(model.rowActivation) + ",mac=" + std::to_string(model.mac) +
+           ",program=" + std::to_string(model.program);
+}
+
+bool loadLatencyModel(const std::string& fileOrText, LatencyModel& out, std::string& error) {
+    std::ifstream file(fileOrText);
+    if (!file.is_open()) {
+        return parseLatencyModel(fileOrText, out, error);
+    }
+    // "key = value" lines: close up the spaces around '='
+    std::string text;
+    std::string line;
+    while (std::getline(file, line)) {
+        size_t equals = line.find('=');
+        size_t comment = line.find('#');
+        if (equals != std::string::npos && equals < comment) {
+            size_t keyEnd = line.find_last_not_of(" \t", equals - 1);
+            size_t valueStart = line.find_first_not_of(" \t", equals + 1);
+            line = line.substr(0, keyEnd == std::string::npos ? 0 : keyEnd + 1) + "=" +
+                   (valueStart == std::string::npos ? "" : line.substr(valueStart));
+        }
+        text += line + "\n";
+    }
+    if (!parseLatencyModel(text, out, error)) {
+        error = fileOrText + ": " + error;
+        return false;
+    }
+    return true;
+}
+
+PipelineTiming::PipelineTiming(const MemoryMap& memMap, const LatencyModel& model)
+    : memoryMap(memMap), latency(model) {
+    reset();
+}
+
+void PipelineTiming::reset() {
+    next = 0;
+    last = 0;
+    std::fill(ready, ready + RESOURCES, 0);
+    std::fill(busy, busy + 3, 0);
+    std::fill(openRow, openRow + 3, -1);
+    pending = false;
+    latchedRow = -1;
+    latchedWrite = false;
+}
+
+PipelineTiming::Effect PipelineTiming::effectOf(Instruction instr) const {
+    Effect effect = {0, 0, -1, -1, static_cast<uint64_t>(latency.issue), false};
+    int opcode = instr.opcode();
+    if (isOutputStage(instr)) {
+        effect.reads = 1u << ACCUMULATOR;
+        effect.writes = 1u << ACCUMULATOR;
+        effect.cycles = latency.mac;
+    } else if (opcode == OPCODE_PROG) {
+        effect.writes = 1u << TABLES;
+        effect.cycles = latency.program;
+    } else if (opcode == OPCODE_END) {
+        effect.barrier = true;
+    } else if (opcode == OPCODE_EXE) {
+        bool reuse = instr.read() && instr.write();
+        if (!reuse && (instr.read() || instr.write())) {
+            effect.writes = 1u << LATCH;
+        } else if (reuse || pending) {
+            // An element access to the latched row
+            effect.row = latchedRow;
+            effect.subarray = latchedRow < memoryMap.baseAddrB ? 0 : latchedRow < memoryMap.baseAddrC ? 1 : 2;
+            effect.cycles = latency.access + (openRow[effect.subarray] != latchedRow ? latency.rowActivation : 0);
+            effect.reads = 1u << LATCH;
+            if (latchedWrite) {
+                effect.reads |= 1u << ACCUMULATOR;
+            } else {
+                effect.writes = 1u << LOADED;
+                if (effect.subarray < 2) {
+                    effect.writes |= 1u << (effect.subarray == 0 ? OPERAND_A : OPERAND_B);
+                }
+            }
+        } else if (exeOperation(instr.addr()) == EXE_OP_MAC) {
+            effect.reads = 1u << OPERAND_A | 1u << OPERAND_B | 1u << ACCUMULATOR | 1u << TABLES;
+            effect.writes = 1u << ACCUMULATOR;
+            effect.cycles = latency.mac;
+        } else if (exeOperation(instr.addr()) == EXE_OP_LOAD_ACC) {
+            effect.reads = 1u << LOADED;
+            effect.writes = 1u << ACCUMULATOR;
+        } else {
+            effect.writes = 1u << ACCUMULATOR;   // CLEAR, SELECT
+        }
+    }
+    effect.cycles = std::max<uint64_t>(effect.cycles, latency.issue);
+    return effect;
+}
+
+uint64_t PipelineTiming::earliest(Instruction instr) const {
+    Effect effect = effectOf(instr);
+    uint64_t cycle = next;
+    for (int r = 0; r < RESOURCES; r++) {
+        if (effect.barrier || (effect.reads >> r & 1)) {
+            cycle = std::max(cycle, ready[r]);
+        } else if ((effect.writes >> r & 1) && ready[r] > effect.cycles) {
+            // Results land in program order
+            cycle = std::max(cycle, ready[r] - effect.cycles);
+        }
+    }
+    for (int s = 0; s < 3; s++) {
+        if (effect.barrier || s == effect.subarray) {
+            cycle = std::max(cycle, busy[s]);
+        }
+    }
+    return cycle;
+}
+
+void PipelineTiming::issue(Instruction instr, uint64_t cycle) {
+    Effect effect = effectOf(instr);
+    uint64_t done = cycle + effect.cycles;
+    for (int r = 0; r < RESOURCES; r++) {
+        if (effect.writes >> r & 1) {
+            ready[r] = done;
+        }
+    }
+    if (effect.subarray >= 0) {
+        busy[effect.subarray] = done;
+        openRow[effect.subarray] = effect.row;
+    }
+    
+    if (instr.opcode() == OPCODE_EXE && instr.read() != instr.write()) {
+        latchedRow = instr.addr();
+        latchedWrite = instr.write();
+        pending = true;
+    } else if (instr.opcode() != OPCODE_NOOP) {
+        pending = false;
+    }
+    last = std::max(last, done);
+    next = cycle + 1;
+}
+
+void HazardPaddingSink::beginCore(const WorkAssignment& work) {
+    timing.reset();
+    next.beginCore(work);
+}
+
+void HazardPaddingSink::emit(Instruction instr) {
+    uint64_t at = timing.earliest(instr);
+    if (at > timing.now()) {
+        Instruction noop = genNoOpInstr(instr.coreId());
+        while (timing.now() < at) {
+            timing.issue(noop, timing.now());
+            next.emit(noop);
+            padding++;
+        }
+    }
+    timing.issue(instr, at);
+    next.emit(instr);
+}
+
+std::vector<uint32_t> interleavePrograms(const std::vector<std::vector<uint32_t>>& latencies,
+                                         const LatencyModel& model, ScheduleReport& report) {
+    report.instructions = 0;
+    report.concatCycles = 0;
+    report.interleaveCycles = 0;
+
+    // Concatenated: every instruction but a core's last waits on the one
+    // before it, so only the hand-over between cores overlaps
+    uint64_t now = 0;
+    for (const auto& program : latencies) {
+        uint64_t freeAt = 0;
+        for (uint32_t cycles : program) {
+            uint64_t issueAt = std::max(now, freeAt);
+            freeAt = issueAt + cycles;
+            now = issueAt + model.issue;
+        }
+        report.concatCycles = std::max(report.concatCycles, freeAt);
+        report.instructions += program.size();
+    }
+    report.concatCycles = std::max(report.concatCycles, now);
+
+    // Interleaved: list scheduling on the cycle each core is free again
+    typedef std::pair<uint64_t, uint32_t> Ready;   // (free at, program)
+    std::priority_queue<Ready, std::vector<Ready>, std::greater<Ready>> ready;
+    std::vector<size_t> next(latencies.size(), 0);
+    for (size_t p = 0; p < latencies.size(); p++) {
+        if (!latencies[p].empty()) {
+            ready.push(Ready(0, static_cast<uint32_t>(p)));
+        }
+    }
+
+    std::vector<uint32_t> order;
+    order.reserve(report.instructions);
+    now = 0;
+    while (!ready.empty()) {
+        Ready slot = ready.top();
+        ready.pop();
+        uint32_t p = slot.second;
+        uint64_t issueAt = std::max(now, slot.first);
+        uint64_t freeAt = issueAt + latencies[p][next[p]];
+        order.push_back(p);
+        report.interleaveCycles = std::max(report.interleaveCycles, freeAt);
+        now = issueAt + model.issue;
+        if (++next[p] < latencies[p].size()) {
+            ready.push(Ready(freeAt, p));
+        }
+    }
+    report.interleaveCycles = std::max(report.interleaveCycles, now);
+    return order;
+}
+
+void InterleavingSink::beginCore(const WorkAssignment& work) {
+    cores.push_back(work);
+    programs.emplace_back();
+}
+
+void InterleavingSink::emit(Instruction instr) {
+    programs.back().push(instr);
+}
+
+void InterleavingSink::annotate(const Annotation& note) {
+    programs.back().annotate(note.kind, note.a, note.b, note.c);
+}
+
+bool InterleavingSink::finish() {
+    std::vector<std::vector<uint32_t>> latencies;
+    for (const auto& program : programs) {
+        latencies.push_back(instructionLatencies(program.instructions, memoryMap, latency));
+    }
+    std::vector<uint32_t> order = interleavePrograms(latencies, latency, report);
+    latencies.clear();
+
+    // Replay in the scheduled order, each comment just ahead of its instruction
+    std::vector<size_t> position(programs.size(), 0);
+    std::vector<size_t> nextNote(programs.size(), 0);
+    for (uint32_t p : order) {
+        const InstructionBuffer& program = programs[p];
+        if (position[p] == 0) {
+            next.beginCore(cores[p]);
+        }
+        while (nextNote[p] < program.annotations.size() &&
+               program.annotations[nextNote[p]].position == position[p]) {
+            next.annotate(program.annotations[nextNote[p]++]);
+        }
+        next.emit(program.instructions[position[p]++]);
+    }
+    for (size_t p = 0; p < programs.size(); p++) {
+        if (programs[p].instructions.empty()) {
+            next.beginCore(cores[p]);
+        }
+        while (nextNote[p] < programs[p].annotations.size()) {
+            next.annotate(programs[p].annotations[nextNote[p]++]);
+        }
+    }
+    programs.clear();
+    return next.finish();
+}
+
+void BroadcastSink::beginCore(const WorkAssignment& work) {
+    cores.push_back(work);
+    programs.emplace_back();
+}
+
+void BroadcastSink::emit(Instruction instr) {
+    programs.back().push(instr);
+}
+
+void BroadcastSink::annotate(const Annotation& note) {
+    programs.back().annotate(note.kind, note.a, note.b, note.c);
+}
+
+bool BroadcastSink::finish() {
+    const IsaDescriptor& isa = activeIsa();
+    const uint32_t coreBits = isa.coreId.mask() << isa.coreId.shift;
+    report.instructions = 0;
+    report.emitted = 0;
+    report.broadcasts = 0;
+    for (const auto& program : programs) {
+        report.instructions += program.size();
+    }
+
+    // A group is cores 0..n, so only the programs of cores 0, 1, 2, ... in
+    // that order can join one
+    size_t groupable = 0;
+    while (groupable < cores.size() && cores[groupable].coreId == static_cast<int>(groupable)) {
+        groupable++;
+    }
+
+    // Step program p past its next instruction, sending its core header and
+    // comments first
+    std::vector<size_t> position(programs.size(), 0);
+    std::vector<size_t> nextNote(programs.size(), 0);
+    auto advance = [&](size_t p) {
+        const InstructionBuffer& program = programs[p];
+        if (position[p] == 0) {
+            next.beginCore(cores[p]);
+        }
+        while (nextNote[p] < program.annotations.size() &&
+               program.annotations[nextNote[p]].position == position[p]) {
+            next.annotate(program.annotations[nextNote[p]++]);
+        }
+        position[p]++;
+    };
+
+    while (true) {
+        // The core furthest behind goes next, lowest index on ties
+        size_t leader = programs.size();
+        for (size_t p = 0; p < programs.size(); p++) {
+            if (position[p] < programs[p].size() &&
+                (leader == programs.size() || position[p] < position[leader])) {
+                leader = p;
+            }
+        }
+        if (leader == programs.size()) {
+            break;
+        }
+
+        Instruction instr = programs[leader].instructions[position[leader]];
+        uint32_t payload = instr.word & ~coreBits;
+        size_t group = 0;
+        while (group < groupable && position[group] < programs[group].size() &&
+               (programs[group].instructions[position[group]].word & ~coreBits) == payload) {
+            group++;
+        }
+
+        if (group > 1 && leader < group) {
+            for (size_t p = 0; p < group; p++) {
+                advance(p);
+            }
+            next.emit(retargetInstr(instr, static_cast<int>(group) - 1, true));
+            report.broadcasts++;
+        } else {
+            advance(leader);
+            next.emit(instr);
+        }
+        report.emitted++;
+    }
+    for (size_t p = 0; p < programs.size(); p++) {
+        if (programs[p].instructions.empty()) {
+            next.beginCore(cores[p]);
+        }
+        while (nextNote[p] < programs[p].annotations.size()) {
+            next.annotate(programs[p].annotations[nextNote[p]++]);
+        }
+    }
+    programs.clear();
+    return next.finish();
+}
@@ -0,0 +1,312 @@
+#include "pim_compiler.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+SparsityPattern SparsityPattern::transposed() const {
+    SparsityPattern t;
+    t.rows = cols;
+    t.cols = rows;
+    t.rowStart.assign(static_cast<size_t>(cols) + 1, 0);
+    for (int c : colIndex) {
+        t.rowStart[c + 1]++;
+    }
+    for (int c = 0; c < cols; c++) {
+        t.rowStart[c + 1] += t.rowStart[c];
+    }
+    // Rows are visited in order, so each column's rows come out ascending
+    t.colIndex.resize(colIndex.size());
+    std::vector<uint32_t> next(t.rowStart.begin(), t.rowStart.end() - 1);
+    for (int r = 0; r < rows; r++) {
+        for (uint32_t p = rowStart[r]; p < rowStart[r + 1]; p++) {
+            t.colIndex[next[colIndex[p]]++] = r;
+        }
+    }
+    return t;
+}
+
+SparsityPattern densePattern(int rows, int cols) {
+    SparsityPattern pattern;
+    pattern.rows = rows;
+    pattern.cols = cols;
+    pattern.rowStart.reserve(static_cast<size_t>(rows) + 1);
+    pattern.colIndex.reserve(static_cast<size_t>(rows) * cols);
+    pattern.rowStart.push_back(0);
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < cols; c++) {
+            pattern.colIndex.push_back(c);
+        }
+        pattern.rowStart.push_back(static_cast<uint32_t>(pattern.colIndex.size()));
+    }
+    return pattern;
+}
+
+// Whitespace-separated tokens of a description, comments dropped
+static std::vector<std::string> descriptionTokens(const std::string& text) {
+    std::vector<std::string> tokens;
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::istringstream words(line.substr(0, line.find('#')));
+        std::string word;
+        while (words >> word) {
+            tokens.push_back(word);
+        }
+    }
+    return tokens;
+}
+
+static bool parseCount(const std::string& token, int64_t& value) {
+    char* end = nullptr;
+    value = std::strtoll(token.c_str(), &end, 10);
+    return !token.empty() && *end == '\0' && value >= 0;
+}
+
+// The tokens after `name`: `count` non-negative integers
+static bool readList(const std::vector<std::string>& tokens, size_t& at, const char* name, size_t count,
+                     std::vector<int64_t>& out, std::string& error) {
+    if (at >= tokens.size() || tokens[at] != name) {
+        error = std::string("expected '") + name + "'";
+        return false;
+    }
+    at++;
+    if (tokens.size() - at < count) {
+        error = std::string("'") + name + "' needs " + std::to_string(count) + " values";
+        return false;
+    }
+    out.resize(count);
+    for (size_t n = 0; n < count; n++, at++) {
+        if (!parseCount(tokens[at], out[n])) {
+            error = std::string("invalid value in '") + name + "': " + tokens[at];
+            return false;
+        }
+    }
+    return true;
+}
+
+// indptr over `major` rows (or columns), then their ascending indices below `minor`
+static bool readCompressed(const std::vector<std::string>& tokens, size_t& at, int64_t major, int64_t minor,
+                           std::vector<int64_t>& indptr, std::vector<int64_t>& indices, std::string& error) {
+    if (!readList(tokens, at, "indptr", static_cast<size_t>(major) + 1, indptr, error)) {
+        return false;
+    }
+    if (indptr[0] != 0) {
+        error = "indptr must start at 0";
+        return false;
+    }
+    for (int64_t r = 0; r < major; r++) {
+        if (indptr[r + 1] < indptr[r]) {
+            error = "indptr must not decrease";
+            return false;
+        }
+    }
+    if (!readList(tokens, at, "indices", static_cast<size_t>(indptr[major]), indices, error)) {
+        return false;
+    }
+    for (int64_t r = 0; r < major; r++) {
+        for (int64_t p = indptr[r]; p < indptr[r + 1]; p++) {
+            if (indices[p] >= minor) {
+                error = "index " + std::to_string(indices[p]) + " is out of range";
+                return false;
+            }
+            if (p > indptr[r] && indices[p] <= indices[p - 1]) {
+                error = "indices must ascend within a row or column";
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool parseDescription(const std::vector<std::string>& tokens, int rows, int cols,
+                             SparsityPattern& out, std::string& error) {
+    const std::string& format = tokens[0];
+    size_t at = 1;
+    std::vector<int64_t> shape;
+    size_t shapeValues = format == "bsr" ? 4 : 2;
+    if (tokens.size() - at < shapeValues) {
+        error = format + " needs its shape";
+        return false;
+    }
+    shape.resize(shapeValues);
+    for (size_t n = 0; n < shapeValues; n++, at++) {
+        if (!parseCount(tokens[at], shape[n]) || (n >= 2 && shape[n] == 0)) {
+            error = "invalid shape: " + tokens[at];
+            return false;
+        }
+    }
+    if (shape[0] != rows || shape[1] != cols) {
+        error = "pattern is " + std::to_string(shape[0]) + " x " + std::to_string(shape[1]) + ", not " +
+                std::to_string(rows) + " x " + std::to_string(cols);
+        return false;
+    }
+
+    SparsityPattern pattern;
+    pattern.rows = rows;
+    pattern.cols = cols;
+    pattern.rowStart.push_back(0);
+    std::vector<int64_t> indptr;
+    std::vector<int64_t> indices;
+    if (format == "csr" || format == "csc") {
+        bool byRow = format == "csr";
+        if (!readCompressed(tokens, at, byRow ? rows : cols, byRow ? cols : rows, indptr, indices, error)) {
+            return false;
+        }
+        pattern.rows = byRow ? rows : cols;
+        pattern.cols = byRow ? cols : rows;
+        pattern.colIndex.assign(indices.begin(), indices.end());
+        for (size_t r = 1; r < indptr.size(); r++) {
+            pattern.rowStart.push_back(static_cast<uint32_t>(indptr[r]));
+        }
+        if (!byRow) {
+            pattern = pattern.transposed();
+        }
+    } else if (format == "bsr") {
+        int64_t blockRows = shape[2];
+        int64_t blockCols = shape[3];
+        int64_t major = (rows + blockRows - 1) / blockRows;
+        if (!readCompressed(tokens, at, major, (cols + blockCols - 1) / blockCols, indptr, indices, error)) {
+            return false;
+        }
+        for (int r = 0; r < rows; r++) {
+            int64_t block = r / blockRows;
+            for (int64_t p = indptr[block]; p < indptr[block + 1]; p++) {
+                int64_t last = std::min<int64_t>(cols, (indices[p] + 1) * blockCols);
+                for (int64_t c = indices[p] * blockCols; c < last; c++) {
+                    pattern.colIndex.push_back(static_cast<int>(c));
+                }
+            }
+            pattern.rowStart.push_back(static_cast<uint32_t>(pattern.colIndex.size()));
+        }
+    } else {
+        for (int r = 0; r < rows; r++, at++) {
+            if (at >= tokens.size() || tokens[at].size() != static_cast<size_t>(cols) ||
+                tokens[at].find_first_not_of("01") != std::string::npos) {
+                error = "mask row " + std::to_string(r) + " must be " + std::to_string(cols) + " 0/1 characters";
+                return false;
+            }
+            for (int c = 0; c < cols; c++) {
+                if (tokens[at][c] == '1') {
+                    pattern.colIndex.push_back(c);
+                }
+            }
+            pattern.rowStart.push_back(static_cast<uint32_t>(pattern.colIndex.size()));
+        }
+    }
+    if (at != tokens.size()) {
+        error = "unexpected " + tokens[at] + " after the pattern";
+        return false;
+    }
+    out = pattern;
+    return true;
+}
+
+bool readSparsityPattern(const std::string& path, int rows, int cols, SparsityPattern& out, std::string& error) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    if (text.compare(0, 6, "\x93NUMPY") != 0) {
+        std::vector<std::string> tokens = descriptionTokens(text);
+        if (!tokens.empty() && (tokens[0] == "csr" || tokens[0] == "csc" || tokens[0] == "bsr" ||
+                                tokens[0] == "mask")) {
+            return parseDescription(tokens, rows, cols, out, error);
+        }
+    }
+
+    // The matrix itself
+    WeightMatrix matrix;
+    if (!readWeightFile(path, rows, cols, matrix, error)) {
+        return false;
+    }
+    out = SparsityPattern();
+    out.rows = rows;
+    out.cols = cols;
+    out.rowStart.push_back(0);
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < cols; c++) {
+            if (matrix.at(r, c) != 0) {
+                out.colIndex.push_back(c);
+            }
+        }
+        out.rowStart.push_back(static_cast<uint32_t>(out.colIndex.size()));
+    }
+    return true;
+}
+
+SparsePlan planSparsity(const MatrixDimensions& dims, const SparsityPattern* a, const std::string& sourceA,
+                        const SparsityPattern* b, const std::string& sourceB) {
+    SparsePlan plan;
+    plan.a = a ? *a : densePattern(dims.M, dims.K);
+    plan.b = b ? b->transposed() : densePattern(dims.N, dims.K);
+    plan.sourceA = a ? sourceA : "";
+    plan.sourceB = b ? sourceB : "";
+    for (int i = 0; i < dims.M; i++) {
+        plan.maxRowNonzerosA = std::max(plan.maxRowNonzerosA,
+                                        static_cast<int>(plan.a.rowStart[i + 1] - plan.a.rowStart[i]));
+    }
+
+    // Each k pairs the nonzeros of column k of A with those of row k of B
+    std::vector<uint64_t> inColumnA(dims.K, 0);
+    std::vector<uint64_t> inRowB(dims.K, 0);
+    for (int k : plan.a.colIndex) {
+        inColumnA[k]++;
+    }
+    for (int k : plan.b.colIndex) {
+        inRowB[k]++;
+    }
+    for (int k = 0; k < dims.K; k++) {
+        plan.macs += inColumnA[k] * inRowB[k];
+    }
+
+    // 64-bit FNV-1a over the shape, which operands are sparse and their
+    // patterns, as 16 hex digits
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto mix = [&hash](const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t n = 0; n < size; n++) {
+            hash ^= bytes[n];
+            hash *= 0x100000001b3ull;
+        }
+    };
+    const int32_t shape[] = {dims.M, dims.K, dims.N, plan.sparseA(), plan.sparseB()};
+    mix(shape, sizeof(shape));
+    for (const SparsityPattern* pattern : {&plan.a, &plan.b}) {
+        mix(pattern->rowStart.data(), pattern->rowStart.size() * sizeof(uint32_t));
+        mix(pattern->colIndex.data(), pattern->colIndex.size() * sizeof(int));
+    }
+    char text[17];
+    std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(hash));
+    plan.fingerprint = text;
+    return plan;
+}
+
+uint32_t SparsePlan::segmentEnd(int i, uint32_t p, int rowSize) const {
+    uint32_t memoryRowEnd = (p / rowSize + 1) * static_cast<uint32_t>(rowSize);
+    return std::min(a.rowStart[i + 1], memoryRowEnd);
+}
+
+void SparsePlan::pairs(int j, uint32_t first, uint32_t last, std::vector<uint32_t>& out) const {
+    out.clear();
+    uint32_t q = b.rowStart[j];
+    for (uint32_t p = first; p < last && q < b.rowStart[j + 1];) {
+        if (a.colIndex[p] < b.colIndex[q]) {
+            p++;
+        } else if (a.colIndex[p] > b.colIndex[q]) {
+            q++;
+        } else {
+            out.push_back(q);
+            p++;
+            q++;
+        }
+    }
+}
+
+bool isSparse(const SparsePlan& plan) {
+    return plan.sparseA() || plan.sparseB();
+}
@@ -0,0 +1,160 @@
+#include "pim_compiler.h"
+#include <cstring>
+#include <ostream>
+
+// Output is assembled here and handed to the stream in blocks of this size
+static const size_t TEXT_BLOCK_BYTES = 1 << 20;
+
+// Longest line the emitter appends in one go (instruction lines are at most
+// 8 + 11 + 32 + 1 bytes)
+static const size_t MAX_LINE_BYTES = 128;
+
+static const char BINARY_MARKER[] = " # Binary: ";
+static const size_t BINARY_MARKER_LENGTH = sizeof(BINARY_MARKER) - 1;
+
+// Per-byte lookup tables: two lowercase hex digits and eight binary digits
+struct TextTables {
+    char hex[256][2];
+    char binary[256][8];
+
+    TextTables() {
+        const char digits[] = "0123456789abcdef";
+        for (int value = 0; value < 256; value++) {
+            hex[value][0] = digits[value >> 4];
+            hex[value][1] = digits[value & 0xF];
+            for (int bit = 0; bit < 8; bit++) {
+                binary[value][bit] = ((value >> (7 - bit)) & 0x1) ? '1' : '0';
+            }
+        }
+    }
+};
+
+static const TextTables& textTables() {
+    static const TextTables tables;
+    return tables;
+}
+
+TextFileSink::TextFileSink(std::ostream& stream, const MatrixDimensions& dims, size_t numCores,
+                           const CodegenOptions& options)
+    : out(stream), block(TEXT_BLOCK_BYTES), used(0),
+      wordBits(activeIsa().wordBits), wordBytes(activeIsa().instructionBytes()),
+      hexDigits(activeIsa().hexDigits()) {
+    std::string header = "# PIM Instructions for Matrix Multiplication\n"
+                         "# Matrix dimensions: " + std::to_string(dims.M) + "x" +
+                         std::to_string(dims.K) + " * " + std::to_string(dims.K) + "x" +
+                         std::to_string(dims.N) + "\n"
+                         "# Using " + std::to_string(numCores) + " cores\n";
+    if (!isDefaultIsa(activeIsa())) {
+        header += "# ISA: " + describeIsa(activeIsa()) + "\n";
+    }
+    std::string layout = layoutTokens(options);
+    if (!layout.empty()) {
+        header += "# Layout: " + layout + "\n";
+    }
+    append(header.data(), header.size());
+}
+
+TextFileSink::~TextFileSink() {
+    flushBlock();
+}
+
+void TextFileSink::beginCore(const WorkAssignment& /*work*/) {
+    // Blank line between cores for readability
+    append("\n", 1);
+}
+
+void TextFileSink::emit(Instruction instr) {
+    if (used + MAX_LINE_BYTES > block.size()) {
+        flushBlock();
+    }
+
+    // Format every byte of the word, most significant first, then keep the
+    // trailing digits that belong to the ISA's word width
+    const TextTables& tables = textTables();
+    char hex[8];
+    char binary[32];
+    for (int b = 0; b < wordBytes; b++) {
+        uint32_t byte = (instr.word >> (8 * (wordBytes - 1 - b))) & 0xFF;
+        std::memcpy(hex + 2 * b, tables.hex[byte], 2);
+        std::memcpy(binary + 8 * b, tables.binary[byte], 8);
+    }
+
+    // "<hex digits> # Binary: <binary digits>\n"
+    char* line = block.data() + used;
+    std::memcpy(line, hex + 2 * wordBytes - hexDigits, hexDigits);
+    line += hexDigits;
+    std::memcpy(line, BINARY_MARKER, BINARY_MARKER_LENGTH);
+    line += BINARY_MARKER_LENGTH;
+    std::memcpy(line, binary + 8 * wordBytes - wordBits, wordBits);
+    line[wordBits] = '\n';
+    used += hexDigits + BINARY_MARKER_LENGTH + wordBits + 1;
+}
+
+void TextFileSink::annotate(const Annotation& note) {
+    // Row and element comments are frequent enough to format in place
+    switch (note.kind) {
+        case NOTE_ROW:
+            append("# Processing row ", 17);
+            appendNumber(note.a);
+            append("\n", 1);
+            break;
+        case NOTE_ELEMENT:
+            append("# Computing element C[", 22);
+            appendNumber(note.a);
+            append("][", 2);
+            appendNumber(note.b);
+            append("]\n", 2);
+            break;
+        default: {
+            std::string line = formatAnnotation(note);
+            append(line.data(), line.size());
+            append("\n", 1);
+            break;
+        }
+    }
+}
+
+bool TextFileSink::finish() {
+    flushBlock();
+    out.flush();
+    return !out.fail();
+}
+
+void TextFileSink::append(const char* text, size_t length) {
+    if (used + length > block.size()) {
+        flushBlock();
+        if (length > block.size()) {
+            out.write(text, length);
+            return;
+        }
+    }
+    std::memcpy(block.data() + used, text, length);
+    used += length;
+}
+
+void TextFileSink::appendNumber(int value) {
+    char digits[12];
+    size_t length = 0;
+    bool negative = value < 0;
+    unsigned int magnitude = negative ? 0u - static_cast<unsigned int>(value) : static_cast<unsigned int>(value);
+    do {
+        digits[length++] = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (negative) {
+        digits[length++] = '-';
+    }
+
+    char text[12];
+    for (size_t i = 0; i < length; i++) {
+        text[i] = digits[length - 1 - i];
+    }
+    append(text, length);
+}
+
+void TextFileSink::flushBlock() {
+    if (used > 0) {
+        out.write(block.data(), used);
+        used = 0;
+    }
+}
@@ -0,0 +1,162 @@
+#include "pim_compiler.h"
+#include <sstream>
+
+bool isTiled(const TilePlan& plan) {
+    return plan.tileM > 0 && plan.tileN > 0 && plan.tileK > 0;
+}
+
+std::string describeTilePlan(const TilePlan& plan) {
+    return std::to_string(plan.tileM) + "," + std::to_string(plan.tileN) + "," + std::to_string(plan.tileK);
+}
+
+bool parseTilePlan(const std::string& text, TilePlan& out) {
+    if (text == "auto") {
+        out = TilePlan();
+        return true;
+    }
+    std::istringstream in(text);
+    TilePlan plan;
+    char comma1 = 0;
+    char comma2 = 0;
+    if (!(in >> plan.tileM >> comma1 >> plan.tileN >> comma2 >> plan.tileK) ||
+        comma1 != ',' || comma2 != ',' || !in.eof() ||
+        plan.tileM < 0 || plan.tileN < 0 || plan.tileK < 0) {
+        return false;
+    }
+    out = plan;
+    return true;
+}
+
+TilePlan tilePlanOf(const MemoryMap& memMap) {
+    TilePlan plan;
+    plan.tileM = memMap.tileM;
+    plan.tileN = memMap.tileN;
+    plan.tileK = memMap.tileK;
+    return plan;
+}
+
+static uint64_t tilesAlong(int size, int tile) {
+    return (static_cast<uint64_t>(size) + tile - 1) / tile;
+}
+
+// M tiles a core's row range touches; each is a separate pass over N and K
+static uint64_t rowPieces(const WorkAssignment& work, const TilePlan& plan) {
+    return static_cast<uint64_t>(work.endRow / plan.tileM - work.startRow / plan.tileM + 1);
+}
+
+uint64_t tiledCoreInstructions(const MatrixDimensions& dims, const TilePlan& plan,
+                               const WorkAssignment& work, bool rowReuse) {
+    const uint64_t N = dims.N;
+    const uint64_t K = dims.K;
+    const uint64_t tilesN = tilesAlong(dims.N, plan.tileN);
+    const uint64_t tilesK = tilesAlong(dims.K, plan.tileK);
+    const uint64_t rows = static_cast<uint64_t>(work.endRow - work.startRow + 1);
+
+    // Every B load of a tile after the first reuses the tile's row, so loads
+    // cost 1 instead of 2 with the reuse pass. Per C element and K tile: a
+    // clear (first tile) or read C + load accumulator (3), 2 + (kLen - 1) * b
+    // for the B loads, kLen MACs and a 2-instruction store. Summed over K
+    // tiles that is 3 tilesK - 2 + tilesK (4 - b) + K (b + 1). Each row also
+    // selects its A row (2) once per N and K tile.
+    const uint64_t b = rowReuse ? 1 : 2;
+    uint64_t perElement = 3 * tilesK - 2 + tilesK * (4 - b) + K * (b + 1);
+    return 2 + rows * (2 * tilesN * tilesK + N * perElement);
+}
+
+uint64_t countTiledRowActivations(const MatrixDimensions& dims, const TilePlan& plan,
+                                  const std::vector<WorkAssignment>& assignments) {
+    const uint64_t tilesN = tilesAlong(dims.N, plan.tileN);
+    const uint64_t tilesK = tilesAlong(dims.K, plan.tileK);
+
+    // A pass over one (M, N, K) tile stays in one row of each subarray, so a
+    // row opens whenever consecutive passes use different tiles: A changes
+    // with the M and K tile, B with the N and K tile, C with the M and N tile
+    uint64_t activations = 0;
+    for (const auto& work : assignments) {
+        uint64_t pieces = rowPieces(work, plan);
+        activations += pieces * (tilesK > 1 ? tilesN * tilesK : 1);
+        activations += tilesN * tilesK > 1 ? pieces * tilesN * tilesK : 1;
+        activations += pieces * tilesN;
+    }
+    return activations;
+}
+
+// Sizes to try along one dimension: the largest allowed, then smaller powers of two
+static std::vector<int> tileCandidates(int size, int limit, int requested) {
+    std::vector<int> candidates;
+    if (requested > 0) {
+        candidates.push_back(std::min(requested, size));
+        return candidates;
+    }
+    int largest = std::max(1, std::min(size, limit));
+    candidates.push_back(largest);
+    int power = 1;
+    while (power * 2 < largest) {
+        power *= 2;
+    }
+    for (; power >= 1; power /= 2) {
+        if (power < largest) {
+            candidates.push_back(power);
+        }
+    }
+    return candidates;
+}
+
+bool planTiles(const MatrixDimensions& dims, const std::vector<WorkAssignment>& assignments,
+               const CodegenOptions& options, TilePlan& out, std::string& error) {
+    const IsaDescriptor& isa = activeIsa();
+    const int rowSize = isa.memoryRowSize;
+    int share = 1;
+    for (const auto& work : assignments) {
+        share = std::max(share, work.endRow - work.startRow + 1);
+    }
+
+    bool found = false;
+    uint64_t best = 0;
+    for (int tileK : tileCandidates(dims.K, rowSize, options.tiles.tileK)) {
+        for (int tileN : tileCandidates(dims.N, rowSize / tileK, options.tiles.tileN)) {
+            for (int tileM : tileCandidates(dims.M, std::min(share, rowSize / std::max(tileK, tileN)),
+                                            options.tiles.tileM)) {
+                if (static_cast<int64_t>(tileM) * tileK > rowSize ||
+                    static_cast<int64_t>(tileK) * tileN > rowSize ||
+                    static_cast<int64_t>(tileM) * tileN > rowSize) {
+                    continue;
+                }
+                TilePlan plan;
+                plan.tileM = tileM;
+                plan.tileN = tileN;
+                plan.tileK = tileK;
+                uint64_t tilesM = tilesAlong(dims.M, tileM);
+                uint64_t tilesN = tilesAlong(dims.N, tileN);
+                uint64_t tilesK = tilesAlong(dims.K, tileK);
+                uint64_t rows = tilesM * tilesK + tilesK * tilesN + tilesM * tilesN;
+                if (rows > static_cast<uint64_t>(isa.maxRows())) {
+                    continue;
+                }
+
+                uint64_t cycles = static_cast<uint64_t>(ROW_ACTIVATION_CYCLES) *
+                                  countTiledRowActivations(dims, plan, assignments);
+                for (const auto& work : assignments) {
+                    cycles += tiledCoreInstructions(dims, plan, work, options.rowReuse);
+                }
+                // Candidates run from large to small, so ties keep the larger tiles
+                if (!found || cycles < best) {
+                    found = true;
+                    best = cycles;
+                    out = plan;
+                }
+            }
+        }
+    }
+
+    if (!found) {
+        error = "no tile plan with tiles of at most " + std::to_string(rowSize) +
+                " elements fits the " + std::to_string(isa.maxRows()) + " rows addressable by ISA " +
+                isa.name;
+        if (options.tiles.tileM > 0 || options.tiles.tileN > 0 || options.tiles.tileK > 0) {
+            error += " (requested " + describeTilePlan(options.tiles) + ")";
+        }
+        return false;
+    }
+    return true;
+}
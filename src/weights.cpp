@@ -0,0 +1,208 @@
+#include "pim_compiler.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <set>
+
+static const char NPY_MAGIC[] = "\x93NUMPY";
+
+// Value of `key` in a .npy header dict, e.g. 'descr': '<i4' -> <i4
+static std::string npyField(const std::string& header, const std::string& key) {
+    size_t pos = header.find("'" + key + "'");
+    if (pos == std::string::npos) {
+        return "";
+    }
+    pos = header.find(':', pos);
+    if (pos == std::string::npos) {
+        return "";
+    }
+    pos = header.find_first_not_of(" ", pos + 1);
+    if (pos == std::string::npos) {
+        return "";
+    }
+    if (header[pos] == '\'') {
+        size_t end = header.find('\'', pos + 1);
+        return end == std::string::npos ? "" : header.substr(pos + 1, end - pos - 1);
+    }
+    if (header[pos] == '(') {
+        size_t end = header.find(')', pos);
+        return end == std::string::npos ? "" : header.substr(pos + 1, end - pos - 1);
+    }
+    size_t end = header.find_first_of(",}", pos);
+    return header.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+}
+
+// Little-endian signed integer of `width` bytes
+static int64_t readSigned(const unsigned char* bytes, int width) {
+    uint64_t value = 0;
+    for (int b = width - 1; b >= 0; b--) {
+        value = value << 8 | bytes[b];
+    }
+    if (width < 8 && (value >> (8 * width - 1)) & 1) {
+        value |= ~0ull << (8 * width);
+    }
+    return static_cast<int64_t>(value);
+}
+
+static bool readNpy(const std::vector<unsigned char>& bytes, int K, int N, WeightMatrix& out, std::string& error) {
+    if (bytes.size() < 10) {
+        error = "truncated .npy header";
+        return false;
+    }
+    int major = bytes[6];
+    size_t headerLength = major == 1 ? bytes[8] | bytes[9] << 8
+                                     : bytes.size() < 12 ? 0 : readSigned(&bytes[8], 4);
+    size_t dataStart = (major == 1 ? 10 : 12) + headerLength;
+    if (headerLength == 0 || dataStart > bytes.size()) {
+        error = "truncated .npy header";
+        return false;
+    }
+    std::string header(bytes.begin() + (major == 1 ? 10 : 12), bytes.begin() + dataStart);
+
+    std::string descr = npyField(header, "descr");
+    int width = 0;
+    if (descr == "|i1" || descr == "i1") {
+        width = 1;
+    } else if (descr == "<i2" || descr == "<i4" || descr == "<i8") {
+        width = descr[2] - '0';
+    } else {
+        error = "weights must be little-endian signed integers, not dtype '" + descr + "'";
+        return false;
+    }
+    bool fortranOrder = npyField(header, "fortran_order") == "True";
+
+    std::string shape = npyField(header, "shape");
+    shape.erase(std::remove(shape.begin(), shape.end(), ' '), shape.end());
+    std::string expected = std::to_string(K) + "," + std::to_string(N);
+    if (shape != expected && shape != expected + ",") {
+        error = "shape (" + shape + ") is not " + std::to_string(K) + " x " + std::to_string(N);
+        return false;
+    }
+    size_t count = static_cast<size_t>(K) * N;
+    if (bytes.size() - dataStart < count * width) {
+        error = "file holds fewer than " + std::to_string(count) + " values";
+        return false;
+    }
+
+    out.K = K;
+    out.N = N;
+    out.values.resize(count);
+    for (size_t index = 0; index < count; index++) {
+        int64_t value = readSigned(&bytes[dataStart + index * width], width);
+        if (value < INT32_MIN || value > INT32_MAX) {
+            error = "weight " + std::to_string(value) + " does not fit int32";
+            return false;
+        }
+        // Column-major files list B[0][0], B[1][0], ...
+        size_t target = fortranOrder ? (index % K) * N + index / K : index;
+        out.values[target] = static_cast<int32_t>(value);
+    }
+    return true;
+}
+
+bool readWeightFile(const std::string& path, int K, int N, WeightMatrix& out, std::string& error) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        error = "cannot open " + path;
+        return false;
+    }
+    std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    if (bytes.size() >= 6 && std::memcmp(bytes.data(), NPY_MAGIC, 6) == 0) {
+        return readNpy(bytes, K, N, out, error);
+    }
+
+    // Raw: exactly K * N little-endian int32 values
+    size_t count = static_cast<size_t>(K) * N;
+    if (bytes.size() != count * 4) {
+        error = "raw weights must be " + std::to_string(K) + " x " + std::to_string(N) + " int32 values (" +
+                std::to_string(count * 4) + " bytes), not " + std::to_string(bytes.size()) + " bytes";
+        return false;
+    }
+    out.K = K;
+    out.N = N;
+    out.values.resize(count);
+    for (size_t index = 0; index < count; index++) {
+        out.values[index] = static_cast<int32_t>(readSigned(&bytes[index * 4], 4));
+    }
+    return true;
+}
+
+WeightPlan planWeights(const WeightMatrix& weights) {
+    WeightPlan plan;
+    plan.K = weights.K;
+    plan.N = weights.N;
+    plan.copies.resize(weights.N);
+    plan.columnStart.push_back(0);
+
+    // Columns are compared through their contents; the first of equal ones is computed
+    std::map<std::vector<int32_t>, int> firstColumn;
+    std::set<int32_t> distinct;
+    std::vector<int32_t> column(weights.K);
+    for (int j = 0; j < weights.N; j++) {
+        for (int k = 0; k < weights.K; k++) {
+            int32_t w = weights.at(k, j);
+            column[k] = w;
+            if (w == 0) {
+                plan.zeros++;
+                continue;
+            }
+            plan.nonzeroK.push_back(k);
+            distinct.insert(w);
+            uint32_t magnitude = w < 0 ? 0u - static_cast<uint32_t>(w) : static_cast<uint32_t>(w);
+            if ((magnitude & (magnitude - 1)) == 0) {
+                plan.powersOfTwo++;
+            }
+        }
+        plan.columnStart.push_back(static_cast<uint32_t>(plan.nonzeroK.size()));
+
+        auto found = firstColumn.find(column);
+        if (found != firstColumn.end()) {
+            plan.copies[found->second].push_back(j);
+        } else {
+            firstColumn[column] = j;
+            plan.computed.push_back(j);
+            plan.macsPerRow += plan.columnStart[j + 1] - plan.columnStart[j];
+        }
+    }
+    plan.distinctValues = distinct.size();
+
+    // 64-bit FNV-1a over the shape and values, as 16 hex digits
+    uint64_t hash = 0xcbf29ce484222325ull;
+    const int32_t shape[] = {weights.K, weights.N};
+    const unsigned char* parts[] = {reinterpret_cast<const unsigned char*>(shape),
+                                    reinterpret_cast<const unsigned char*>(weights.values.data())};
+    const size_t sizes[] = {sizeof(shape), weights.values.size() * sizeof(int32_t)};
+    for (int part = 0; part < 2; part++) {
+        for (size_t b = 0; b < sizes[part]; b++) {
+            hash ^= parts[part][b];
+            hash *= 0x100000001b3ull;
+        }
+    }
+    char text[17];
+    std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(hash));
+    plan.fingerprint = text;
+    return plan;
+}
+
+void WeightPlan::nonzeroRange(int j, int kStart, int kEnd, uint32_t& first, uint32_t& last) const {
+    auto begin = nonzeroK.begin() + columnStart[j];
+    auto end = nonzeroK.begin() + columnStart[j + 1];
+    first = static_cast<uint32_t>(std::lower_bound(begin, end, kStart) - nonzeroK.begin());
+    last = static_cast<uint32_t>(std::lower_bound(begin, end, kEnd) - nonzeroK.begin());
+}
+
+bool weightsFit(const WeightMatrix& weights, int bits) {
+    if (bits >= 32) {
+        return true;
+    }
+    int32_t low = -(1 << (bits - 1));
+    int32_t high = (1 << (bits - 1)) - 1;
+    for (int32_t w : weights.values) {
+        if (w < low || w > high) {
+            return false;
+        }
+    }
+    return true;
+}
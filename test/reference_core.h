@@ -0,0 +1,306 @@
+#ifndef REFERENCE_CORE_H
+#define REFERENCE_CORE_H
+
+#include "pim_compiler.h"
+#include <algorithm>
+#include <cassert>
+#include <sstream>
+
+// C elements no program has stored
+const int64_t UNWRITTEN = INT64_MIN;
+
+// Reference interpreter shared by the tests. Runs core programs on small
+// integer matrices with the simulator's semantics and counts what they do:
+//   - A row-set (EXE R=1 or W=1) and the offset after it, or a reuse of the
+//     latched row (R=1 W=1), access one element. The access is decoded back
+//     to its matrix position through the layout, row-major, packed, tiled or
+//     compact, and must land inside the matrix.
+//   - CLEAR, LOAD_ACC, MAC and SELECT act on numbered accumulators, and a C
+//     store writes the current one.
+//   - A MAC multiplies the B element read last by A[i][k], i from the last A
+//     read. It counts as reading A itself unless that read was A[i][k].
+//   - The bias rows of an epilogue (options.epilogue) hold bias[j], and its
+//     output stage applies the epilogue's parameters to the current
+//     accumulator.
+// Sparse operands (options.sparse) are zero off their patterns. Row
+// activations follow the row activation model: one open row per core in each
+// of the A, B and C subarrays.
+class ReferenceCore : public InstructionSink {
+public:
+    ReferenceCore(const MatrixDimensions& dims, const MemoryMap& memMap, const CodegenOptions& options)
+        : counts(), activations(0), maxAccumulator(0), outputStages(0), dims(dims), memMap(memMap), sparse(options.sparse),
+          epilogue(options.epilogue), acc(activeIsa().accumulators, 0) {
+        a.resize(static_cast<size_t>(dims.M) * dims.K);
+        b.resize(static_cast<size_t>(dims.K) * dims.N);
+        for (int i = 0; i < dims.M; i++) {
+            for (int k = 0; k < dims.K; k++) {
+                a[static_cast<size_t>(i) * dims.K + k] = (i * 7 + k * 3) % 11 - 5;
+            }
+        }
+        for (int k = 0; k < dims.K; k++) {
+            for (int j = 0; j < dims.N; j++) {
+                b[static_cast<size_t>(k) * dims.N + j] = (k * 5 + j) % 13 - 6;
+            }
+        }
+        if (sparse) {
+            std::vector<int32_t> maskedA(a.size(), 0);
+            std::vector<int32_t> maskedB(b.size(), 0);
+            for (int i = 0; i < dims.M; i++) {
+                for (uint32_t p = sparse->a.rowStart[i]; p < sparse->a.rowStart[i + 1]; p++) {
+                    size_t index = static_cast<size_t>(i) * dims.K + sparse->a.colIndex[p];
+                    maskedA[index] = a[index];
+                }
+            }
+            for (int j = 0; j < dims.N; j++) {
+                for (uint32_t q = sparse->b.rowStart[j]; q < sparse->b.rowStart[j + 1]; q++) {
+                    size_t index = static_cast<size_t>(sparse->b.colIndex[q]) * dims.N + j;
+                    maskedB[index] = b[index];
+                }
+            }
+            a.swap(maskedA);
+            b.swap(maskedB);
+        }
+        bias.resize(dims.N);
+        for (int j = 0; j < dims.N; j++) {
+            bias[j] = j * 37 % 101 - 50;
+        }
+        c.assign(static_cast<size_t>(dims.M) * dims.N, UNWRITTEN);
+        beginCore(WorkAssignment());
+    }
+
+    void beginCore(const WorkAssignment& /*work*/) override {
+        pending = false;
+        write = false;
+        row = -1;
+        current = 0;
+        rowOfA = -1;
+        lastA = -1;
+        k = -1;
+        j = -1;
+        loaded = 0;
+        openRow[0] = openRow[1] = openRow[2] = -1;
+        std::fill(acc.begin(), acc.end(), 0);
+    }
+
+    void emit(Instruction instr) override {
+        if (isOutputStage(instr)) {
+            assert(epilogue && instr.addr() == memMap.baseAddrOutputStage && memMap.outputStages == 1);
+            acc[current] = epilogue->apply(acc[current], 0);
+            outputStages++;
+            return;
+        }
+        if (instr.opcode() != OPCODE_EXE) {
+            return;
+        }
+        if (instr.read() && instr.write()) {
+            access(instr.addr());
+        } else if (instr.read() || instr.write()) {
+            row = instr.addr();
+            write = instr.write();
+            pending = true;
+        } else if (pending) {
+            access(instr.addr());
+            pending = false;
+        } else {
+            current = exeAccumulator(instr.addr());
+            assert(current < static_cast<int>(acc.size()));
+            maxAccumulator = std::max(maxAccumulator, current);
+            switch (exeOperation(instr.addr())) {
+            case EXE_OP_CLEAR:
+                acc[current] = 0;
+                break;
+            case EXE_OP_LOAD_ACC:
+                acc[current] = loaded;
+                break;
+            case EXE_OP_MAC:
+                assert(rowOfA >= 0 && k >= 0);
+                if (lastA != static_cast<int64_t>(rowOfA) * dims.K + k) {
+                    counts.aMacReads++;
+                }
+                acc[current] += static_cast<int64_t>(a[static_cast<size_t>(rowOfA) * dims.K + k]) *
+                                b[static_cast<size_t>(k) * dims.N + j];
+                counts.macs++;
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    // C = A * B, with the epilogue if there is one, every element stored
+    bool matchesReference() const {
+        for (int i = 0; i < dims.M; i++) {
+            for (int col = 0; col < dims.N; col++) {
+                int64_t dot = 0;
+                for (int kk = 0; kk < dims.K; kk++) {
+                    dot += static_cast<int64_t>(a[static_cast<size_t>(i) * dims.K + kk]) *
+                           b[static_cast<size_t>(kk) * dims.N + col];
+                }
+                if (epilogue) {
+                    dot = epilogue->apply(dot, epilogue->bias ? bias[col] : 0);
+                }
+                if (c[static_cast<size_t>(i) * dims.N + col] != dot) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Inputs, row-major; tests may replace them before running a program
+    std::vector<int32_t> a;
+    std::vector<int32_t> b;
+    std::vector<int32_t> bias;
+    std::vector<int64_t> c;
+
+    AccessCounts counts;
+    uint64_t activations;
+    int maxAccumulator;
+    uint64_t outputStages;
+
+private:
+    // Position (r, col) of the element at `offset` of memory row `memoryRow`
+    // in a rows x cols matrix stored from `base`, perRow elements or one
+    // tileRows x tileCols tile to a row
+    void locate(int memoryRow, int offset, int base, int perRow, int rows, int cols, int tileRows,
+                int tileCols, int& r, int& col) const {
+        if (memMap.tileK > 0) {
+            int tilesAcross = (cols + tileCols - 1) / tileCols;
+            assert(offset < tileRows * tileCols);
+            r = (memoryRow - base) / tilesAcross * tileRows + offset / tileCols;
+            col = (memoryRow - base) % tilesAcross * tileCols + offset % tileCols;
+        } else {
+            assert(offset < perRow);
+            int64_t index = static_cast<int64_t>(memoryRow - base) * perRow + offset;
+            r = static_cast<int>(index / cols);
+            col = static_cast<int>(index % cols);
+        }
+        assert(r < rows && col < cols);
+    }
+
+    // Row r and column col of nonzero `index` of a compact operand, stored
+    // from `base` in the order of `pattern`
+    void locateNonzero(int memoryRow, int offset, int base, int perRow, const SparsityPattern& pattern, int& r,
+                       int& col) const {
+        int64_t index = static_cast<int64_t>(memoryRow - base) * perRow + offset;
+        assert(index < static_cast<int64_t>(pattern.nonzeros()));
+        r = static_cast<int>(std::upper_bound(pattern.rowStart.begin(), pattern.rowStart.end(), index) -
+                             pattern.rowStart.begin()) - 1;
+        col = pattern.colIndex[index];
+    }
+
+    void access(int offset) {
+        assert(row >= 0 && row < memMap.baseAddrLut);
+        int subarray = row < memMap.baseAddrB ? 0 : row < memMap.baseAddrC ? 1 : 2;
+        if (openRow[subarray] != row) {
+            openRow[subarray] = row;
+            activations++;
+        }
+        if (row >= memMap.baseAddrBias) {
+            assert(!write && row < memMap.baseAddrBias + memMap.biasRows);
+            loaded = bias[static_cast<size_t>(row - memMap.baseAddrBias) * memMap.elementsPerRowC + offset];
+            return;
+        }
+        if (row >= memMap.baseAddrC) {
+            int i, col;
+            locate(row, offset, memMap.baseAddrC, memMap.elementsPerRowC, dims.M, dims.N, memMap.tileM,
+                   memMap.tileN, i, col);
+            int64_t& element = c[static_cast<size_t>(i) * dims.N + col];
+            if (write) {
+                element = acc[current];
+                counts.cStores++;
+            } else {
+                assert(element != UNWRITTEN);
+                loaded = element;
+                counts.cLoads++;
+            }
+            return;
+        }
+        assert(!write);
+        if (row >= memMap.baseAddrB) {
+            if (sparse && sparse->sparseB()) {
+                locateNonzero(row, offset, memMap.baseAddrB, memMap.elementsPerRowB, sparse->b, j, k);
+            } else {
+                locate(row, offset, memMap.baseAddrB, memMap.elementsPerRowB, dims.K, dims.N, memMap.tileK,
+                       memMap.tileN, k, j);
+            }
+            loaded = b[static_cast<size_t>(k) * dims.N + j];
+            counts.bLoads++;
+            return;
+        }
+        int col;
+        if (sparse && sparse->sparseA()) {
+            locateNonzero(row, offset, memMap.baseAddrA, memMap.elementsPerRowA, sparse->a, rowOfA, col);
+        } else {
+            locate(row, offset, memMap.baseAddrA, memMap.elementsPerRowA, dims.M, dims.K, memMap.tileM,
+                   memMap.tileK, rowOfA, col);
+        }
+        lastA = static_cast<int64_t>(rowOfA) * dims.K + col;
+        loaded = a[static_cast<size_t>(lastA)];
+        counts.aLoads++;
+    }
+
+    MatrixDimensions dims;
+    MemoryMap memMap;
+    const SparsePlan* sparse;
+    const EpilogueSpec* epilogue;
+    std::vector<int64_t> acc;
+    bool pending;
+    bool write;
+    int row;
+    int current;
+    int rowOfA;
+    int64_t lastA;
+    int k;
+    int j;
+    int64_t loaded;
+    int openRow[3];
+};
+
+// A kernel's program for every core, as run by the reference interpreter,
+// counted, and written as a text file, with its estimate (all 0 for a
+// pipelined kernel, whose padding the estimator does not follow)
+struct KernelRun {
+    KernelRun(const MatrixDimensions& dims, const MemoryMap& memMap, const CodegenOptions& options)
+        : core(dims, memMap, options), estimate() {}
+
+    ReferenceCore core;
+    CountingSink counter;
+    std::string text;
+    CompileEstimate estimate;
+};
+
+// Generate the program of every core of `work` with `options`, check that it
+// computes C (with B replaced by `b` if given) and that the estimate counts
+// it exactly where there is one
+inline KernelRun runKernel(const MatrixDimensions& dims, const std::vector<WorkAssignment>& work,
+                           const MemoryMap& memMap, const CodegenOptions& options,
+                           const std::vector<int32_t>* b = nullptr) {
+    KernelRun run(dims, memMap, options);
+    if (b) {
+        run.core.b = *b;
+    }
+    std::ostringstream text;
+    TextFileSink textSink(text, dims, work.size(), options);
+    TeeSink files(textSink, run.counter);
+    TeeSink sink(files, run.core);
+    for (const auto& w : work) {
+        sink.beginCore(w);
+        generateCoreInstructions(w.coreId, w.startRow, w.endRow, dims, memMap, sink, options);
+        sink.endCore();
+    }
+    sink.finish();
+    assert(run.core.matchesReference());
+
+    run.text = text.str();
+    if (options.pipeline) {
+        return run;
+    }
+    run.estimate = estimateCompile(dims, work, memMap, options);
+    assert(run.estimate.totalInstructions == run.counter.instructions);
+    assert(run.estimate.totalAnnotations == run.counter.annotations);
+    assert(run.estimate.textBytes == run.text.size());
+    return run;
+}
+
+#endif // REFERENCE_CORE_H
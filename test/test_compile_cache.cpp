@@ -0,0 +1,112 @@
+#include "pim_compiler.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <cassert>
+#include <cstdlib>
+
+static const std::string CACHE_DIR = "test_compile_cache.d/nested";
+
+static void writeFile(const std::string& filename, const std::string& contents) {
+    std::ofstream out(filename, std::ios::binary);
+    out << contents;
+}
+
+static std::string readFile(const std::string& filename) {
+    std::ifstream in(filename, std::ios::binary);
+    std::stringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
+}
+
+void testKeys() {
+    std::cout << "Testing cache keys..." << std::endl;
+    MatrixDimensions dims = {8, 6, 4};
+    std::string key = compileCacheKey(dims, 2, "text");
+    assert(key == compileCacheKey(dims, 2, "text"));
+    assert(key != compileCacheKey(dims, 3, "text"));
+    assert(key != compileCacheKey(dims, 2, "bin"));
+    MatrixDimensions other = {8, 4, 6};
+    assert(key != compileCacheKey(other, 2, "text"));
+    CodegenOptions noReuse;
+    noReuse.rowReuse = false;
+    assert(key == compileCacheKey(dims, 2, "text", CodegenOptions()));
+    assert(key != compileCacheKey(dims, 2, "text", noReuse));
+
+    // More cores than rows compiles the same program as one core per row
+    assert(compileCacheKey(dims, 8, "text") == compileCacheKey(dims, 20, "text"));
+    assert(compileCacheHash(key).size() == 16);
+    assert(compileCacheHash(key) != compileCacheHash(compileCacheKey(dims, 3, "text")));
+}
+
+void testStoreAndFetch() {
+    std::cout << "Testing store and fetch..." << std::endl;
+    std::system(("rm -rf " + CACHE_DIR).c_str());
+    MatrixDimensions dims = {5, 3, 7};
+    std::string key = compileCacheKey(dims, 2, "text");
+
+    CacheEntryInfo info;
+    assert(!fetchFromCache(CACHE_DIR, key, "test_cache_out.pim", "test_cache_out.pim.tac", info));
+
+    writeFile("test_cache_in.pim", "program bytes\n");
+    writeFile("test_cache_in.pim.tac", "tac bytes\n");
+    CacheEntryInfo stored = {123, 45};
+    assert(storeInCache(CACHE_DIR, key, "test_cache_in.pim", "test_cache_in.pim.tac", stored));
+
+    assert(fetchFromCache(CACHE_DIR, key, "test_cache_out.pim", "test_cache_out.pim.tac", info));
+    assert(info.instructions == 123 && info.commentLines == 45);
+    assert(readFile("test_cache_out.pim") == "program bytes\n");
+    assert(readFile("test_cache_out.pim.tac") == "tac bytes\n");
+
+    // A different key under the same hash must not be served
+    std::string keyPath = CACHE_DIR + "/" + compileCacheHash(key) + ".key";
+    writeFile(keyPath, compileCacheKey(dims, 3, "text") + "instructions 1\ncomments 1\n");
+    assert(!fetchFromCache(CACHE_DIR, key, "test_cache_out.pim", "test_cache_out.pim.tac", info));
+}
+
+// Writers racing on one entry must leave readers seeing either nothing or a complete entry
+void testConcurrentStores() {
+    std::cout << "Testing concurrent stores..." << std::endl;
+    std::system(("rm -rf " + CACHE_DIR).c_str());
+    MatrixDimensions dims = {64, 64, 64};
+    std::string key = compileCacheKey(dims, 4, "bin");
+    std::string program(1 << 20, 'p');
+    writeFile("test_cache_big.pimb", program);
+    writeFile("test_cache_big.pimb.tac", "tac\n");
+
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; t++) {
+        writers.emplace_back([&]() {
+            CacheEntryInfo entry = {7, 3};
+            for (int round = 0; round < 5; round++) {
+                assert(storeInCache(CACHE_DIR, key, "test_cache_big.pimb", "test_cache_big.pimb.tac", entry));
+            }
+        });
+    }
+    for (int round = 0; round < 50; round++) {
+        CacheEntryInfo info;
+        if (fetchFromCache(CACHE_DIR, key, "test_cache_read.pimb", "test_cache_read.pimb.tac", info)) {
+            assert(info.instructions == 7 && info.commentLines == 3);
+            assert(readFile("test_cache_read.pimb") == program);
+        }
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+
+    CacheEntryInfo info;
+    assert(fetchFromCache(CACHE_DIR, key, "test_cache_read.pimb", "test_cache_read.pimb.tac", info));
+    assert(readFile("test_cache_read.pimb") == program);
+}
+
+int main() {
+    std::cout << "=== Testing Compile Cache ===" << std::endl;
+
+    testKeys();
+    testStoreAndFetch();
+    testConcurrentStores();
+
+    std::cout << "\nAll tests completed!" << std::endl;
+    return 0;
+}
@@ -3,6 +3,7 @@
 #include <vector>
 #include <string>
 #include <cstdlib>
+#include "pim_compiler.h"
 
 // Simple matrix multiplication reference implementation
 void matrixMultiply(std::vector<std::vector<int>>& A, 
@@ -28,6 +29,7 @@ void simulateInstructions(const std::vector<std::string>& instructions) {
     std::cout << "Simulating " << instructions.size() << " instructions..." << std::endl;
     
     int instr_count = 0;
+    int noop_count = 0;
     int prog_count = 0;
     int exe_count = 0;
     int end_count = 0;
@@ -40,23 +42,22 @@ void simulateInstructions(const std::vector<std::string>& instructions) {
         
         instr_count++;
         
-        // Parse instruction type from first 2 bits (first hex digit)
-        char type_hex = instr[0];
-        int type = 0;
+        // Opcode sits in bits 18-17 of the 24-bit word
+        Instruction decoded;
+        if (!parseHexInstruction(instr, decoded)) {
+            continue;
+        }
         
-        if (type_hex == '0') {
-            // PROG instruction
-            prog_count++;
-        } else if (type_hex == '4' || type_hex == '5') {
-            // EXE instruction
-            exe_count++;
-        } else if (type_hex == '8' || type_hex == '9') {
-            // END instruction
-            end_count++;
+        switch (decoded.opcode()) {
+            case OPCODE_NOOP: noop_count++; break;
+            case OPCODE_PROG: prog_count++; break;
+            case OPCODE_EXE: exe_count++; break;
+            case OPCODE_END: end_count++; break;
         }
     }
     
     std::cout << "Instruction count: " << instr_count << std::endl;
+    std::cout << "  NOOP instructions: " << noop_count << std::endl;
     std::cout << "  PROG instructions: " << prog_count << std::endl;
     std::cout << "  EXE instructions: " << exe_count << std::endl;
     std::cout << "  END instructions: " << end_count << std::endl;
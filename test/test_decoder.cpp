@@ -0,0 +1,140 @@
+#include "pim_compiler.h"
+#include <iostream>
+#include <fstream>
+#include <cassert>
+
+// Every field combination must decode back to what the generators were given
+void testFieldRoundTrip() {
+    std::cout << "Testing field round trip..." << std::endl;
+    std::vector<Instruction> words;
+    for (int core = 0; core < 64; core += 7) {
+        for (int addr = 0; addr < 512; addr += 37) {
+            for (int flags = 0; flags < 4; flags++) {
+                words.push_back(genProgInstr(core, flags & 1, flags & 2, addr));
+                words.push_back(genExeInstr(core, flags & 1, flags & 2, addr));
+                words.push_back(genEndInstr(core, flags & 1, flags & 2, addr));
+            }
+        }
+    }
+    words.push_back(genNoOpInstr());
+
+    std::vector<uint8_t> packed;
+    for (const auto& instr : words) {
+        packed.push_back(instr.word & 0xFF);
+        packed.push_back((instr.word >> 8) & 0xFF);
+        packed.push_back((instr.word >> 16) & 0xFF);
+    }
+
+    DecodedInstructions fromWords;
+    DecodedInstructions fromBytes;
+    decodeInstructions(words, fromWords);
+    decodeInstructions(packed.data(), words.size(), fromBytes);
+    assert(fromWords.size() == words.size());
+    assert(fromBytes.size() == words.size());
+
+    for (size_t i = 0; i < words.size(); i++) {
+        const Instruction& instr = words[i];
+        assert(unpackInstruction(&packed[3 * i]) == instr);
+        assert(fromWords.opcode[i] == instr.opcode() && fromBytes.opcode[i] == instr.opcode());
+        assert(fromWords.coreId[i] == instr.coreId() && fromBytes.coreId[i] == instr.coreId());
+        assert(fromWords.read[i] == instr.read() && fromBytes.read[i] == instr.read());
+        assert(fromWords.write[i] == instr.write() && fromBytes.write[i] == instr.write());
+        assert(fromWords.addr[i] == static_cast<uint32_t>(instr.addr()) &&
+               fromBytes.addr[i] == static_cast<uint32_t>(instr.addr()));
+    }
+}
+
+void testTextForms() {
+    std::cout << "Testing text forms..." << std::endl;
+    Instruction instr;
+    assert(parseHexInstruction("020c00 # Binary: 000000100000110000000000", instr));
+    assert(instr.opcode() == OPCODE_PROG && instr.coreId() == 1 && instr.read() && instr.addr() == 0);
+    assert(disassemble(instr) == "PROG core=1 R=1 W=0 addr=0");
+    assert(disassemble(genExeInstr(3, false, true, 300)) == "EXE  core=3 R=0 W=1 addr=300");
+    assert(!parseHexInstruction("# Processing row 0", instr));
+    assert(!parseHexInstruction("", instr));
+}
+
+// The same program read back from .pim, .pimb and .piml must match the generator
+void testProgramFiles() {
+    std::cout << "Testing program files..." << std::endl;
+    MatrixDimensions dims;
+    dims.M = 9;
+    dims.K = 7;
+    dims.N = 5;
+    std::vector<WorkAssignment> work = distributeWork(dims, 3);
+    MemoryMap memMap = optimizeMemoryLayout(dims);
+
+    std::ofstream textFile("test_decoder.pim");
+    TextFileSink textSink(textFile, dims, work.size(), CodegenOptions());
+    BinaryFileSink binarySink("test_decoder.pimb", dims, work, CodegenOptions());
+    LoopFileSink loopSink("test_decoder.piml", dims, work, CodegenOptions());
+    TeeSink files(textSink, binarySink);
+    TeeSink sink(files, loopSink);
+    std::vector<Instruction> expected;
+    for (const auto& w : work) {
+        InstructionBuffer program = generateCoreInstructions(w.coreId, w.startRow, w.endRow, dims, memMap);
+        expected.insert(expected.end(), program.instructions.begin(), program.instructions.end());
+        sink.beginCore(w);
+        replayBuffer(program, sink);
+        sink.endCore();
+    }
+    sink.finish();
+    textFile.close();
+
+    const char* filenames[] = {"test_decoder.pim", "test_decoder.pimb", "test_decoder.piml"};
+    for (const char* filename : filenames) {
+        LoadedProgram program;
+        assert(readProgramFile(filename, program));
+        assert(program.dims.M == 9 && program.dims.K == 7 && program.dims.N == 5);
+        assert(program.assignments.size() == work.size());
+        assert(program.instructions == expected);
+        size_t next = 0;
+        for (size_t c = 0; c < work.size(); c++) {
+            assert(program.assignments[c].startRow == work[c].startRow);
+            assert(program.assignments[c].endRow == work[c].endRow);
+            assert(program.firstInstr[c] == next);
+            next += program.counts[c];
+        }
+        assert(next == expected.size());
+    }
+}
+
+// A .pimb whose core table points past its stream, or whose header size
+// wraps, must be rejected rather than read out of bounds
+void testCorruptBinary() {
+    std::cout << "Testing corrupt binary programs..." << std::endl;
+    std::ifstream in("test_decoder.pimb", std::ios::binary);
+    std::vector<char> original((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    // Core 0's instruction count, its first instruction, and a core count
+    // whose table size wraps 32 bits
+    const uint32_t damage[][2] = {
+        {40 + 16, 100000000u},
+        {40 + 12, 0xFFFFFFF0u},
+        {24, 0x0CCCCCCDu},
+    };
+    for (const auto& patch : damage) {
+        std::vector<char> bytes = original;
+        for (int b = 0; b < 4; b++) {
+            bytes[patch[0] + b] = static_cast<char>((patch[1] >> (8 * b)) & 0xFF);
+        }
+        std::ofstream out("test_decoder_damaged.pimb", std::ios::binary);
+        out.write(bytes.data(), bytes.size());
+        out.close();
+        LoadedProgram program;
+        assert(!readProgramFile("test_decoder_damaged.pimb", program));
+    }
+}
+
+int main() {
+    std::cout << "=== Testing Instruction Decoder ===" << std::endl;
+
+    testFieldRoundTrip();
+    testTextForms();
+    testProgramFiles();
+    testCorruptBinary();
+
+    std::cout << "\nAll tests completed!" << std::endl;
+    return 0;
+}
@@ -0,0 +1,167 @@
+#include "pim_compiler.h"
+#include "reference_core.h"
+#include <iostream>
+#include <cassert>
+
+static EpilogueSpec parsed(const std::string& text) {
+    EpilogueSpec spec;
+    std::string error;
+    assert(parseEpilogue(text, spec, error));
+    return spec;
+}
+
+// The fused program computes the epilogue, runs one output stage per element
+// when it has one, and its estimate is exact with and without row reuse
+void checkKernel(int M, int K, int N, int numCores, const std::string& text) {
+    MatrixDimensions dims;
+    dims.M = M;
+    dims.K = K;
+    dims.N = N;
+    std::vector<WorkAssignment> work = distributeWork(dims, numCores);
+    const EpilogueSpec spec = parsed(text);
+    CodegenOptions options;
+    options.epilogue = &spec;
+    MemoryMap memMap = optimizeMemoryLayout(dims, options);
+    assert(memMap.baseAddrBias == memMap.baseAddrC + (M * N + memMap.elementsPerRowC - 1) / memMap.elementsPerRowC);
+    assert(memMap.biasRows == (spec.bias ? (N + memMap.elementsPerRowC - 1) / memMap.elementsPerRowC : 0));
+    assert(memMap.baseAddrLut == memMap.baseAddrOutputStage + memMap.outputStages);
+
+    for (int reuse = 0; reuse < 2; reuse++) {
+        options.rowReuse = reuse == 1;
+        assert(resolveLoopOrder(dims, memMap, options).loopOrder == LOOP_ORDER_IJK);
+        assert(usesEpilogue(memMap, resolveLoopOrder(dims, memMap, options)));
+
+        KernelRun run = runKernel(dims, work, memMap, options);
+        const CountingSink& counter = run.counter;
+        assert(run.core.outputStages == (spec.hasOutputStage() ? static_cast<uint64_t>(M) * N : 0));
+        assert(counter.annotations == work.size() + static_cast<size_t>(M) * (1 + N));
+
+        // Exactly epilogueInstructionsPerElement more than plain ijk
+        CodegenOptions plain;
+        plain.rowReuse = options.rowReuse;
+        plain.loopOrder = LOOP_ORDER_IJK;
+        uint64_t plainInstructions = estimateCompile(dims, work, memMap, plain).totalInstructions;
+        assert(counter.instructions ==
+               plainInstructions + static_cast<uint64_t>(M) * N * epilogueInstructionsPerElement(spec));
+
+        if (reuse == 1) {
+            std::cout << "  " << M << "x" << K << " * " << K << "x" << N << " with " << describeEpilogue(spec)
+                      << ": " << counter.instructions << " instructions, " << plainInstructions << " without"
+                      << std::endl;
+        }
+    }
+}
+
+void testSpecs() {
+    EpilogueSpec spec;
+    std::string error;
+    assert(!hasEpilogue(spec) && describeEpilogue(spec).empty());
+
+    // Items in any order; relu raises the clamp's minimum whichever comes first
+    assert(describeEpilogue(parsed("relu,shift=8,bias,alpha=3")) == "bias,alpha=3,shift=8,relu");
+    assert(describeEpilogue(parsed("clamp=-5:100,relu")) == "clamp=0:100");
+    assert(describeEpilogue(parsed("relu,clamp=-5:100")) == "clamp=0:100");
+    assert(describeEpilogue(parsed("clamp=-128:127")) == "clamp=-128:127");
+    assert(describeEpilogue(parsed("alpha=1,shift=0")).empty());
+    for (const char* text : {"bias", "alpha=-2,relu", "shift=31,clamp=-1:1"}) {
+        assert(describeEpilogue(parsed(text)) == text);
+        assert(describeEpilogue(parsed(describeEpilogue(parsed(text)))) == text);
+    }
+    assert(parsed("bias").bias && !parsed("bias").hasOutputStage());
+    assert(!parsed("relu").bias && parsed("relu").hasOutputStage());
+
+    for (const char* text : {"", "gelu", "bias,bias", "shift=32", "shift=-1", "alpha=4294967296",
+                             "clamp=5", "clamp=5:4", "relu,clamp=-9:-1", "alpha=", "bias,"}) {
+        assert(!parseEpilogue(text, spec, error) && !error.empty());
+        error.clear();
+    }
+
+    // ((dot + bias) * alpha) >> shift, rounding down, then the clamp
+    EpilogueSpec requantize = parsed("alpha=3,shift=2,clamp=-10:10");
+    assert(requantize.apply(5, 1) == 4);       // 18 >> 2
+    assert(requantize.apply(-5, 0) == -4);     // -15 >> 2 rounds down
+    assert(requantize.apply(100, 0) == 10);
+    assert(requantize.apply(-100, 0) == -10);
+    assert(parsed("relu").apply(-7, 3) == 0 && parsed("relu").apply(7, -3) == 4);
+}
+
+int main() {
+    std::cout << "=== Testing Fused Epilogues ===" << std::endl;
+    testSpecs();
+
+    checkKernel(9, 20, 7, 3, "bias");
+    checkKernel(9, 20, 7, 3, "relu");
+    checkKernel(9, 20, 7, 3, "bias,alpha=5,shift=3,clamp=-128:127");
+    checkKernel(6, 30, 300, 2, "bias,relu");               // The bias takes two rows
+    checkKernel(4, 600, 9, 2, "bias,alpha=-2,shift=4");    // Rows of A wider than a memory row
+    checkKernel(4, 1500, 5, 3, "relu");
+
+    // The output stage is a PROG with W=1 alone, which LUT loads and
+    // programming a core are not
+    Instruction stage = genOutputStageInstr(3, 41);
+    assert(isOutputStage(stage) && stage.opcode() == OPCODE_PROG && stage.coreId() == 3 && stage.addr() == 41);
+    assert(!isOutputStage(genProgInstr(3, true, false, 1)) && !isOutputStage(genProgInstr(3, true, true, 41)));
+
+    // LUT images move past the epilogue rows
+    MatrixDimensions dims;
+    dims.M = 6;
+    dims.K = 5;
+    dims.N = 7;
+    const EpilogueSpec biasRelu = parsed("bias,relu");
+    CodegenOptions options;
+    options.epilogue = &biasRelu;
+    CodegenOptions lut = options;
+    lut.lutPrecision = 8;
+    MemoryMap lutMap = optimizeMemoryLayout(dims, lut);
+    assert(lutMap.baseAddrBias == lutMap.baseAddrC + 1 && lutMap.baseAddrOutputStage == lutMap.baseAddrC + 2);
+    assert(lutMap.baseAddrLut == lutMap.baseAddrC + 3 && lutMap.lutImages > 0);
+
+    // Persistent kernels: the setup program is unchanged, the invocation
+    // fuses the epilogue as the whole program does
+    MemoryMap memMap = optimizeMemoryLayout(dims, options);
+    CodegenOptions setup = options;
+    setup.part = PROGRAM_SETUP;
+    CodegenOptions invocation = options;
+    invocation.part = PROGRAM_INVOCATION;
+    for (const auto& w : distributeWork(dims, 2)) {
+        std::vector<Instruction> whole =
+            generateCoreInstructions(w.coreId, w.startRow, w.endRow, dims, memMap, options).instructions;
+        std::vector<Instruction> body =
+            generateCoreInstructions(w.coreId, w.startRow, w.endRow, dims, memMap, invocation).instructions;
+        assert(generateCoreInstructions(w.coreId, w.startRow, w.endRow, dims, memMap, setup).instructions.size() == 2);
+        assert(std::equal(body.begin(), body.end() - 1, whole.begin() + 1));
+    }
+
+    // Only plain untiled ijk fuses an epilogue, and it is never pipelined
+    assert(resolveLoopOrder(dims, memMap, options).loopOrder == LOOP_ORDER_IJK);
+    options.loopOrder = LOOP_ORDER_IKJ;
+    assert(!usesEpilogue(memMap, options));
+    options.loopOrder = LOOP_ORDER_IJK;
+    options.registerBlock = 4;
+    assert(!usesEpilogue(memMap, options));
+    options.registerBlock = 1;
+    LatencyModel latency;
+    options.pipeline = &latency;
+    assert(usesEpilogue(memMap, options) && !usesPipelining(memMap, options));
+    options.pipeline = nullptr;
+
+    // The epilogue travels in the program header and the compile cache key
+    std::string tokens = layoutTokens(options);
+    assert(tokens == "epilogue=bias,relu");
+    EpilogueSpec none;
+    options.epilogue = &none;
+    assert(!usesEpilogue(memMap, options));
+    assert(layoutTokens(options).empty());
+    ProgramLayout layout;
+    assert(applyContainerHeader(tokens.data(), tokens.data() + tokens.size(), layout));
+    assert(describeEpilogue(layout.epilogue) == "bias,relu" && layoutTokens(layout.options()) == tokens);
+    std::string invalid = "epilogue=gelu";
+    assert(!applyContainerHeader(invalid.data(), invalid.data() + invalid.size(), layout));
+    EpilogueSpec relu = parsed("relu");
+    options.epilogue = &relu;
+    assert(describeCodegenOptions(CodegenOptions()).find(" epilogue=off") != std::string::npos);
+    assert(describeCodegenOptions(options).find(" epilogue=relu") != std::string::npos);
+
+    std::cout << "\nAll tests completed!" << std::endl;
+    return 0;
+}
@@ -0,0 +1,60 @@
+#include "pim_compiler.h"
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <cassert>
+
+// Generate every core's program and compare the real counts and output sizes
+// against the closed-form estimate
+void checkShape(int M, int K, int N, int numCores) {
+    MatrixDimensions dims;
+    dims.M = M;
+    dims.K = K;
+    dims.N = N;
+    std::vector<WorkAssignment> work = distributeWork(dims, numCores);
+    MemoryMap memMap = optimizeMemoryLayout(dims);
+    CompileEstimate estimate = estimateCompile(dims, work, memMap);
+
+    std::ostringstream text;
+    TextFileSink textSink(text, dims, work.size(), CodegenOptions());
+    BinaryFileSink binarySink("test_estimator.pimb", dims, work, CodegenOptions());
+    CountingSink counter;
+    TeeSink files(textSink, binarySink);
+    TeeSink sink(files, counter);
+    for (const auto& w : work) {
+        sink.beginCore(w);
+        generateCoreInstructions(w.coreId, w.startRow, w.endRow, dims, memMap, sink);
+        sink.endCore();
+    }
+    sink.finish();
+
+    std::ifstream binary("test_estimator.pimb", std::ios::binary | std::ios::ate);
+    uint64_t binaryBytes = static_cast<uint64_t>(binary.tellg());
+
+    std::cout << "  " << M << "x" << K << " * " << K << "x" << N << " on " << work.size()
+              << " cores: estimated " << estimate.totalInstructions << ", generated "
+              << counter.instructions << std::endl;
+
+    assert(estimate.cores.size() == counter.perCore.size());
+    for (size_t c = 0; c < counter.perCore.size(); c++) {
+        assert(estimate.cores[c].instructions == counter.perCore[c]);
+    }
+    assert(estimate.totalInstructions == counter.instructions);
+    assert(estimate.totalAnnotations == counter.annotations);
+    assert(estimate.textBytes == text.str().size());
+    assert(estimate.binaryBytes == binaryBytes);
+}
+
+int main() {
+    std::cout << "=== Testing Compile Estimator ===" << std::endl;
+
+    checkShape(4, 4, 4, 2);
+    checkShape(16, 16, 16, 4);
+    checkShape(33, 17, 45, 5);
+    checkShape(128, 8, 120, 3);
+    checkShape(8, 600, 3, 2);
+    checkShape(7, 9, 11, 16);
+
+    std::cout << "\nAll tests completed!" << std::endl;
+    return 0;
+}
@@ -0,0 +1,156 @@
+#include "pim_compiler.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cassert>
+
+void testDefaultLayout() {
+    std::cout << "Testing default ISA layout..." << std::endl;
+    setActiveIsa(defaultIsa());
+    assert(isDefaultIsa(activeIsa()));
+    assert(activeIsa().instructionBytes() == 3 && activeIsa().hexDigits() == 6);
+
+    // The original encoding: opcode at bits 18-17, core 16-11, R 10, W 9, addr 8-0
+    assert(genProgInstr(1, true, false, 1).word == 0x020c01);
+    assert(genExeInstr(63, false, true, 511).word == 0x05ffff - 0x400);
+    assert(genEndInstr(0).word == 0x060000);
+    assert(genNoOpInstr().word == 0);
+}
+
+void testDescriptors() {
+    std::cout << "Testing descriptor parsing..." << std::endl;
+    IsaDescriptor isa;
+    assert(isaByName("pim32", isa) && isa.maxCores() == 1024 && isa.maxRows() == 1 << 18);
+    assert(!isaByName("pim99", isa));
+
+    // The header form round-trips
+    std::string error;
+    IsaDescriptor parsed;
+    assert(parseIsaDescription(describeIsa(isa), parsed, error));
+    assert(describeIsa(parsed) == describeIsa(isa));
+
+    std::ofstream file("test_isa.isa");
+    file << "# wide cores\n"
+         << "name = wide\n"
+         << "word = 28\n"
+         << "opcode = 26:2\n"
+         << "core = 17:9   # 512 cores\n"
+         << "read = 16\n"
+         << "write = 15\n"
+         << "addr = 0:15\n"
+         << "ops = 3, 2, 1, 0\n"
+         << "row = 256\n";
+    file.close();
+    assert(loadIsa("test_isa.isa", isa));
+    assert(isa.name == "wide" && isa.wordBits == 28 && isa.instructionBytes() == 4 && isa.hexDigits() == 7);
+    assert(isa.coreId.shift == 17 && isa.coreId.width == 9 && isa.memoryRowSize == 256);
+    assert(isa.opcodeValues[OPCODE_NOOP] == 3 && isa.opcodeValues[OPCODE_END] == 0);
+
+    // Malformed or inconsistent descriptors are rejected
+    assert(!parseIsaDescription("word=40", parsed, error));
+    assert(!parseIsaDescription("core=8:6", parsed, error));             // overlaps the address field
+    assert(!parseIsaDescription("opcode=23:2", parsed, error));          // past the end of the word
+    assert(!parseIsaDescription("ops=0,1,1,3", parsed, error));          // duplicate encodings
+    assert(!parseIsaDescription("ops=0,1,2,4", parsed, error));          // does not fit two bits
+    assert(!parseIsaDescription("row=1024", parsed, error));             // offsets overflow 9 bits
+    assert(!parseIsaDescription("lanes=4", parsed, error));
+    assert(!parseIsaDescription("addr=0", parsed, error));
+    assert(!parseIsaDescription("broadcast=10", parsed, error));         // the read bit
+    assert(!parseIsaDescription("broadcast=24", parsed, error));         // past the end of the word
+
+    // The broadcast bit is optional and shows in the description only when present
+    assert(isaByName("pim24b", isa) && isa.hasBroadcast() && isa.broadcast.shift == 19);
+    assert(parseIsaDescription(describeIsa(isa), parsed, error) && parsed.hasBroadcast());
+    assert(!defaultIsa().hasBroadcast() && !isDefaultIsa(isa));
+    setActiveIsa(isa);
+    Instruction shared = retargetInstr(genExeInstr(2, true, false, 7), 3, true);
+    assert(shared.broadcast() && shared.coreId() == 3 && shared.read() && shared.addr() == 7);
+    assert(retargetInstr(shared, 1) == genExeInstr(1, true, false, 7));
+    setActiveIsa(defaultIsa());
+}
+
+void testCustomEncoding() {
+    std::cout << "Testing custom encoding..." << std::endl;
+    IsaDescriptor isa;
+    assert(loadIsa("test_isa.isa", isa));
+    setActiveIsa(isa);
+
+    Instruction instr = genExeInstr(300, true, false, 20000);
+    assert(instr.opcode() == OPCODE_EXE && instr.coreId() == 300 && instr.read() && !instr.write());
+    assert(instr.addr() == 20000);
+    assert(genNoOpInstr().opcode() == OPCODE_NOOP && genNoOpInstr().word == (3u << 26));
+    assert(isaOverflowCount() == 0);
+
+    // Values past a field are counted instead of silently wrapping
+    genExeInstr(512, false, false, 0);
+    genExeInstr(0, false, false, 1 << 15);
+    assert(isaOverflowCount() == 2);
+
+    setActiveIsa(defaultIsa());
+    genProgInstr(64);
+    assert(isaOverflowCount() == 3);
+}
+
+void testLayoutAndLimits() {
+    std::cout << "Testing layout and limits..." << std::endl;
+    IsaDescriptor isa = defaultIsa();
+    isa.name = "rows16";
+    isa.memoryRowSize = 16;
+    setActiveIsa(isa);
+
+    MatrixDimensions dims;
+    dims.M = 40;
+    dims.K = 40;
+    dims.N = 8;
+    MemoryMap memMap = optimizeMemoryLayout(dims);
+    assert(memMap.baseAddrB == 100 && memMap.baseAddrC == 120);
+
+    std::string error;
+    assert(checkProgramFitsIsa(distributeWork(dims, 8), memMap, dims, error));
+    MatrixDimensions big = dims;
+    big.M = 200;
+    assert(!checkProgramFitsIsa(distributeWork(big, 8), optimizeMemoryLayout(big), big, error));
+    assert(!checkProgramFitsIsa(distributeWork(big, 100), optimizeMemoryLayout(dims), dims, error));
+
+    // Text and binary writers size their words from the ISA; the estimate agrees
+    IsaDescriptor wide;
+    assert(loadIsa("test_isa.isa", wide));
+    setActiveIsa(wide);
+    std::vector<WorkAssignment> work = distributeWork(dims, 5);
+    memMap = optimizeMemoryLayout(dims);
+    CompileEstimate estimate = estimateCompile(dims, work, memMap);
+    std::ostringstream text;
+    TextFileSink textSink(text, dims, work.size(), CodegenOptions());
+    BinaryFileSink binarySink("test_isa.pimb", dims, work, CodegenOptions());
+    TeeSink sink(textSink, binarySink);
+    for (const auto& w : work) {
+        sink.beginCore(w);
+        generateCoreInstructions(w.coreId, w.startRow, w.endRow, dims, memMap, sink);
+        sink.endCore();
+    }
+    sink.finish();
+    std::ifstream binary("test_isa.pimb", std::ios::binary | std::ios::ate);
+    assert(estimate.textBytes == text.str().size());
+    assert(estimate.binaryBytes == static_cast<uint64_t>(binary.tellg()));
+    assert(text.str().find("# ISA: name=wide word=28") != std::string::npos);
+
+    // Reading the program back restores its ISA
+    setActiveIsa(defaultIsa());
+    LoadedProgram program;
+    assert(readProgramFile("test_isa.pimb", program));
+    assert(activeIsa().name == "wide");
+    assert(program.instructions.size() == estimate.totalInstructions);
+    setActiveIsa(defaultIsa());
+}
+
+int main() {
+    std::cout << "=== Testing ISA Descriptor ===" << std::endl;
+
+    testDefaultLayout();
+    testDescriptors();
+    testCustomEncoding();
+    testLayoutAndLimits();
+
+    std::cout << "\nAll tests completed!" << std::endl;
+    return 0;
+}
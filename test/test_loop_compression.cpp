@@ -0,0 +1,144 @@
+#include "pim_compiler.h"
+#include <iostream>
+#include <fstream>
+#include <cassert>
+
+// Compress one core's program, round-trip it through the encoded word stream,
+// and check the expansion reproduces the original exactly
+size_t roundTrip(const InstructionBuffer& program) {
+    std::vector<uint32_t> encoded;
+    encodeLoops(compressLoops(program.instructions), encoded);
+
+    std::vector<LoopToken> decoded;
+    bool ok = decodeLoops(encoded.data(), encoded.size(), decoded);
+    assert(ok);
+
+    InstructionBuffer expanded;
+    BufferSink sink(expanded);
+    expandLoops(decoded, sink);
+
+    assert(expanded.size() == program.size());
+    for (size_t i = 0; i < program.size(); i++) {
+        assert(expanded.instructions[i] == program.instructions[i]);
+    }
+    return encoded.size() * 4;
+}
+
+// Overwrite the little-endian uint32 at `offset` of a file
+static void patchU32(const char* filename, size_t offset, uint32_t value) {
+    std::fstream file(filename, std::ios::in | std::ios::out | std::ios::binary);
+    char bytes[4] = {static_cast<char>(value & 0xFF), static_cast<char>((value >> 8) & 0xFF),
+                     static_cast<char>((value >> 16) & 0xFF), static_cast<char>((value >> 24) & 0xFF)};
+    file.seekp(offset);
+    file.write(bytes, 4);
+}
+
+// Damaged record streams and core tables must be rejected, not looped on or
+// read past
+void testCorruptPrograms() {
+    std::cout << "Testing corrupt records..." << std::endl;
+    std::vector<LoopToken> tokens;
+    const uint32_t emptyRun[] = {0, 1, 2};
+    const uint32_t emptyBody[] = {0x80000001u, 4, 0, 7};
+    assert(!decodeLoops(emptyRun, 3, tokens));
+    assert(!decodeLoops(emptyBody, 4, tokens));
+
+    MatrixDimensions dims;
+    dims.M = 6;
+    dims.K = 5;
+    dims.N = 4;
+    std::vector<WorkAssignment> work = distributeWork(dims, 2);
+    MemoryMap memMap = optimizeMemoryLayout(dims);
+    const char* filename = "test_loop_compression.piml";
+    const char* damaged = "test_loop_compression_damaged.piml";
+    {
+        LoopFileSink sink(filename, dims, work, CodegenOptions());
+        for (const auto& w : work) {
+            sink.beginCore(w);
+            replayBuffer(generateCoreInstructions(w.coreId, w.startRow, w.endRow, dims, memMap), sink);
+            sink.endCore();
+        }
+        assert(sink.finish());
+    }
+    LoopProgram program;
+    assert(readLoopProgram(filename, program));
+    uint32_t headerSize = 0;
+    {
+        std::ifstream in(filename, std::ios::binary);
+        unsigned char bytes[12];
+        in.read(reinterpret_cast<char*>(bytes), 12);
+        headerSize = bytes[8] | (bytes[9] << 8) | (bytes[10] << 16) | (static_cast<uint32_t>(bytes[11]) << 24);
+    }
+
+    // Each damage is applied to a fresh copy: a zero first record word, a
+    // core count whose table size wraps 32 bits, a record stream size that
+    // wraps with the header size, cores out of order and an offset past the
+    // stream
+    const uint32_t damage[][2] = {
+        {0, 0},
+        {24, 0x20000000u},
+        {36, 0xFFFFFFF8u},
+        {40 + 20, 0xFFFFFFF0u},
+        {40 + 24 + 20, 0x10000000u},
+    };
+    for (const auto& patch : damage) {
+        {
+            std::ifstream in(filename, std::ios::binary);
+            std::ofstream out(damaged, std::ios::binary);
+            out << in.rdbuf();
+        }
+        patchU32(damaged, patch[0] == 0 ? headerSize : patch[0], patch[1]);
+        assert(!readLoopProgram(damaged, program));
+    }
+}
+
+int main() {
+    std::cout << "=== Testing Loop-Compressed Program Encoding ===" << std::endl;
+
+    // Shapes covering single-row, row-crossing and multi-segment layouts
+    const int shapes[][4] = {
+        {4, 4, 4, 2},
+        {16, 16, 16, 4},
+        {64, 64, 64, 4},
+        {256, 128, 64, 8},
+        {33, 17, 45, 5},
+        {8, 600, 3, 2},
+    };
+
+    for (const auto& shape : shapes) {
+        MatrixDimensions dims;
+        dims.M = shape[0];
+        dims.K = shape[1];
+        dims.N = shape[2];
+        MemoryMap memMap = optimizeMemoryLayout(dims);
+        std::vector<WorkAssignment> work = distributeWork(dims, shape[3]);
+
+        // Row reuse makes the first B load of each element differ from the
+        // rest, and where that changes mid-element the bodies no longer repeat,
+        // so only the plain stream is required to shrink
+        for (int reuse = 0; reuse <= 1; reuse++) {
+            CodegenOptions options;
+            options.rowReuse = reuse != 0;
+
+            size_t rawBytes = 0;
+            size_t packedBytes = 0;
+            for (const auto& w : work) {
+                InstructionBuffer program = generateCoreInstructions(
+                    w.coreId, w.startRow, w.endRow, dims, memMap, options);
+                rawBytes += program.size() * PIMB_INSTRUCTION_BYTES;
+                packedBytes += roundTrip(program);
+            }
+
+            std::cout << "  " << dims.M << "x" << dims.K << " * " << dims.K << "x" << dims.N
+                      << " on " << work.size() << " cores" << (reuse ? " (row reuse)" : "") << ": "
+                      << rawBytes << " bytes packed, " << packedBytes << " bytes loop-compressed"
+                      << std::endl;
+            assert(reuse || packedBytes < rawBytes);
+        }
+    }
+
+    testCorruptPrograms();
+
+    std::cout << "\nAll tests completed!" << std::endl;
+    return 0;
+}
@@ -0,0 +1,213 @@
+#include "pim_compiler.h"
+#include "reference_core.h"
+#include <iostream>
+#include <cassert>
+
+void checkShape(int M, int K, int N, int numCores, int blockColumns) {
+    MatrixDimensions dims;
+    dims.M = M;
+    dims.K = K;
+    dims.N = N;
+    std::vector<WorkAssignment> work = distributeWork(dims, numCores);
+    MemoryMap memMap = optimizeMemoryLayout(dims);
+
+    std::cout << "  " << M << "x" << K << " * " << K << "x" << N << " on " << work.size() << " cores:";
+    const LoopOrder orders[] = {LOOP_ORDER_IJK, LOOP_ORDER_IKJ, LOOP_ORDER_BLOCKED, LOOP_ORDER_KJI};
+    for (LoopOrder order : orders) {
+        CodegenOptions options;
+        options.loopOrder = order;
+        options.blockColumns = blockColumns;
+
+        // Every order computes C, its instruction count is exact, and the
+        // model agrees with the replayed accesses
+        KernelRun run = runKernel(dims, work, memMap, options);
+        uint64_t modeled = countRowActivations(dims, work, memMap, order, blockColumnsFor(dims, options));
+        assert(modeled == run.core.activations);
+        AccessCounts counts = countAccesses(dims, work, memMap, order, blockColumnsFor(dims, options));
+        assert(counts.aLoads == run.core.counts.aLoads);
+        assert(counts.bLoads == run.core.counts.bLoads);
+        assert(counts.cLoads == run.core.counts.cLoads);
+        assert(counts.cStores == run.core.counts.cStores);
+        assert(counts.macs == run.core.counts.macs);
+        assert(counts.macs == static_cast<uint64_t>(M) * N * K);
+        std::cout << " " << loopOrderName(order) << " " << modeled;
+    }
+
+    // auto takes the cheapest order under the model
+    CodegenOptions automatic;
+    automatic.blockColumns = blockColumns;
+    LoopOrder chosen = resolveLoopOrder(dims, memMap, automatic).loopOrder;
+    std::vector<LoopOrderCost> costs = compareLoopOrders(dims, memMap, automatic);
+    for (const auto& cost : costs) {
+        if (cost.order == chosen) {
+            for (const auto& other : costs) {
+                assert(cost.cycles <= other.cycles);
+            }
+        }
+    }
+    std::cout << " -> " << loopOrderName(chosen) << std::endl;
+}
+
+// A wide B is touched row by row in ikj/blocked but column by column in ijk
+void testChoice() {
+    MatrixDimensions narrow;
+    narrow.M = 16;
+    narrow.K = 4;
+    narrow.N = 16;
+    MemoryMap narrowMap = optimizeMemoryLayout(narrow);
+    assert(resolveLoopOrder(narrow, narrowMap, CodegenOptions()).loopOrder == LOOP_ORDER_IJK);
+
+    MatrixDimensions wide;
+    wide.M = 4;
+    wide.K = 8;
+    wide.N = 700;
+    MemoryMap wideMap = optimizeMemoryLayout(wide);
+    assert(resolveLoopOrder(wide, wideMap, CodegenOptions()).loopOrder != LOOP_ORDER_IJK);
+
+    CodegenOptions fixed;
+    fixed.loopOrder = LOOP_ORDER_IKJ;
+    assert(resolveLoopOrder(narrow, narrowMap, fixed).loopOrder == LOOP_ORDER_IKJ);
+}
+
+// A dataflow limits auto to its own orders
+void testDataflows() {
+    MatrixDimensions dims;
+    dims.M = 16;
+    dims.K = 4;
+    dims.N = 16;
+    MemoryMap memMap = optimizeMemoryLayout(dims);
+    const Dataflow dataflows[] = {DATAFLOW_OUTPUT, DATAFLOW_INPUT, DATAFLOW_WEIGHT};
+    for (Dataflow dataflow : dataflows) {
+        CodegenOptions options;
+        options.dataflow = dataflow;
+        assert(dataflowOf(resolveLoopOrder(dims, memMap, options).loopOrder) == dataflow);
+        for (const auto& cost : compareLoopOrders(dims, memMap, options)) {
+            assert(dataflowOf(cost.order) == dataflow);
+        }
+    }
+
+    // Weight-stationary loads each B element once per core instead of once per row
+    std::vector<WorkAssignment> work = distributeWork(dims, 4);
+    AccessCounts weight = countAccesses(dims, work, memMap, LOOP_ORDER_KJI, 0);
+    AccessCounts output = countAccesses(dims, work, memMap, LOOP_ORDER_IJK, 0);
+    assert(weight.bLoads == 4u * 4 * 16);
+    assert(output.bLoads == 16u * 4 * 16);
+    assert(weight.aLoads == weight.macs);
+
+    Dataflow parsed;
+    assert(parseDataflow("weight", parsed) && parsed == DATAFLOW_WEIGHT);
+    assert(!parseDataflow("row", parsed));
+}
+
+// Blocks never cross a memory row of C
+void testBlocks() {
+    MatrixDimensions dims;
+    dims.M = 3;
+    dims.K = 4;
+    dims.N = 300;
+    MemoryMap memMap = optimizeMemoryLayout(dims);
+    // Row 1 of C starts at element 300, so its first block ends at 512 - 300
+    assert(blockEnd(1, 0, dims, memMap, 512) == 212);
+    assert(blockEnd(1, 212, dims, memMap, 512) == 300);
+    assert(blockEnd(1, 0, dims, memMap, 50) == 50);
+    assert(blockEnd(0, 0, dims, memMap, 512) == 300);
+}
+
+// Tiled programs: the estimate and the activation model are exact, and the
+// planner's tiles respect the row, per-core and address limits
+void checkTiled(int M, int K, int N, int numCores, TilePlan requested) {
+    MatrixDimensions dims;
+    dims.M = M;
+    dims.K = K;
+    dims.N = N;
+    std::vector<WorkAssignment> work = distributeWork(dims, numCores);
+    CodegenOptions options;
+    options.tiling = true;
+    options.tiles = requested;
+
+    TilePlan plan;
+    std::string error;
+    assert(planTiles(dims, work, options, plan, error));
+    const int rowSize = activeIsa().memoryRowSize;
+    assert(plan.tileM * plan.tileK <= rowSize && plan.tileK * plan.tileN <= rowSize &&
+           plan.tileM * plan.tileN <= rowSize);
+    assert(requested.tileM > 0 || plan.tileM <= (M + numCores - 1) / numCores);
+
+    options.tiles = plan;
+    MemoryMap memMap = optimizeMemoryLayout(dims, options);
+    assert(checkProgramFitsIsa(work, memMap, dims, error));
+    std::cout << "  " << M << "x" << K << " * " << K << "x" << N << " on " << work.size() << " cores, tiles "
+              << describeTilePlan(plan) << ":";
+    for (int reuse = 0; reuse < 2; reuse++) {
+        options.rowReuse = reuse == 1;
+        KernelRun run = runKernel(dims, work, memMap, options);
+        assert(countTiledRowActivations(dims, plan, work) == run.core.activations);
+        assert(run.core.counts.macs == static_cast<uint64_t>(M) * N * K);
+        std::cout << " " << run.counter.instructions;
+    }
+    std::cout << " instructions, " << countTiledRowActivations(dims, plan, work) << " activations" << std::endl;
+
+    // Program headers carry the plan
+    std::string block = containerHeaderBlock(options);
+    assert(block == "tiles=" + describeTilePlan(plan));
+    ProgramLayout layout;
+    assert(applyContainerHeader(block.data(), block.data() + block.size(), layout));
+    assert(describeTilePlan(layout.tiles) == describeTilePlan(plan) && layout.options().tiling);
+}
+
+void testTiling() {
+    TilePlan automatic;
+    TilePlan fixed;
+    fixed.tileM = 4;
+    fixed.tileN = 8;
+    fixed.tileK = 16;
+    TilePlan deepK;
+    deepK.tileK = 128;
+
+    checkTiled(4, 4, 4, 2, automatic);
+    checkTiled(33, 17, 45, 5, automatic);
+    checkTiled(33, 17, 45, 5, fixed);
+    checkTiled(5, 600, 6, 2, automatic);     // K wider than a memory row
+    checkTiled(20, 40, 30, 3, deepK);
+    checkTiled(7, 9, 700, 3, automatic);
+
+    // Tiles that cannot fit a memory row are refused
+    MatrixDimensions dims;
+    dims.M = 64;
+    dims.K = 64;
+    dims.N = 64;
+    CodegenOptions options;
+    options.tiling = true;
+    options.tiles.tileM = 64;
+    options.tiles.tileK = 64;
+    TilePlan plan;
+    std::string error;
+    assert(!planTiles(dims, distributeWork(dims, 1), options, plan, error));
+
+    TilePlan parsed;
+    assert(parseTilePlan("4,0,16", parsed) && parsed.tileM == 4 && parsed.tileN == 0 && parsed.tileK == 16);
+    assert(parseTilePlan("auto", parsed) && !isTiled(parsed));
+    assert(!parseTilePlan("4,8", parsed));
+}
+
+int main() {
+    std::cout << "=== Testing Loop Orders ===" << std::endl;
+
+    testChoice();
+    testDataflows();
+    testBlocks();
+    testTiling();
+    checkShape(4, 4, 4, 2, 0);
+    checkShape(7, 33, 45, 3, 0);
+    checkShape(5, 6, 600, 2, 0);
+    checkShape(9, 20, 300, 4, 0);
+    checkShape(9, 20, 300, 4, 64);
+    checkShape(3, 5, 1100, 1, 200);
+    checkShape(16, 64, 2, 5, 0);
+    checkShape(3, 600, 7, 2, 0);       // Rows of A wider than a memory row
+    checkShape(5, 1100, 40, 3, 16);
+    checkShape(2, 520, 300, 1, 0);
+
+    std::cout << "\nAll tests completed!" << std::endl;
+    return 0;
+}
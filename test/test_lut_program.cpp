@@ -0,0 +1,156 @@
+#include "pim_compiler.h"
+#include <iostream>
+#include <sstream>
+#include <cassert>
+
+// Multiply the way a core does: digit products from the multiply tables,
+// rippled into a 2 * precision bit product through ADD and ADDC
+int64_t lutMultiply(int64_t a, int64_t b, int precision) {
+    const int digits = precision / 4;
+    const int width = 2 * digits;
+    const int top = digits - 1;
+    const uint64_t operandMask = (1ull << (4 * digits)) - 1;
+    const uint64_t productMask = width >= 16 ? ~0ull : (1ull << (4 * width)) - 1;
+
+    uint64_t product = 0;
+    for (int i = 0; i < digits; i++) {
+        for (int j = 0; j < digits; j++) {
+            int x = static_cast<int>(((static_cast<uint64_t>(a) & operandMask) >> (4 * i)) & 0xF);
+            int y = static_cast<int>(((static_cast<uint64_t>(b) & operandMask) >> (4 * j)) & 0xF);
+            int partial;
+            if (i == top && j == top) {
+                partial = lutEntry(LUT_MUL_SS, x, y);
+            } else if (i == top) {
+                partial = lutEntry(LUT_MUL_SU, x, y);
+            } else if (j == top) {
+                partial = lutEntry(LUT_MUL_SU, y, x);
+            } else {
+                partial = lutEntry(LUT_MUL_UU, x, y);
+            }
+            if ((i == top || j == top) && partial >= 128) {
+                partial -= 256;
+            }
+            uint64_t addend = (static_cast<uint64_t>(static_cast<int64_t>(partial)) << (4 * (i + j))) & productMask;
+
+            uint64_t sum = 0;
+            int carry = 0;
+            for (int n = 0; n < width; n++) {
+                int s = lutEntry(carry ? LUT_ADDC : LUT_ADD, (product >> (4 * n)) & 0xF, (addend >> (4 * n)) & 0xF);
+                sum |= static_cast<uint64_t>(s & 0xF) << (4 * n);
+                carry = s >> 4;
+            }
+            product = sum;
+        }
+    }
+    // Sign-extend the product register
+    if (width < 16 && (product >> (4 * width - 1)) & 1) {
+        return static_cast<int64_t>(product | ~productMask);
+    }
+    return static_cast<int64_t>(product);
+}
+
+// The tables multiply every pair of 4- and 8-bit operands, and a sample of 16-bit ones
+void testTables() {
+    for (int a = -8; a < 8; a++) {
+        for (int b = -8; b < 8; b++) {
+            assert(lutMultiply(a, b, 4) == a * b);
+        }
+    }
+    for (int a = -128; a < 128; a++) {
+        for (int b = -128; b < 128; b++) {
+            assert(lutMultiply(a, b, 8) == a * b);
+        }
+    }
+    const int64_t samples[] = {-32768, -32767, -4097, -256, -1, 0, 1, 15, 16, 255, 4096, 12345, 32767};
+    for (int64_t a : samples) {
+        for (int64_t b : samples) {
+            assert(lutMultiply(a, b, 16) == a * b);
+        }
+    }
+
+    assert(lutFunctions(0).empty());
+    assert(lutFunctions(4).size() == 3 && lutFunctions(4)[0] == LUT_MUL_SS);
+    assert(lutFunctions(8).size() == 5 && lutFunctions(16).size() == 5);
+    assert(lutLookupsPerMac(4) == 3 && lutLookupsPerMac(8) == 20 && lutLookupsPerMac(16) == 144);
+
+    int precision = 0;
+    assert(parseLutPrecision("8", precision) && precision == 8);
+    assert(!parseLutPrecision("12", precision) && !parseLutPrecision("8bit", precision));
+}
+
+// Every core loads the tables from the rows after C, and the estimate counts
+// the loads and the "# Layout: lut=N" line
+void checkProgram(int M, int K, int N, int numCores, int precision) {
+    MatrixDimensions dims;
+    dims.M = M;
+    dims.K = K;
+    dims.N = N;
+    std::vector<WorkAssignment> work = distributeWork(dims, numCores);
+    CodegenOptions options;
+    options.lutPrecision = precision;
+    MemoryMap memMap = optimizeMemoryLayout(dims, options);
+    const int images = static_cast<int>(lutFunctions(precision).size());
+    assert(memMap.lutImages == images);
+    assert(memMap.baseAddrLut == memMap.baseAddrC + (M * N + activeIsa().memoryRowSize - 1) / activeIsa().memoryRowSize);
+    std::string error;
+    assert(checkProgramFitsIsa(work, memMap, dims, error));
+
+    std::ostringstream text;
+    TextFileSink textSink(text, dims, work.size(), options);
+    CountingSink counter;
+    TeeSink sink(textSink, counter);
+    for (const auto& w : work) {
+        InstructionBuffer program = generateCoreInstructions(w.coreId, w.startRow, w.endRow, dims, memMap, options);
+        assert(program.instructions[0] == genProgInstr(w.coreId, true, false, 1));
+        for (int image = 0; image < images; image++) {
+            assert(program.instructions[1 + image] == genProgInstr(w.coreId, true, true, memMap.baseAddrLut + image));
+        }
+        assert(program.instructions[1 + images].opcode() == OPCODE_EXE);
+        sink.beginCore(w);
+        replayBuffer(program, sink);
+        sink.endCore();
+    }
+    sink.finish();
+
+    CompileEstimate estimate = estimateCompile(dims, work, memMap, options);
+    assert(estimate.totalInstructions == counter.instructions);
+    assert(estimate.textBytes == text.str().size());
+    assert(text.str().find("# Layout: lut=" + std::to_string(precision) + "\n") != std::string::npos);
+
+    // The precision travels in the header
+    std::string block = containerHeaderBlock(options);
+    ProgramLayout layout;
+    assert(applyContainerHeader(block.data(), block.data() + block.size(), layout));
+    assert(layout.lutPrecision == precision);
+
+    std::cout << "  " << M << "x" << K << " * " << K << "x" << N << " on " << work.size() << " cores, "
+              << precision << "-bit: " << images << " tables, " << counter.instructions << " instructions"
+              << std::endl;
+}
+
+int main() {
+    std::cout << "=== Testing LUT Programming ===" << std::endl;
+
+    testTables();
+    checkProgram(4, 4, 4, 2, 4);
+    checkProgram(33, 17, 45, 5, 8);
+    checkProgram(8, 600, 3, 2, 16);
+
+    // Tables need rows of at least 256 elements
+    IsaDescriptor narrow;
+    std::string error;
+    assert(parseIsaDescription("row=128", narrow, error));
+    setActiveIsa(narrow);
+    MatrixDimensions dims;
+    dims.M = 4;
+    dims.K = 4;
+    dims.N = 4;
+    CodegenOptions options;
+    options.lutPrecision = 8;
+    MemoryMap memMap = optimizeMemoryLayout(dims, options);
+    assert(!checkProgramFitsIsa(distributeWork(dims, 2), memMap, dims, error));
+    setActiveIsa(defaultIsa());
+
+    std::cout << "\nAll tests completed!" << std::endl;
+    return 0;
+}
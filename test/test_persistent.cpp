@@ -0,0 +1,107 @@
+#include "pim_compiler.h"
+#include <algorithm>
+#include <iostream>
+#include <cassert>
+
+static std::vector<Instruction> coreProgram(const WorkAssignment& work, const MatrixDimensions& dims,
+                                            const MemoryMap& memMap, CodegenOptions options, ProgramPart part) {
+    options.part = part;
+    return generateCoreInstructions(work.coreId, work.startRow, work.endRow, dims, memMap, options).instructions;
+}
+
+// The setup program and one invocation make up the whole program: the setup
+// programs the core and loads its tables, the invocation computes C, and
+// both park the core where the whole program ends it
+void checkSplit(int M, int K, int N, int numCores, CodegenOptions options) {
+    MatrixDimensions dims;
+    dims.M = M;
+    dims.K = K;
+    dims.N = N;
+    std::vector<WorkAssignment> work = distributeWork(dims, numCores);
+    if (options.tiling) {
+        TilePlan plan;
+        std::string error;
+        assert(planTiles(dims, work, options, plan, error));
+        options.tiles = plan;
+    }
+    MemoryMap memMap = optimizeMemoryLayout(dims, options);
+    const size_t prologue = 1 + memMap.lutImages;
+
+    uint64_t invocationInstructions = 0;
+    for (const auto& w : work) {
+        std::vector<Instruction> whole = coreProgram(w, dims, memMap, options, PROGRAM_WHOLE);
+        std::vector<Instruction> setup = coreProgram(w, dims, memMap, options, PROGRAM_SETUP);
+        std::vector<Instruction> invocation = coreProgram(w, dims, memMap, options, PROGRAM_INVOCATION);
+
+        assert(setup.size() == prologue + 1);
+        assert(std::equal(setup.begin(), setup.begin() + prologue, whole.begin()));
+        assert(setup.back() == genParkInstr(w.coreId));
+
+        assert(invocation.size() + prologue == whole.size());
+        assert(std::equal(invocation.begin(), invocation.end() - 1, whole.begin() + prologue));
+        assert(invocation.back() == genParkInstr(w.coreId));
+        assert(whole.back() == genEndInstr(w.coreId));
+        for (Instruction instr : invocation) {
+            assert(instr.opcode() != OPCODE_PROG);
+        }
+        invocationInstructions += invocation.size();
+    }
+
+    // The estimate of an invocation program is exact too
+    CodegenOptions invocation = options;
+    invocation.part = PROGRAM_INVOCATION;
+    assert(estimateCompile(dims, work, memMap, invocation).totalInstructions == invocationInstructions);
+}
+
+int main() {
+    std::cout << "=== Testing Persistent Kernels ===" << std::endl;
+
+    CodegenOptions options;
+    checkSplit(9, 7, 6, 3, options);
+    checkSplit(4, 600, 9, 2, options);   // Rows of A wider than a memory row
+    options.loopOrder = LOOP_ORDER_IKJ;
+    checkSplit(12, 40, 30, 4, options);
+    options.loopOrder = LOOP_ORDER_KJI;
+    options.rowReuse = false;
+    checkSplit(5, 6, 7, 2, options);
+
+    // Cores that load their own LUTs load them once, in the setup program
+    CodegenOptions lut;
+    lut.lutPrecision = 8;
+    checkSplit(10, 12, 8, 3, lut);
+
+    CodegenOptions tiled;
+    tiled.tiling = true;
+    checkSplit(20, 30, 25, 2, tiled);
+
+    // Parking is END with the read flag
+    Instruction park = genParkInstr(5);
+    assert(park.opcode() == OPCODE_END && park.read() && !park.write() && park.coreId() == 5);
+    assert(park != genEndInstr(5));
+
+    ProgramPart part = PROGRAM_WHOLE;
+    assert(parseProgramPart("setup", part) && part == PROGRAM_SETUP);
+    assert(parseProgramPart(programPartName(PROGRAM_INVOCATION), part) && part == PROGRAM_INVOCATION);
+    assert(!parseProgramPart("resident", part));
+
+    // The part travels in the program header and the compile cache key
+    CodegenOptions setup;
+    setup.part = PROGRAM_SETUP;
+    std::string tokens = layoutTokens(setup);
+    assert(tokens == "persistent=setup");
+    ProgramLayout layout;
+    assert(applyContainerHeader(tokens.data(), tokens.data() + tokens.size(), layout));
+    assert(layout.part == PROGRAM_SETUP && layout.options().part == PROGRAM_SETUP);
+    std::string whole = "persistent=whole";
+    assert(!applyContainerHeader(whole.data(), whole.data() + whole.size(), layout));
+    std::string none;
+    assert(applyContainerHeader(none.data(), none.data(), layout) && layout.part == PROGRAM_WHOLE);
+
+    CodegenOptions invocation;
+    invocation.part = PROGRAM_INVOCATION;
+    assert(describeCodegenOptions(CodegenOptions()).find(" part=whole") != std::string::npos);
+    assert(describeCodegenOptions(invocation).find(" part=invocation") != std::string::npos);
+
+    std::cout << "\nAll tests completed!" << std::endl;
+    return 0;
+}
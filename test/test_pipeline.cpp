@@ -0,0 +1,197 @@
+#include "pim_compiler.h"
+#include "reference_core.h"
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cassert>
+
+// Issues every instruction in the cycle after the one before, with no
+// interlocks, and counts those that would have had to wait
+class HazardChecker : public InstructionSink {
+public:
+    HazardChecker(const MemoryMap& memMap, const LatencyModel& model)
+        : timing(memMap, model), hazards(0), cycles(0) {}
+    void beginCore(const WorkAssignment& /*work*/) override { timing.reset(); }
+    void emit(Instruction instr) override {
+        if (timing.earliest(instr) > timing.now()) {
+            hazards++;
+        }
+        timing.issue(instr, timing.now());
+    }
+    void endCore() override { cycles += timing.finish(); }
+
+    PipelineTiming timing;
+    size_t hazards;
+    uint64_t cycles;   // Summed over the cores
+};
+
+void testLatencyTable() {
+    LatencyModel model;
+    std::string error;
+    assert(describeLatencyModel(model) == "issue=1,access=4,activation=32,mac=2,program=16");
+    assert(parseLatencyModel("access=6, mac=3  # slow multiplier", model, error));
+    assert(model.access == 6 && model.mac == 3 && model.issue == 1 && model.rowActivation == ROW_ACTIVATION_CYCLES);
+    LatencyModel copy;
+    assert(parseLatencyModel(describeLatencyModel(model), copy, error));
+    assert(describeLatencyModel(copy) == describeLatencyModel(model));
+    assert(parseLatencyModel("activation=0", model, error) && model.rowActivation == 0);
+    assert(!parseLatencyModel("mac=0", model, error));
+    assert(!parseLatencyModel("multiply=3", model, error));
+    assert(!parseLatencyModel("access=fast", model, error));
+    assert(!parseLatencyModel("access", model, error));
+    assert(model.mac == 3);   // Rejected tables leave the model alone
+
+    // Table files are "key = value" lines
+    const char* path = "test_pipeline_latencies.txt";
+    {
+        std::ofstream file(path);
+        file << "# A slower memory\naccess = 7\nactivation = 40   # per row\n";
+    }
+    LatencyModel loaded;
+    assert(loadLatencyModel(path, loaded, error));
+    assert(loaded.access == 7 && loaded.rowActivation == 40 && loaded.mac == 2);
+    std::remove(path);
+    assert(loadLatencyModel("mac=5", loaded, error) && loaded.mac == 5);
+}
+
+// Results are ready their latency after issue; only what an instruction
+// reads or overwrites holds it back
+void testTiming() {
+    MemoryMap memMap = {};
+    memMap.baseAddrA = 0;
+    memMap.baseAddrB = 4;
+    memMap.baseAddrC = 8;
+    LatencyModel model;
+    PipelineTiming timing(memMap, model);
+    const int core = 1;
+
+    timing.issue(genExeInstr(core, true, false, 5), 0);              // Row-set, B
+    assert(timing.earliest(genExeInstr(core, false, false, 3)) == 1);
+    timing.issue(genExeInstr(core, false, false, 3), 1);             // Opens row 5: B ready at 37
+    Instruction mac = genExeInstr(core, false, false, EXE_OP_MAC);
+    assert(timing.earliest(mac) == 37);
+    timing.issue(genExeInstr(core, true, false, 0), 2);              // A is another subarray
+    assert(timing.earliest(genExeInstr(core, false, false, 1)) == 3);
+    timing.issue(genExeInstr(core, false, false, 1), 3);             // A ready at 39
+    assert(timing.earliest(mac) == 39);
+    timing.issue(genExeInstr(core, false, false, EXE_OP_CLEAR), 4);
+    timing.issue(mac, 39);                                           // Accumulator ready at 41
+    assert(timing.now() == 40);
+    assert(timing.earliest(genExeInstr(core, true, true, 4)) == 40); // A row 0 is latched, open and idle
+    timing.issue(genExeInstr(core, false, true, 9), 40);             // Store to C reads the accumulator
+    assert(timing.earliest(genExeInstr(core, false, false, 0)) == 41);
+    timing.issue(genExeInstr(core, false, false, 0), 41);            // Done at 77
+    assert(timing.earliest(genExeInstr(core, false, false, EXE_OP_CLEAR)) == 42);
+    assert(timing.earliest(genEndInstr(core)) == 77);
+    assert(timing.finish() == 77);
+    assert(timing.earliest(genNoOpInstr(core)) == timing.now());
+}
+
+// The pipelined kernel computes C and runs hazard-free with no interlocks,
+// in fewer cycles than the plain ijk kernel padded for the same latencies
+void checkKernel(int M, int K, int N, int numCores, const LatencyModel& model) {
+    MatrixDimensions dims;
+    dims.M = M;
+    dims.K = K;
+    dims.N = N;
+    std::vector<WorkAssignment> work = distributeWork(dims, numCores);
+    MemoryMap memMap = optimizeMemoryLayout(dims);
+
+    for (int reuse = 0; reuse < 2; reuse++) {
+        CodegenOptions options;
+        options.rowReuse = reuse == 1;
+        options.pipeline = &model;
+        assert(resolveLoopOrder(dims, memMap, options).loopOrder == LOOP_ORDER_IJK);
+        assert(usesPipelining(memMap, resolveLoopOrder(dims, memMap, options)));
+
+        KernelRun run = runKernel(dims, work, memMap, options);
+        const CountingSink& counter = run.counter;
+        assert(counter.noops > 0);
+        HazardChecker checker(memMap, model);
+        for (const auto& w : work) {
+            checker.beginCore(w);
+            generateCoreInstructions(w.coreId, w.startRow, w.endRow, dims, memMap, checker, options);
+            checker.endCore();
+        }
+        assert(checker.hazards == 0);
+
+        // Plain ijk: hazards as it stands, and more cycles once padded
+        CodegenOptions plain;
+        plain.rowReuse = options.rowReuse;
+        plain.loopOrder = LOOP_ORDER_IJK;
+        CountingSink plainCounter;
+        HazardChecker unpadded(memMap, model);
+        HazardChecker padded(memMap, model);
+        HazardPaddingSink padding(padded, memMap, model);
+        for (const auto& w : work) {
+            unpadded.beginCore(w);
+            generateCoreInstructions(w.coreId, w.startRow, w.endRow, dims, memMap, unpadded, plain);
+            unpadded.endCore();
+            TeeSink both(plainCounter, padding);
+            both.beginCore(w);
+            generateCoreInstructions(w.coreId, w.startRow, w.endRow, dims, memMap, both, plain);
+            both.endCore();
+        }
+        assert(unpadded.hazards > 0);
+        assert(padded.hazards == 0);
+        assert(counter.annotations == plainCounter.annotations);
+        assert(checker.cycles < padded.cycles);
+
+        if (reuse == 1) {
+            std::cout << "  " << M << "x" << K << " * " << K << "x" << N << " on " << work.size() << " cores, "
+                      << describeLatencyModel(model) << ": " << checker.cycles << " cycles pipelined vs "
+                      << padded.cycles << " plain (" << counter.noops << " NOOPs vs " << padding.noops() << ")"
+                      << std::endl;
+        }
+    }
+}
+
+int main() {
+    std::cout << "=== Testing Software Pipelining ===" << std::endl;
+    testLatencyTable();
+    testTiming();
+
+    LatencyModel defaults;
+    LatencyModel fast;
+    std::string error;
+    assert(parseLatencyModel("access=2,activation=0,mac=1,program=1", fast, error));
+    LatencyModel slow;
+    assert(parseLatencyModel("issue=2,access=9,activation=40,mac=5", slow, error));
+
+    checkKernel(6, 7, 5, 2, defaults);
+    checkKernel(33, 17, 45, 5, defaults);
+    checkKernel(8, 64, 100, 3, slow);     // B and C span several memory rows
+    checkKernel(4, 600, 9, 2, defaults);  // Rows of A wider than a memory row
+    checkKernel(4, 600, 9, 2, slow);
+    checkKernel(9, 5, 1, 3, fast);        // One column: the load moves across rows
+
+    // Only plain untiled ijk is pipelined
+    MatrixDimensions dims;
+    dims.M = 6;
+    dims.K = 5;
+    dims.N = 7;
+    MemoryMap memMap = optimizeMemoryLayout(dims);
+    CodegenOptions options;
+    options.pipeline = &defaults;
+    options.loopOrder = LOOP_ORDER_IKJ;
+    assert(!usesPipelining(memMap, options));
+    options.loopOrder = LOOP_ORDER_IJK;
+    options.registerBlock = 4;
+    assert(!usesPipelining(memMap, options));
+
+    // The table travels in the program header
+    CodegenOptions padded;
+    padded.pipeline = &slow;
+    std::string tokens = layoutTokens(padded);
+    assert(tokens == "pipeline=" + describeLatencyModel(slow));
+    assert(layoutTokens(CodegenOptions()).empty());
+    ProgramLayout layout;
+    assert(applyContainerHeader(tokens.data(), tokens.data() + tokens.size(), layout));
+    assert(layout.pipelined && describeLatencyModel(layout.pipeline) == describeLatencyModel(slow));
+    assert(layout.options().pipeline && layoutTokens(layout.options()) == tokens);
+    options.registerBlock = 1;
+    assert(describeCodegenOptions(options).find(" pipeline=issue=1,") != std::string::npos);
+
+    std::cout << "\nAll tests completed!" << std::endl;
+    return 0;
+}
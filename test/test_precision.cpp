@@ -0,0 +1,117 @@
+#include "pim_compiler.h"
+#include "reference_core.h"
+#include <iostream>
+#include <cassert>
+
+// The accumulator bound is tight: the worst-case sum fits, one bit fewer does not
+void testAccumulatorBits() {
+    const int precisions[] = {4, 8};
+    for (int bits : precisions) {
+        for (int64_t K = 1; K <= 5000; K++) {
+            int64_t worst = K << (2 * bits - 2);
+            int needed = accumulatorBitsNeeded(bits, static_cast<int>(K));
+            assert(worst <= (int64_t(1) << (needed - 1)) - 1);
+            assert(worst > (int64_t(1) << (needed - 2)) - 1);
+        }
+    }
+
+    ElementPrecision precision;
+    std::string error;
+    assert(choosePrecision(4, 1, precision, error) && precision.accumulatorBits == 8);
+    assert(choosePrecision(4, 17, precision, error) && precision.accumulatorBits == 16);
+    assert(choosePrecision(8, 1, precision, error) && precision.accumulatorBits == 16);
+    assert(choosePrecision(8, 17, precision, error) && precision.dataBits == 8 && precision.accumulatorBits == 32);
+    assert(choosePrecision(8, 131071, precision, error));
+    assert(!choosePrecision(8, 131072, precision, error));
+
+    int bits = 0;
+    assert(parseDataPrecision("int4", bits) && bits == 4);
+    assert(parseDataPrecision("int32", bits) && bits == 32);
+    assert(!parseDataPrecision("int16", bits) && !parseDataPrecision("8", bits));
+    assert(parseElementPrecision("8,16", precision) && describeElementPrecision(precision) == "8,16");
+    assert(!parseElementPrecision("8,12", precision) && !parseElementPrecision("3,8", precision) &&
+           !parseElementPrecision("8", precision));
+}
+
+// A packed layout takes fewer rows, every access stays within its matrix, the
+// program still computes C, and the estimate counts it exactly
+void checkPacked(int M, int K, int N, int numCores, int bits, LoopOrder order) {
+    MatrixDimensions dims;
+    dims.M = M;
+    dims.K = K;
+    dims.N = N;
+    std::vector<WorkAssignment> work = distributeWork(dims, numCores);
+    ElementPrecision precision;
+    std::string error;
+    assert(choosePrecision(bits, K, precision, error));
+    CodegenOptions options;
+    options.loopOrder = order;
+    options.precision = precision;
+    MemoryMap memMap = optimizeMemoryLayout(dims, options);
+    const int rowSize = activeIsa().memoryRowSize;
+    assert(memMap.elementsPerRowA == rowSize * (MEMORY_SLOT_BITS / bits));
+    assert(memMap.elementsPerRowC == rowSize * (MEMORY_SLOT_BITS / precision.accumulatorBits));
+    assert(memMap.rowsPerMatrixRowA == (K + memMap.elementsPerRowA - 1) / memMap.elementsPerRowA);
+    assert(checkProgramFitsIsa(work, memMap, dims, error));
+
+    KernelRun run = runKernel(dims, work, memMap, options);
+    std::string layout = "# Layout: precision=" + describeElementPrecision(precision) + "\n";
+    assert(run.text.find(layout) != std::string::npos);
+
+    // The packing travels in the header
+    std::string block = containerHeaderBlock(options);
+    ProgramLayout header;
+    assert(applyContainerHeader(block.data(), block.data() + block.size(), header));
+    assert(header.precision.dataBits == bits && header.precision.accumulatorBits == precision.accumulatorBits);
+
+    std::cout << "  " << M << "x" << K << " * " << K << "x" << N << " on " << work.size() << " cores, int"
+              << bits << " (C int" << precision.accumulatorBits << "), " << loopOrderName(order) << ": "
+              << memMap.baseAddrLut << " rows, " << run.counter.instructions << " instructions" << std::endl;
+}
+
+int main() {
+    std::cout << "=== Testing Packed Precision ===" << std::endl;
+
+    testAccumulatorBits();
+
+    // Unpacked by default
+    MatrixDimensions dims;
+    dims.M = 33;
+    dims.K = 17;
+    dims.N = 45;
+    MemoryMap memMap = optimizeMemoryLayout(dims);
+    assert(memMap.elementsPerRowA == MEMORY_ROW_SIZE && memMap.elementsPerRowC == MEMORY_ROW_SIZE);
+    assert(containerHeaderBlock(CodegenOptions()).empty());
+
+    // Packed offsets run past pim24's 9-bit address field once a matrix
+    // holds more than 512 elements, as all of these do
+    ElementPrecision precision;
+    std::string error;
+    assert(choosePrecision(8, dims.K, precision, error));
+    CodegenOptions packed;
+    packed.precision = precision;
+    memMap = optimizeMemoryLayout(dims, packed);
+    assert(!checkProgramFitsIsa(distributeWork(dims, 4), memMap, dims, error));
+    dims.M = dims.K = dims.N = 64;
+    memMap = optimizeMemoryLayout(dims, packed);
+    assert(!checkProgramFitsIsa(distributeWork(dims, 4), memMap, dims, error));
+    assert(error.find("offset 2047 of a packed memory row") != std::string::npos);
+
+    IsaDescriptor isa;
+    assert(isaByName("pim32", isa));
+    setActiveIsa(isa);
+    const LoopOrder orders[] = {LOOP_ORDER_IJK, LOOP_ORDER_IKJ, LOOP_ORDER_BLOCKED, LOOP_ORDER_KJI};
+    for (LoopOrder order : orders) {
+        checkPacked(33, 17, 45, 5, 8, order);
+        checkPacked(33, 17, 45, 5, 4, order);
+        checkPacked(9, 3000, 5, 4, 8, order);      // Rows of A wider than a packed memory row
+    }
+    checkPacked(6, 1, 700, 2, 4, LOOP_ORDER_IJK);  // int8 C, 4 per slot
+    checkPacked(64, 64, 64, 8, 4, LOOP_ORDER_AUTO);
+    checkPacked(64, 64, 64, 8, 8, LOOP_ORDER_AUTO);
+    checkPacked(96, 128, 80, 8, 8, LOOP_ORDER_IJK);
+    setActiveIsa(defaultIsa());
+
+    std::cout << "\nAll tests completed!" << std::endl;
+    return 0;
+}
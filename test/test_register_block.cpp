@@ -0,0 +1,98 @@
+#include "pim_compiler.h"
+#include "reference_core.h"
+#include <iostream>
+#include <cassert>
+
+// The kernel computes C, loads A once per k and block, and the estimate
+// counts the program exactly with and without row reuse
+void checkKernel(int M, int K, int N, int numCores, int registerBlock) {
+    MatrixDimensions dims;
+    dims.M = M;
+    dims.K = K;
+    dims.N = N;
+    std::vector<WorkAssignment> work = distributeWork(dims, numCores);
+    MemoryMap memMap = optimizeMemoryLayout(dims);
+
+    for (int reuse = 0; reuse < 2; reuse++) {
+        CodegenOptions options;
+        options.registerBlock = registerBlock;
+        options.rowReuse = reuse == 1;
+        assert(resolveLoopOrder(dims, memMap, options).loopOrder == LOOP_ORDER_IJK);
+        assert(usesRegisterBlocking(memMap, resolveLoopOrder(dims, memMap, options)));
+
+        KernelRun run = runKernel(dims, work, memMap, options);
+        assert(run.core.maxAccumulator == std::min(registerBlock, N) - 1);
+
+        AccessCounts expected = countRegisterBlockedAccesses(dims, work, registerBlock);
+        const AccessCounts& counts = run.core.counts;
+        assert(counts.aLoads == expected.aLoads);
+        assert(counts.bLoads == expected.bLoads);
+        assert(counts.cStores == expected.cStores);
+        assert(counts.macs == expected.macs);
+        assert(counts.aMacReads == 0);
+        assert(counts.cLoads == 0);
+
+        // The buffered form is the same program
+        InstructionBuffer buffer = generateCoreInstructions(work[0].coreId, work[0].startRow, work[0].endRow,
+                                                            dims, memMap, options);
+        assert(buffer.size() == run.estimate.cores[0].instructions);
+
+        if (reuse == 1) {
+            std::cout << "  " << M << "x" << K << " * " << K << "x" << N << " on " << work.size()
+                      << " cores, " << registerBlock << " accumulators: " << run.counter.instructions
+                      << " instructions, " << static_cast<double>(expected.macs) / expected.aLoads
+                      << " MACs per A load" << std::endl;
+        }
+    }
+
+    // Plain ijk leaves all but one MAC per row and segment to read A itself
+    CodegenOptions plain;
+    plain.loopOrder = LOOP_ORDER_IJK;
+    AccessCounts counts = runKernel(dims, work, memMap, plain).core.counts;
+    AccessCounts expected = countAccesses(dims, work, memMap, LOOP_ORDER_IJK, 0);
+    assert(counts.aMacReads == expected.aMacReads);
+    assert(counts.aLoads == expected.aLoads);
+    assert(counts.cLoads == expected.cLoads);
+}
+
+int main() {
+    std::cout << "=== Testing Register Blocking ===" << std::endl;
+
+    // Accumulator counts travel in the ISA description and must fit the
+    // address field above the operation bits
+    IsaDescriptor isa;
+    std::string error;
+    assert(defaultIsa().accumulators == 1);
+    assert(parseIsaDescription("acc=8", isa, error) && isa.accumulators == 8);
+    assert(describeIsa(isa).find(" acc=8") != std::string::npos);
+    assert(describeIsa(defaultIsa()).find("acc=") == std::string::npos);
+    assert(parseIsaDescription(describeIsa(isa), isa, error) && isa.accumulators == 8);
+    assert(parseIsaDescription("acc=128", isa, error));
+    assert(!parseIsaDescription("acc=129", isa, error));
+    assert(!parseIsaDescription("acc=0", isa, error));
+    assert(exeOperand(EXE_OP_MAC, 0) == EXE_OP_MAC);
+    assert(exeOperation(exeOperand(EXE_OP_SELECT, 5)) == EXE_OP_SELECT);
+    assert(exeAccumulator(exeOperand(EXE_OP_CLEAR, 5)) == 5);
+
+    assert(parseIsaDescription("acc=16", isa, error));
+    setActiveIsa(isa);
+    checkKernel(33, 17, 45, 5, 4);
+    checkKernel(33, 17, 45, 5, 16);
+    checkKernel(8, 64, 100, 3, 7);      // Blocks straddle memory rows of B and C
+    checkKernel(4, 600, 9, 2, 4);       // Rows of A wider than a memory row
+    checkKernel(5, 3, 2, 2, 8);         // Fewer columns than accumulators
+    setActiveIsa(defaultIsa());
+
+    // One accumulator is plain ijk
+    MatrixDimensions dims;
+    dims.M = 6;
+    dims.K = 5;
+    dims.N = 7;
+    MemoryMap memMap = optimizeMemoryLayout(dims);
+    CodegenOptions options;
+    options.loopOrder = LOOP_ORDER_IJK;
+    assert(!usesRegisterBlocking(memMap, options));
+
+    std::cout << "\nAll tests completed!" << std::endl;
+    return 0;
+}
@@ -0,0 +1,116 @@
+#include "pim_compiler.h"
+#include <iostream>
+#include <cassert>
+
+// Undo the row reuse pass: put back the row-set each merged access stands for
+static std::vector<Instruction> unmerge(const std::vector<Instruction>& program) {
+    std::vector<Instruction> expanded;
+    bool latched = false;
+    int row = 0;
+    bool write = false;
+    for (size_t i = 0; i < program.size(); i++) {
+        Instruction instr = program[i];
+        if (instr.opcode() == OPCODE_EXE && instr.read() && instr.write()) {
+            assert(latched);
+            expanded.push_back(genExeInstr(instr.coreId(), !write, write, row));
+            expanded.push_back(genExeInstr(instr.coreId(), false, false, instr.addr()));
+            continue;
+        }
+        if (instr.opcode() == OPCODE_EXE && instr.read() != instr.write()) {
+            latched = true;
+            row = instr.addr();
+            write = instr.write();
+        } else if (instr.opcode() != OPCODE_EXE) {
+            latched = false;
+        }
+        expanded.push_back(instr);
+    }
+    return expanded;
+}
+
+// Generate with and without the pass; the optimized program must expand back
+// to the plain one and both estimates must match what was generated
+void checkShape(int M, int K, int N, int numCores) {
+    MatrixDimensions dims;
+    dims.M = M;
+    dims.K = K;
+    dims.N = N;
+    std::vector<WorkAssignment> work = distributeWork(dims, numCores);
+    MemoryMap memMap = optimizeMemoryLayout(dims);
+
+    // Both programs use the loop order chosen for the optimized one
+    CodegenOptions reuse = resolveLoopOrder(dims, memMap, CodegenOptions());
+    CodegenOptions plain = reuse;
+    plain.rowReuse = false;
+
+    CompileEstimate plainEstimate = estimateCompile(dims, work, memMap, plain);
+    CompileEstimate reuseEstimate = estimateCompile(dims, work, memMap, reuse);
+
+    size_t plainTotal = 0;
+    size_t reuseTotal = 0;
+    for (size_t c = 0; c < work.size(); c++) {
+        const WorkAssignment& w = work[c];
+        InstructionBuffer before = generateCoreInstructions(w.coreId, w.startRow, w.endRow, dims, memMap, plain);
+        InstructionBuffer after = generateCoreInstructions(w.coreId, w.startRow, w.endRow, dims, memMap, reuse);
+
+        assert(unmerge(after.instructions) == before.instructions);
+        assert(after.annotations.size() == before.annotations.size());
+        assert(plainEstimate.cores[c].instructions == before.size());
+        assert(reuseEstimate.cores[c].instructions == after.size());
+        plainTotal += before.size();
+        reuseTotal += after.size();
+    }
+    assert(plainEstimate.totalInstructions == plainTotal);
+    assert(reuseEstimate.totalInstructions == reuseTotal);
+
+    std::cout << "  " << M << "x" << K << " * " << K << "x" << N << " on " << work.size()
+              << " cores: " << plainTotal << " -> " << reuseTotal << " instructions ("
+              << 100.0 * (plainTotal - reuseTotal) / plainTotal << "% removed)" << std::endl;
+}
+
+// Hand-built stream: only a pair naming the latched row and direction merges
+void testPeephole() {
+    InstructionBuffer out;
+    BufferSink buffer(out);
+    RowReuseSink reuse(buffer);
+    reuse.emit(genProgInstr(1, true, false, 1));
+    reuse.emit(genExeInstr(1, true, false, 7));   // Read row 7
+    reuse.emit(genExeInstr(1, false, false, 3));
+    reuse.emit(genExeInstr(1, false, false, 2));   // MAC
+    reuse.emit(genExeInstr(1, true, false, 7));   // Same row, same direction: merged
+    reuse.emit(genExeInstr(1, false, false, 4));
+    reuse.emit(genExeInstr(1, false, true, 7));   // Same row, now a write: kept
+    reuse.emit(genExeInstr(1, false, false, 4));
+    reuse.emit(genExeInstr(1, true, false, 7));   // Back to reading: kept
+    reuse.emit(genExeInstr(1, false, false, 5));
+    reuse.emit(genEndInstr(1));
+    reuse.emit(genProgInstr(1, true, false, 1));
+    reuse.emit(genExeInstr(1, true, false, 7));   // After PROG: kept
+    reuse.emit(genExeInstr(1, false, false, 6));
+    reuse.flush();
+
+    assert(out.size() == 13);
+    assert(reuse.removedInstructions() == 1);
+    Instruction merged = out.instructions[4];
+    assert(merged.opcode() == OPCODE_EXE && merged.read() && merged.write() && merged.addr() == 4);
+    assert(out.instructions[5] == genExeInstr(1, false, true, 7));
+    assert(out.instructions[11] == genExeInstr(1, true, false, 7));
+}
+
+int main() {
+    std::cout << "=== Testing Row Reuse Pass ===" << std::endl;
+
+    testPeephole();
+    checkShape(4, 4, 4, 2);
+    checkShape(16, 16, 16, 4);
+    checkShape(33, 17, 45, 5);
+    checkShape(16, 64, 2, 4);
+    checkShape(128, 8, 120, 3);
+    checkShape(8, 600, 3, 2);
+    checkShape(2, 513, 3, 1);      // Rows of A wider than a memory row
+    checkShape(3, 2048, 5, 2);
+    checkShape(3, 40, 700, 2);     // B rows wider than a memory row: nothing merges
+
+    std::cout << "\nAll tests completed!" << std::endl;
+    return 0;
+}
@@ -0,0 +1,228 @@
+#include "pim_compiler.h"
+#include <iostream>
+#include <fstream>
+#include <cassert>
+
+// Busy cycles follow the access protocol: row-sets are register writes, the
+// offset is the access and opens the row if another one is open
+void testLatencies() {
+    MemoryMap memMap = {};
+    memMap.baseAddrA = 0;
+    memMap.baseAddrB = 4;
+    memMap.baseAddrC = 8;
+    LatencyModel model;
+    std::vector<Instruction> program = {
+        genProgInstr(1, true, false, 1),
+        genExeInstr(1, true, false, 5),    // Row-set
+        genExeInstr(1, false, false, 3),   // Access, opens row 5
+        genExeInstr(1, false, false, EXE_OP_MAC),
+        genExeInstr(1, true, true, 4),     // Reuse of row 5: already open
+        genExeInstr(1, true, false, 0),
+        genExeInstr(1, false, false, 9),   // Row 0 is in A, a different subarray
+        genExeInstr(1, true, false, 6),
+        genExeInstr(1, false, false, 1),   // Row 6 replaces row 5 in B
+        genExeInstr(1, false, false, EXE_OP_CLEAR),
+        genEndInstr(1),
+    };
+    std::vector<uint32_t> expected = {16, 1, 36, 2, 4, 1, 36, 1, 36, 1, 1};
+    assert(instructionLatencies(program, memMap, model) == expected);
+}
+
+std::vector<InstructionBuffer> generatePrograms(const MatrixDimensions& dims, const std::vector<WorkAssignment>& work,
+                                                const MemoryMap& memMap) {
+    std::vector<InstructionBuffer> programs;
+    for (const auto& w : work) {
+        programs.push_back(generateCoreInstructions(w.coreId, w.startRow, w.endRow, dims, memMap));
+    }
+    return programs;
+}
+
+// The interleaved order keeps each core's program intact and is never slower
+void checkSchedule(int M, int K, int N, int numCores) {
+    MatrixDimensions dims;
+    dims.M = M;
+    dims.K = K;
+    dims.N = N;
+    std::vector<WorkAssignment> work = distributeWork(dims, numCores);
+    MemoryMap memMap = optimizeMemoryLayout(dims);
+    std::vector<InstructionBuffer> programs = generatePrograms(dims, work, memMap);
+
+    LatencyModel model;
+    std::vector<std::vector<uint32_t>> latencies;
+    uint64_t busiest = 0;
+    for (const auto& program : programs) {
+        latencies.push_back(instructionLatencies(program.instructions, memMap, model));
+        uint64_t busy = 0;
+        for (uint32_t cycles : latencies.back()) {
+            busy += cycles;
+        }
+        busiest = std::max(busiest, busy);
+    }
+
+    ScheduleReport report;
+    std::vector<uint32_t> order = interleavePrograms(latencies, model, report);
+    std::vector<size_t> issued(programs.size(), 0);
+    for (uint32_t p : order) {
+        issued[p]++;
+    }
+    for (size_t p = 0; p < programs.size(); p++) {
+        assert(issued[p] == programs[p].size());
+    }
+    assert(order.size() == report.instructions);
+
+    // No core can finish sooner than its own work, nor the stream sooner than
+    // one issue per instruction
+    assert(report.interleaveCycles <= report.concatCycles);
+    assert(report.interleaveCycles >= busiest);
+    assert(report.interleaveCycles >= report.instructions);
+    if (work.size() == 1) {
+        assert(report.interleaveCycles == report.concatCycles);
+    }
+
+    std::cout << "  " << M << "x" << K << " * " << K << "x" << N << " on " << work.size() << " cores: "
+              << report.concatCycles << " -> " << report.interleaveCycles << " cycles" << std::endl;
+}
+
+// Interleaved .pim and .pimb programs read back core by core
+void testFiles() {
+    MatrixDimensions dims;
+    dims.M = 9;
+    dims.K = 7;
+    dims.N = 5;
+    std::vector<WorkAssignment> work = distributeWork(dims, 3);
+    MemoryMap memMap = optimizeMemoryLayout(dims);
+    std::vector<InstructionBuffer> programs = generatePrograms(dims, work, memMap);
+
+    CodegenOptions options;
+    options.schedule = SCHEDULE_INTERLEAVE;
+    assert(containerHeaderBlock(options) == "schedule=interleave");
+    std::ofstream textFile("test_scheduler.pim");
+    TextFileSink textSink(textFile, dims, work.size(), options);
+    BinaryFileSink binarySink("test_scheduler.pimb", dims, work, options);
+    TeeSink files(textSink, binarySink);
+    InterleavingSink sink(files, memMap);
+    for (size_t c = 0; c < work.size(); c++) {
+        sink.beginCore(work[c]);
+        replayBuffer(programs[c], sink);
+        sink.endCore();
+    }
+    assert(sink.finish());
+    textFile.close();
+
+    // The estimate counts the "# Layout: schedule=interleave" line
+    std::ifstream written("test_scheduler.pim", std::ios::binary | std::ios::ate);
+    CompileEstimate estimate = estimateCompile(dims, work, memMap, options);
+    assert(static_cast<uint64_t>(written.tellg()) == estimate.textBytes);
+
+    const char* filenames[] = {"test_scheduler.pim", "test_scheduler.pimb"};
+    for (const char* filename : filenames) {
+        LoadedProgram program;
+        assert(readProgramFile(filename, program));
+        assert(program.layout.schedule == SCHEDULE_INTERLEAVE);
+        assert(program.assignments.size() == work.size());
+        for (size_t c = 0; c < work.size(); c++) {
+            std::vector<Instruction> core(program.instructions.begin() + program.firstInstr[c],
+                                          program.instructions.begin() + program.firstInstr[c] + program.counts[c]);
+            assert(core == programs[c].instructions);
+        }
+    }
+
+    StreamSchedule parsed;
+    assert(parseSchedule("interleave", parsed) && parsed == SCHEDULE_INTERLEAVE);
+    assert(!parseSchedule("round-robin", parsed));
+}
+
+// Counts the words of a stream and the core instructions they deliver
+class DeliveryCounter : public InstructionSink {
+public:
+    DeliveryCounter() : words(0), delivered(0) {}
+    void emit(Instruction instr) override {
+        words++;
+        delivered += instr.broadcast() ? instr.coreId() + 1 : 1;
+    }
+    
+    uint64_t words;
+    uint64_t delivered;
+};
+
+// A broadcast stream delivers every core exactly its own program, in fewer words
+void checkBroadcast(int M, int K, int N, int numCores, LoopOrder order) {
+    MatrixDimensions dims;
+    dims.M = M;
+    dims.K = K;
+    dims.N = N;
+    std::vector<WorkAssignment> work = distributeWork(dims, numCores);
+    MemoryMap memMap = optimizeMemoryLayout(dims);
+    CodegenOptions options;
+    options.loopOrder = order;
+    std::vector<InstructionBuffer> programs;
+    for (const auto& w : work) {
+        programs.push_back(generateCoreInstructions(w.coreId, w.startRow, w.endRow, dims, memMap, options));
+    }
+
+    IsaDescriptor isa;
+    assert(isaByName("pim24b", isa));
+    setActiveIsa(isa);
+    options.schedule = SCHEDULE_BROADCAST;
+    std::ofstream textFile("test_broadcast.pim");
+    TextFileSink textSink(textFile, dims, work.size(), options);
+    BinaryFileSink binarySink("test_broadcast.pimb", dims, work, options);
+    TeeSink files(textSink, binarySink);
+    DeliveryCounter counter;
+    TeeSink outputs(files, counter);
+    BroadcastSink sink(outputs);
+    for (size_t c = 0; c < work.size(); c++) {
+        sink.beginCore(work[c]);
+        replayBuffer(programs[c], sink);
+        sink.endCore();
+    }
+    assert(sink.finish());
+    textFile.close();
+
+    const BroadcastReport& report = sink.broadcastReport();
+    assert(report.emitted == counter.words);
+    assert(report.instructions == counter.delivered);
+    assert(report.emitted + report.broadcasts <= report.instructions);
+    assert(work.size() > 1 ? report.broadcasts > 0 : report.emitted == report.instructions);
+
+    // Readers hand every core its own unicast copy of each broadcast
+    const char* filenames[] = {"test_broadcast.pim", "test_broadcast.pimb"};
+    for (const char* filename : filenames) {
+        LoadedProgram program;
+        assert(readProgramFile(filename, program));
+        assert(program.layout.schedule == SCHEDULE_BROADCAST && activeIsa().hasBroadcast());
+        assert(program.assignments.size() == work.size());
+        for (size_t c = 0; c < work.size(); c++) {
+            std::vector<Instruction> core(program.instructions.begin() + program.firstInstr[c],
+                                          program.instructions.begin() + program.firstInstr[c] + program.counts[c]);
+            assert(core == programs[c].instructions);
+        }
+    }
+    setActiveIsa(defaultIsa());
+
+    std::cout << "  " << M << "x" << K << " * " << K << "x" << N << " on " << work.size() << " cores, "
+              << loopOrderName(order) << ": " << report.instructions << " -> " << report.emitted
+              << " instructions" << std::endl;
+}
+
+int main() {
+    std::cout << "=== Testing Stream Scheduler ===" << std::endl;
+
+    testLatencies();
+    checkSchedule(4, 4, 4, 1);
+    checkSchedule(4, 4, 4, 2);
+    checkSchedule(33, 17, 45, 5);
+    checkSchedule(16, 64, 2, 4);
+    checkSchedule(9, 20, 300, 4);
+    testFiles();
+    checkBroadcast(4, 4, 4, 1, LOOP_ORDER_IJK);
+    checkBroadcast(4, 4, 4, 2, LOOP_ORDER_IJK);
+    checkBroadcast(7, 9, 6, 3, LOOP_ORDER_IJK);     // Core 2 has one row, the others three
+    checkBroadcast(33, 17, 45, 5, LOOP_ORDER_IKJ);
+    checkBroadcast(9, 20, 300, 4, LOOP_ORDER_BLOCKED);
+    checkBroadcast(16, 64, 2, 4, LOOP_ORDER_KJI);
+    checkBroadcast(9, 600, 5, 4, LOOP_ORDER_IJK);   // Rows of A wider than a memory row
+
+    std::cout << "\nAll tests completed!" << std::endl;
+    return 0;
+}
@@ -0,0 +1,188 @@
+#include "pim_compiler.h"
+#include "reference_core.h"
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cassert>
+
+// A pattern keeping about one element in `every`, with the rows and columns
+// in `empty` left out entirely
+static SparsityPattern pruned(int rows, int cols, int every, int seed, int empty = -1) {
+    SparsityPattern pattern;
+    pattern.rows = rows;
+    pattern.cols = cols;
+    pattern.rowStart.push_back(0);
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < cols; c++) {
+            if (r != empty && c != empty && (r * 31 + c * 17 + seed) % every == 0) {
+                pattern.colIndex.push_back(c);
+            }
+        }
+        pattern.rowStart.push_back(static_cast<uint32_t>(pattern.colIndex.size()));
+    }
+    return pattern;
+}
+
+// The sparse kernel computes C from the nonzeros alone, runs exactly the
+// planned MACs and is estimated exactly
+void checkKernel(int M, int K, int N, int numCores, const SparsityPattern* a, const SparsityPattern* b) {
+    MatrixDimensions dims;
+    dims.M = M;
+    dims.K = K;
+    dims.N = N;
+    std::vector<WorkAssignment> work = distributeWork(dims, numCores);
+    SparsePlan plan = planSparsity(dims, a, "a.mask", b, "b.mask");
+    CodegenOptions options;
+    options.sparse = &plan;
+    MemoryMap memMap = optimizeMemoryLayout(dims, options);
+
+    for (int reuse = 0; reuse < 2; reuse++) {
+        options.rowReuse = reuse == 1;
+        assert(resolveLoopOrder(dims, memMap, options).loopOrder == LOOP_ORDER_IJK);
+        assert(usesSparsity(memMap, resolveLoopOrder(dims, memMap, options)));
+
+        KernelRun run = runKernel(dims, work, memMap, options);
+        assert(run.core.counts.macs == plan.macs);
+        assert(run.counter.annotations == work.size() + static_cast<size_t>(M) * (1 + N));
+
+        if (reuse == 1) {
+            std::cout << "  " << M << "x" << K << " * " << K << "x" << N << ", A " << plan.a.nonzeros() << " / B "
+                      << plan.b.nonzeros() << " nonzeros: " << plan.macs
+                      << " MACs, " << run.counter.instructions << " instructions" << std::endl;
+        }
+    }
+}
+
+void testPatternFiles() {
+    const char* path = "test_sparse_pattern.txt";
+    auto read = [&](const std::string& text, int rows, int cols, SparsityPattern& out) {
+        {
+            std::ofstream file(path);
+            file << text;
+        }
+        std::string error;
+        bool ok = readSparsityPattern(path, rows, cols, out, error);
+        assert(ok || !error.empty());
+        return ok;
+    };
+
+    // The same 3 x 4 pattern three ways
+    SparsityPattern csr, csc, mask, bsr;
+    assert(read("# pruned\ncsr 3 4\nindptr 0 2 2 4\nindices 0 3 1 2\n", 3, 4, csr));
+    assert(csr.nonzeros() == 4 && csr.rowStart == std::vector<uint32_t>({0, 2, 2, 4}));
+    assert(read("csc 3 4 indptr 0 1 2 3 4 indices 0 2 2 0", 3, 4, csc));
+    assert(csc.rowStart == csr.rowStart && csc.colIndex == csr.colIndex);
+    assert(read("mask 3 4\n1001\n0000\n0110\n", 3, 4, mask));
+    assert(mask.colIndex == csr.colIndex);
+    assert(csr.transposed().transposed().colIndex == csr.colIndex);
+
+    // 2 x 2 blocks; the edge block of row 4 is clipped
+    assert(read("bsr 5 4 2 2\nindptr 0 1 1 2\nindices 1 0\n", 5, 4, bsr));
+    assert(bsr.rowStart == std::vector<uint32_t>({0, 2, 4, 4, 4, 6}));
+    assert(bsr.colIndex == std::vector<int>({2, 3, 2, 3, 0, 1}));
+
+    SparsityPattern rejected;
+    assert(!read("csr 4 3 indptr 0 0 0 0 0 indices", 3, 4, rejected));   // Wrong shape
+    assert(!read("csr 3 4 indptr 0 1 1 1 indices 4", 3, 4, rejected));   // Column out of range
+    assert(!read("csr 3 4 indptr 0 2 2 2 indices 3 1", 3, 4, rejected)); // Descending
+    assert(!read("csr 3 4 indptr 0 2 1 2 indices 0 1", 3, 4, rejected)); // indptr decreasing
+    assert(!read("csr 3 4 indptr 0 1 1 1 indices 0 5", 3, 4, rejected)); // Extra token
+    assert(!read("mask 3 4\n1001\n0000\n", 3, 4, rejected));
+    assert(!read("mask 3 4\n1001\n0a00\n0110\n", 3, 4, rejected));
+
+    // Anything else is the matrix itself: raw int32 values here
+    {
+        std::ofstream file(path, std::ios::binary);
+        const int32_t values[] = {5, 0, 0, -2, 0, 0, 0, 0, 0, 7, 1, 0};
+        file.write(reinterpret_cast<const char*>(values), sizeof(values));
+    }
+    SparsityPattern fromMatrix;
+    std::string error;
+    assert(readSparsityPattern(path, 3, 4, fromMatrix, error));
+    assert(fromMatrix.rowStart == csr.rowStart && fromMatrix.colIndex == csr.colIndex);
+    assert(!readSparsityPattern(path, 4, 4, fromMatrix, error));
+    std::remove(path);
+    assert(!readSparsityPattern(path, 3, 4, fromMatrix, error));
+}
+
+int main() {
+    std::cout << "=== Testing Sparse Operands ===" << std::endl;
+    testPatternFiles();
+
+    SparsityPattern a = pruned(9, 20, 5, 1, 4);      // Row 4 of A is empty
+    SparsityPattern b = pruned(20, 7, 4, 2, 3);      // So is column 3 of B
+    checkKernel(9, 20, 7, 3, &a, nullptr);
+    checkKernel(9, 20, 7, 3, nullptr, &b);
+    checkKernel(9, 20, 7, 3, &a, &b);
+    SparsityPattern wide = pruned(4, 1500, 2, 0);    // 750 nonzeros a row: two memory rows
+    SparsityPattern tall = pruned(1500, 9, 3, 5);
+    checkKernel(4, 1500, 9, 2, &wide, nullptr);
+    checkKernel(4, 1500, 9, 2, &wide, &tall);
+    SparsityPattern large = pruned(40, 300, 10, 3);  // 90% zeros
+    SparsityPattern weights = pruned(300, 64, 10, 7);
+    checkKernel(40, 300, 64, 4, &large, &weights);
+
+    // A dense A and B are laid out and run just as plain ijk; so are
+    // segmented rows
+    for (int K : {20, 600}) {
+        MatrixDimensions dims;
+        dims.M = 5;
+        dims.K = K;
+        dims.N = 6;
+        SparsityPattern full = densePattern(dims.M, dims.K);
+        SparsePlan plan = planSparsity(dims, &full, "full.mask", nullptr, "");
+        CodegenOptions sparse;
+        sparse.sparse = &plan;
+        MemoryMap memMap = optimizeMemoryLayout(dims, sparse);
+        assert(plan.macs == static_cast<uint64_t>(dims.M) * dims.N * dims.K);
+        CodegenOptions plain;
+        plain.loopOrder = LOOP_ORDER_IJK;
+        MemoryMap plainMap = optimizeMemoryLayout(dims);
+        assert(memMap.baseAddrB == plainMap.baseAddrB && memMap.baseAddrC == plainMap.baseAddrC);
+        for (const auto& w : distributeWork(dims, 2)) {
+            assert(generateCoreInstructions(w.coreId, w.startRow, w.endRow, dims, memMap, sparse).instructions ==
+                   generateCoreInstructions(w.coreId, w.startRow, w.endRow, dims, plainMap, plain).instructions);
+        }
+    }
+
+    // Only untiled ijk without register blocking or weights runs sparse
+    MatrixDimensions dims;
+    dims.M = 6;
+    dims.K = 5;
+    dims.N = 7;
+    SparsityPattern small = pruned(6, 5, 2, 0);
+    SparsePlan plan = planSparsity(dims, &small, "a.mask", nullptr, "");
+    MemoryMap memMap = optimizeMemoryLayout(dims);
+    CodegenOptions options;
+    options.sparse = &plan;
+    options.loopOrder = LOOP_ORDER_IKJ;
+    assert(!usesSparsity(memMap, options));
+    options.loopOrder = LOOP_ORDER_IJK;
+    options.registerBlock = 4;
+    assert(!usesSparsity(memMap, options));
+    options.registerBlock = 1;
+    LatencyModel latency;
+    options.pipeline = &latency;
+    assert(usesSparsity(memMap, options) && !usesPipelining(memMap, options));
+
+    // The pattern files travel in the program header, the fingerprint in
+    // the compile cache key
+    SparsityPattern smallB = pruned(5, 7, 3, 0);
+    SparsePlan files = planSparsity(dims, &small, "a.mask", &smallB, "pruned.npy");
+    CodegenOptions recorded;
+    recorded.sparse = &files;
+    std::string tokens = layoutTokens(recorded);
+    assert(tokens == "sparse-a=a.mask sparse-b=pruned.npy");
+    assert(layoutTokens(CodegenOptions()).empty());
+    ProgramLayout layout;
+    assert(applyContainerHeader(tokens.data(), tokens.data() + tokens.size(), layout));
+    assert(layout.sparse.sourceA == "a.mask" && layout.sparse.sourceB == "pruned.npy");
+    assert(layoutTokens(layout.options()) == tokens);
+    assert(describeCodegenOptions(CodegenOptions()).find(" sparse=off") != std::string::npos);
+    assert(describeCodegenOptions(options).find(" sparse=" + plan.fingerprint) != std::string::npos);
+    SparsityPattern other = pruned(6, 5, 2, 1);
+    assert(planSparsity(dims, &other, "a.mask", nullptr, "").fingerprint != plan.fingerprint);
+
+    std::cout << "\nAll tests completed!" << std::endl;
+    return 0;
+}
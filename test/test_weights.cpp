@@ -0,0 +1,201 @@
+#include "pim_compiler.h"
+#include "reference_core.h"
+#include <iostream>
+#include <cstdio>
+#include <cassert>
+
+// Mostly zero weights, a column repeating an earlier one and an all-zero one
+WeightMatrix sparseWeights(int K, int N) {
+    WeightMatrix weights;
+    weights.K = K;
+    weights.N = N;
+    for (int k = 0; k < K; k++) {
+        for (int j = 0; j < N; j++) {
+            int column = j == N - 1 && N > 2 ? 1 : j;
+            int32_t w = (k * 5 + column * 3) % 7 < 3 ? (k + column) % 9 - 4 : 0;
+            weights.values.push_back(column == 0 ? 0 : w);
+        }
+    }
+    return weights;
+}
+
+// The specialized programs compute A times the weights, and the estimate and
+// access counts match them exactly
+void checkKernel(int M, int K, int N, int numCores, const WeightMatrix& weights) {
+    MatrixDimensions dims;
+    dims.M = M;
+    dims.K = K;
+    dims.N = N;
+    std::vector<WorkAssignment> work = distributeWork(dims, numCores);
+    MemoryMap memMap = optimizeMemoryLayout(dims);
+    WeightPlan plan = planWeights(weights);
+
+    for (int reuse = 0; reuse < 2; reuse++) {
+        CodegenOptions options;
+        options.weights = &plan;
+        options.rowReuse = reuse == 1;
+        CodegenOptions resolved = resolveLoopOrder(dims, memMap, options);
+        assert(resolved.loopOrder == LOOP_ORDER_IJK && usesWeightSpecialization(memMap, resolved));
+
+        KernelRun run = runKernel(dims, work, memMap, options, &weights.values);
+
+        AccessCounts expected = countWeightedAccesses(dims, work, memMap, plan);
+        const AccessCounts& counts = run.core.counts;
+        assert(counts.aLoads == expected.aLoads);
+        assert(counts.bLoads == expected.bLoads);
+        assert(counts.cLoads == expected.cLoads);
+        assert(counts.cStores == expected.cStores);
+        assert(counts.macs == expected.macs);
+        assert(counts.aMacReads == expected.aMacReads);
+        if (memMap.rowsPerMatrixRowA == 1) {
+            assert(expected.macs == plan.macsPerRow * M);
+        }
+
+        // Never longer than the generic kernel
+        CodegenOptions generic = options;
+        generic.weights = nullptr;
+        generic.loopOrder = LOOP_ORDER_IJK;
+        assert(run.estimate.totalInstructions <= estimateCompile(dims, work, memMap, generic).totalInstructions);
+
+        if (reuse == 1) {
+            std::cout << "  " << M << "x" << K << " * " << K << "x" << N << " on " << work.size() << " cores: "
+                      << expected.macs << " of " << static_cast<uint64_t>(M) * K * N << " MACs, "
+                      << run.counter.instructions << " instructions" << std::endl;
+        }
+    }
+}
+
+void testPlan() {
+    WeightMatrix weights;
+    weights.K = 3;
+    weights.N = 4;
+    weights.values = {0, 4, 4, 0,
+                      3, -8, -8, 0,
+                      0, 1, 1, 0};
+    WeightPlan plan = planWeights(weights);
+    assert(plan.zeros == 5);
+    assert(plan.distinctValues == 4);      // 4, 3, -8, 1
+    assert(plan.powersOfTwo == 6);         // Every nonzero weight but the 3
+    assert(plan.computed == std::vector<int>({0, 1, 3}));
+    assert(plan.copies[1] == std::vector<int>({2}) && plan.copies[0].empty());
+    assert(plan.macsPerRow == 4);
+    uint32_t first, last;
+    plan.nonzeroRange(1, 1, 3, first, last);
+    assert(last - first == 2 && plan.nonzeroK[first] == 1);
+
+    // The fingerprint follows the values
+    WeightPlan same = planWeights(weights);
+    weights.values[0] = 9;
+    assert(same.fingerprint == plan.fingerprint && planWeights(weights).fingerprint != plan.fingerprint);
+    assert(weightsFit(weights, 8) && !weightsFit(weights, 4) && weightsFit(weights, 32));
+}
+
+// .npy (row- and column-major, any integer width) and raw int32 files
+void testReadWeights() {
+    const std::string npy = "test_weights.npy";
+    const std::string raw = "test_weights.bin";
+    std::string error;
+    WeightMatrix weights;
+
+    auto writeNpy = [&](const std::string& dict, const std::vector<unsigned char>& data) {
+        std::string header = dict;
+        while ((10 + header.size() + 1) % 64 != 0) {
+            header += ' ';
+        }
+        header += '\n';
+        std::ofstream out(npy, std::ios::binary);
+        out.write("\x93NUMPY\x01\x00", 8);
+        out.put(static_cast<char>(header.size() & 0xff));
+        out.put(static_cast<char>(header.size() >> 8));
+        out << header;
+        out.write(reinterpret_cast<const char*>(data.data()), data.size());
+    };
+
+    std::vector<unsigned char> int32s;
+    const int32_t values[] = {1, -2, 0, 70000, 5, -6};
+    for (int32_t v : values) {
+        for (int b = 0; b < 4; b++) {
+            int32s.push_back(static_cast<unsigned char>(static_cast<uint32_t>(v) >> (8 * b)));
+        }
+    }
+    writeNpy("{'descr': '<i4', 'fortran_order': False, 'shape': (2, 3), }", int32s);
+    assert(readWeightFile(npy, 2, 3, weights, error));
+    assert(weights.at(0, 1) == -2 && weights.at(1, 0) == 70000 && weights.at(1, 2) == -6);
+    assert(!readWeightFile(npy, 3, 2, weights, error) && error.find("shape") != std::string::npos);
+
+    // Column-major int8: B[0][0], B[1][0], B[0][1], ...
+    writeNpy("{'descr': '|i1', 'fortran_order': True, 'shape': (2, 3), }", {1, 0xfe, 3, 4, 5, 6});
+    assert(readWeightFile(npy, 2, 3, weights, error));
+    assert(weights.at(0, 0) == 1 && weights.at(1, 0) == -2 && weights.at(0, 1) == 3 && weights.at(1, 2) == 6);
+
+    writeNpy("{'descr': '<f4', 'fortran_order': False, 'shape': (1, 1), }", {0, 0, 0x80, 0x3f});
+    assert(!readWeightFile(npy, 1, 1, weights, error) && error.find("<f4") != std::string::npos);
+
+    {
+        std::ofstream out(raw, std::ios::binary);
+        out.write(reinterpret_cast<const char*>(int32s.data()), int32s.size());
+    }
+    assert(readWeightFile(raw, 3, 2, weights, error) && weights.at(1, 1) == 70000);
+    assert(!readWeightFile(raw, 2, 2, weights, error));
+    assert(!readWeightFile("no_such_weights.npy", 2, 3, weights, error));
+    std::remove(npy.c_str());
+    std::remove(raw.c_str());
+}
+
+int main() {
+    std::cout << "=== Testing Weight Specialization ===" << std::endl;
+    testPlan();
+    testReadWeights();
+
+    checkKernel(12, 20, 9, 3, sparseWeights(20, 9));
+    checkKernel(33, 17, 45, 5, sparseWeights(17, 45));
+    checkKernel(8, 64, 100, 3, sparseWeights(64, 100));   // B and C rows straddle memory rows
+    checkKernel(5, 700, 6, 2, sparseWeights(700, 6));     // Rows of A wider than a memory row
+
+    // Weights only in the first segment leave the later segments out
+    WeightMatrix early = sparseWeights(700, 6);
+    for (int k = 300; k < 700; k++) {
+        for (int j = 0; j < 6; j++) {
+            early.values[static_cast<size_t>(k) * 6 + j] = 0;
+        }
+    }
+    checkKernel(5, 700, 6, 2, early);
+
+    // Dense weights cost what the generic kernel does
+    WeightMatrix dense;
+    dense.K = 6;
+    dense.N = 5;
+    for (int v = 0; v < 30; v++) {
+        dense.values.push_back(v + 1);
+    }
+    MatrixDimensions dims;
+    dims.M = 4;
+    dims.K = 6;
+    dims.N = 5;
+    std::vector<WorkAssignment> work = distributeWork(dims, 2);
+    MemoryMap memMap = optimizeMemoryLayout(dims);
+    WeightPlan plan = planWeights(dense);
+    CodegenOptions options;
+    options.weights = &plan;
+    CodegenOptions generic;
+    generic.loopOrder = LOOP_ORDER_IJK;
+    assert(estimateCompile(dims, work, memMap, options).totalInstructions ==
+           estimateCompile(dims, work, memMap, generic).totalInstructions);
+    checkKernel(4, 6, 5, 2, dense);
+
+    // The weight file travels in the header and the cache key
+    assert(describeCodegenOptions(options).find("weights=" + plan.fingerprint) != std::string::npos);
+    assert(describeCodegenOptions(generic).find("weights=off") != std::string::npos);
+    assert(layoutTokens(options).empty());
+    plan.source = "models/w.npy";
+    assert(layoutTokens(options) == "weights=models/w.npy");
+    std::string block = containerHeaderBlock(options);
+    ProgramLayout layout;
+    assert(applyContainerHeader(block.data(), block.data() + block.size(), layout));
+    assert(layout.weights.source == "models/w.npy" && layoutTokens(layout.options()) == block);
+    std::string none;
+    assert(applyContainerHeader(none.data(), none.data(), layout) && layout.weights.source.empty());
+
+    std::cout << "\nAll tests completed!" << std::endl;
+    return 0;
+}
@@ -0,0 +1,150 @@
+#include "pim_compiler.h"
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// Measures .pim text output throughput: the table-driven TextFileSink against
+// the original per-line path (stringstream hex, per-character binary expansion,
+// std::endl after every line). Both write the same program to disk.
+
+// The original hex-to-binary expansion from main.cpp
+static std::string legacyHexToBinary(const std::string& hex) {
+    std::string binary;
+    for (char c : hex) {
+        switch (toupper(c)) {
+            case '0': binary += "0000"; break;
+            case '1': binary += "0001"; break;
+            case '2': binary += "0010"; break;
+            case '3': binary += "0011"; break;
+            case '4': binary += "0100"; break;
+            case '5': binary += "0101"; break;
+            case '6': binary += "0110"; break;
+            case '7': binary += "0111"; break;
+            case '8': binary += "1000"; break;
+            case '9': binary += "1001"; break;
+            case 'A': binary += "1010"; break;
+            case 'B': binary += "1011"; break;
+            case 'C': binary += "1100"; break;
+            case 'D': binary += "1101"; break;
+            case 'E': binary += "1110"; break;
+            case 'F': binary += "1111"; break;
+            default: binary += "????";
+        }
+    }
+    return binary;
+}
+
+static void writeLegacy(std::ofstream& out, const MatrixDimensions& dims,
+                        const std::vector<WorkAssignment>& assignments,
+                        const std::vector<InstructionBuffer>& programs) {
+    out << "# PIM Instructions for Matrix Multiplication" << std::endl;
+    out << "# Matrix dimensions: " << dims.M << "x" << dims.K << " * " << dims.K << "x"
+        << dims.N << std::endl;
+    out << "# Using " << assignments.size() << " cores" << std::endl;
+    for (size_t c = 0; c < programs.size(); c++) {
+        out << std::endl;
+        const InstructionBuffer& program = programs[c];
+        size_t nextNote = 0;
+        for (size_t i = 0; i <= program.instructions.size(); i++) {
+            while (nextNote < program.annotations.size() &&
+                   program.annotations[nextNote].position == i) {
+                out << formatAnnotation(program.annotations[nextNote++]) << std::endl;
+            }
+            if (i < program.instructions.size()) {
+                std::string hex = to_hex_string(program.instructions[i].word);
+                out << hex << " # Binary: " << legacyHexToBinary(hex) << std::endl;
+            }
+        }
+    }
+}
+
+static void writeTable(std::ofstream& out, const MatrixDimensions& dims,
+                       const std::vector<WorkAssignment>& assignments,
+                       const std::vector<InstructionBuffer>& programs) {
+    TextFileSink sink(out, dims, assignments.size(), CodegenOptions());
+    for (size_t c = 0; c < programs.size(); c++) {
+        sink.beginCore(assignments[c]);
+        replayBuffer(programs[c], sink);
+        sink.endCore();
+    }
+    sink.finish();
+}
+
+template <typename Writer>
+static double timeWriter(Writer writer, const std::string& filename, const MatrixDimensions& dims,
+                         const std::vector<WorkAssignment>& assignments,
+                         const std::vector<InstructionBuffer>& programs, uint64_t& bytes) {
+    auto startTime = std::chrono::high_resolution_clock::now();
+    {
+        std::ofstream out(filename);
+        writer(out, dims, assignments, programs);
+    }
+    auto endTime = std::chrono::high_resolution_clock::now();
+
+    std::ifstream written(filename, std::ios::binary | std::ios::ate);
+    bytes = static_cast<uint64_t>(written.tellg());
+    return std::chrono::duration<double>(endTime - startTime).count();
+}
+
+static bool sameContents(const std::string& first, const std::string& second) {
+    std::ifstream a(first, std::ios::binary);
+    std::ifstream b(second, std::ios::binary);
+    std::string left((std::istreambuf_iterator<char>(a)), std::istreambuf_iterator<char>());
+    std::string right((std::istreambuf_iterator<char>(b)), std::istreambuf_iterator<char>());
+    return left == right;
+}
+
+int main(int argc, char* argv[]) {
+    MatrixDimensions dims;
+    dims.M = 128;
+    dims.K = 128;
+    dims.N = 128;
+    int numCores = 4;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-M" && i + 1 < argc) {
+            dims.M = std::stoi(argv[++i]);
+        } else if (arg == "-K" && i + 1 < argc) {
+            dims.K = std::stoi(argv[++i]);
+        } else if (arg == "-N" && i + 1 < argc) {
+            dims.N = std::stoi(argv[++i]);
+        } else if (arg == "-c" && i + 1 < argc) {
+            numCores = std::stoi(argv[++i]);
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [-M rows] [-K inner] [-N cols] [-c cores]" << std::endl;
+            return 1;
+        }
+    }
+
+    MemoryMap memMap = optimizeMemoryLayout(dims);
+    std::vector<WorkAssignment> assignments = distributeWork(dims, numCores);
+
+    // Generate once so only the text formatting and writing is timed
+    std::vector<InstructionBuffer> programs;
+    for (const auto& work : assignments) {
+        programs.push_back(generateCoreInstructions(work.coreId, work.startRow, work.endRow, dims, memMap));
+    }
+
+    uint64_t legacyBytes = 0;
+    uint64_t tableBytes = 0;
+    double legacySeconds = timeWriter(writeLegacy, "bench_legacy.pim", dims, assignments, programs, legacyBytes);
+    double tableSeconds = timeWriter(writeTable, "bench_table.pim", dims, assignments, programs, tableBytes);
+
+    std::cout << "Matrix " << dims.M << "x" << dims.K << " * " << dims.K << "x" << dims.N
+              << " on " << assignments.size() << " cores" << std::endl;
+    std::cout << "  legacy emitter: " << legacyBytes << " bytes in " << legacySeconds * 1000.0
+              << " ms, " << legacyBytes / legacySeconds / 1e9 << " GB/s" << std::endl;
+    std::cout << "  table emitter:  " << tableBytes << " bytes in " << tableSeconds * 1000.0
+              << " ms, " << tableBytes / tableSeconds / 1e9 << " GB/s" << std::endl;
+    std::cout << "  speedup: " << legacySeconds / tableSeconds << "x" << std::endl;
+
+    if (!sameContents("bench_legacy.pim", "bench_table.pim")) {
+        std::cerr << "Error: emitters produced different output" << std::endl;
+        return 1;
+    }
+    std::cout << "  outputs are byte-identical" << std::endl;
+    return 0;
+}
@@ -0,0 +1,98 @@
+#include "pim_compiler.h"
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+
+// Expands a loop-compressed .piml program back into .pim text or a .pimb container
+
+void printHelp(const char* programName) {
+    std::cout << "PIM Loop-Compressed Program Expander" << std::endl;
+    std::cout << "Usage: " << programName << " <input.piml> [options]" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  -o <file>       Output file (default: expanded.pim)" << std::endl;
+    std::cout << "  --format=<fmt>  Output format: text (hex .pim [default]) or bin (packed .pimb)" << std::endl;
+    std::cout << "  -h, --help      Show this help message" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    std::string inputFile = "";
+    std::string outputFile = "";
+    std::string outputFormat = "text";
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            printHelp(argv[0]);
+            return 0;
+        } else if (arg == "-o" && i + 1 < argc) {
+            outputFile = argv[++i];
+        } else if (arg.compare(0, 9, "--format=") == 0) {
+            outputFormat = arg.substr(9);
+            if (outputFormat != "text" && outputFormat != "bin") {
+                std::cerr << "Error: Unknown output format: " << outputFormat << std::endl;
+                return 1;
+            }
+        } else if (inputFile.empty()) {
+            inputFile = arg;
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            printHelp(argv[0]);
+            return 1;
+        }
+    }
+
+    if (inputFile.empty()) {
+        std::cerr << "Error: No input file specified." << std::endl;
+        printHelp(argv[0]);
+        return 1;
+    }
+    if (outputFile.empty()) {
+        outputFile = (outputFormat == "bin") ? "expanded.pimb" : "expanded.pim";
+    }
+
+    LoopProgram program;
+    if (!readLoopProgram(inputFile, program)) {
+        return 1;
+    }
+
+    // The expanded program keeps the header of the compressed one
+    CodegenOptions options = program.layout.options();
+    std::ofstream textFile;
+    std::unique_ptr<InstructionSink> output;
+    if (outputFormat == "bin") {
+        std::unique_ptr<BinaryFileSink> binarySink(
+            new BinaryFileSink(outputFile, program.dims, program.assignments, options));
+        if (!binarySink->isOpen()) {
+            return 1;
+        }
+        output = std::move(binarySink);
+    } else {
+        textFile.open(outputFile);
+        if (!textFile.is_open()) {
+            std::cerr << "Error: Could not open output file " << outputFile << std::endl;
+            return 1;
+        }
+        output.reset(new TextFileSink(textFile, program.dims, program.assignments.size(), options));
+    }
+
+    CountingSink counter;
+    TeeSink sink(*output, counter);
+    for (size_t c = 0; c < program.assignments.size(); c++) {
+        const WorkAssignment& work = program.assignments[c];
+        sink.beginCore(work);
+        // Core headers carry the row ranges the simulator reads back
+        Annotation header = {0, NOTE_CORE_HEADER, work.coreId, work.startRow, work.endRow};
+        sink.annotate(header);
+        expandLoops(program.cores[c], sink);
+        sink.endCore();
+    }
+    if (!sink.finish()) {
+        std::cerr << "Error: Failed writing output file " << outputFile << std::endl;
+        return 1;
+    }
+
+    std::cout << "Expanded " << counter.instructions << " instructions for "
+              << program.assignments.size() << " cores to " << outputFile << std::endl;
+    return 0;
+}
@@ -0,0 +1,135 @@
+#include "pim_compiler.h"
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+// Disassembles a .pim, .pimb or .piml program, or summarises it with --stats
+
+void printHelp(const char* programName) {
+    std::cout << "PIM Program Disassembler" << std::endl;
+    std::cout << "Usage: " << programName << " <program> [options]" << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "  --core <id>     Only show this core's program" << std::endl;
+    std::cout << "  --stats         Print per-core opcode counts and decode rate instead of a listing" << std::endl;
+    std::cout << "  -h, --help      Show this help message" << std::endl;
+}
+
+static void printListing(const LoadedProgram& program, size_t c) {
+    const WorkAssignment& work = program.assignments[c];
+    std::cout << std::endl << "Core " << work.coreId << " (Rows " << work.startRow << " to "
+              << work.endRow << "): " << program.counts[c] << " instructions" << std::endl;
+
+    char prefix[32];
+    for (size_t i = 0; i < program.counts[c]; i++) {
+        size_t index = program.firstInstr[c] + i;
+        Instruction instr = program.instructions[index];
+        std::snprintf(prefix, sizeof(prefix), "%8zu:  %0*x  ", index, activeIsa().hexDigits(), instr.word);
+        std::cout << prefix << disassemble(instr) << "\n";
+    }
+}
+
+static void printStats(const LoadedProgram& program, const DecodedInstructions& fields, size_t c) {
+    const WorkAssignment& work = program.assignments[c];
+    size_t opcodes[5] = {0, 0, 0, 0, 0};
+    size_t reads = 0;
+    size_t writes = 0;
+    size_t reuses = 0;
+    size_t foreign = 0;
+    size_t end = program.firstInstr[c] + program.counts[c];
+    for (size_t i = program.firstInstr[c]; i < end; i++) {
+        opcodes[std::min<int>(fields.opcode[i], 4)]++;
+        if (fields.read[i] && fields.write[i]) {
+            reuses++;
+        } else {
+            reads += fields.read[i];
+            writes += fields.write[i];
+        }
+        if (fields.coreId[i] != work.coreId) {
+            foreign++;
+        }
+    }
+
+    std::cout << "Core " << work.coreId << " (Rows " << work.startRow << " to " << work.endRow
+              << "): " << program.counts[c] << " instructions" << std::endl;
+    for (int op = 0; op < 4; op++) {
+        std::cout << "  " << opcodeName(op) << ": " << opcodes[op] << std::endl;
+    }
+    if (opcodes[4] > 0) {
+        std::cout << "  Unknown opcodes: " << opcodes[4] << std::endl;
+    }
+    std::cout << "  Row reads (R=1): " << reads << std::endl;
+    std::cout << "  Row writes (W=1): " << writes << std::endl;
+    std::cout << "  Row reuses (R=1 W=1): " << reuses << std::endl;
+    if (foreign > 0) {
+        std::cout << "  Warning: " << foreign << " instructions address another core" << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::string inputFile = "";
+    int onlyCore = -1;
+    bool stats = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
+            printHelp(argv[0]);
+            return 0;
+        } else if (arg == "--core" && i + 1 < argc) {
+            onlyCore = std::stoi(argv[++i]);
+        } else if (arg == "--stats") {
+            stats = true;
+        } else if (inputFile.empty()) {
+            inputFile = arg;
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            printHelp(argv[0]);
+            return 1;
+        }
+    }
+
+    if (inputFile.empty()) {
+        std::cerr << "Error: No input file specified." << std::endl;
+        printHelp(argv[0]);
+        return 1;
+    }
+
+    LoadedProgram program;
+    if (!readProgramFile(inputFile, program)) {
+        return 1;
+    }
+
+    std::cout << inputFile << ": " << program.dims.M << "x" << program.dims.K << " * "
+              << program.dims.K << "x" << program.dims.N << ", " << program.assignments.size()
+              << " cores, " << program.instructions.size() << " instructions" << std::endl;
+    if (!isDefaultIsa(activeIsa())) {
+        std::cout << "ISA: " << describeIsa(activeIsa()) << std::endl;
+    }
+
+    if (stats) {
+        auto startTime = std::chrono::high_resolution_clock::now();
+        DecodedInstructions fields;
+        decodeInstructions(program.instructions, fields);
+        auto endTime = std::chrono::high_resolution_clock::now();
+        double seconds = std::chrono::duration<double>(endTime - startTime).count();
+
+        for (size_t c = 0; c < program.assignments.size(); c++) {
+            if (onlyCore < 0 || program.assignments[c].coreId == onlyCore) {
+                printStats(program, fields, c);
+            }
+        }
+        if (seconds > 0) {
+            std::cout << "Decoded " << fields.size() << " instructions at "
+                      << fields.size() / seconds / 1e6 << " million/s" << std::endl;
+        }
+        return 0;
+    }
+
+    for (size_t c = 0; c < program.assignments.size(); c++) {
+        if (onlyCore < 0 || program.assignments[c].coreId == onlyCore) {
+            printListing(program, c);
+        }
+    }
+    return 0;
+}